@@ -34,6 +34,7 @@
 #include <util/platform.h>
 #include <util/profiler.hpp>
 #include <util/dstr.hpp>
+#include <media-io/audio-resampler.h>
 
 #include "obs-app.hpp"
 #include "platform.hpp"
@@ -1328,6 +1329,8 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_uint(basicConfig, "Audio", "SampleRate", 48000);
 	config_set_default_string(basicConfig, "Audio", "ChannelSetup",
 				  "Stereo");
+	config_set_default_bool(basicConfig, "Audio", "PolyphaseResampler",
+				false);
 	config_set_default_double(basicConfig, "Audio", "MeterDecayRate",
 				  VOLUME_METER_DECAY_FAST);
 	config_set_default_uint(basicConfig, "Audio", "PeakMeterType", 0);
@@ -3605,6 +3608,10 @@ bool OBSBasic::ResetAudio()
 	else
 		ai.speakers = SPEAKERS_STEREO;
 
+	/* applies to the resamplers created from now on */
+	audio_resampler_set_polyphase(
+		config_get_bool(basicConfig, "Audio", "PolyphaseResampler"));
+
 	return obs_reset_audio(&ai);
 }
 
@@ -228,6 +228,13 @@ void OBSBasicSettings::SaveStream1Settings()
 				QT_TO_UTF8(ui->codec->currentText()));
 		obs_data_set_string(settings, "protocol",
 				QT_TO_UTF8(ui->streamProtocol->currentText()));
+		// No widgets for these yet, keep the configured values
+		obs_data_t *old_settings = obs_service_get_settings(oldService);
+		obs_data_set_int(settings, "simulcast_layers",
+				obs_data_get_int(old_settings, "simulcast_layers"));
+		obs_data_set_bool(settings, "encoder_passthrough",
+				obs_data_get_bool(old_settings, "encoder_passthrough"));
+		obs_data_release(old_settings);
 	}
 
 	obs_data_set_bool(settings, "bwtest",
@@ -453,6 +453,7 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	HookWidget(ui->disableAudioDucking,  CHECK_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->browserHWAccel,       CHECK_CHANGED,  ADV_RESTART);
 #endif
+	HookWidget(ui->polyphaseResampler,   CHECK_CHANGED,  ADV_RESTART);
 	HookWidget(ui->filenameFormatting,   EDIT_CHANGED,   ADV_CHANGED);
 	HookWidget(ui->overwriteIfExists,    CHECK_CHANGED,  ADV_CHANGED);
 	HookWidget(ui->simpleRBPrefix,       EDIT_CHANGED,   ADV_CHANGED);
@@ -483,8 +484,10 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 #endif
 
 #if !defined(_WIN32) && !defined(__APPLE__) && !HAVE_PULSEAUDIO
-	delete ui->audioAdvGroupBox;
-	ui->audioAdvGroupBox = nullptr;
+	delete ui->monitoringDeviceLabel;
+	delete ui->monitoringDevice;
+	ui->monitoringDeviceLabel = nullptr;
+	ui->monitoringDevice = nullptr;
 #endif
 
 #ifdef _WIN32
@@ -531,9 +534,7 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	delete ui->enableLowLatencyMode;
 	delete ui->browserHWAccel;
 	delete ui->sourcesGroup;
-#if defined(__APPLE__) || HAVE_PULSEAUDIO
 	delete ui->disableAudioDucking;
-#endif
 	ui->rendererLabel = nullptr;
 	ui->renderer = nullptr;
 	ui->adapterLabel = nullptr;
@@ -545,10 +546,8 @@ OBSBasicSettings::OBSBasicSettings(QWidget *parent)
 	ui->enableLowLatencyMode = nullptr;
 	ui->browserHWAccel = nullptr;
 	ui->sourcesGroup = nullptr;
-#if defined(__APPLE__) || HAVE_PULSEAUDIO
 	ui->disableAudioDucking = nullptr;
 #endif
-#endif
 
 #ifndef __APPLE__
 	delete ui->disableOSXVSync;
@@ -2251,6 +2250,8 @@ void OBSBasicSettings::LoadAdvancedSettings()
 	int rbTime = config_get_int(main->Config(), "AdvOut", "RecRBTime");
 	int rbSize = config_get_int(main->Config(), "AdvOut", "RecRBSize");
 	bool autoRemux = config_get_bool(main->Config(), "Video", "AutoRemux");
+	bool polyphaseResampler =
+		config_get_bool(main->Config(), "Audio", "PolyphaseResampler");
 
 	loading = true;
 
@@ -2278,6 +2279,7 @@ void OBSBasicSettings::LoadAdvancedSettings()
 	ui->streamDelayPreserve->setChecked(preserveDelay);
 	ui->streamDelayEnable->setChecked(enableDelay);
 	ui->autoRemux->setChecked(autoRemux);
+	ui->polyphaseResampler->setChecked(polyphaseResampler);
 
 	SetComboByName(ui->colorFormat, videoColorFormat);
 	SetComboByName(ui->colorSpace, videoColorSpace);
@@ -2974,6 +2976,7 @@ void OBSBasicSettings::SaveAdvancedSettings()
 	SaveSpinBox(ui->reconnectMaxRetries, "Output", "MaxRetries");
 	SaveComboData(ui->bindToIP, "Output", "BindIP");
 	SaveCheckBox(ui->autoRemux, "Video", "AutoRemux");
+	SaveCheckBox(ui->polyphaseResampler, "Audio", "PolyphaseResampler");
 
 #if defined(_WIN32) || defined(__APPLE__) || HAVE_PULSEAUDIO
 	QString newDevice = ui->monitoringDevice->currentData().toString();
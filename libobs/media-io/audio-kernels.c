@@ -0,0 +1,548 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include "audio-kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+	defined(_M_IX86)
+#define KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+struct audio_kernels {
+	enum audio_kernel_level level;
+	void (*mix_add)(float *dst, const float *src, size_t count);
+	void (*mix_add_gain)(float *dst, const float *src, const float *gain,
+			     size_t count);
+	void (*apply_gain)(float *data, float gain, size_t count);
+	void (*apply_gain_ramp)(float *data, const float *gain, size_t count);
+	void (*clamp)(float *data, size_t count);
+	void (*downmix)(float *const *data, size_t channels, size_t count);
+	float (*dot)(const float *a, const float *b, size_t count);
+};
+
+/* ------------------------------------------------------------------------- */
+/* scalar, also used for the tails of the vector implementations             */
+
+static void mix_add_scalar(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void mix_add_gain_scalar(float *dst, const float *src,
+				const float *gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * gain[i];
+}
+
+static void apply_gain_scalar(float *data, float gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= gain;
+}
+
+static void apply_gain_ramp_scalar(float *data, const float *gain,
+				   size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= gain[i];
+}
+
+static void clamp_scalar(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static void downmix_scalar(float *const *data, size_t channels, size_t count)
+{
+	const float channels_i = 1.0f / (float)channels;
+
+	for (size_t ch = 1; ch < channels; ch++) {
+		for (size_t i = 0; i < count; i++)
+			data[0][i] += data[ch][i];
+	}
+
+	for (size_t i = 0; i < count; i++)
+		data[0][i] *= channels_i;
+
+	for (size_t ch = 1; ch < channels; ch++) {
+		for (size_t i = 0; i < count; i++)
+			data[ch][i] = data[0][i];
+	}
+}
+
+/* four partial sums, as the vector implementations keep them */
+static float dot_tail(float acc[4], const float *a, const float *b, size_t i,
+		      size_t count)
+{
+	for (; i < count; i++)
+		acc[i & 3] += a[i] * b[i];
+	return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+static float dot_scalar(const float *a, const float *b, size_t count)
+{
+	float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	return dot_tail(acc, a, b, 0, count);
+}
+
+static const struct audio_kernels kernels_scalar = {
+	AUDIO_KERNEL_SCALAR,   mix_add_scalar,         mix_add_gain_scalar,
+	apply_gain_scalar,     apply_gain_ramp_scalar, clamp_scalar,
+	downmix_scalar,        dot_scalar,
+};
+
+/* ------------------------------------------------------------------------- */
+/* SSE2, always available on x86                                             */
+
+#ifdef KERNELS_X86
+
+static void mix_add_sse2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+						  _mm_loadu_ps(src + i)));
+	mix_add_scalar(dst + i, src + i, count - i);
+}
+
+static void mix_add_gain_sse2(float *dst, const float *src, const float *gain,
+			      size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_mul_ps(_mm_loadu_ps(src + i),
+					_mm_loadu_ps(gain + i));
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), val));
+	}
+	mix_add_gain_scalar(dst + i, src + i, gain + i, count - i);
+}
+
+static void apply_gain_sse2(float *data, float gain, size_t count)
+{
+	const __m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), g));
+	apply_gain_scalar(data + i, gain, count - i);
+}
+
+static void apply_gain_ramp_sse2(float *data, const float *gain, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i),
+						   _mm_loadu_ps(gain + i)));
+	apply_gain_ramp_scalar(data + i, gain + i, count - i);
+}
+
+/* min/max return their second operand for NaN, which keeps NaN like the
+ * comparisons of the scalar version do */
+static void clamp_sse2(float *data, size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minus_one = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_min_ps(one, _mm_loadu_ps(data + i));
+		_mm_storeu_ps(data + i, _mm_max_ps(minus_one, val));
+	}
+	clamp_scalar(data + i, count - i);
+}
+
+static void downmix_sse2(float *const *data, size_t channels, size_t count)
+{
+	const float channels_i = 1.0f / (float)channels;
+
+	for (size_t ch = 1; ch < channels; ch++)
+		mix_add_sse2(data[0], data[ch], count);
+	apply_gain_sse2(data[0], channels_i, count);
+	for (size_t ch = 1; ch < channels; ch++)
+		memcpy(data[ch], data[0], count * sizeof(float));
+}
+
+static float dot_sse2_acc(__m128 acc, const float *a, const float *b,
+			  size_t i, size_t count)
+{
+	float lanes[4];
+
+	for (; i + 4 <= count; i += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i),
+						 _mm_loadu_ps(b + i)));
+
+	_mm_storeu_ps(lanes, acc);
+	return dot_tail(lanes, a, b, i, count);
+}
+
+static float dot_sse2(const float *a, const float *b, size_t count)
+{
+	return dot_sse2_acc(_mm_setzero_ps(), a, b, 0, count);
+}
+
+static const struct audio_kernels kernels_sse2 = {
+	AUDIO_KERNEL_SSE2,   mix_add_sse2,         mix_add_gain_sse2,
+	apply_gain_sse2,     apply_gain_ramp_sse2, clamp_sse2,
+	downmix_sse2,        dot_sse2,
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX2, when the CPU has it                                                 */
+
+TARGET_AVX2
+static void mix_add_avx2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(dst + i,
+				 _mm256_add_ps(_mm256_loadu_ps(dst + i),
+					       _mm256_loadu_ps(src + i)));
+	mix_add_sse2(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2
+static void mix_add_gain_avx2(float *dst, const float *src, const float *gain,
+			      size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_mul_ps(_mm256_loadu_ps(src + i),
+					   _mm256_loadu_ps(gain + i));
+		_mm256_storeu_ps(dst + i,
+				 _mm256_add_ps(_mm256_loadu_ps(dst + i), val));
+	}
+	mix_add_gain_sse2(dst + i, src + i, gain + i, count - i);
+}
+
+TARGET_AVX2
+static void apply_gain_avx2(float *data, float gain, size_t count)
+{
+	const __m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(data + i,
+				 _mm256_mul_ps(_mm256_loadu_ps(data + i), g));
+	apply_gain_sse2(data + i, gain, count - i);
+}
+
+TARGET_AVX2
+static void apply_gain_ramp_avx2(float *data, const float *gain, size_t count)
+{
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(data + i,
+				 _mm256_mul_ps(_mm256_loadu_ps(data + i),
+					       _mm256_loadu_ps(gain + i)));
+	apply_gain_ramp_sse2(data + i, gain + i, count - i);
+}
+
+TARGET_AVX2
+static void clamp_avx2(float *data, size_t count)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 minus_one = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_min_ps(one, _mm256_loadu_ps(data + i));
+		_mm256_storeu_ps(data + i, _mm256_max_ps(minus_one, val));
+	}
+	clamp_sse2(data + i, count - i);
+}
+
+TARGET_AVX2
+static void downmix_avx2(float *const *data, size_t channels, size_t count)
+{
+	const float channels_i = 1.0f / (float)channels;
+
+	for (size_t ch = 1; ch < channels; ch++)
+		mix_add_avx2(data[0], data[ch], count);
+	apply_gain_avx2(data[0], channels_i, count);
+	for (size_t ch = 1; ch < channels; ch++)
+		memcpy(data[ch], data[0], count * sizeof(float));
+}
+
+/* the products are added to four sums in the same order as the others */
+TARGET_AVX2
+static float dot_avx2(const float *a, const float *b, size_t count)
+{
+	__m128 acc = _mm_setzero_ps();
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_mul_ps(_mm256_loadu_ps(a + i),
+					   _mm256_loadu_ps(b + i));
+		acc = _mm_add_ps(acc, _mm256_castps256_ps128(val));
+		acc = _mm_add_ps(acc, _mm256_extractf128_ps(val, 1));
+	}
+	return dot_sse2_acc(acc, a, b, i, count);
+}
+
+static const struct audio_kernels kernels_avx2 = {
+	AUDIO_KERNEL_AVX2,   mix_add_avx2,         mix_add_gain_avx2,
+	apply_gain_avx2,     apply_gain_ramp_avx2, clamp_avx2,
+	downmix_avx2,        dot_avx2,
+};
+
+static bool cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	/* OSXSAVE and AVX, then the OS must save the YMM registers */
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* NEON                                                                      */
+
+#ifdef KERNELS_NEON
+
+static void mix_add_neon(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i),
+					     vld1q_f32(src + i)));
+	mix_add_scalar(dst + i, src + i, count - i);
+}
+
+/* vmlaq_f32 may fuse, multiply and add separately */
+static void mix_add_gain_neon(float *dst, const float *src, const float *gain,
+			      size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val =
+			vmulq_f32(vld1q_f32(src + i), vld1q_f32(gain + i));
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), val));
+	}
+	mix_add_gain_scalar(dst + i, src + i, gain + i, count - i);
+}
+
+static void apply_gain_neon(float *data, float gain, size_t count)
+{
+	const float32x4_t g = vdupq_n_f32(gain);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i), g));
+	apply_gain_scalar(data + i, gain, count - i);
+}
+
+static void apply_gain_ramp_neon(float *data, const float *gain, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i),
+					      vld1q_f32(gain + i)));
+	apply_gain_ramp_scalar(data + i, gain + i, count - i);
+}
+
+/* vminq/vmaxq would turn NaN into NaN too, but compare and select to
+ * follow the scalar version exactly */
+static void clamp_neon(float *data, size_t count)
+{
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const float32x4_t minus_one = vdupq_n_f32(-1.0f);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float32x4_t val = vld1q_f32(data + i);
+		val = vbslq_f32(vcgtq_f32(val, one), one, val);
+		val = vbslq_f32(vcltq_f32(val, minus_one), minus_one, val);
+		vst1q_f32(data + i, val);
+	}
+	clamp_scalar(data + i, count - i);
+}
+
+static void downmix_neon(float *const *data, size_t channels, size_t count)
+{
+	const float channels_i = 1.0f / (float)channels;
+
+	for (size_t ch = 1; ch < channels; ch++)
+		mix_add_neon(data[0], data[ch], count);
+	apply_gain_neon(data[0], channels_i, count);
+	for (size_t ch = 1; ch < channels; ch++)
+		memcpy(data[ch], data[0], count * sizeof(float));
+}
+
+static float dot_neon(const float *a, const float *b, size_t count)
+{
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	float lanes[4];
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		acc = vaddq_f32(acc,
+				vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+
+	vst1q_f32(lanes, acc);
+	return dot_tail(lanes, a, b, i, count);
+}
+
+static const struct audio_kernels kernels_neon = {
+	AUDIO_KERNEL_NEON,   mix_add_neon,         mix_add_gain_neon,
+	apply_gain_neon,     apply_gain_ramp_neon, clamp_neon,
+	downmix_neon,        dot_neon,
+};
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* dispatch                                                                  */
+
+static const struct audio_kernels *get_kernels_for(enum audio_kernel_level l)
+{
+	switch (l) {
+	case AUDIO_KERNEL_SCALAR:
+		return &kernels_scalar;
+#ifdef KERNELS_X86
+	case AUDIO_KERNEL_SSE2:
+		return &kernels_sse2;
+	case AUDIO_KERNEL_AVX2:
+		return cpu_has_avx2() ? &kernels_avx2 : NULL;
+#endif
+#ifdef KERNELS_NEON
+	case AUDIO_KERNEL_NEON:
+		return &kernels_neon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/* Picked on first use.  Racing first uses all store the same pointer. */
+static const struct audio_kernels *volatile kernels = NULL;
+
+static inline const struct audio_kernels *get_kernels(void)
+{
+	const struct audio_kernels *k = kernels;
+	if (!k) {
+		k = get_kernels_for(audio_kernels_best_level());
+		kernels = k;
+	}
+	return k;
+}
+
+enum audio_kernel_level audio_kernels_best_level(void)
+{
+#ifdef KERNELS_X86
+	return cpu_has_avx2() ? AUDIO_KERNEL_AVX2 : AUDIO_KERNEL_SSE2;
+#elif defined(KERNELS_NEON)
+	return AUDIO_KERNEL_NEON;
+#else
+	return AUDIO_KERNEL_SCALAR;
+#endif
+}
+
+enum audio_kernel_level audio_kernels_get_level(void)
+{
+	return get_kernels()->level;
+}
+
+bool audio_kernels_set_level(enum audio_kernel_level level)
+{
+	const struct audio_kernels *k = get_kernels_for(level);
+	if (!k)
+		return false;
+
+	kernels = k;
+	return true;
+}
+
+const char *audio_kernels_level_name(enum audio_kernel_level level)
+{
+	switch (level) {
+	case AUDIO_KERNEL_SCALAR:
+		return "scalar";
+	case AUDIO_KERNEL_SSE2:
+		return "SSE2";
+	case AUDIO_KERNEL_AVX2:
+		return "AVX2";
+	case AUDIO_KERNEL_NEON:
+		return "NEON";
+	}
+	return "unknown";
+}
+
+void audio_mix_add(float *dst, const float *src, size_t count)
+{
+	get_kernels()->mix_add(dst, src, count);
+}
+
+void audio_mix_add_gain(float *dst, const float *src, const float *gain,
+			size_t count)
+{
+	get_kernels()->mix_add_gain(dst, src, gain, count);
+}
+
+void audio_apply_gain(float *data, float gain, size_t count)
+{
+	get_kernels()->apply_gain(data, gain, count);
+}
+
+void audio_apply_gain_ramp(float *data, const float *gain, size_t count)
+{
+	get_kernels()->apply_gain_ramp(data, gain, count);
+}
+
+void audio_clamp(float *data, size_t count)
+{
+	get_kernels()->clamp(data, count);
+}
+
+void audio_downmix_to_mono_planar(float *const *data, size_t channels,
+				  size_t count)
+{
+	if (channels > 1)
+		get_kernels()->downmix(data, channels, count);
+}
+
+float audio_dot_product(const float *a, const float *b, size_t count)
+{
+	return get_kernels()->dot(a, b, count);
+}
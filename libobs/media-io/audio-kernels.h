@@ -0,0 +1,77 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Float audio kernels for the audio thread's inner loops (mixing, volume,
+ * clamping, downmixing) and for resampling.
+ *
+ * The implementation is picked at runtime for the CPU (SSE2, AVX2 or NEON,
+ * scalar otherwise).  Every implementation gives the exact same results as
+ * the scalar one: no fused multiply-add and no reordering of the sums.
+ * Buffers do not need to be aligned.
+ */
+
+enum audio_kernel_level {
+	AUDIO_KERNEL_SCALAR,
+	AUDIO_KERNEL_SSE2,
+	AUDIO_KERNEL_AVX2,
+	AUDIO_KERNEL_NEON,
+};
+
+/** dst[i] += src[i] */
+EXPORT void audio_mix_add(float *dst, const float *src, size_t count);
+
+/** dst[i] += src[i] * gain[i] */
+EXPORT void audio_mix_add_gain(float *dst, const float *src, const float *gain,
+			       size_t count);
+
+/** data[i] *= gain */
+EXPORT void audio_apply_gain(float *data, float gain, size_t count);
+
+/** data[i] *= gain[i], for volume changes within a block */
+EXPORT void audio_apply_gain_ramp(float *data, const float *gain,
+				  size_t count);
+
+/** Clamps to -1.0..1.0 */
+EXPORT void audio_clamp(float *data, size_t count);
+
+/** Averages the planes into every plane */
+EXPORT void audio_downmix_to_mono_planar(float *const *data, size_t channels,
+					 size_t count);
+
+/** Sum of a[i] * b[i], kept in four partial sums (element i goes to sum
+ * i % 4) that are added as (s0 + s1) + (s2 + s3) */
+EXPORT float audio_dot_product(const float *a, const float *b, size_t count);
+
+/** Best level supported by the CPU */
+EXPORT enum audio_kernel_level audio_kernels_best_level(void);
+EXPORT enum audio_kernel_level audio_kernels_get_level(void);
+/** For benchmarks and tests: false if the CPU does not support it */
+EXPORT bool audio_kernels_set_level(enum audio_kernel_level level);
+EXPORT const char *audio_kernels_level_name(enum audio_kernel_level level);
+
+#ifdef __cplusplus
+}
+#endif
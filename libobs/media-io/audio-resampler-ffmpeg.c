@@ -16,13 +16,35 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
 #include "audio-resampler.h"
+#include "audio-resampler-polyphase.h"
 #include "audio-io.h"
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 
+/* classes_mutex guards the list and the resampler counts, the times are
+ * added without it by the threads resampling */
+struct resampler_class {
+	struct resampler_class *next;
+	struct audio_resampler_stats stats;
+
+	volatile long long calls;
+	volatile long long in_frames;
+	volatile long long out_frames;
+	volatile long long time_ns;
+};
+
+static pthread_mutex_t classes_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct resampler_class *first_class = NULL;
+static volatile bool polyphase_enabled = false;
+
 struct audio_resampler {
+	struct resampler_class *cls;
+	struct polyphase_resampler *polyphase;
+
 	struct SwrContext *context;
 	bool opened;
 
@@ -91,12 +113,109 @@ static inline uint64_t convert_speaker_layout(enum speaker_layout layout)
 	return 0;
 }
 
+static inline bool same_info(const struct resample_info *a,
+			     const struct resample_info *b)
+{
+	return a->samples_per_sec == b->samples_per_sec &&
+	       a->format == b->format && a->speakers == b->speakers;
+}
+
+static struct resampler_class *get_class(const struct resample_info *dst,
+					 const struct resample_info *src,
+					 bool polyphase)
+{
+	struct resampler_class *cls;
+
+	pthread_mutex_lock(&classes_mutex);
+
+	for (cls = first_class; cls; cls = cls->next) {
+		if (same_info(&cls->stats.src, src) &&
+		    same_info(&cls->stats.dst, dst) &&
+		    cls->stats.polyphase == polyphase) {
+			cls->stats.resamplers++;
+			goto exit;
+		}
+	}
+
+	cls = bzalloc(sizeof(struct resampler_class));
+	cls->stats.src = *src;
+	cls->stats.dst = *dst;
+	cls->stats.polyphase = polyphase;
+	cls->stats.resamplers = 1;
+	cls->next = first_class;
+	first_class = cls;
+
+exit:
+	pthread_mutex_unlock(&classes_mutex);
+	return cls;
+}
+
+static void release_class(struct resampler_class *cls)
+{
+	struct resampler_class **prev;
+
+	pthread_mutex_lock(&classes_mutex);
+
+	if (--cls->stats.resamplers == 0) {
+		for (prev = &first_class; *prev; prev = &(*prev)->next) {
+			if (*prev == cls) {
+				*prev = cls->next;
+				break;
+			}
+		}
+		bfree(cls);
+	}
+
+	pthread_mutex_unlock(&classes_mutex);
+}
+
+size_t audio_resampler_get_stats(struct audio_resampler_stats *stats,
+				 size_t max_stats)
+{
+	size_t count = 0;
+
+	pthread_mutex_lock(&classes_mutex);
+
+	for (struct resampler_class *cls = first_class; cls; cls = cls->next) {
+		if (stats && count < max_stats) {
+			struct audio_resampler_stats *out = &stats[count];
+
+			*out = cls->stats;
+			out->calls = (uint64_t)os_atomic_load_long_long(
+				&cls->calls);
+			out->in_frames = (uint64_t)os_atomic_load_long_long(
+				&cls->in_frames);
+			out->out_frames = (uint64_t)os_atomic_load_long_long(
+				&cls->out_frames);
+			out->time_ns = (uint64_t)os_atomic_load_long_long(
+				&cls->time_ns);
+		}
+		count++;
+	}
+
+	pthread_mutex_unlock(&classes_mutex);
+	return count;
+}
+
+void audio_resampler_set_polyphase(bool enable)
+{
+	polyphase_enabled = enable;
+}
+
 audio_resampler_t *audio_resampler_create(const struct resample_info *dst,
 					  const struct resample_info *src)
 {
 	struct audio_resampler *rs = bzalloc(sizeof(struct audio_resampler));
 	int errcode;
 
+	if (polyphase_enabled && polyphase_resampler_supported(dst, src)) {
+		rs->polyphase = polyphase_resampler_create(dst, src);
+		rs->cls = get_class(dst, src, true);
+		return rs;
+	}
+
+	rs->cls = get_class(dst, src, false);
+
 	rs->opened = false;
 	rs->input_freq = src->samples_per_sec;
 	rs->input_layout = convert_speaker_layout(src->speakers);
@@ -151,6 +270,9 @@ audio_resampler_t *audio_resampler_create(const struct resample_info *dst,
 void audio_resampler_destroy(audio_resampler_t *rs)
 {
 	if (rs) {
+		polyphase_resampler_destroy(rs->polyphase);
+		release_class(rs->cls);
+
 		if (rs->context)
 			swr_free(&rs->context);
 		if (rs->output_buffer[0])
@@ -160,13 +282,19 @@ void audio_resampler_destroy(audio_resampler_t *rs)
 	}
 }
 
-bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
-			      uint32_t *out_frames, uint64_t *ts_offset,
-			      const uint8_t *const input[], uint32_t in_frames)
+static void add_class_time(struct resampler_class *cls, uint32_t in_frames,
+			   uint32_t out_frames, uint64_t time_ns)
 {
-	if (!rs)
-		return false;
+	os_atomic_add_long_long(&cls->calls, 1);
+	os_atomic_add_long_long(&cls->in_frames, (long long)in_frames);
+	os_atomic_add_long_long(&cls->out_frames, (long long)out_frames);
+	os_atomic_add_long_long(&cls->time_ns, (long long)time_ns);
+}
 
+static bool swr_resample(audio_resampler_t *rs, uint8_t *output[],
+			 uint32_t *out_frames, uint64_t *ts_offset,
+			 const uint8_t *const input[], uint32_t in_frames)
+{
 	struct SwrContext *context = rs->context;
 	int ret;
 
@@ -203,3 +331,29 @@ bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
 	*out_frames = (uint32_t)ret;
 	return true;
 }
+
+bool audio_resampler_resample(audio_resampler_t *rs, uint8_t *output[],
+			      uint32_t *out_frames, uint64_t *ts_offset,
+			      const uint8_t *const input[], uint32_t in_frames)
+{
+	uint64_t start;
+	bool success;
+
+	if (!rs)
+		return false;
+
+	start = os_gettime_ns();
+
+	if (rs->polyphase)
+		success = polyphase_resampler_resample(rs->polyphase, output,
+						       out_frames, ts_offset,
+						       input, in_frames);
+	else
+		success = swr_resample(rs, output, out_frames, ts_offset,
+				       input, in_frames);
+
+	if (success)
+		add_class_time(rs->cls, in_frames, *out_frames,
+			       os_gettime_ns() - start);
+	return success;
+}
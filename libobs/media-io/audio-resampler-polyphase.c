@@ -0,0 +1,482 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include <string.h>
+
+#include "../util/bmem.h"
+#include "../util/threading.h"
+#include "audio-kernels.h"
+#include "audio-resampler-polyphase.h"
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433832795
+#endif
+
+/* zero crossings of the sinc on both sides when upsampling, widened with
+ * the ratio when downsampling so that the transition band keeps its width */
+#define BASE_TAPS 32
+#define MAX_PHASES 1024
+#define MAX_DECIMATION 4
+
+#define CUTOFF 0.95
+#define KAISER_BETA 9.0
+
+struct polyphase_filter {
+	struct polyphase_filter *next;
+	uint32_t in_rate;
+	uint32_t out_rate;
+
+	/* out_rate / in_rate reduced to phases / step */
+	uint32_t phases;
+	uint32_t step;
+	uint32_t taps;
+
+	/* taps coefficients per phase, in the order of the input samples */
+	float *coeffs;
+	long refs;
+};
+
+static pthread_mutex_t filters_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct polyphase_filter *first_filter = NULL;
+
+struct polyphase_resampler {
+	struct polyphase_filter *filter;
+
+	uint32_t channels;
+	uint32_t in_rate;
+	enum audio_format in_format;
+	enum audio_format out_format;
+
+	/* per channel: taps - 1 samples of history followed by the input */
+	float *buffers[MAX_AUDIO_CHANNELS];
+	size_t buffer_frames;
+
+	float *results[MAX_AUDIO_CHANNELS];
+	size_t result_frames;
+
+	uint8_t *output[MAX_AV_PLANES];
+	size_t output_size;
+
+	/* next output: its last input sample and its phase */
+	size_t index;
+	uint32_t phase;
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/* Kaiser windowed sinc.  Phase p of an output sample lies p / phases input
+ * samples after the center of the window. */
+static void build_filter(struct polyphase_filter *f)
+{
+	double cutoff = CUTOFF;
+	double half = (double)f->taps / 2.0;
+	double i0_beta = bessel_i0(KAISER_BETA);
+
+	if (f->step > f->phases)
+		cutoff *= (double)f->phases / (double)f->step;
+
+	f->coeffs = bmalloc(sizeof(float) * f->phases * f->taps);
+
+	for (uint32_t p = 0; p < f->phases; p++) {
+		float *coeffs = f->coeffs + p * f->taps;
+		double values[BASE_TAPS * MAX_DECIMATION];
+		double sum = 0.0;
+
+		for (uint32_t j = 0; j < f->taps; j++) {
+			double x = half - 1.0 - (double)j +
+				   (double)p / (double)f->phases;
+			double r = x / half;
+			double w = 0.0, s = 1.0;
+
+			if (r > -1.0 && r < 1.0)
+				w = bessel_i0(KAISER_BETA * sqrt(1.0 - r * r)) /
+				    i0_beta;
+			if (x != 0.0)
+				s = sin(M_PI * cutoff * x) / (M_PI * cutoff * x);
+
+			values[j] = s * w;
+			sum += values[j];
+		}
+
+		/* unity gain at DC for every phase */
+		for (uint32_t j = 0; j < f->taps; j++)
+			coeffs[j] = (float)(values[j] / sum);
+	}
+}
+
+static struct polyphase_filter *get_filter(uint32_t in_rate, uint32_t out_rate)
+{
+	struct polyphase_filter *f;
+	uint32_t div = gcd(in_rate, out_rate);
+
+	pthread_mutex_lock(&filters_mutex);
+
+	for (f = first_filter; f; f = f->next) {
+		if (f->in_rate == in_rate && f->out_rate == out_rate) {
+			f->refs++;
+			goto exit;
+		}
+	}
+
+	f = bzalloc(sizeof(struct polyphase_filter));
+	f->in_rate = in_rate;
+	f->out_rate = out_rate;
+	f->phases = out_rate / div;
+	f->step = in_rate / div;
+	f->taps = BASE_TAPS;
+	if (f->step > f->phases)
+		f->taps = (BASE_TAPS * f->step + f->phases - 1) / f->phases;
+	f->taps = (f->taps + 7) & ~7;
+	f->refs = 1;
+	build_filter(f);
+
+	f->next = first_filter;
+	first_filter = f;
+
+exit:
+	pthread_mutex_unlock(&filters_mutex);
+	return f;
+}
+
+static void release_filter(struct polyphase_filter *filter)
+{
+	struct polyphase_filter **prev;
+
+	pthread_mutex_lock(&filters_mutex);
+
+	if (--filter->refs == 0) {
+		for (prev = &first_filter; *prev; prev = &(*prev)->next) {
+			if (*prev == filter) {
+				*prev = filter->next;
+				break;
+			}
+		}
+
+		bfree(filter->coeffs);
+		bfree(filter);
+	}
+
+	pthread_mutex_unlock(&filters_mutex);
+}
+
+bool polyphase_resampler_supported(const struct resample_info *dst,
+				   const struct resample_info *src)
+{
+	uint32_t div, phases, step;
+
+	if (!src->samples_per_sec || !dst->samples_per_sec)
+		return false;
+	if (src->samples_per_sec == dst->samples_per_sec)
+		return false;
+	if (src->speakers != dst->speakers || src->speakers == SPEAKERS_UNKNOWN)
+		return false;
+	if (src->format == AUDIO_FORMAT_UNKNOWN ||
+	    dst->format == AUDIO_FORMAT_UNKNOWN)
+		return false;
+
+	div = gcd(src->samples_per_sec, dst->samples_per_sec);
+	phases = dst->samples_per_sec / div;
+	step = src->samples_per_sec / div;
+
+	return phases <= MAX_PHASES && step <= phases * MAX_DECIMATION;
+}
+
+struct polyphase_resampler *
+polyphase_resampler_create(const struct resample_info *dst,
+			   const struct resample_info *src)
+{
+	struct polyphase_resampler *pr;
+
+	if (!polyphase_resampler_supported(dst, src))
+		return NULL;
+
+	pr = bzalloc(sizeof(struct polyphase_resampler));
+	pr->filter = get_filter(src->samples_per_sec, dst->samples_per_sec);
+	pr->channels = get_audio_channels(src->speakers);
+	pr->in_rate = src->samples_per_sec;
+	pr->in_format = src->format;
+	pr->out_format = dst->format;
+	pr->index = pr->filter->taps - 1;
+	return pr;
+}
+
+void polyphase_resampler_destroy(struct polyphase_resampler *pr)
+{
+	if (!pr)
+		return;
+
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
+		bfree(pr->buffers[i]);
+		bfree(pr->results[i]);
+	}
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		bfree(pr->output[i]);
+
+	release_filter(pr->filter);
+	bfree(pr);
+}
+
+/* ------------------------------------------------------------------------- */
+/* format conversion                                                         */
+
+static enum audio_format packed_format(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		return AUDIO_FORMAT_U8BIT;
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		return AUDIO_FORMAT_16BIT;
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return AUDIO_FORMAT_32BIT;
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		return AUDIO_FORMAT_FLOAT;
+	default:
+		return format;
+	}
+}
+
+static void read_samples(float *dst, const uint8_t *src, size_t stride,
+			 enum audio_format format, size_t frames)
+{
+	switch (packed_format(format)) {
+	case AUDIO_FORMAT_U8BIT:
+		for (size_t i = 0; i < frames; i++)
+			dst[i] = ((float)src[i * stride] - 128.0f) / 128.0f;
+		break;
+	case AUDIO_FORMAT_16BIT: {
+		const int16_t *s = (const int16_t *)src;
+		for (size_t i = 0; i < frames; i++)
+			dst[i] = (float)s[i * stride] / 32768.0f;
+		break;
+	}
+	case AUDIO_FORMAT_32BIT: {
+		const int32_t *s = (const int32_t *)src;
+		for (size_t i = 0; i < frames; i++)
+			dst[i] = (float)((double)s[i * stride] / 2147483648.0);
+		break;
+	}
+	default: {
+		const float *s = (const float *)src;
+		if (stride == 1) {
+			memcpy(dst, s, frames * sizeof(float));
+		} else {
+			for (size_t i = 0; i < frames; i++)
+				dst[i] = s[i * stride];
+		}
+		break;
+	}
+	}
+}
+
+static inline float clamp_sample(float val)
+{
+	return (val > 1.0f) ? 1.0f : ((val < -1.0f) ? -1.0f : val);
+}
+
+static void write_samples(uint8_t *dst, const float *src, size_t stride,
+			  enum audio_format format, size_t frames)
+{
+	switch (packed_format(format)) {
+	case AUDIO_FORMAT_U8BIT:
+		for (size_t i = 0; i < frames; i++)
+			dst[i * stride] = (uint8_t)lrintf(
+				clamp_sample(src[i]) * 127.0f + 128.0f);
+		break;
+	case AUDIO_FORMAT_16BIT: {
+		int16_t *d = (int16_t *)dst;
+		for (size_t i = 0; i < frames; i++)
+			d[i * stride] =
+				(int16_t)lrintf(clamp_sample(src[i]) * 32767.0f);
+		break;
+	}
+	case AUDIO_FORMAT_32BIT: {
+		int32_t *d = (int32_t *)dst;
+		for (size_t i = 0; i < frames; i++)
+			d[i * stride] = (int32_t)lrint(
+				(double)clamp_sample(src[i]) * 2147483647.0);
+		break;
+	}
+	default: {
+		float *d = (float *)dst;
+		if (stride == 1) {
+			memcpy(d, src, frames * sizeof(float));
+		} else {
+			for (size_t i = 0; i < frames; i++)
+				d[i * stride] = src[i];
+		}
+		break;
+	}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void ensure_buffers(struct polyphase_resampler *pr, size_t frames)
+{
+	size_t history = pr->filter->taps - 1;
+
+	if (frames <= pr->buffer_frames)
+		return;
+
+	for (uint32_t ch = 0; ch < pr->channels; ch++) {
+		float *buffer = bmalloc(frames * sizeof(float));
+
+		if (pr->buffers[ch])
+			memcpy(buffer, pr->buffers[ch],
+			       history * sizeof(float));
+		else
+			memset(buffer, 0, history * sizeof(float));
+
+		bfree(pr->buffers[ch]);
+		pr->buffers[ch] = buffer;
+	}
+	pr->buffer_frames = frames;
+}
+
+static void ensure_results(struct polyphase_resampler *pr, size_t frames)
+{
+	size_t bytes_per_frame = get_audio_bytes_per_channel(pr->out_format);
+	bool planar = is_audio_planar(pr->out_format);
+	size_t planes = planar ? pr->channels : 1;
+	size_t size;
+
+	if (!planar)
+		bytes_per_frame *= pr->channels;
+	size = frames * bytes_per_frame;
+
+	if (frames > pr->result_frames) {
+		for (uint32_t ch = 0; ch < pr->channels; ch++) {
+			bfree(pr->results[ch]);
+			pr->results[ch] = bmalloc(frames * sizeof(float));
+		}
+		pr->result_frames = frames;
+	}
+
+	if (size > pr->output_size) {
+		for (size_t i = 0; i < planes; i++) {
+			bfree(pr->output[i]);
+			pr->output[i] = bmalloc(size);
+		}
+		pr->output_size = size;
+	}
+}
+
+bool polyphase_resampler_resample(struct polyphase_resampler *pr,
+				  uint8_t *output[], uint32_t *out_frames,
+				  uint64_t *ts_offset,
+				  const uint8_t *const input[], uint32_t in_frames)
+{
+	const struct polyphase_filter *f;
+	bool in_planar, out_planar;
+	size_t history, end, count = 0;
+	double delay;
+
+	if (!pr)
+		return false;
+
+	f = pr->filter;
+	history = f->taps - 1;
+	end = history + in_frames;
+	in_planar = is_audio_planar(pr->in_format);
+	out_planar = is_audio_planar(pr->out_format);
+
+	ensure_buffers(pr, end);
+
+	for (uint32_t ch = 0; ch < pr->channels; ch++) {
+		const uint8_t *src =
+			in_planar ? input[ch]
+				  : input[0] + ch * get_audio_bytes_per_channel(
+							    pr->in_format);
+		read_samples(pr->buffers[ch] + history, src,
+			     in_planar ? 1 : pr->channels, pr->in_format,
+			     in_frames);
+	}
+
+	/* how far the first output of this call is centered before the first
+	 * input sample */
+	delay = (double)history + (double)f->taps / 2.0 - (double)pr->index -
+		(double)pr->phase / (double)f->phases;
+	*ts_offset = delay > 0.0
+			     ? (uint64_t)(delay * 1000000000.0 /
+					  (double)pr->in_rate)
+			     : 0;
+
+	if (pr->index < end) {
+		uint64_t avail = (uint64_t)(end - pr->index) * f->phases -
+				 pr->phase;
+		count = (size_t)((avail + f->step - 1) / f->step);
+	}
+
+	ensure_results(pr, count);
+
+	for (size_t n = 0; n < count; n++) {
+		const float *coeffs = f->coeffs + pr->phase * f->taps;
+		size_t start = pr->index - history;
+
+		for (uint32_t ch = 0; ch < pr->channels; ch++)
+			pr->results[ch][n] = audio_dot_product(
+				pr->buffers[ch] + start, coeffs, f->taps);
+
+		pr->phase += f->step;
+		pr->index += pr->phase / f->phases;
+		pr->phase %= f->phases;
+	}
+
+	/* keep the last taps - 1 input samples */
+	for (uint32_t ch = 0; ch < pr->channels; ch++)
+		memmove(pr->buffers[ch], pr->buffers[ch] + in_frames,
+			history * sizeof(float));
+	pr->index -= in_frames;
+
+	for (uint32_t ch = 0; ch < pr->channels; ch++) {
+		uint8_t *dst = out_planar
+				       ? pr->output[ch]
+				       : pr->output[0] +
+						 ch * get_audio_bytes_per_channel(
+							      pr->out_format);
+		write_samples(dst, pr->results[ch], out_planar ? 1 : pr->channels,
+			      pr->out_format, count);
+	}
+
+	for (size_t i = 0; i < (out_planar ? pr->channels : 1); i++)
+		output[i] = pr->output[i];
+
+	*out_frames = (uint32_t)count;
+	return true;
+}
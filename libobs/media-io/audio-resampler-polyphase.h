@@ -0,0 +1,56 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "audio-resampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Float polyphase resampler used by audio_resampler for plain rate changes.
+ *
+ * The filter tables depend only on the pair of rates, so they are built
+ * once and shared by every resampler converting between the same rates;
+ * each resampler only keeps its own history.  The filtering runs on the
+ * audio kernels' dot product.
+ */
+
+struct polyphase_resampler;
+
+/* rate changes with the same layout on both sides, and rates whose ratio
+ * does not need too many phases */
+extern bool polyphase_resampler_supported(const struct resample_info *dst,
+					  const struct resample_info *src);
+
+extern struct polyphase_resampler *
+polyphase_resampler_create(const struct resample_info *dst,
+			   const struct resample_info *src);
+extern void polyphase_resampler_destroy(struct polyphase_resampler *pr);
+
+extern bool polyphase_resampler_resample(struct polyphase_resampler *pr,
+					 uint8_t *output[],
+					 uint32_t *out_frames,
+					 uint64_t *ts_offset,
+					 const uint8_t *const input[],
+					 uint32_t in_frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -44,6 +44,37 @@ EXPORT bool audio_resampler_resample(audio_resampler_t *resampler,
 				     const uint8_t *const input[],
 				     uint32_t in_frames);
 
+/**
+ * Resamplers are grouped by conversion class, the pair of source and
+ * destination formats.  Resamplers go through libswresample, unless the
+ * polyphase filter is enabled: plain rate changes then go through it, with
+ * tables shared by the whole class.
+ */
+struct audio_resampler_stats {
+	struct resample_info src;
+	struct resample_info dst;
+	bool polyphase;
+	uint32_t resamplers;
+	uint64_t calls;
+	uint64_t in_frames;
+	uint64_t out_frames;
+	uint64_t time_ns;
+};
+
+/**
+ * Gets the stats of the conversion classes in use, returns the number of
+ * classes (which may be more than max_stats)
+ */
+EXPORT size_t audio_resampler_get_stats(struct audio_resampler_stats *stats,
+					size_t max_stats);
+
+/**
+ * Uses the polyphase filter for the plain rate changes of the new
+ * resamplers.  Off by default: its output is not bit-identical to the
+ * libswresample one it replaces.
+ */
+EXPORT void audio_resampler_set_polyphase(bool enable);
+
 #ifdef __cplusplus
 }
 #endif
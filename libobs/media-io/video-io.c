@@ -32,29 +32,84 @@ extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
 #define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
+#define MAX_INPUT_QUEUE 2
 
 struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* locked and not sent yet, or still used by input threads */
+	bool used;
+	long refs;
+
+	/* identifies the frame for the conversion cache */
+	uint64_t id;
+};
+
+struct scaled_frame {
+	struct video_frame frame;
+	uint64_t id;
+	bool valid;
+	long refs;
+};
+
+/* inputs asking for the same conversion share their scaler and its output,
+ * so each frame is only converted once for all of them */
+struct video_conversion {
+	struct video_scale_info info;
+	video_scaler_t *scaler;
+	long inputs;
+
+	pthread_mutex_t mutex;
+	DARRAY(struct scaled_frame *) frames;
+	uint64_t hits;
+	uint64_t misses;
 };
 
+struct video_input_thread;
+
 struct video_input {
 	struct video_scale_info conversion;
-	video_scaler_t *scaler;
-	struct video_frame frame[MAX_CONVERT_BUFFERS];
-	int cur_frame;
+	struct video_conversion *convert;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	/* only one frame out of frame_rate_divisor is sent */
+	uint32_t frame_rate_divisor;
+	uint32_t frame_count;
+
+	/* threaded inputs: owns the conversion and the callback */
+	struct video_input_thread *thread;
+
+	volatile long total_frames;
+	volatile long skipped_frames;
+	volatile long shared_frames;
+	uint64_t lag_ns;
+	uint64_t max_lag_ns;
 };
 
-static inline void video_input_free(struct video_input *input)
-{
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
-}
+struct video_input_job {
+	struct cached_frame_info *frame_info;
+	struct video_data frame;
+	uint64_t queued_ns;
+};
+
+struct video_input_thread {
+	struct video_output *video;
+	struct video_input input;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	os_sem_t *sem;
+	bool stop;
+	bool detached;
+
+	struct video_input_job queue[MAX_INPUT_QUEUE];
+	size_t queue_start;
+	size_t queue_size;
+};
 
 struct video_output {
 	struct video_output_info info;
@@ -73,10 +128,20 @@ struct video_output {
 	pthread_mutex_t input_mutex;
 	DARRAY(struct video_input) inputs;
 
+	/* input threads can hold on to any frame, so the slots are reused in
+	 * any order and added keeps the order they are sent in */
 	size_t available_frames;
 	size_t first_added;
-	size_t last_added;
+	size_t num_added;
+	size_t added[MAX_CACHE_SIZE];
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
+	uint64_t next_frame_id;
+
+	bool threaded_inputs;
+	volatile long input_threads;
+
+	pthread_mutex_t conversions_mutex;
+	DARRAY(struct video_conversion *) conversions;
 
 	volatile bool raw_active;
 	volatile long gpu_refs;
@@ -84,35 +149,343 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
-static inline bool scale_video_output(struct video_input *input,
-				      struct video_data *data)
+/* called with data_mutex held */
+static inline void free_cached_frame(struct video_output *video,
+				     struct cached_frame_info *frame_info)
 {
-	bool success = true;
+	if (frame_info->used && !frame_info->count && !frame_info->refs) {
+		frame_info->used = false;
+		video->available_frames++;
+	}
+}
 
-	if (input->scaler) {
-		struct video_frame *frame;
+static void release_frame(struct video_output *video,
+			  struct cached_frame_info *frame_info)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	frame_info->refs--;
+	free_cached_frame(video, frame_info);
+	pthread_mutex_unlock(&video->data_mutex);
+}
 
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+static void video_conversion_release(struct video_output *video,
+				     struct video_conversion *convert)
+{
+	bool destroy;
 
-		frame = &input->frame[input->cur_frame];
+	if (!convert)
+		return;
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+	pthread_mutex_lock(&video->conversions_mutex);
+	destroy = --convert->inputs == 0;
+	if (destroy)
+		da_erase_item(video->conversions, &convert);
+	pthread_mutex_unlock(&video->conversions_mutex);
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i] = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
+	if (!destroy)
+		return;
+
+	for (size_t i = 0; i < convert->frames.num; i++) {
+		video_frame_free(&convert->frames.array[i]->frame);
+		bfree(convert->frames.array[i]);
+	}
+	da_free(convert->frames);
+	video_scaler_destroy(convert->scaler);
+	pthread_mutex_destroy(&convert->mutex);
+	bfree(convert);
+}
+
+static inline bool same_conversion(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+/* called with input_mutex held */
+static struct video_conversion *
+video_conversion_get(struct video_output *video,
+		     const struct video_scale_info *info)
+{
+	struct video_conversion *convert = NULL;
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+	int ret;
+
+	pthread_mutex_lock(&video->conversions_mutex);
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		if (same_conversion(&video->conversions.array[i]->info, info)) {
+			convert = video->conversions.array[i];
+			convert->inputs++;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&video->conversions_mutex);
+
+	if (convert)
+		return convert;
+
+	convert = bzalloc(sizeof(struct video_conversion));
+	convert->info = *info;
+	convert->inputs = 1;
+
+	ret = video_scaler_create(&convert->scaler, info, &from,
+				  VIDEO_SCALE_FAST_BILINEAR);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		bfree(convert);
+		return NULL;
+	}
+
+	pthread_mutex_init(&convert->mutex, NULL);
+
+	pthread_mutex_lock(&video->conversions_mutex);
+	da_push_back(video->conversions, &convert);
+	pthread_mutex_unlock(&video->conversions_mutex);
+	return convert;
+}
+
+/* the first input to ask for a frame converts it, the other ones get the
+ * same result.  the oldest unused result is overwritten, keeping at least
+ * MAX_CONVERT_BUFFERS of them. */
+static struct scaled_frame *scale_frame(struct video_conversion *convert,
+					uint64_t id,
+					const struct video_data *data,
+					bool *shared)
+{
+	struct scaled_frame *scaled = NULL;
+
+	pthread_mutex_lock(&convert->mutex);
+
+	for (size_t i = 0; i < convert->frames.num; i++) {
+		struct scaled_frame *frame = convert->frames.array[i];
+
+		if (frame->valid && frame->id == id) {
+			frame->refs++;
+			convert->hits++;
+			pthread_mutex_unlock(&convert->mutex);
+			*shared = true;
+			return frame;
+		}
+
+		if (!frame->refs && (!scaled || scaled->id > frame->id))
+			scaled = frame;
+	}
+
+	if (!scaled || convert->frames.num < MAX_CONVERT_BUFFERS) {
+		scaled = bzalloc(sizeof(struct scaled_frame));
+		video_frame_init(&scaled->frame, convert->info.format,
+				 convert->info.width, convert->info.height);
+		da_push_back(convert->frames, &scaled);
+	}
+
+	scaled->valid = video_scaler_scale(convert->scaler, scaled->frame.data,
+					   scaled->frame.linesize,
+					   (const uint8_t *const *)data->data,
+					   data->linesize);
+	scaled->id = id;
+	if (scaled->valid) {
+		scaled->refs++;
+		convert->misses++;
+	} else {
+		scaled = NULL;
+	}
+
+	pthread_mutex_unlock(&convert->mutex);
+
+	*shared = false;
+	return scaled;
+}
+
+static inline void release_scaled_frame(struct video_conversion *convert,
+					struct scaled_frame *scaled)
+{
+	if (scaled) {
+		pthread_mutex_lock(&convert->mutex);
+		scaled->refs--;
+		pthread_mutex_unlock(&convert->mutex);
+	}
+}
+
+static inline void send_video_input(struct video_input *input, uint64_t id,
+				    struct video_data *data)
+{
+	struct scaled_frame *scaled = NULL;
+
+	if (input->convert) {
+		bool shared;
+
+		scaled = scale_frame(input->convert, id, data, &shared);
+		if (!scaled) {
 			blog(LOG_WARNING, "video-io: Could not scale frame!");
+			return;
+		}
+
+		if (shared)
+			os_atomic_inc_long(&input->shared_frames);
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			data->data[i] = scaled->frame.data[i];
+			data->linesize[i] = scaled->frame.linesize[i];
 		}
 	}
 
-	return success;
+	input->callback(input->param, data);
+	release_scaled_frame(input->convert, scaled);
+}
+
+static void video_input_thread_free(struct video_input_thread *thread)
+{
+	for (size_t i = 0; i < thread->queue_size; i++) {
+		size_t idx = (thread->queue_start + i) % MAX_INPUT_QUEUE;
+		release_frame(thread->video, thread->queue[idx].frame_info);
+	}
+
+	video_conversion_release(thread->video, thread->input.convert);
+
+	os_sem_destroy(thread->sem);
+	pthread_mutex_destroy(&thread->mutex);
+	bfree(thread);
+}
+
+static void *video_input_thread(void *param)
+{
+	struct video_input_thread *thread = param;
+	struct video_input *input = &thread->input;
+
+	os_set_thread_name("video-io: input thread");
+
+	while (os_sem_wait(thread->sem) == 0) {
+		struct video_input_job job;
+		uint64_t lag;
+
+		if (thread->stop)
+			break;
+
+		pthread_mutex_lock(&thread->mutex);
+
+		job = thread->queue[thread->queue_start];
+		thread->queue_start = (thread->queue_start + 1) %
+				      MAX_INPUT_QUEUE;
+		thread->queue_size--;
+
+		lag = os_gettime_ns() - job.queued_ns;
+		input->lag_ns = lag;
+		if (lag > input->max_lag_ns)
+			input->max_lag_ns = lag;
+
+		pthread_mutex_unlock(&thread->mutex);
+
+		send_video_input(input, job.frame_info->id, &job.frame);
+
+		release_frame(thread->video, job.frame_info);
+
+		/* the callback disconnected itself */
+		if (thread->stop)
+			break;
+	}
+
+	if (thread->detached) {
+		struct video_output *video = thread->video;
+
+		video_input_thread_free(thread);
+		os_atomic_dec_long(&video->input_threads);
+	}
+	return NULL;
+}
+
+static void video_input_thread_stop(struct video_input_thread *thread)
+{
+	struct video_output *video = thread->video;
+
+	thread->stop = true;
+
+	/* a callback can disconnect itself, the thread then frees itself
+	 * after the callback returns */
+	if (pthread_equal(pthread_self(), thread->thread)) {
+		thread->detached = true;
+		pthread_detach(thread->thread);
+		return;
+	}
+
+	os_sem_post(thread->sem);
+	pthread_join(thread->thread, NULL);
+	video_input_thread_free(thread);
+	os_atomic_dec_long(&video->input_threads);
+}
+
+static void log_input_skipped(struct video_input *input)
+{
+	long skipped = os_atomic_load_long(&input->skipped_frames);
+	long total = os_atomic_load_long(&input->total_frames);
+
+	if (skipped)
+		blog(LOG_INFO,
+		     "Video input stopped, number of frames it skipped "
+		     "due to lag: %ld/%ld (%0.1f%%), max lag: %" PRIu64
+		     " ms",
+		     skipped, total, (double)skipped / (double)total * 100.0,
+		     input->max_lag_ns / 1000000);
+}
+
+static inline void video_input_free(struct video_output *video,
+				    struct video_input *input)
+{
+	if (input->thread) {
+		log_input_skipped(&input->thread->input);
+		video_input_thread_stop(input->thread);
+	}
+
+	video_conversion_release(video, input->convert);
+}
+
+/* the frame stays in its cache slot until the input thread is done with it.
+ * if the thread is still busy with the previous frames, this one is skipped
+ * for this input only. */
+static void queue_video_input(struct video_output *video,
+			      struct video_input_thread *thread,
+			      struct cached_frame_info *frame_info,
+			      const struct video_data *frame)
+{
+	struct video_input *input = &thread->input;
+	struct video_input_job *job;
+
+	os_atomic_inc_long(&input->total_frames);
+
+	pthread_mutex_lock(&thread->mutex);
+
+	if (thread->queue_size == MAX_INPUT_QUEUE) {
+		pthread_mutex_unlock(&thread->mutex);
+		os_atomic_inc_long(&input->skipped_frames);
+		return;
+	}
+
+	pthread_mutex_lock(&video->data_mutex);
+	frame_info->refs++;
+	pthread_mutex_unlock(&video->data_mutex);
+
+	job = &thread->queue[(thread->queue_start + thread->queue_size) %
+			     MAX_INPUT_QUEUE];
+	job->frame_info = frame_info;
+	job->frame = *frame;
+	job->queued_ns = os_gettime_ns();
+	thread->queue_size++;
+
+	pthread_mutex_unlock(&thread->mutex);
+
+	os_sem_post(thread->sem);
 }
 
 static inline bool video_output_cur_frame(struct video_output *video)
@@ -125,7 +498,7 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	frame_info = &video->cache[video->first_added];
+	frame_info = &video->cache[video->added[video->first_added]];
 
 	pthread_mutex_unlock(&video->data_mutex);
 
@@ -137,8 +510,18 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		struct video_input *input = video->inputs.array + i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (input->frame_rate_divisor > 1 &&
+		    input->frame_count++ % input->frame_rate_divisor != 0)
+			continue;
+
+		if (input->thread) {
+			queue_video_input(video, input->thread, frame_info,
+					  &frame);
+			continue;
+		}
+
+		os_atomic_inc_long(&input->total_frames);
+		send_video_input(input, frame_info->id, &frame);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -155,8 +538,8 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		video->num_added--;
+		free_cached_frame(video, frame_info);
 	} else if (skipped) {
 		--frame_info->skipped;
 		os_atomic_inc_long(&video->skipped_frames);
@@ -246,6 +629,8 @@ int video_output_open(video_t **video, struct video_output_info *info)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->conversions_mutex, NULL) != 0)
+		goto fail;
 	if (os_sem_init(&out->update_semaphore, 0) != 0)
 		goto fail;
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
@@ -270,15 +655,22 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video, &video->inputs.array[i]);
 	da_free(video->inputs);
 
+	/* input threads of callbacks that disconnected themselves */
+	while (os_atomic_load_long(&video->input_threads))
+		os_sleep_ms(1);
+
 	for (size_t i = 0; i < video->info.cache_size; i++)
 		video_frame_free((struct video_frame *)&video->cache[i]);
 
+	da_free(video->conversions);
+
 	os_sem_destroy(video->update_semaphore);
 	pthread_mutex_destroy(&video->data_mutex);
 	pthread_mutex_destroy(&video->input_mutex);
+	pthread_mutex_destroy(&video->conversions_mutex);
 	bfree(video);
 }
 
@@ -302,37 +694,48 @@ static inline bool video_input_init(struct video_input *input,
 	if (input->conversion.width != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->convert = video_conversion_get(video, &input->conversion);
+		if (!input->convert)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
 	}
 
 	return true;
 }
 
+/* moves the conversion and the callback to a thread of their own */
+static bool video_input_thread_init(struct video_input *input,
+				    struct video_output *video)
+{
+	struct video_input_thread *thread =
+		bzalloc(sizeof(struct video_input_thread));
+
+	thread->video = video;
+	thread->input = *input;
+
+	if (pthread_mutex_init(&thread->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&thread->sem, 0) != 0)
+		goto fail_sem;
+	if (pthread_create(&thread->thread, NULL, video_input_thread,
+			   thread) != 0)
+		goto fail_thread;
+
+	input->convert = NULL;
+	input->thread = thread;
+	os_atomic_inc_long(&video->input_threads);
+	return true;
+
+fail_thread:
+	os_sem_destroy(thread->sem);
+fail_sem:
+	pthread_mutex_destroy(&thread->mutex);
+fail:
+	blog(LOG_ERROR, "video_input_thread_init: Failed to create thread");
+	video_input_free(video, input);
+	bfree(thread);
+	return false;
+}
+
 static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
@@ -371,6 +774,8 @@ bool video_output_connect(
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
+		if (success && video->threaded_inputs)
+			success = video_input_thread_init(&input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -387,6 +792,30 @@ bool video_output_connect(
 	return success;
 }
 
+bool video_output_set_frame_rate_divisor(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param, uint32_t divisor)
+{
+	bool found = false;
+
+	if (!video || !callback)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input *input = video->inputs.array + idx;
+		input->frame_rate_divisor = divisor;
+		input->frame_count = 0;
+		found = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return found;
+}
+
 static void log_skipped(video_t *video)
 {
 	long skipped = os_atomic_load_long(&video->skipped_frames);
@@ -416,7 +845,7 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		video_input_free(video, video->inputs.array + idx);
 		da_erase(video->inputs, idx);
 
 		if (video->inputs.num == 0) {
@@ -430,6 +859,81 @@ void video_output_disconnect(video_t *video,
 	pthread_mutex_unlock(&video->input_mutex);
 }
 
+void video_output_set_threaded_inputs(video_t *video, bool threaded)
+{
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+	video->threaded_inputs = threaded;
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+bool video_output_get_input_stats(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param, struct video_input_stats *stats)
+{
+	bool found = false;
+
+	if (!video || !callback || !stats)
+		return false;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input_thread *thread =
+			video->inputs.array[idx].thread;
+		struct video_input *input = thread ? &thread->input
+						   : video->inputs.array + idx;
+
+		if (thread)
+			pthread_mutex_lock(&thread->mutex);
+
+		stats->total_frames =
+			(uint32_t)os_atomic_load_long(&input->total_frames);
+		stats->skipped_frames =
+			(uint32_t)os_atomic_load_long(&input->skipped_frames);
+		stats->shared_frames =
+			(uint32_t)os_atomic_load_long(&input->shared_frames);
+		stats->lag_ns = input->lag_ns;
+		stats->max_lag_ns = input->max_lag_ns;
+		stats->threaded = thread != NULL;
+
+		if (thread)
+			pthread_mutex_unlock(&thread->mutex);
+		found = true;
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return found;
+}
+
+void video_output_get_conversion_stats(video_t *video,
+				       struct video_conversion_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->conversions_mutex);
+
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *convert = video->conversions.array[i];
+
+		pthread_mutex_lock(&convert->mutex);
+		stats->hits += convert->hits;
+		stats->misses += convert->misses;
+		pthread_mutex_unlock(&convert->mutex);
+	}
+
+	stats->conversions = (uint32_t)video->conversions.num;
+
+	pthread_mutex_unlock(&video->conversions_mutex);
+}
+
 bool video_output_active(const video_t *video)
 {
 	if (!video)
@@ -453,21 +957,38 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
+	if (video->available_frames == 0 && video->num_added) {
+		size_t last_added = (video->first_added + video->num_added -
+				     1) %
+				    video->info.cache_size;
+
+		cfi = &video->cache[video->added[last_added]];
+		cfi->count += count;
+		cfi->skipped += count;
+		locked = false;
+
+	} else if (video->available_frames == 0) {
+		/* input threads are still using every frame */
+		os_atomic_inc_long(&video->skipped_frames);
 		locked = false;
 
 	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
+		size_t idx = 0;
+
+		while (video->cache[idx].used)
+			idx++;
+
+		video->added[(video->first_added + video->num_added) %
+			     video->info.cache_size] = idx;
+		video->num_added++;
+		video->available_frames--;
 
-		cfi = &video->cache[video->last_added];
+		cfi = &video->cache[idx];
 		cfi->frame.timestamp = timestamp;
 		cfi->count = count;
 		cfi->skipped = 0;
+		cfi->used = true;
+		cfi->id = ++video->next_frame_id;
 
 		memcpy(frame, &cfi->frame, sizeof(*frame));
 
@@ -486,7 +1007,6 @@ void video_output_unlock_frame(video_t *video)
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	video->available_frames--;
 	os_sem_post(video->update_semaphore);
 
 	pthread_mutex_unlock(&video->data_mutex);
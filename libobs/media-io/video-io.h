@@ -239,6 +239,54 @@ EXPORT void video_output_disconnect(video_t *video,
 						     struct video_data *frame),
 				    void *param);
 
+/**
+ * Only sends one frame out of divisor to a connected callback (0 or 1 to
+ * send every frame).  Skipped frames are not converted either.  Returns
+ * false if the callback is not connected.
+ */
+EXPORT bool video_output_set_frame_rate_divisor(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param, uint32_t divisor);
+
+/**
+ * Gives every callback connected afterwards its own thread and a short frame
+ * queue, instead of calling them all in turn from the video output thread.
+ * A callback that falls behind then only skips its own frames, see
+ * video_output_get_input_stats.  Callbacks already connected are left as
+ * they are.
+ */
+EXPORT void video_output_set_threaded_inputs(video_t *video, bool threaded);
+
+struct video_input_stats {
+	uint32_t total_frames;
+	/** Frames dropped because the callback's queue was full */
+	uint32_t skipped_frames;
+	/** Frames another callback had already converted */
+	uint32_t shared_frames;
+	/** Time the last frame waited in the queue */
+	uint64_t lag_ns;
+	uint64_t max_lag_ns;
+	bool threaded;
+};
+
+EXPORT bool video_output_get_input_stats(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param, struct video_input_stats *stats);
+
+/**
+ * Callbacks connected with the same conversion share its result: each frame
+ * is converted once (a miss) and reused by the other callbacks (hits).
+ */
+struct video_conversion_stats {
+	uint32_t conversions;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+EXPORT void
+video_output_get_conversion_stats(video_t *video,
+				  struct video_conversion_stats *stats);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *
@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include <inttypes.h>
+#include "media-io/audio-kernels.h"
 #include "obs-internal.h"
 
 struct ts_info {
@@ -26,6 +27,18 @@ struct ts_info {
 #define DEBUG_AUDIO 0
 #define MAX_BUFFERING_TICKS 45
 
+/* Level in the audio tree for this tick: 0 for sources without children,
+ * otherwise one more than the highest of their children */
+static inline int get_render_level(struct obs_core_audio *audio,
+				   obs_source_t *source)
+{
+	if (source->audio_render_tick != audio->render_tick) {
+		source->audio_render_tick = audio->render_tick;
+		source->audio_render_level = 0;
+	}
+	return source->audio_render_level;
+}
+
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
 	struct obs_core_audio *audio = p;
@@ -36,7 +49,150 @@ static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 			da_push_back(audio->render_order, &s);
 	}
 
-	UNUSED_PARAMETER(parent);
+	/* children are enumerated after their own children, so their level
+	 * is final here */
+	if (parent) {
+		int level = get_render_level(audio, source) + 1;
+		if (get_render_level(audio, parent) < level)
+			parent->audio_render_level = level;
+	}
+}
+
+static void render_source(struct audio_render_pool *pool,
+			  obs_source_t *source)
+{
+	uint64_t start = os_gettime_ns();
+
+	obs_source_audio_render(source, pool->mixers, pool->channels,
+				pool->sample_rate, pool->size);
+	source->audio_render_time_ns = os_gettime_ns() - start;
+}
+
+static void render_batch_items(struct audio_render_pool *pool)
+{
+	long i;
+
+	while ((i = os_atomic_inc_long(&pool->next) - 1) < pool->batch_size)
+		render_source(pool, pool->batch[i]);
+}
+
+static void *audio_render_thread(void *param)
+{
+	struct audio_render_pool *pool = param;
+
+	os_set_thread_name("audio-io: render thread");
+
+	while (os_sem_wait(pool->work_sem) == 0) {
+		if (pool->stop)
+			break;
+
+		render_batch_items(pool);
+		os_sem_post(pool->done_sem);
+	}
+
+	return NULL;
+}
+
+bool audio_render_pool_init(struct audio_render_pool *pool,
+			    size_t num_threads)
+{
+	pool->num_threads = 0;
+	pool->stop = false;
+
+	if (!num_threads)
+		return true;
+	if (os_sem_init(&pool->work_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&pool->done_sem, 0) != 0)
+		return false;
+
+	for (size_t i = 0; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, audio_render_thread,
+				   pool) != 0)
+			return false;
+		pool->num_threads++;
+	}
+
+	blog(LOG_INFO, "audio: rendering sources on %d extra thread(s)",
+	     (int)num_threads);
+	return true;
+}
+
+void audio_render_pool_free(struct audio_render_pool *pool)
+{
+	pool->stop = true;
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->work_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_sem_destroy(pool->work_sem);
+	os_sem_destroy(pool->done_sem);
+	memset(pool, 0, sizeof(*pool));
+}
+
+static void render_batch(struct obs_core_audio *audio)
+{
+	struct audio_render_pool *pool = &audio->render_pool;
+	size_t num = audio->render_batch.num;
+	size_t helpers = num - 1;
+
+	if (helpers > pool->num_threads)
+		helpers = pool->num_threads;
+
+	pool->batch = audio->render_batch.array;
+	pool->batch_size = (long)num;
+	pool->next = 0;
+
+	for (size_t i = 0; i < helpers; i++)
+		os_sem_post(pool->work_sem);
+
+	render_batch_items(pool);
+
+	for (size_t i = 0; i < helpers; i++)
+		os_sem_wait(pool->done_sem);
+}
+
+/* Sources only depend on their children (composite sources mix the audio
+ * their children rendered this tick), so each level is rendered after the
+ * one below it and the sources of a level are rendered in parallel */
+static void render_audio_tree(struct obs_core_audio *audio, uint32_t mixers,
+			      size_t channels, size_t sample_rate,
+			      size_t audio_size)
+{
+	struct audio_render_pool *pool = &audio->render_pool;
+	int max_level = 0;
+
+	pool->mixers = mixers;
+	pool->channels = channels;
+	pool->sample_rate = sample_rate;
+	pool->size = audio_size;
+
+	if (!pool->num_threads) {
+		for (size_t i = 0; i < audio->render_order.num; i++)
+			render_source(pool, audio->render_order.array[i]);
+		return;
+	}
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		int level =
+			get_render_level(audio, audio->render_order.array[i]);
+		if (level > max_level)
+			max_level = level;
+	}
+
+	for (int level = 0; level <= max_level; level++) {
+		da_resize(audio->render_batch, 0);
+
+		for (size_t i = 0; i < audio->render_order.num; i++) {
+			obs_source_t *source = audio->render_order.array[i];
+			if (source->audio_render_level == level)
+				da_push_back(audio->render_batch, &source);
+		}
+
+		if (audio->render_batch.num)
+			render_batch(audio);
+	}
 }
 
 static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
@@ -45,8 +201,9 @@ static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 }
 
 static inline void mix_audio(struct audio_output_data *mixes,
-			     obs_source_t *source, size_t channels,
-			     size_t sample_rate, struct ts_info *ts)
+			     obs_source_t *source, uint32_t mixers,
+			     size_t channels, size_t sample_rate,
+			     struct ts_info *ts)
 {
 	size_t total_floats = AUDIO_OUTPUT_FRAMES;
 	size_t start_point = 0;
@@ -64,17 +221,15 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		/* no output on this mix */
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
 
-			mix += start_point;
-			end = aud + total_floats;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *mix = mixes[mix_idx].data[ch];
+			float *aud = source->audio_output_buf[mix_idx][ch];
 
-			while (aud < end)
-				*(mix++) += *(aud++);
+			audio_mix_add(mix + start_point, aud, total_floats);
 		}
 	}
 }
@@ -389,11 +544,14 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
 	struct ts_info ts = {start_ts_in, end_ts_in};
+	uint64_t tick_start = os_gettime_ns();
+	uint64_t tick_ns;
 	size_t audio_size;
 	uint64_t min_ts;
 
 	da_resize(audio->render_order, 0);
 	da_resize(audio->root_nodes, 0);
+	audio->render_tick++;
 
 	circlebuf_push_back(&audio->buffered_timestamps, &ts, sizeof(ts));
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
@@ -431,11 +589,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-					audio_size);
-	}
+	render_audio_tree(audio, mixers, channels, sample_rate, audio_size);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
@@ -461,8 +615,8 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 			pthread_mutex_lock(&source->audio_buf_mutex);
 
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-					  &ts);
+				mix_audio(mixes, source, mixers, channels,
+					  sample_rate, &ts);
 
 			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
@@ -491,6 +645,16 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	*out_ts = ts.start;
 
+	/* ------------------------------------------------ */
+	/* a tick must not take longer than the audio it outputs */
+	tick_ns = os_gettime_ns() - tick_start;
+	audio->last_tick_ns = tick_ns;
+	audio->total_tick_ns += tick_ns;
+	if (tick_ns > audio->max_tick_ns)
+		audio->max_tick_ns = tick_ns;
+	if (tick_ns > audio_frames_to_ns(sample_rate, AUDIO_OUTPUT_FRAMES))
+		audio->deadline_misses++;
+
 	if (audio->buffering_wait_ticks) {
 		audio->buffering_wait_ticks--;
 		return false;
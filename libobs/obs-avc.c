@@ -16,6 +16,7 @@
 ******************************************************************************/
 
 #include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
@@ -135,18 +136,20 @@ void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 {
 	struct array_output_data output;
 	struct serializer s;
-	long ref = 1;
 
 	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
 	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
 			   &avc_packet->priority);
 
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
+	/* released with obs_encoder_packet_release: from the packet pool */
+	avc_packet->data = obs_encoder_packet_alloc_data(output.bytes.num);
+	avc_packet->size = output.bytes.num;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	memcpy(avc_packet->data, output.bytes.array, output.bytes.num);
+
+	array_output_serializer_free(&output);
 }
 
 static inline bool has_start_code(const uint8_t *data)
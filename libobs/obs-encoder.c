@@ -644,6 +644,52 @@ void obs_encoder_stop(obs_encoder_t *encoder,
 		pthread_mutex_unlock(&encoder->init_mutex);
 }
 
+bool obs_encoder_connect_packets(obs_encoder_t *encoder,
+				 void (*new_packet)(void *param,
+						    struct encoder_packet *packet),
+				 void *param)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_connect_packets"))
+		return false;
+	if (!obs_ptr_valid(new_packet, "obs_encoder_connect_packets"))
+		return false;
+	if (!encoder->media) {
+		blog(LOG_WARNING,
+		     "obs_encoder_connect_packets: encoder '%s' has no "
+		     "media output",
+		     obs_encoder_get_name(encoder));
+		return false;
+	}
+	if (!obs_encoder_initialize(encoder)) {
+		blog(LOG_WARNING,
+		     "obs_encoder_connect_packets: failed to initialize "
+		     "encoder '%s'",
+		     obs_encoder_get_name(encoder));
+		return false;
+	}
+
+	obs_encoder_start(encoder, new_packet, param);
+	return true;
+}
+
+void obs_encoder_disconnect_packets(
+	obs_encoder_t *encoder,
+	void (*new_packet)(void *param, struct encoder_packet *packet),
+	void *param)
+{
+	obs_encoder_stop(encoder, new_packet, param);
+}
+
+void obs_encoder_request_keyframe(obs_encoder_t *encoder)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_request_keyframe"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	os_atomic_set_bool(&encoder->keyframe_requested, true);
+}
+
 const char *obs_encoder_get_codec(const obs_encoder_t *encoder)
 {
 	return obs_encoder_valid(encoder, "obs_encoder_get_codec")
@@ -843,7 +889,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 				    struct encoder_callback *cb,
 				    struct encoder_packet *packet)
 {
-	struct encoder_packet first_packet;
+	struct encoder_packet first_packet, sei_packet;
 	DARRAY(uint8_t) data;
 	uint8_t *sei;
 	size_t size;
@@ -863,14 +909,17 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	da_push_back_array(data, sei, size);
 	da_push_back_array(data, packet->data, packet->size);
 
-	first_packet = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	sei_packet = *packet;
+	sei_packet.data = data.array;
+	sei_packet.size = data.num;
+
+	obs_encoder_packet_create_instance(&first_packet, &sei_packet);
+	da_free(data);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -933,15 +982,22 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 		pkt->sys_dts_usec += encoder->pause.ts_offset / 1000;
 		pthread_mutex_unlock(&encoder->pause.mutex);
 
+		/* the data belongs to the encoder until its next packet: copy
+		 * it once, every output then references the same buffer */
+		struct encoder_packet shared;
+		obs_encoder_packet_create_instance(&shared, pkt);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+			send_packet(encoder, cb, &shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
 	}
 }
 
@@ -1037,6 +1093,8 @@ static void receive_video(void *param, struct video_data *frame)
 
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
+	enc_frame.keyframe =
+		os_atomic_set_bool(&encoder->keyframe_requested, false);
 
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts += encoder->timebase_num;
@@ -1294,16 +1352,186 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* packet data pool
+ *
+ * Packet data is allocated with a small header in front of it, the
+ * reference count right before the data.  Buffers come in power of two
+ * size classes and released ones are kept for reuse, so that the packets
+ * of a running output do not go through the allocator.  The pool only
+ * holds on to PACKET_POOL_MAX_BYTES, the rest is freed on release.
+ *
+ * obs_encoder_packet_release reads that header, so every packet data it
+ * releases has to come from obs_encoder_packet_alloc_data.  */
+
+#define PACKET_POOL_MIN_SHIFT 9
+#define PACKET_POOL_CLASSES 16
+#define PACKET_POOL_MAX_FREE 32
+#define PACKET_POOL_MAX_BYTES (32 * 1024 * 1024)
+#define PACKET_NO_CLASS 0xFFFFFFFF
+#define PACKET_HEADER_SIZE 16
+
+struct packet_header {
+	uint32_t size_class;
+	uint32_t size;
+};
+
+/* counters of struct obs_encoder_packet_stats, read without the pool mutex.
+ * pooled_bytes is only changed with the mutex held */
+struct packet_pool_counters {
+	volatile long long live_packets;
+	volatile long long live_bytes;
+	volatile long long pooled_bytes;
+	volatile long long allocations;
+	volatile long long pool_hits;
+	volatile long long copies;
+	volatile long long copied_bytes;
+};
+
+struct packet_pool {
+	pthread_mutex_t mutex;
+	DARRAY(uint8_t *) free[PACKET_POOL_CLASSES];
+	bool shut_down;
+
+	struct packet_pool_counters stats;
+};
+
+static struct packet_pool packet_pool = {PTHREAD_MUTEX_INITIALIZER};
+
+static inline uint32_t packet_size_class(size_t size)
+{
+	for (uint32_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		if (size <= ((size_t)1 << (PACKET_POOL_MIN_SHIFT + i)))
+			return i;
+	}
+	return PACKET_NO_CLASS;
+}
+
+uint8_t *obs_encoder_packet_alloc_data(size_t size)
+{
+	struct packet_pool_counters *stats = &packet_pool.stats;
+	uint32_t size_class = packet_size_class(size);
+	struct packet_header *header;
+	uint8_t *block = NULL;
+	size_t capacity = size;
+
+	if (size_class != PACKET_NO_CLASS) {
+		capacity = (size_t)1 << (PACKET_POOL_MIN_SHIFT + size_class);
+
+		pthread_mutex_lock(&packet_pool.mutex);
+		if (packet_pool.free[size_class].num) {
+			block = *(uint8_t **)da_end(packet_pool.free[size_class]);
+			da_pop_back(packet_pool.free[size_class]);
+			os_atomic_add_long_long(&stats->pooled_bytes,
+						-(long long)capacity);
+		}
+		pthread_mutex_unlock(&packet_pool.mutex);
+	}
+
+	if (block)
+		os_atomic_add_long_long(&stats->pool_hits, 1);
+	else
+		block = bmalloc(PACKET_HEADER_SIZE + capacity);
+
+	os_atomic_add_long_long(&stats->allocations, 1);
+	os_atomic_add_long_long(&stats->live_packets, 1);
+	os_atomic_add_long_long(&stats->live_bytes, (long long)capacity);
+
+	header = (struct packet_header *)block;
+	header->size_class = size_class;
+	header->size = (uint32_t)capacity;
+	*((long *)(block + PACKET_HEADER_SIZE) - 1) = 1;
+
+	return block + PACKET_HEADER_SIZE;
+}
+
+static void free_packet_data(uint8_t *data)
+{
+	struct packet_pool_counters *stats = &packet_pool.stats;
+	uint8_t *block = data - PACKET_HEADER_SIZE;
+	struct packet_header *header = (struct packet_header *)block;
+	uint32_t size_class = header->size_class;
+	size_t capacity = header->size;
+	long long pooled;
+
+	os_atomic_add_long_long(&stats->live_packets, -1);
+	os_atomic_add_long_long(&stats->live_bytes, -(long long)capacity);
+
+	if (size_class != PACKET_NO_CLASS) {
+		pthread_mutex_lock(&packet_pool.mutex);
+		pooled = os_atomic_load_long_long(&stats->pooled_bytes);
+		if (!packet_pool.shut_down &&
+		    packet_pool.free[size_class].num < PACKET_POOL_MAX_FREE &&
+		    pooled + (long long)capacity <= PACKET_POOL_MAX_BYTES) {
+			da_push_back(packet_pool.free[size_class], &block);
+			os_atomic_add_long_long(&stats->pooled_bytes,
+						(long long)capacity);
+			block = NULL;
+		}
+		pthread_mutex_unlock(&packet_pool.mutex);
+	}
+
+	bfree(block);
+}
+
+void obs_encoder_packet_pool_free(void)
+{
+	long long live_packets;
+
+	pthread_mutex_lock(&packet_pool.mutex);
+
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		for (size_t j = 0; j < packet_pool.free[i].num; j++)
+			bfree(packet_pool.free[i].array[j]);
+		da_free(packet_pool.free[i]);
+	}
+	os_atomic_add_long_long(
+		&packet_pool.stats.pooled_bytes,
+		-os_atomic_load_long_long(&packet_pool.stats.pooled_bytes));
+
+	/* packets still referenced by plugins are freed on release */
+	packet_pool.shut_down = true;
+
+	pthread_mutex_unlock(&packet_pool.mutex);
+
+	live_packets = os_atomic_load_long_long(&packet_pool.stats.live_packets);
+	if (live_packets)
+		blog(LOG_DEBUG, "%lld encoder packets still referenced",
+		     live_packets);
+}
+
+void obs_get_encoder_packet_stats(struct obs_encoder_packet_stats *stats)
+{
+	struct packet_pool_counters *counters = &packet_pool.stats;
+
+	if (!stats)
+		return;
+
+	stats->live_packets =
+		(uint64_t)os_atomic_load_long_long(&counters->live_packets);
+	stats->live_bytes =
+		(uint64_t)os_atomic_load_long_long(&counters->live_bytes);
+	stats->pooled_bytes =
+		(uint64_t)os_atomic_load_long_long(&counters->pooled_bytes);
+	stats->allocations =
+		(uint64_t)os_atomic_load_long_long(&counters->allocations);
+	stats->pool_hits =
+		(uint64_t)os_atomic_load_long_long(&counters->pool_hits);
+	stats->copies = (uint64_t)os_atomic_load_long_long(&counters->copies);
+	stats->copied_bytes =
+		(uint64_t)os_atomic_load_long_long(&counters->copied_bytes);
+}
+
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 					const struct encoder_packet *src)
 {
-	long *p_refs;
-
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = obs_encoder_packet_alloc_data(src->size);
 	memcpy(dst->data, src->data, src->size);
+
+	os_atomic_add_long_long(&packet_pool.stats.copies, 1);
+	os_atomic_add_long_long(&packet_pool.stats.copied_bytes,
+				(long long)src->size);
 }
 
 void obs_duplicate_encoder_packet(struct encoder_packet *dst,
@@ -1339,7 +1567,7 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 	if (pkt->data) {
 		long *p_refs = ((long *)pkt->data) - 1;
 		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+			free_packet_data(pkt->data);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
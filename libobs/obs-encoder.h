@@ -98,6 +98,9 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t pts;
+
+	/** Encode this frame as a keyframe (video only) */
+	bool keyframe;
 };
 
 /**
@@ -0,0 +1,312 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/darray.h"
+#include "obs.h"
+
+/*
+ * Interleave queue for encoded outputs.
+ *
+ * Packets are kept in one FIFO per track (video, then each audio mix), and
+ * the tracks are k-way merged through a small heap keyed on the dts of each
+ * track's first packet.  Encoders hand packets over in dts order, so a push
+ * is an append plus at most a heap insert, and a pop is O(log tracks).
+ *
+ * The merged order is the one the old sorted packet array had: by dts, with
+ * video before audio on equal dts, and otherwise in order of arrival.
+ */
+
+#define INTERLEAVE_TRACKS (1 + MAX_AUDIO_MIXES)
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	uint64_t order;
+};
+
+struct interleave_track {
+	DARRAY(struct interleaved_packet) packets;
+	size_t head;
+};
+
+struct interleave_queue {
+	struct interleave_track tracks[INTERLEAVE_TRACKS];
+
+	/* non-empty tracks, min-heap on their first packet */
+	size_t heap[INTERLEAVE_TRACKS];
+	size_t heap_size;
+
+	size_t num;
+	uint64_t next_order;
+};
+
+static inline size_t interleave_track_of(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+static inline bool interleaved_before(const struct interleaved_packet *a,
+				      const struct interleaved_packet *b)
+{
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	if (a->packet.type != b->packet.type)
+		return a->packet.type == OBS_ENCODER_VIDEO;
+	return a->order < b->order;
+}
+
+static inline size_t interleave_track_count(const struct interleave_queue *q,
+					    size_t track)
+{
+	return q->tracks[track].packets.num - q->tracks[track].head;
+}
+
+static inline struct interleaved_packet *
+interleave_track_get(struct interleave_queue *q, size_t track, size_t idx)
+{
+	struct interleave_track *t = &q->tracks[track];
+	return t->packets.array + t->head + idx;
+}
+
+static inline struct encoder_packet *
+interleave_track_first(struct interleave_queue *q, size_t track)
+{
+	return interleave_track_count(q, track)
+		       ? &interleave_track_get(q, track, 0)->packet
+		       : NULL;
+}
+
+static inline struct encoder_packet *
+interleave_track_last(struct interleave_queue *q, size_t track)
+{
+	size_t count = interleave_track_count(q, track);
+	return count ? &interleave_track_get(q, track, count - 1)->packet
+		     : NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool interleave_heap_less(struct interleave_queue *q, size_t a,
+					size_t b)
+{
+	return interleaved_before(interleave_track_get(q, q->heap[a], 0),
+				  interleave_track_get(q, q->heap[b], 0));
+}
+
+static inline void interleave_heap_swap(struct interleave_queue *q, size_t a,
+					size_t b)
+{
+	size_t track = q->heap[a];
+	q->heap[a] = q->heap[b];
+	q->heap[b] = track;
+}
+
+static inline void interleave_heap_up(struct interleave_queue *q, size_t idx)
+{
+	while (idx) {
+		size_t parent = (idx - 1) / 2;
+		if (!interleave_heap_less(q, idx, parent))
+			break;
+
+		interleave_heap_swap(q, idx, parent);
+		idx = parent;
+	}
+}
+
+static inline void interleave_heap_down(struct interleave_queue *q, size_t idx)
+{
+	for (;;) {
+		size_t left = idx * 2 + 1;
+		size_t right = left + 1;
+		size_t min = idx;
+
+		if (left < q->heap_size && interleave_heap_less(q, left, min))
+			min = left;
+		if (right < q->heap_size && interleave_heap_less(q, right, min))
+			min = right;
+		if (min == idx)
+			break;
+
+		interleave_heap_swap(q, idx, min);
+		idx = min;
+	}
+}
+
+static inline size_t interleave_heap_find(struct interleave_queue *q,
+					  size_t track)
+{
+	for (size_t i = 0; i < q->heap_size; i++) {
+		if (q->heap[i] == track)
+			return i;
+	}
+	return DARRAY_INVALID;
+}
+
+/* rebuilds the heap, needed when the timestamps of a whole track changed */
+static inline void interleave_queue_resort(struct interleave_queue *q)
+{
+	q->heap_size = 0;
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		if (interleave_track_count(q, i))
+			q->heap[q->heap_size++] = i;
+	}
+
+	for (size_t i = q->heap_size / 2; i > 0; i--)
+		interleave_heap_down(q, i - 1);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* takes ownership of the packet */
+static inline void interleave_queue_push(struct interleave_queue *q,
+					 struct encoder_packet *packet)
+{
+	size_t track = interleave_track_of(packet);
+	struct interleave_track *t = &q->tracks[track];
+	size_t count = interleave_track_count(q, track);
+	struct interleaved_packet entry = {*packet, q->next_order++};
+	size_t idx = count;
+
+	/* late packets are rare, walk back to their place in the track */
+	while (idx && interleaved_before(&entry,
+					 interleave_track_get(q, track, idx - 1)))
+		idx--;
+
+	if (idx == count)
+		da_push_back(t->packets, &entry);
+	else
+		da_insert(t->packets, t->head + idx, &entry);
+
+	q->num++;
+
+	if (!count) {
+		q->heap[q->heap_size] = track;
+		interleave_heap_up(q, q->heap_size++);
+	} else if (!idx) {
+		interleave_heap_up(q, interleave_heap_find(q, track));
+	}
+}
+
+static inline struct encoder_packet *
+interleave_queue_first(struct interleave_queue *q)
+{
+	return q->heap_size ? interleave_track_first(q, q->heap[0]) : NULL;
+}
+
+/* moves the first packet of the merged order to *packet */
+static inline bool interleave_queue_pop(struct interleave_queue *q,
+					struct encoder_packet *packet)
+{
+	struct interleave_track *t;
+	size_t track;
+
+	if (!q->heap_size)
+		return false;
+
+	track = q->heap[0];
+	t = &q->tracks[track];
+	*packet = t->packets.array[t->head++].packet;
+	q->num--;
+
+	if (t->head == t->packets.num) {
+		da_resize(t->packets, 0);
+		t->head = 0;
+
+		q->heap[0] = q->heap[--q->heap_size];
+	} else if (t->head >= 64 && t->head * 2 >= t->packets.num) {
+		da_erase_range(t->packets, 0, t->head);
+		t->head = 0;
+	}
+
+	interleave_heap_down(q, 0);
+	return true;
+}
+
+/* releases the first count packets of the merged order */
+static inline void interleave_queue_discard(struct interleave_queue *q,
+					    size_t count)
+{
+	struct encoder_packet packet;
+
+	while (count-- && interleave_queue_pop(q, &packet))
+		obs_encoder_packet_release(&packet);
+}
+
+/* position of a track's packet in the merged order */
+static inline size_t interleave_queue_rank(struct interleave_queue *q,
+					   size_t track, size_t idx)
+{
+	struct interleaved_packet *target = interleave_track_get(q, track, idx);
+	size_t rank = idx;
+
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		size_t lo = 0;
+		size_t hi = interleave_track_count(q, i);
+
+		if (i == track)
+			continue;
+
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (interleaved_before(interleave_track_get(q, i, mid),
+					       target))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		rank += lo;
+	}
+
+	return rank;
+}
+
+/* index of the first packet of a track with a dts at or past dts_usec */
+static inline size_t interleave_track_lower_bound(struct interleave_queue *q,
+						  size_t track, int64_t dts_usec)
+{
+	size_t lo = 0;
+	size_t hi = interleave_track_count(q, track);
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (interleave_track_get(q, track, mid)->packet.dts_usec <
+		    dts_usec)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static inline void interleave_queue_free(struct interleave_queue *q)
+{
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		struct interleave_track *t = &q->tracks[i];
+
+		for (size_t j = t->head; j < t->packets.num; j++)
+			obs_encoder_packet_release(&t->packets.array[j].packet);
+		da_free(t->packets);
+		t->head = 0;
+	}
+
+	q->heap_size = 0;
+	q->num = 0;
+	q->next_order = 0;
+}
@@ -20,6 +20,7 @@
 #include "util/c99defs.h"
 #include "util/darray.h"
 #include "util/circlebuf.h"
+#include "util/spsc-ring.h"
 #include "util/dstr.h"
 #include "util/threading.h"
 #include "util/platform.h"
@@ -35,8 +36,10 @@
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #define NUM_TEXTURES 2
+#define MAX_READBACK_DEPTH 8
 #define NUM_CHANNELS 3
 #define MICROSECOND_DEN 1000000
 #define NUM_ENCODE_TEXTURES 3
@@ -236,12 +239,12 @@ struct obs_tex_frame {
 
 struct obs_core_video {
 	graphics_t *graphics;
-	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
+	gs_stagesurf_t *copy_surfaces[MAX_READBACK_DEPTH][NUM_CHANNELS];
 	gs_texture_t *render_texture;
 	gs_texture_t *output_texture;
 	gs_texture_t *convert_textures[NUM_CHANNELS];
 	bool texture_rendered;
-	bool textures_copied[NUM_TEXTURES];
+	bool textures_copied[MAX_READBACK_DEPTH];
 	bool texture_converted;
 	bool using_nv12_tex;
 	struct circlebuf vframe_info_buffer;
@@ -260,6 +263,28 @@ struct obs_core_video {
 	gs_samplerstate_t *point_sampler;
 	gs_stagesurf_t *mapped_surfaces[NUM_CHANNELS];
 	int cur_texture;
+
+	/* frames between staging a frame and mapping it */
+	int readback_depth;
+	uint32_t readback_depth_setting;
+	bool readback_threaded_setting;
+
+	/* copies the mapped frame to the video output while the next one
+	 * renders */
+	pthread_t readback_thread;
+	bool readback_thread_initialized;
+	volatile bool readback_stop;
+	os_sem_t *readback_sem;
+	os_event_t *readback_done;
+	struct video_data readback_frame;
+	int readback_count;
+	bool readback_pending;
+
+	uint64_t readback_frames;
+	uint64_t map_wait_last_ns;
+	uint64_t map_wait_max_ns;
+	uint64_t map_wait_total_ns;
+	uint64_t copy_wait_total_ns;
 	long raw_active;
 	long gpu_encoder_active;
 	pthread_mutex_t gpu_encoder_mutex;
@@ -276,6 +301,14 @@ struct obs_core_video {
 	uint64_t video_frame_interval_ns;
 	uint64_t video_avg_frame_time_ns;
 	double video_fps;
+
+	/* per-frame timings of the graphics thread */
+	pthread_mutex_t frame_records_mutex;
+	struct obs_video_frame_record frame_records[OBS_VIDEO_FRAME_RECORDS];
+	size_t frame_record_pos;
+	size_t num_frame_records;
+	volatile long output_lock_failures;
+
 	video_t *video;
 	pthread_t video_thread;
 	uint32_t total_frames;
@@ -293,6 +326,7 @@ struct obs_core_video {
 	uint32_t base_height;
 	float color_matrix[16];
 	enum obs_scale_type scale_type;
+	bool threaded_outputs;
 
 	gs_texture_t *transparent_texture;
 
@@ -310,12 +344,42 @@ struct obs_core_video {
 
 struct audio_monitor;
 
+#define MAX_AUDIO_RENDER_THREADS 3
+
+/* Renders a batch of independent sources on worker threads, the audio
+ * thread takes its share of the batch and waits for the rest */
+struct audio_render_pool {
+	pthread_t threads[MAX_AUDIO_RENDER_THREADS];
+	size_t num_threads;
+	os_sem_t *work_sem;
+	os_sem_t *done_sem;
+	volatile bool stop;
+
+	struct obs_source **batch;
+	long batch_size;
+	volatile long next;
+	uint32_t mixers;
+	size_t channels;
+	size_t sample_rate;
+	size_t size;
+};
+
 struct obs_core_audio {
 	audio_t *audio;
 
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* sources are rendered one level of the audio tree at a time, the
+	 * sources of a level in parallel */
+	struct audio_render_pool render_pool;
+	DARRAY(struct obs_source *) render_batch;
+	uint64_t render_tick;
+	uint64_t deadline_misses;
+	uint64_t last_tick_ns;
+	uint64_t max_tick_ns;
+	uint64_t total_tick_ns;
+
 	uint64_t buffered_ts;
 	struct circlebuf buffered_timestamps;
 	int buffering_wait_ticks;
@@ -425,9 +489,13 @@ struct obs_core {
 extern struct obs_core *obs;
 
 extern void *obs_graphics_thread(void *param);
+extern void *obs_video_readback_thread(void *param);
 
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
 
+extern bool audio_render_pool_init(struct audio_render_pool *pool,
+				   size_t num_threads);
+extern void audio_render_pool_free(struct audio_render_pool *pool);
 extern bool audio_callback(void *param, uint64_t start_ts_in,
 			   uint64_t end_ts_in, uint64_t *out_ts,
 			   uint32_t mixers, struct audio_output_data *mixes);
@@ -593,7 +661,7 @@ struct obs_source {
 	uint64_t resample_offset;
 	uint64_t last_audio_ts;
 	uint64_t next_audio_ts_min;
-	uint64_t next_audio_sys_ts_min;
+	uint64_t next_audio_sys_ts_min; /* thread outputting the audio only */
 	uint64_t last_frame_ts;
 	uint64_t last_sys_timestamp;
 	bool async_rendered;
@@ -607,8 +675,21 @@ struct obs_source {
 	struct obs_source *next_audio_source;
 	struct obs_source **prev_next_audio_source;
 	uint64_t audio_ts;
+	uint64_t audio_render_tick;
+	int audio_render_level;
+	uint64_t audio_render_time_ns;
 	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
+
+	/* audio from obs_source_output_audio on its way to audio_input_buf,
+	 * moved over by the audio thread.  blocks queued before the last
+	 * reset of the input buffers are dropped.  the thread outputting the
+	 * audio resyncs next_audio_sys_ts_min to audio_input_reset_ts when
+	 * it sees a new audio_input_reset epoch. */
+	struct spsc_ring audio_input_ring;
+	volatile long audio_input_reset;
+	volatile long long audio_input_reset_ts;
+	long audio_input_epoch;
 	DARRAY(struct audio_action) audio_actions;
 	float *audio_output_buf[MAX_AUDIO_MIXES][MAX_AUDIO_CHANNELS];
 	struct resample_info sample_info;
@@ -880,7 +961,7 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	struct interleave_queue interleaved_packets;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -973,6 +1054,8 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 extern void
 obs_encoder_packet_create_instance(struct encoder_packet *dst,
 				   const struct encoder_packet *src);
+extern uint8_t *obs_encoder_packet_alloc_data(size_t size);
+extern void obs_encoder_packet_pool_free(void);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
@@ -1013,6 +1096,7 @@ struct obs_encoder {
 
 	volatile bool active;
 	volatile bool paused;
+	volatile bool keyframe_requested;
 	bool initialized;
 
 	/* indicates ownership of the info.id buffer */
@@ -168,10 +168,7 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
-	da_free(output->interleaved_packets);
+	interleave_queue_free(&output->interleaved_packets);
 }
 
 static inline void clear_audio_buffers(obs_output_t *output)
@@ -972,6 +969,21 @@ void obs_output_set_video_conversion(obs_output_t *output,
 	output->video_conversion_set = true;
 }
 
+static void default_raw_video_callback(void *param, struct video_data *frame);
+
+bool obs_output_set_video_frame_rate_divisor(obs_output_t *output,
+					     uint32_t divisor)
+{
+	if (!obs_output_valid(output,
+			      "obs_output_set_video_frame_rate_divisor"))
+		return false;
+	if ((output->info.flags & OBS_OUTPUT_ENCODED) != 0)
+		return false;
+
+	return video_output_set_frame_rate_divisor(
+		output->video, default_raw_video_callback, output, divisor);
+}
+
 void obs_output_set_audio_conversion(
 	obs_output_t *output, const struct audio_convert_info *conversion)
 {
@@ -1179,20 +1191,14 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	caption_frame_t cf;
 	sei_t sei;
 	uint8_t *data;
+	uint8_t *out_data;
 	size_t size;
-	long ref = 1;
-
-	DARRAY(uint8_t) out_data;
 
 	if (out->priority > 1)
 		return false;
 
 	sei_init(&sei, 0.0);
 
-	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	caption_frame_init(&cf);
 	caption_frame_from_text(&cf, &output->caption_head->text[0]);
 
@@ -1200,16 +1206,20 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 	data = malloc(sei_render_size(&sei));
 	size = sei_render(&sei, data);
+
+	/* released with obs_encoder_packet_release: from the packet pool */
+	out_data = obs_encoder_packet_alloc_data(out->size + 4 + size);
+	memcpy(out_data, out->data, out->size);
 	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
+	memcpy(out_data + out->size, nal_start, 4);
+	memcpy(out_data + out->size + 4, data, size);
 	free(data);
 
 	obs_encoder_packet_release(out);
 
 	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	out->data = out_data;
+	out->size = backup.size + 4 + size;
 
 	sei_free(&sei);
 
@@ -1222,15 +1232,17 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet *first =
+		interleave_queue_first(&output->interleaved_packets);
+	struct encoder_packet out;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
 	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	if (!first || !has_higher_opposing_ts(output, first))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_queue_pop(&output->interleaved_packets, &out);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1275,75 +1287,95 @@ static inline void set_higher_ts(struct obs_output *output,
 	}
 }
 
-static inline struct encoder_packet *
-find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx);
+static inline size_t packet_track(enum obs_encoder_type type,
+				  size_t audio_idx)
+{
+	return type == OBS_ENCODER_VIDEO ? 0 : 1 + audio_idx;
+}
 
 /* gets the point where audio and video are closest together */
 static size_t get_interleaved_start_idx(struct obs_output *output)
 {
+	struct interleave_queue *q = &output->interleaved_packets;
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
-	struct encoder_packet *first_video =
-		find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
-
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		int64_t diff;
-
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
-		}
+	struct interleaved_packet *closest = NULL;
+	size_t closest_track = 0;
+	size_t closest_idx = 0;
+	struct encoder_packet *first_video = interleave_track_first(q, 0);
+	size_t video_idx = interleave_queue_rank(q, 0, 0);
+	size_t idx;
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
+	/* each track is sorted, so only the packets on either side of the
+	 * first video packet can be the closest one of their track */
+	for (size_t i = 1; i < INTERLEAVE_TRACKS; i++) {
+		size_t count = interleave_track_count(q, i);
+		size_t after = interleave_track_lower_bound(
+			q, i, first_video->dts_usec);
+		size_t candidates[2];
+		size_t num = 0;
+
+		if (after) {
+			int64_t dts = interleave_track_get(q, i, after - 1)
+					      ->packet.dts_usec;
+			candidates[num++] =
+				interleave_track_lower_bound(q, i, dts);
+		}
+		if (after < count)
+			candidates[num++] = after;
+
+		for (size_t j = 0; j < num; j++) {
+			struct interleaved_packet *packet =
+				interleave_track_get(q, i, candidates[j]);
+			int64_t diff = llabs(packet->packet.dts_usec -
+					     first_video->dts_usec);
+
+			if (diff < closest_diff ||
+			    (diff == closest_diff &&
+			     interleaved_before(packet, closest))) {
+				closest_diff = diff;
+				closest = packet;
+				closest_track = i;
+				closest_idx = candidates[j];
+			}
 		}
 	}
 
+	idx = closest ? interleave_queue_rank(q, closest_track, closest_idx)
+		      : 0;
 	return video_idx < idx ? video_idx : idx;
 }
 
 static int prune_premature_packets(struct obs_output *output)
 {
+	struct interleave_queue *q = &output->interleaved_packets;
 	size_t audio_mixes = num_audio_mixes(output);
 	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
+	size_t max_idx;
 	int64_t duration_usec;
 	int64_t max_diff = 0;
 	int64_t diff = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1) {
+	video = interleave_track_first(q, 0);
+	if (!video) {
 		output->received_video = false;
 		return -1;
 	}
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
+	max_idx = interleave_queue_rank(q, 0, 0);
 	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
+		size_t track = packet_track(OBS_ENCODER_AUDIO, i);
 		struct encoder_packet *audio;
-		int audio_idx;
+		size_t audio_idx;
 
-		audio_idx = find_first_packet_type_idx(output,
-						       OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		audio = interleave_track_first(q, track);
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
+		audio_idx = interleave_queue_rank(q, track, 0);
 		if (audio_idx > max_idx)
 			max_idx = audio_idx;
 
@@ -1352,18 +1384,12 @@ static int prune_premature_packets(struct obs_output *output)
 			max_diff = diff;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	return diff > duration_usec ? (int)max_idx + 1 : 0;
 }
 
 static void discard_to_idx(struct obs_output *output, size_t idx)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
-	}
-
-	da_erase_range(output->interleaved_packets, 0, idx);
+	interleave_queue_discard(&output->interleaved_packets, idx);
 }
 
 #define DEBUG_STARTING_PACKETS 0
@@ -1375,13 +1401,20 @@ static bool prune_interleaved_packets(struct obs_output *output)
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
-		     (int)packet->track_idx, packet->dts_usec,
-		     (int)i < prune_start ? "true" : "false");
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		struct interleave_queue *q = &output->interleaved_packets;
+		size_t count = interleave_track_count(q, i);
+
+		for (size_t j = 0; j < count; j++) {
+			struct encoder_packet *packet =
+				&interleave_track_get(q, i, j)->packet;
+			size_t idx = interleave_queue_rank(q, i, j);
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
+			     packet->type == OBS_ENCODER_AUDIO ? "audio"
+							       : "video",
+			     (int)packet->track_idx, packet->dts_usec,
+			     (int)idx < prune_start ? "true" : "false");
+		}
 	}
 #endif
 
@@ -1399,62 +1432,20 @@ static bool prune_interleaved_packets(struct obs_output *output)
 	return true;
 }
 
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)i;
-		}
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-				     enum obs_encoder_type type,
-				     size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)(i - 1);
-		}
-	}
-
-	return -1;
-}
-
 static inline struct encoder_packet *
 find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		       size_t audio_idx)
 {
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return interleave_track_first(&output->interleaved_packets,
+				      packet_track(type, audio_idx));
 }
 
 static inline struct encoder_packet *
 find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
 		      size_t audio_idx)
 {
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return interleave_track_last(&output->interleaved_packets,
+				     packet_track(type, audio_idx));
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1534,10 +1525,15 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_video_ts -= video->dts_usec;
 
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		struct interleave_queue *q = &output->interleaved_packets;
+		size_t count = interleave_track_count(q, i);
+
+		for (size_t j = 0; j < count; j++) {
+			struct encoder_packet *packet =
+				&interleave_track_get(q, i, j)->packet;
+			apply_interleaved_packet_offset(output, packet);
+		}
 	}
 
 	return true;
@@ -1546,51 +1542,27 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 					     struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
+	interleave_queue_push(&output->interleaved_packets, out);
 }
 
+/* offsets are per track, so only the order between tracks can change */
 static void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	interleave_queue_resort(&output->interleaved_packets);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 					 int64_t dts_usec)
 {
-	size_t idx = 0;
-
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	struct interleave_queue *q = &output->interleaved_packets;
+	struct encoder_packet *first;
 
-		if (p->dts_usec >= dts_usec)
-			break;
+	while ((first = interleave_queue_first(q)) &&
+	       first->dts_usec < dts_usec) {
+		struct encoder_packet packet;
+		interleave_queue_pop(q, &packet);
+		obs_encoder_packet_release(&packet);
 	}
-
-	if (idx)
-		discard_to_idx(output, idx);
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1623,7 +1595,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
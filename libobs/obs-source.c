@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-kernels.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
@@ -99,6 +100,11 @@ const char *obs_source_get_display_name(const char *id)
 	return (info != NULL) ? info->get_name(info->type_data) : NULL;
 }
 
+/* size of the queue between a source and the audio thread, about 0.7 seconds
+ * of stereo audio.  bigger blocks are queued in parts. */
+#define AUDIO_INPUT_RING_SIZE (256 * 1024)
+#define MAX_AUDIO_INPUT_BLOCK_SIZE (AUDIO_INPUT_RING_SIZE / 4)
+
 static void allocate_audio_output_buffer(struct obs_source *source)
 {
 	size_t size = sizeof(float) * AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS *
@@ -167,6 +173,9 @@ bool obs_source_init(struct obs_source *source)
 
 	if (is_audio_source(source) || is_composite_source(source))
 		allocate_audio_output_buffer(source);
+	if (is_audio_source(source))
+		spsc_ring_init(&source->audio_input_ring,
+			       AUDIO_INPUT_RING_SIZE);
 
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION) {
 		if (!obs_transition_init(source))
@@ -590,6 +599,7 @@ void obs_source_destroy(struct obs_source *source)
 		bfree(source->audio_data.data[i]);
 	for (i = 0; i < MAX_AUDIO_CHANNELS; i++)
 		circlebuf_free(&source->audio_input_buf[i]);
+	spsc_ring_free(&source->audio_input_ring);
 	audio_resampler_destroy(source->resampler);
 	bfree(source->audio_output_buf[0][0]);
 
@@ -1112,7 +1122,15 @@ static inline void reset_audio_timing(obs_source_t *source, uint64_t timestamp,
 	source->timing_adjust = os_time - timestamp;
 }
 
-static void reset_audio_data(obs_source_t *source, uint64_t os_time)
+/* followed by the planes in the ring */
+struct audio_input_block {
+	uint64_t timestamp;
+	uint32_t frames;
+	bool push_back;
+	long reset;
+};
+
+static void clear_audio_input(obs_source_t *source, uint64_t os_time)
 {
 	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
 		if (source->audio_input_buf[i].size)
@@ -1122,7 +1140,17 @@ static void reset_audio_data(obs_source_t *source, uint64_t os_time)
 
 	source->last_audio_input_buf_size = 0;
 	source->audio_ts = os_time;
-	source->next_audio_sys_ts_min = os_time;
+}
+
+static void reset_audio_data(obs_source_t *source, uint64_t os_time)
+{
+	/* also drops the audio still queued for the audio thread, and has
+	 * the thread outputting the audio resync to os_time */
+	os_atomic_set_long_long(&source->audio_input_reset_ts,
+				(long long)os_time);
+	os_atomic_inc_long(&source->audio_input_reset);
+
+	clear_audio_input(source, os_time);
 }
 
 static void handle_ts_jump(obs_source_t *source, uint64_t expected, uint64_t ts,
@@ -1162,16 +1190,28 @@ static inline size_t get_buf_placement(audio_t *audio, uint64_t offset)
 	return (size_t)(offset * (uint64_t)sample_rate / 1000000000ULL);
 }
 
+static inline void get_audio_input_plane(const struct spsc_ring_span *block,
+					 size_t plane, size_t size,
+					 struct spsc_ring_span *data)
+{
+	spsc_ring_span_sub(block, sizeof(struct audio_input_block) +
+					  plane * size,
+			   size, data);
+}
+
 static void source_output_audio_place(obs_source_t *source,
-				      const struct audio_data *in)
+				      const struct audio_input_block *in,
+				      const struct spsc_ring_span *span)
 {
 	audio_t *audio = obs->audio.audio;
 	size_t buf_placement;
 	size_t channels = audio_output_get_channels(audio);
 	size_t size = in->frames * sizeof(float);
 
+	/* unlike reset_audio_data, leaves next_audio_sys_ts_min to the thread
+	 * outputting the audio */
 	if (!source->audio_ts || in->timestamp < source->audio_ts)
-		reset_audio_data(source, in->timestamp);
+		clear_audio_input(source, in->timestamp);
 
 	buf_placement =
 		get_buf_placement(audio, in->timestamp - source->audio_ts) *
@@ -1190,8 +1230,15 @@ static void source_output_audio_place(obs_source_t *source,
 		return;
 
 	for (size_t i = 0; i < channels; i++) {
+		struct spsc_ring_span data;
+
+		get_audio_input_plane(span, i, size, &data);
 		circlebuf_place(&source->audio_input_buf[i], buf_placement,
-				in->data[i], size);
+				data.data[0], data.size[0]);
+		if (data.size[1])
+			circlebuf_place(&source->audio_input_buf[i],
+					buf_placement + data.size[0],
+					data.data[1], data.size[1]);
 		circlebuf_pop_back(&source->audio_input_buf[i], NULL,
 				   source->audio_input_buf[i].size -
 					   (buf_placement + size));
@@ -1200,8 +1247,9 @@ static void source_output_audio_place(obs_source_t *source,
 	source->last_audio_input_buf_size = 0;
 }
 
-static inline void source_output_audio_push_back(obs_source_t *source,
-						 const struct audio_data *in)
+static inline void source_output_audio_push_back(
+	obs_source_t *source, const struct audio_input_block *in,
+	const struct spsc_ring_span *span)
 {
 	audio_t *audio = obs->audio.audio;
 	size_t channels = audio_output_get_channels(audio);
@@ -1211,15 +1259,113 @@ static inline void source_output_audio_push_back(obs_source_t *source,
 	if ((source->audio_input_buf[0].size + size) > MAX_BUF_SIZE)
 		return;
 
-	for (size_t i = 0; i < channels; i++)
-		circlebuf_push_back(&source->audio_input_buf[i], in->data[i],
-				    size);
+	for (size_t i = 0; i < channels; i++) {
+		struct spsc_ring_span data;
+
+		get_audio_input_plane(span, i, size, &data);
+		circlebuf_push_back(&source->audio_input_buf[i], data.data[0],
+				    data.size[0]);
+		if (data.size[1])
+			circlebuf_push_back(&source->audio_input_buf[i],
+					    data.data[1], data.size[1]);
+	}
 
 	/* reset audio input buffer size to ensure that audio doesn't get
 	 * perpetually cut */
 	source->last_audio_input_buf_size = 0;
 }
 
+/* called by the thread outputting the audio: no lock is taken, the audio
+ * thread moves the blocks to the input buffers on its next tick.  reset is
+ * the audio_input_reset epoch the timestamps were worked out against, the
+ * blocks are dropped if the audio data is reset in the meantime */
+static void queue_audio_input(obs_source_t *source, const struct audio_data *in,
+			      bool push_back, long reset)
+{
+	struct spsc_ring *ring = &source->audio_input_ring;
+	size_t sample_rate = audio_output_get_sample_rate(obs->audio.audio);
+	size_t channels = audio_output_get_channels(obs->audio.audio);
+	size_t max_frames = (MAX_AUDIO_INPUT_BLOCK_SIZE -
+			     sizeof(struct audio_input_block)) /
+			    (channels * sizeof(float));
+	struct audio_input_block block;
+	size_t offset = 0;
+
+	if (!ring->data)
+		return;
+
+	block.push_back = push_back;
+	block.reset = reset;
+
+	while (offset < in->frames) {
+		size_t frames = in->frames - offset;
+		struct spsc_ring_span span;
+		size_t size;
+
+		if (frames > max_frames)
+			frames = max_frames;
+		size = frames * sizeof(float);
+
+		block.timestamp = in->timestamp +
+				  conv_frames_to_time(sample_rate, offset);
+		block.frames = (uint32_t)frames;
+
+		/* the audio thread is behind, drop it like a full input
+		 * buffer would */
+		if (!spsc_ring_write_peek(ring, sizeof(block) + size * channels,
+					  &span))
+			return;
+
+		spsc_ring_span_write(&span, 0, &block, sizeof(block));
+		for (size_t i = 0; i < channels; i++)
+			spsc_ring_span_write(&span, sizeof(block) + i * size,
+					     in->data[i] +
+						     offset * sizeof(float),
+					     size);
+
+		spsc_ring_write_commit(ring, sizeof(block) + size * channels);
+
+		block.push_back = true;
+		offset += frames;
+	}
+}
+
+/* called by the audio thread before rendering the source */
+static void drain_audio_input(obs_source_t *source, size_t channels)
+{
+	struct spsc_ring *ring = &source->audio_input_ring;
+	struct audio_input_block block;
+	struct spsc_ring_span span;
+
+	if (!ring->data)
+		return;
+
+	pthread_mutex_lock(&source->audio_buf_mutex);
+
+	while (spsc_ring_read_peek(ring, sizeof(block), &span)) {
+		size_t size = sizeof(block);
+
+		spsc_ring_span_read(&span, 0, &block, sizeof(block));
+		size += block.frames * sizeof(float) * channels;
+
+		/* the planes are committed along with the header */
+		spsc_ring_read_peek(ring, size, &span);
+
+		if (block.reset == source->audio_input_reset) {
+			if (block.push_back && source->audio_ts)
+				source_output_audio_push_back(source, &block,
+							      &span);
+			else
+				source_output_audio_place(source, &block,
+							  &span);
+		}
+
+		spsc_ring_read_commit(ring, size);
+	}
+
+	pthread_mutex_unlock(&source->audio_buf_mutex);
+}
+
 static inline bool source_muted(obs_source_t *source, uint64_t os_time)
 {
 	if (source->push_to_mute_enabled && source->user_push_to_mute_pressed)
@@ -1250,6 +1396,7 @@ static void source_output_audio_data(obs_source_t *source,
 	int64_t sync_offset;
 	bool using_direct_ts = false;
 	bool push_back = false;
+	long reset;
 
 	/* detects 'directly' set timestamps as long as they're within
 	 * a certain threshold */
@@ -1282,7 +1429,14 @@ static void source_output_audio_data(obs_source_t *source,
 
 	in.timestamp += source->timing_adjust;
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
+	/* the audio data was reset by another thread since the last call */
+	reset = os_atomic_load_long(&source->audio_input_reset);
+	if (reset != source->audio_input_epoch) {
+		source->audio_input_epoch = reset;
+		source->next_audio_sys_ts_min =
+			(uint64_t)os_atomic_load_long_long(
+				&source->audio_input_reset_ts);
+	}
 
 	if (source->next_audio_sys_ts_min == in.timestamp) {
 		push_back = true;
@@ -1300,7 +1454,9 @@ static void source_output_audio_data(obs_source_t *source,
 		 * just clear the audio data in that small window and force a
 		 * resync.  This handles all cases rather than just looping. */
 		} else if (diff > MAX_TS_VAR) {
+			pthread_mutex_lock(&source->audio_buf_mutex);
 			reset_audio_timing(source, data->timestamp, os_time);
+			pthread_mutex_unlock(&source->audio_buf_mutex);
 			in.timestamp = data->timestamp + source->timing_adjust;
 		}
 	}
@@ -1318,14 +1474,8 @@ static void source_output_audio_data(obs_source_t *source,
 		source->last_sync_offset = sync_offset;
 	}
 
-	if (source->monitoring_type != OBS_MONITORING_TYPE_MONITOR_ONLY) {
-		if (push_back && source->audio_ts)
-			source_output_audio_push_back(source, &in);
-		else
-			source_output_audio_place(source, &in);
-	}
-
-	pthread_mutex_unlock(&source->audio_buf_mutex);
+	if (source->monitoring_type != OBS_MONITORING_TYPE_MONITOR_ONLY)
+		queue_audio_input(source, &in, push_back, reset);
 
 	source_signal_audio_data(source, data, source_muted(source, os_time));
 }
@@ -2897,25 +3047,12 @@ static void copy_audio_data(obs_source_t *source, const uint8_t *const data[],
 		source->audio_storage_size = size;
 }
 
-/* TODO: SSE optimization */
 static void downmix_to_mono_planar(struct obs_source *source, uint32_t frames)
 {
 	size_t channels = audio_output_get_channels(obs->audio.audio);
-	const float channels_i = 1.0f / (float)channels;
 	float **data = (float **)source->audio_data.data;
 
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[0][frame] += data[channel][frame];
-	}
-
-	for (uint32_t frame = 0; frame < frames; frame++)
-		data[0][frame] *= channels_i;
-
-	for (size_t channel = 1; channel < channels; channel++) {
-		for (uint32_t frame = 0; frame < frames; frame++)
-			data[channel][frame] = data[0][frame];
-	}
+	audio_downmix_to_mono_planar(data, channels, frames);
 }
 
 static void process_audio_balancing(struct obs_source *source, uint32_t frames,
@@ -4179,24 +4316,16 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 					 size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_apply_gain(source->audio_output_buf[mix][0], vol,
+			 AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 				     size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_apply_gain_ramp(source->audio_output_buf[mix][ch],
+				      vol_data, AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -4218,8 +4347,8 @@ static inline void apply_audio_action(obs_source_t *source,
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels,
-				size_t sample_rate)
+static void apply_audio_actions(obs_source_t *source, uint32_t mixers,
+				size_t channels, size_t sample_rate)
 {
 	float *vol_data = malloc(sizeof(float) * AUDIO_OUTPUT_FRAMES);
 	float cur_vol = get_source_volume(source, source->audio_ts);
@@ -4259,7 +4388,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
+		if ((source->audio_mixers & mixers & (1 << mix)) != 0)
 			multiply_vol_data(source, mix, channels, vol_data);
 	}
 
@@ -4286,7 +4415,8 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
+			apply_audio_actions(source, mixers, channels,
+					    sample_rate);
 			return;
 		}
 	}
@@ -4295,10 +4425,17 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 	if (vol == 1.0f)
 		return;
 
-	if (vol == 0.0f || mixers == 0) {
-		memset(source->audio_output_buf[0][0], 0,
-		       AUDIO_OUTPUT_FRAMES * sizeof(float) *
-			       MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+	if (mixers == 0)
+		return;
+
+	/* unrouted mixes are not read, only clear the others */
+	if (vol == 0.0f) {
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((mixers & (1 << mix)) != 0)
+				memset(source->audio_output_buf[mix][0], 0,
+				       AUDIO_OUTPUT_FRAMES * sizeof(float) *
+					       channels);
+		}
 		return;
 	}
 
@@ -4371,11 +4508,15 @@ static inline void process_audio_source_tick(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->audio_buf_mutex);
 
+	/* mixes without output are neither read nor written: scenes,
+	 * transitions and the final mix only go through the mixes in mixers */
 	for (size_t mix = 1; mix < MAX_AUDIO_MIXES; mix++) {
 		uint32_t mix_and_val = (1 << mix);
 
-		if ((source->audio_mixers & mix_and_val) == 0 ||
-		    (mixers & mix_and_val) == 0) {
+		if ((mixers & mix_and_val) == 0)
+			continue;
+
+		if ((source->audio_mixers & mix_and_val) == 0) {
 			memset(source->audio_output_buf[mix][0], 0,
 			       size * channels);
 			continue;
@@ -4386,7 +4527,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 			       source->audio_output_buf[0][ch], size);
 	}
 
-	if ((source->audio_mixers & 1) == 0 || (mixers & 1) == 0)
+	if ((source->audio_mixers & 1) == 0 && (mixers & 1) != 0)
 		memset(source->audio_output_buf[0][0], 0, size * channels);
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
@@ -4406,6 +4547,8 @@ void obs_source_audio_render(obs_source_t *source, uint32_t mixers,
 		return;
 	}
 
+	drain_audio_input(source, channels);
+
 	if (!source->audio_ts) {
 		source->audio_pending = true;
 		return;
@@ -4431,6 +4574,13 @@ uint64_t obs_source_get_audio_timestamp(const obs_source_t *source)
 		       : 0;
 }
 
+uint64_t obs_source_get_audio_render_time(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_audio_render_time")
+		       ? source->audio_render_time_ns
+		       : 0;
+}
+
 void obs_source_get_audio_mix(const obs_source_t *source,
 			      struct obs_source_audio_mix *audio)
 {
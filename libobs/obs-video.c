@@ -24,7 +24,8 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 
-static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
+static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time,
+			     struct obs_video_frame_record *record)
 {
 	struct obs_core_data *data = &obs->data;
 	struct obs_source *source;
@@ -62,7 +63,21 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 		source = (struct obs_source *)source->context.next;
 
 		if (cur_source) {
+			uint64_t start = os_gettime_ns();
+			uint64_t tick_ns;
+
 			obs_source_video_tick(cur_source, seconds);
+
+			tick_ns = os_gettime_ns() - start;
+			if (tick_ns > record->slowest_source_ns) {
+				const char *name =
+					obs_source_get_name(cur_source);
+
+				record->slowest_source_ns = tick_ns;
+				strncpy(record->slowest_source, name ? name : "",
+					sizeof(record->slowest_source) - 1);
+			}
+
 			obs_source_release(cur_source);
 		}
 	}
@@ -109,6 +124,15 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 
 static inline void unmap_last_surface(struct obs_core_video *video)
 {
+	/* the readback thread may still be copying out of the surfaces */
+	if (video->readback_pending) {
+		uint64_t start = os_gettime_ns();
+
+		os_event_wait(video->readback_done);
+		video->readback_pending = false;
+		video->copy_wait_total_ns += os_gettime_ns() - start;
+	}
+
 	for (int c = 0; c < NUM_CHANNELS; ++c) {
 		if (video->mapped_surfaces[c]) {
 			gs_stagesurface_unmap(video->mapped_surfaces[c]);
@@ -512,9 +536,13 @@ static inline void render_video(struct obs_core_video *video, bool raw_active,
 static inline bool download_frame(struct obs_core_video *video,
 				  int prev_texture, struct video_data *frame)
 {
+	uint64_t start, wait;
+
 	if (!video->textures_copied[prev_texture])
 		return false;
 
+	start = os_gettime_ns();
+
 	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
 		gs_stagesurf_t *surface =
 			video->copy_surfaces[prev_texture][channel];
@@ -526,6 +554,13 @@ static inline bool download_frame(struct obs_core_video *video,
 			video->mapped_surfaces[channel] = surface;
 		}
 	}
+
+	wait = os_gettime_ns() - start;
+	video->map_wait_last_ns = wait;
+	video->map_wait_total_ns += wait;
+	if (wait > video->map_wait_max_ns)
+		video->map_wait_max_ns = wait;
+	video->readback_frames++;
 	return true;
 }
 
@@ -681,12 +716,14 @@ static inline void output_video_data(struct obs_core_video *video,
 		}
 
 		video_output_unlock_frame(video->video);
+	} else {
+		os_atomic_inc_long(&video->output_lock_failures);
 	}
 }
 
-static inline void video_sleep(struct obs_core_video *video, bool raw_active,
-			       const bool gpu_active, uint64_t *p_time,
-			       uint64_t interval_ns)
+static inline int video_sleep(struct obs_core_video *video, bool raw_active,
+			      const bool gpu_active, uint64_t *p_time,
+			      uint64_t interval_ns)
 {
 	struct obs_vframe_info vframe_info;
 	uint64_t cur_time = *p_time;
@@ -713,6 +750,8 @@ static inline void video_sleep(struct obs_core_video *video, bool raw_active,
 	if (gpu_active)
 		circlebuf_push_back(&video->vframe_info_buffer_gpu,
 				    &vframe_info, sizeof(vframe_info));
+
+	return count;
 }
 
 static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
@@ -724,8 +763,8 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 {
 	struct obs_core_video *video = &obs->video;
 	int cur_texture = video->cur_texture;
-	int prev_texture = cur_texture == 0 ? NUM_TEXTURES - 1
-					    : cur_texture - 1;
+	/* the oldest staged frame, readback_depth - 1 frames behind */
+	int prev_texture = (cur_texture + 1) % video->readback_depth;
 	struct video_data frame;
 	bool frame_ready = 0;
 
@@ -760,15 +799,48 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 				    sizeof(vframe_info));
 
 		frame.timestamp = vframe_info.timestamp;
-		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
-		profile_end(output_frame_output_video_data_name);
+
+		if (video->readback_thread_initialized) {
+			/* the surfaces stay mapped until the next frame is
+			 * staged, which waits for the copy */
+			video->readback_frame = frame;
+			video->readback_count = vframe_info.count;
+			video->readback_pending = true;
+			os_event_reset(video->readback_done);
+			os_sem_post(video->readback_sem);
+		} else {
+			profile_start(output_frame_output_video_data_name);
+			output_video_data(video, &frame, vframe_info.count);
+			profile_end(output_frame_output_video_data_name);
+		}
 	}
 
-	if (++video->cur_texture == NUM_TEXTURES)
+	if (++video->cur_texture == video->readback_depth)
 		video->cur_texture = 0;
 }
 
+void *obs_video_readback_thread(void *param)
+{
+	struct obs_core_video *video = &((struct obs_core *)param)->video;
+
+	os_set_thread_name("libobs: video readback thread");
+
+	for (;;) {
+		if (os_sem_wait(video->readback_sem) != 0)
+			break;
+		if (video->readback_stop)
+			break;
+
+		output_video_data(video, &video->readback_frame,
+				  video->readback_count);
+		os_event_signal(video->readback_done);
+	}
+
+	/* never leave the graphics thread waiting */
+	os_event_signal(video->readback_done);
+	return NULL;
+}
+
 #define NBSP "\xC2\xA0"
 
 static void clear_base_frame_data(void)
@@ -795,6 +867,18 @@ static void clear_gpu_frame_data(void)
 }
 #endif
 
+static void push_frame_record(struct obs_core_video *video,
+			      const struct obs_video_frame_record *record)
+{
+	pthread_mutex_lock(&video->frame_records_mutex);
+	video->frame_records[video->frame_record_pos] = *record;
+	video->frame_record_pos =
+		(video->frame_record_pos + 1) % OBS_VIDEO_FRAME_RECORDS;
+	if (video->num_frame_records < OBS_VIDEO_FRAME_RECORDS)
+		video->num_frame_records++;
+	pthread_mutex_unlock(&video->frame_records_mutex);
+}
+
 static const char *tick_sources_name = "tick_sources";
 static const char *render_displays_name = "render_displays";
 static const char *output_frame_name = "output_frame";
@@ -826,6 +910,10 @@ void *obs_graphics_thread(void *param)
 	while (!video_output_stopped(obs->video.video)) {
 		uint64_t frame_start = os_gettime_ns();
 		uint64_t frame_time_ns;
+		uint64_t stage_start, readback_frames;
+		long lock_failures;
+		struct obs_video_frame_record record = {0};
+		int count;
 		bool raw_active = obs->video.raw_active > 0;
 #ifdef _WIN32
 		const bool gpu_active = obs->video.gpu_encoder_active > 0;
@@ -854,16 +942,28 @@ void *obs_graphics_thread(void *param)
 		gs_begin_frame();
 		gs_leave_context();
 
+		record.frame_start = frame_start;
+		readback_frames = obs->video.readback_frames;
+		lock_failures = os_atomic_load_long(
+			&obs->video.output_lock_failures);
+
 		profile_start(tick_sources_name);
-		last_time = tick_sources(obs->video.video_time, last_time);
+		stage_start = os_gettime_ns();
+		last_time = tick_sources(obs->video.video_time, last_time,
+					 &record);
+		record.tick_sources_ns = os_gettime_ns() - stage_start;
 		profile_end(tick_sources_name);
 
 		profile_start(output_frame_name);
+		stage_start = os_gettime_ns();
 		output_frame(raw_active, gpu_active);
+		record.output_frame_ns = os_gettime_ns() - stage_start;
 		profile_end(output_frame_name);
 
 		profile_start(render_displays_name);
+		stage_start = os_gettime_ns();
 		render_displays();
+		record.render_displays_ns = os_gettime_ns() - stage_start;
 		profile_end(render_displays_name);
 
 		frame_time_ns = os_gettime_ns() - frame_start;
@@ -872,8 +972,27 @@ void *obs_graphics_thread(void *param)
 
 		profile_reenable_thread();
 
-		video_sleep(&obs->video, raw_active, gpu_active,
-			    &obs->video.video_time, interval);
+		count = video_sleep(&obs->video, raw_active, gpu_active,
+				    &obs->video.video_time, interval);
+
+		/* with threaded readback a failed lock shows up on the frame
+		 * after the one it belongs to */
+		if (obs->video.readback_frames != readback_frames) {
+			record.flags |= OBS_VIDEO_FRAME_RENDERED;
+			record.map_wait_ns = obs->video.map_wait_last_ns;
+		}
+		if (count > 1) {
+			record.flags |= OBS_VIDEO_FRAME_LAGGED;
+			record.lagged_frames = (uint32_t)(count - 1);
+		}
+		if (os_atomic_load_long(&obs->video.output_lock_failures) !=
+		    lock_failures)
+			record.flags |= OBS_VIDEO_FRAME_SKIPPED;
+		stage_start = os_gettime_ns();
+		if (stage_start > obs->video.video_time)
+			record.sleep_overshoot_ns =
+				stage_start - obs->video.video_time;
+		push_frame_record(&obs->video, &record);
 
 		frame_time_total_ns += frame_time_ns;
 		fps_total_ns += (obs->video.video_time - last_time);
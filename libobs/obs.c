@@ -199,7 +199,7 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+	for (int i = 0; i < video->readback_depth; i++) {
 #ifdef _WIN32
 		if (video->using_nv12_tex) {
 			video->copy_surfaces[i][0] =
@@ -378,6 +378,30 @@ static inline void set_video_matrix(struct obs_core_video *video,
 	memcpy(video->color_matrix, &mat, sizeof(float) * 16);
 }
 
+static void free_readback_sync(struct obs_core_video *video)
+{
+	os_sem_destroy(video->readback_sem);
+	os_event_destroy(video->readback_done);
+	video->readback_sem = NULL;
+	video->readback_done = NULL;
+	video->readback_pending = false;
+}
+
+static void stop_readback_thread(struct obs_core_video *video)
+{
+	void *thread_retval;
+
+	if (!video->readback_thread_initialized)
+		return;
+
+	video->readback_stop = true;
+	os_sem_post(video->readback_sem);
+	pthread_join(video->readback_thread, &thread_retval);
+	video->readback_thread_initialized = false;
+
+	free_readback_sync(video);
+}
+
 static int obs_init_video(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -395,6 +419,20 @@ static int obs_init_video(struct obs_video_info *ovi)
 
 	set_video_matrix(video, ovi);
 
+	video->readback_depth = video->readback_depth_setting
+					? (int)video->readback_depth_setting
+					: NUM_TEXTURES;
+	video->readback_frames = 0;
+	video->map_wait_last_ns = 0;
+	video->map_wait_max_ns = 0;
+	video->map_wait_total_ns = 0;
+	video->copy_wait_total_ns = 0;
+
+	pthread_mutex_lock(&video->frame_records_mutex);
+	video->frame_record_pos = 0;
+	video->num_frame_records = 0;
+	pthread_mutex_unlock(&video->frame_records_mutex);
+
 	errorcode = video_output_open(&video->video, &vi);
 
 	if (errorcode != VIDEO_OUTPUT_SUCCESS) {
@@ -407,6 +445,8 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	video_output_set_threaded_inputs(video->video, video->threaded_outputs);
+
 	gs_enter_context(video->graphics);
 
 	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
@@ -423,10 +463,29 @@ static int obs_init_video(struct obs_video_info *ovi)
 	if (pthread_mutex_init(&video->gpu_encoder_mutex, NULL) < 0)
 		return OBS_VIDEO_FAIL;
 
+	if (video->readback_threaded_setting) {
+		video->readback_stop = false;
+		video->readback_pending = false;
+		if (os_sem_init(&video->readback_sem, 0) != 0 ||
+		    os_event_init(&video->readback_done,
+				  OS_EVENT_TYPE_MANUAL) != 0 ||
+		    pthread_create(&video->readback_thread, NULL,
+				   obs_video_readback_thread, obs) != 0) {
+			free_readback_sync(video);
+			return OBS_VIDEO_FAIL;
+		}
+		video->readback_thread_initialized = true;
+	}
+
+	blog(LOG_INFO, "Video readback depth: %d%s", video->readback_depth,
+	     video->readback_thread_initialized ? ", threaded" : "");
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 				   obs_graphics_thread, obs);
-	if (errorcode != 0)
+	if (errorcode != 0) {
+		stop_readback_thread(video);
 		return OBS_VIDEO_FAIL;
+	}
 
 	video->thread_initialized = true;
 	video->ovi = *ovi;
@@ -445,6 +504,8 @@ static void stop_video(void)
 			video->thread_initialized = false;
 		}
 	}
+
+	stop_readback_thread(video);
 }
 
 static void obs_free_video(void)
@@ -468,7 +529,7 @@ static void obs_free_video(void)
 			}
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_READBACK_DEPTH; i++) {
 			for (size_t c = 0; c < NUM_CHANNELS; c++) {
 				if (video->copy_surfaces[i][c]) {
 					gs_stagesurface_destroy(
@@ -487,7 +548,7 @@ static void obs_free_video(void)
 			}
 		}
 
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		for (size_t i = 0; i < MAX_READBACK_DEPTH; i++) {
 			for (size_t c = 0; c < NUM_CHANNELS; c++) {
 				if (video->copy_surfaces[i][c]) {
 					gs_stagesurface_destroy(
@@ -555,7 +616,9 @@ static void obs_free_graphics(void)
 static bool obs_init_audio(struct audio_output_info *ai)
 {
 	struct obs_core_audio *audio = &obs->audio;
+	size_t render_threads;
 	int errorcode;
+	int cores;
 
 	pthread_mutexattr_t attr;
 
@@ -573,6 +636,15 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	/* the audio thread renders too, leave a core to video */
+	cores = os_get_logical_cores();
+	render_threads = cores > 2 ? (size_t)(cores - 2) : 0;
+	if (render_threads > MAX_AUDIO_RENDER_THREADS)
+		render_threads = MAX_AUDIO_RENDER_THREADS;
+	if (!audio_render_pool_init(&audio->render_pool, render_threads))
+		blog(LOG_WARNING, "Could not start the audio render threads, "
+				  "rendering audio sources serially");
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -590,9 +662,12 @@ static void obs_free_audio(void)
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	audio_render_pool_free(&audio->render_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	da_free(audio->render_batch);
 
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
@@ -823,6 +898,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 
 	pthread_mutex_init_value(&obs->audio.monitoring_mutex);
 	pthread_mutex_init_value(&obs->video.gpu_encoder_mutex);
+	if (pthread_mutex_init(&obs->video.frame_records_mutex, NULL) != 0)
+		return false;
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -998,6 +1075,8 @@ void obs_shutdown(void)
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
+	obs_encoder_packet_pool_free();
+	pthread_mutex_destroy(&obs->video.frame_records_mutex);
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
@@ -1210,6 +1289,62 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+bool obs_get_audio_render_stats(struct obs_audio_render_stats *stats)
+{
+	struct obs_core_audio *audio;
+
+	if (!obs || !stats || !obs->audio.audio)
+		return false;
+
+	audio = &obs->audio;
+	stats->ticks = audio->render_tick;
+	stats->deadline_misses = audio->deadline_misses;
+	stats->last_tick_ns = audio->last_tick_ns;
+	stats->max_tick_ns = audio->max_tick_ns;
+	stats->total_tick_ns = audio->total_tick_ns;
+	stats->render_threads = (uint32_t)audio->render_pool.num_threads;
+	return true;
+}
+
+void obs_set_video_readback(uint32_t depth, bool threaded)
+{
+	if (!obs)
+		return;
+
+	if (depth > MAX_READBACK_DEPTH)
+		depth = MAX_READBACK_DEPTH;
+
+	obs->video.readback_depth_setting = depth;
+	obs->video.readback_threaded_setting = threaded;
+}
+
+bool obs_get_video_readback_stats(struct obs_video_readback_stats *stats)
+{
+	struct obs_core_video *video;
+
+	if (!obs || !stats || !obs->video.video)
+		return false;
+
+	video = &obs->video;
+	stats->depth = (uint32_t)video->readback_depth;
+	stats->threaded = video->readback_thread_initialized;
+	stats->frames = video->readback_frames;
+	stats->last_map_wait_ns = video->map_wait_last_ns;
+	stats->max_map_wait_ns = video->map_wait_max_ns;
+	stats->total_map_wait_ns = video->map_wait_total_ns;
+	stats->total_copy_wait_ns = video->copy_wait_total_ns;
+	return true;
+}
+
+void obs_set_threaded_video_outputs(bool threaded)
+{
+	if (!obs)
+		return;
+
+	obs->video.threaded_outputs = threaded;
+	video_output_set_threaded_inputs(obs->video.video, threaded);
+}
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
 	if (!obs)
@@ -2196,6 +2331,161 @@ uint64_t obs_get_frame_interval_ns(void)
 	return obs ? obs->video.video_frame_interval_ns : 0;
 }
 
+static size_t copy_frame_records(struct obs_video_frame_record *records,
+				 size_t max_records)
+{
+	struct obs_core_video *video = &obs->video;
+	size_t count, start;
+
+	pthread_mutex_lock(&video->frame_records_mutex);
+
+	count = video->num_frame_records;
+	if (count > max_records)
+		count = max_records;
+
+	start = (video->frame_record_pos + OBS_VIDEO_FRAME_RECORDS - count) %
+		OBS_VIDEO_FRAME_RECORDS;
+	for (size_t i = 0; i < count; i++)
+		records[i] = video->frame_records[(start + i) %
+						  OBS_VIDEO_FRAME_RECORDS];
+
+	pthread_mutex_unlock(&video->frame_records_mutex);
+	return count;
+}
+
+size_t obs_get_video_frame_records(struct obs_video_frame_record *records,
+				   size_t max_records)
+{
+	if (!obs || !records)
+		return 0;
+
+	return copy_frame_records(records, max_records);
+}
+
+static int cmp_uint64(const void *a, const void *b)
+{
+	uint64_t val_a = *(const uint64_t *)a;
+	uint64_t val_b = *(const uint64_t *)b;
+	return val_a < val_b ? -1 : (val_a > val_b ? 1 : 0);
+}
+
+static void get_stage_stats(uint64_t *values, size_t count,
+			    struct obs_video_stage_stats *stats)
+{
+	qsort(values, count, sizeof(uint64_t), cmp_uint64);
+
+	/* nearest rank */
+	stats->p50_ns = values[(count * 50 + 99) / 100 - 1];
+	stats->p95_ns = values[(count * 95 + 99) / 100 - 1];
+	stats->p99_ns = values[(count * 99 + 99) / 100 - 1];
+	stats->max_ns = values[count - 1];
+}
+
+bool obs_get_video_frame_stats(struct obs_video_frame_stats *stats)
+{
+	struct obs_video_frame_record *records;
+	uint64_t *values;
+	size_t count;
+
+	if (!obs || !stats)
+		return false;
+
+	records = bmalloc(sizeof(*records) * OBS_VIDEO_FRAME_RECORDS);
+	count = copy_frame_records(records, OBS_VIDEO_FRAME_RECORDS);
+	if (!count) {
+		bfree(records);
+		return false;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	stats->frames = (uint32_t)count;
+	stats->interval_ns = obs->video.video_frame_interval_ns;
+
+	for (size_t i = 0; i < count; i++) {
+		if (records[i].flags & OBS_VIDEO_FRAME_RENDERED)
+			stats->rendered_frames++;
+		if (records[i].flags & OBS_VIDEO_FRAME_SKIPPED)
+			stats->skipped_frames++;
+		stats->lagged_frames += records[i].lagged_frames;
+	}
+
+	values = bmalloc(sizeof(uint64_t) * count);
+
+#define GET_STAGE_STATS(name, expr)                               \
+	do {                                                      \
+		for (size_t i = 0; i < count; i++) {              \
+			struct obs_video_frame_record *r;         \
+			r = &records[i];                          \
+			values[i] = (expr);                       \
+		}                                                 \
+		get_stage_stats(values, count, &stats->name);     \
+	} while (false)
+
+	GET_STAGE_STATS(frame_time, r->tick_sources_ns + r->output_frame_ns +
+					    r->render_displays_ns);
+	GET_STAGE_STATS(tick_sources, r->tick_sources_ns);
+	GET_STAGE_STATS(output_frame, r->output_frame_ns);
+	GET_STAGE_STATS(render_displays, r->render_displays_ns);
+	GET_STAGE_STATS(map_wait, r->map_wait_ns);
+	GET_STAGE_STATS(sleep_overshoot, r->sleep_overshoot_ns);
+
+#undef GET_STAGE_STATS
+
+	bfree(values);
+	bfree(records);
+	return true;
+}
+
+struct frame_records_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t count;
+	uint32_t padding;
+	uint64_t interval_ns;
+};
+
+bool obs_dump_video_frame_records(const char *path)
+{
+	struct frame_records_header header = {{0}};
+	struct obs_video_frame_record *records;
+	size_t count;
+	bool success;
+	FILE *file;
+
+	if (!obs || !path)
+		return false;
+
+	file = os_fopen(path, "wb");
+	if (!file) {
+		blog(LOG_WARNING, "Could not open '%s' to dump frame records",
+		     path);
+		return false;
+	}
+
+	records = bmalloc(sizeof(*records) * OBS_VIDEO_FRAME_RECORDS);
+	count = copy_frame_records(records, OBS_VIDEO_FRAME_RECORDS);
+
+	memcpy(header.magic, "OBSFRAME", 8);
+	header.version = 1;
+	header.record_size = sizeof(struct obs_video_frame_record);
+	header.count = (uint32_t)count;
+	header.interval_ns = obs->video.video_frame_interval_ns;
+
+	success = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (success && count)
+		success = fwrite(records, sizeof(*records), count, file) ==
+			  count;
+
+	fclose(file);
+	bfree(records);
+
+	if (!success)
+		blog(LOG_WARNING, "Failed to write frame records to '%s'",
+		     path);
+	return success;
+}
+
 enum obs_obj_type obs_obj_get_type(void *obj)
 {
 	struct obs_context_data *context = obj;
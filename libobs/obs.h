@@ -187,6 +187,90 @@ struct obs_audio_info {
 	enum speaker_layout speakers;
 };
 
+/**
+ * Audio thread timings.  A tick renders, mixes and outputs
+ * AUDIO_OUTPUT_FRAMES frames; it misses its deadline when it takes longer
+ * than the duration of those frames.
+ */
+struct obs_audio_render_stats {
+	uint64_t ticks;
+	uint64_t deadline_misses;
+	uint64_t last_tick_ns;
+	uint64_t max_tick_ns;
+	uint64_t total_tick_ns;
+	/** Worker threads rendering sources along with the audio thread */
+	uint32_t render_threads;
+};
+
+#define OBS_VIDEO_FRAME_RECORDS 1024
+
+enum obs_video_frame_flags {
+	/** A frame was read back and sent to the raw video outputs */
+	OBS_VIDEO_FRAME_RENDERED = 1 << 0,
+	/** The frame took more than one interval, see lagged_frames */
+	OBS_VIDEO_FRAME_LAGGED = 1 << 1,
+	/** The video output had no free frame to copy to */
+	OBS_VIDEO_FRAME_SKIPPED = 1 << 2,
+};
+
+/**
+ * Timings of one iteration of the graphics thread.  Stage times are
+ * durations in nanoseconds, frame_start is os_gettime_ns based.
+ */
+struct obs_video_frame_record {
+	uint64_t frame_start;
+	uint64_t tick_sources_ns;
+	uint64_t output_frame_ns;
+	uint64_t render_displays_ns;
+	/** Time spent mapping the frame read back this iteration */
+	uint64_t map_wait_ns;
+	/** Time video_sleep woke up past the next frame's deadline */
+	uint64_t sleep_overshoot_ns;
+	uint32_t flags;
+	/** Number of intervals lost to this frame (0 when on time) */
+	uint32_t lagged_frames;
+	/** Source that took longest to tick, empty if none */
+	uint64_t slowest_source_ns;
+	char slowest_source[64];
+};
+
+struct obs_video_stage_stats {
+	uint64_t p50_ns;
+	uint64_t p95_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+};
+
+struct obs_video_frame_stats {
+	/** Number of records the summary covers (at most
+	 * OBS_VIDEO_FRAME_RECORDS) */
+	uint32_t frames;
+	uint32_t rendered_frames;
+	uint32_t lagged_frames;
+	uint32_t skipped_frames;
+	uint64_t interval_ns;
+
+	/** tick_sources + output_frame + render_displays */
+	struct obs_video_stage_stats frame_time;
+	struct obs_video_stage_stats tick_sources;
+	struct obs_video_stage_stats output_frame;
+	struct obs_video_stage_stats render_displays;
+	struct obs_video_stage_stats map_wait;
+	struct obs_video_stage_stats sleep_overshoot;
+};
+
+struct obs_video_readback_stats {
+	uint32_t depth;
+	bool threaded;
+	uint64_t frames;
+	/** Time the graphics thread waited to map a frame */
+	uint64_t last_map_wait_ns;
+	uint64_t max_map_wait_ns;
+	uint64_t total_map_wait_ns;
+	/** Time the graphics thread waited for the copy of the previous frame */
+	uint64_t total_copy_wait_ns;
+};
+
 /**
  * Sent to source filters via the filter_audio callback to allow filtering of
  * audio data
@@ -389,6 +473,30 @@ EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
 
+/** Gets the audio thread timings, returns false if no audio */
+EXPORT bool obs_get_audio_render_stats(struct obs_audio_render_stats *stats);
+
+/**
+ * Sets how many frames the raw video readback from the GPU runs behind
+ * rendering (2 by default, up to 8), and whether the frames are copied out
+ * of the staging surfaces on a thread of their own.  A deeper readback keeps
+ * the graphics thread from waiting on the GPU when it maps a frame, which
+ * matters most with software rendering, at the cost of latency.  Takes
+ * effect on the next obs_reset_video; 0 uses the default depth.
+ */
+EXPORT void obs_set_video_readback(uint32_t depth, bool threaded);
+
+/** Gets the raw video readback timings, returns false if no video */
+EXPORT bool
+obs_get_video_readback_stats(struct obs_video_readback_stats *stats);
+
+/**
+ * Runs each raw video encoder and raw video output connected afterwards on
+ * its own thread, so that a slow one only skips its own frames instead of
+ * delaying all the others.  Kept across video resets.
+ */
+EXPORT void obs_set_threaded_video_outputs(bool threaded);
+
 /**
  * Opens a plugin module directly from a specific path.
  *
@@ -735,6 +843,28 @@ EXPORT uint64_t obs_get_frame_interval_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/**
+ * Summarizes the last OBS_VIDEO_FRAME_RECORDS iterations of the graphics
+ * thread, returns false if there are none yet
+ */
+EXPORT bool obs_get_video_frame_stats(struct obs_video_frame_stats *stats);
+
+/**
+ * Copies the most recent frame records, oldest first, and returns how many
+ * were copied
+ */
+EXPORT size_t obs_get_video_frame_records(struct obs_video_frame_record *records,
+					  size_t max_records);
+
+/**
+ * Writes the frame records to a file for offline analysis.  The file starts
+ * with the 8 bytes "OBSFRAME", then a uint32_t format version (1), a
+ * uint32_t record size, a uint32_t record count, a uint32_t padding and a
+ * uint64_t frame interval in nanoseconds, followed by the records oldest
+ * first, all in native byte order.
+ */
+EXPORT bool obs_dump_video_frame_records(const char *path);
+
 EXPORT bool obs_nv12_tex_active(void);
 
 EXPORT void obs_apply_private_data(obs_data_t *settings);
@@ -1299,6 +1429,8 @@ EXPORT uint32_t obs_source_get_base_height(obs_source_t *source);
 
 EXPORT bool obs_source_audio_pending(const obs_source_t *source);
 EXPORT uint64_t obs_source_get_audio_timestamp(const obs_source_t *source);
+/** Time the last audio tick took to render this source, in nanoseconds */
+EXPORT uint64_t obs_source_get_audio_render_time(const obs_source_t *source);
 EXPORT void obs_source_get_audio_mix(const obs_source_t *source,
 				     struct obs_source_audio_mix *audio);
 
@@ -1835,6 +1967,14 @@ EXPORT void
 obs_output_set_video_conversion(obs_output_t *output,
 				const struct video_scale_info *conversion);
 
+/**
+ * Only sends one raw video frame out of divisor to the output while it is
+ * capturing data, e.g. to adapt to the available bandwidth.  Used only for
+ * raw output.
+ */
+EXPORT bool obs_output_set_video_frame_rate_divisor(obs_output_t *output,
+						    uint32_t divisor);
+
 /** Optionally sets the audio conversion info.  Used only for raw output */
 EXPORT void
 obs_output_set_audio_conversion(obs_output_t *output,
@@ -2032,16 +2172,66 @@ DEPRECATED
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 #endif
 
+/**
+ * References and releases encoded packets.  The data of a released packet
+ * must have been allocated by libobs (encoder output, obs_parse_avc_packet,
+ * obs_duplicate_encoder_packet): it is returned to the encoder packet pool,
+ * which keeps its own header in front of the data.  Packets built by hand
+ * with a 'long' reference count in front of the data can't be released
+ * with this any more.
+ */
 EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 				   struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+struct obs_encoder_packet_stats {
+	/** Packet buffers currently referenced, and their size */
+	uint64_t live_packets;
+	uint64_t live_bytes;
+	/** Released buffers kept for reuse */
+	uint64_t pooled_bytes;
+	uint64_t allocations;
+	uint64_t pool_hits;
+	/** Copies of packet data: one per encoded packet, the outputs share
+	 * it */
+	uint64_t copies;
+	uint64_t copied_bytes;
+};
+
+/**
+ * Gets the counters of the encoder packet buffers, which every encoded
+ * packet sent to outputs is allocated from
+ */
+EXPORT void obs_get_encoder_packet_stats(struct obs_encoder_packet_stats *stats);
+
 EXPORT void *obs_encoder_create_rerouted(obs_encoder_t *encoder,
 					 const char *reroute_id);
 
 /** Returns whether encoder is paused */
 EXPORT bool obs_encoder_paused(const obs_encoder_t *output);
 
+/**
+ * Receives the packets of an encoder without going through an output, for
+ * outputs that send encoded video while taking raw audio (or the opposite).
+ * Initializes and starts the encoder if it is not already running.  The
+ * packet passed to the callback is only valid during the call: use
+ * obs_encoder_packet_ref to keep it.
+ */
+EXPORT bool obs_encoder_connect_packets(
+	obs_encoder_t *encoder,
+	void (*new_packet)(void *param, struct encoder_packet *packet),
+	void *param);
+EXPORT void obs_encoder_disconnect_packets(
+	obs_encoder_t *encoder,
+	void (*new_packet)(void *param, struct encoder_packet *packet),
+	void *param);
+
+/**
+ * Asks a video encoder to make its next frame a keyframe.  Only honored by
+ * encoders checking encoder_frame::keyframe.
+ */
+EXPORT void obs_encoder_request_keyframe(obs_encoder_t *encoder);
+
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
 
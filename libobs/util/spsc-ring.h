@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2020 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed capacity single-producer/single-consumer byte ring.
+ *
+ * Unlike circlebuf it needs no lock: one thread may write while another one
+ * reads.  Data is written and read through peek/commit pairs so that it can
+ * be copied in place; a peeked region is split in two when it wraps around
+ * the end of the buffer.  The producer and consumer positions are kept on
+ * separate cache lines.
+ */
+
+#define SPSC_RING_CACHE_LINE 64
+
+struct spsc_ring {
+	uint8_t *data;
+	size_t capacity;
+
+	uint8_t pad0[SPSC_RING_CACHE_LINE];
+
+	/* producer side */
+	volatile long head;
+	unsigned long cached_tail;
+
+	uint8_t pad1[SPSC_RING_CACHE_LINE];
+
+	/* consumer side */
+	volatile long tail;
+	unsigned long cached_head;
+
+	uint8_t pad2[SPSC_RING_CACHE_LINE];
+};
+
+struct spsc_ring_span {
+	uint8_t *data[2];
+	size_t size[2];
+};
+
+/* the positions only ever grow (modulo the range of long), so the capacity
+ * must be a power of two */
+static inline void spsc_ring_init(struct spsc_ring *ring, size_t capacity)
+{
+	size_t size = 4096;
+
+	while (size < capacity)
+		size *= 2;
+
+	memset(ring, 0, sizeof(struct spsc_ring));
+	ring->data = (uint8_t *)bmalloc(size);
+	ring->capacity = size;
+}
+
+static inline void spsc_ring_free(struct spsc_ring *ring)
+{
+	bfree(ring->data);
+	memset(ring, 0, sizeof(struct spsc_ring));
+}
+
+/* only one side ever writes a position, so the swap always succeeds: it is
+ * used because it is a full barrier on every platform, which makes the data
+ * written before it visible to the other side */
+static inline void spsc_ring_publish(volatile long *pos, unsigned long val)
+{
+	os_atomic_compare_swap_long(pos, *pos, (long)val);
+}
+
+static inline void spsc_ring_get_span(const struct spsc_ring *ring,
+				      unsigned long pos, size_t size,
+				      struct spsc_ring_span *span)
+{
+	size_t offset = (size_t)pos & (ring->capacity - 1);
+	size_t first = ring->capacity - offset;
+
+	if (first > size)
+		first = size;
+
+	span->data[0] = ring->data + offset;
+	span->size[0] = first;
+	span->data[1] = ring->data;
+	span->size[1] = size - first;
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer */
+
+static inline size_t spsc_ring_free_space(struct spsc_ring *ring)
+{
+	unsigned long head = (unsigned long)ring->head;
+
+	ring->cached_tail = (unsigned long)os_atomic_load_long(&ring->tail);
+	return ring->capacity - (size_t)(head - ring->cached_tail);
+}
+
+/** Gets the region to write the next size bytes to, false if they do not
+ * fit.  Nothing is visible to the consumer until spsc_ring_write_commit.  */
+static inline bool spsc_ring_write_peek(struct spsc_ring *ring, size_t size,
+					struct spsc_ring_span *span)
+{
+	unsigned long head = (unsigned long)ring->head;
+
+	if (ring->capacity - (head - ring->cached_tail) < size) {
+		ring->cached_tail =
+			(unsigned long)os_atomic_load_long(&ring->tail);
+		if (ring->capacity - (head - ring->cached_tail) < size)
+			return false;
+	}
+
+	spsc_ring_get_span(ring, head, size, span);
+	return true;
+}
+
+static inline void spsc_ring_write_commit(struct spsc_ring *ring, size_t size)
+{
+	spsc_ring_publish(&ring->head,
+			  (unsigned long)ring->head + (unsigned long)size);
+}
+
+static inline bool spsc_ring_push(struct spsc_ring *ring, const void *data,
+				  size_t size)
+{
+	struct spsc_ring_span span;
+
+	if (!spsc_ring_write_peek(ring, size, &span))
+		return false;
+
+	memcpy(span.data[0], data, span.size[0]);
+	if (span.size[1])
+		memcpy(span.data[1], (const uint8_t *)data + span.size[0],
+		       span.size[1]);
+
+	spsc_ring_write_commit(ring, size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer */
+
+static inline size_t spsc_ring_size(struct spsc_ring *ring)
+{
+	unsigned long tail = (unsigned long)ring->tail;
+
+	ring->cached_head = (unsigned long)os_atomic_load_long(&ring->head);
+	return (size_t)(ring->cached_head - tail);
+}
+
+/** Gets the region of the next size bytes to read, false if there are not
+ * that many.  They stay in the ring until spsc_ring_read_commit.  */
+static inline bool spsc_ring_read_peek(struct spsc_ring *ring, size_t size,
+				       struct spsc_ring_span *span)
+{
+	unsigned long tail = (unsigned long)ring->tail;
+
+	if (ring->cached_head - tail < size) {
+		ring->cached_head =
+			(unsigned long)os_atomic_load_long(&ring->head);
+		if (ring->cached_head - tail < size)
+			return false;
+	}
+
+	spsc_ring_get_span(ring, tail, size, span);
+	return true;
+}
+
+static inline void spsc_ring_read_commit(struct spsc_ring *ring, size_t size)
+{
+	spsc_ring_publish(&ring->tail,
+			  (unsigned long)ring->tail + (unsigned long)size);
+}
+
+static inline bool spsc_ring_pop(struct spsc_ring *ring, void *data,
+				 size_t size)
+{
+	struct spsc_ring_span span;
+
+	if (!spsc_ring_read_peek(ring, size, &span))
+		return false;
+
+	if (data) {
+		memcpy(data, span.data[0], span.size[0]);
+		if (span.size[1])
+			memcpy((uint8_t *)data + span.size[0], span.data[1],
+			       span.size[1]);
+	}
+
+	spsc_ring_read_commit(ring, size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* span helpers */
+
+/** Narrows a peeked span to size bytes at offset */
+static inline void spsc_ring_span_sub(const struct spsc_ring_span *span,
+				      size_t offset, size_t size,
+				      struct spsc_ring_span *sub)
+{
+	if (offset < span->size[0]) {
+		size_t first = span->size[0] - offset;
+
+		if (first > size)
+			first = size;
+
+		sub->data[0] = span->data[0] + offset;
+		sub->size[0] = first;
+		sub->data[1] = span->data[1];
+		sub->size[1] = size - first;
+	} else {
+		sub->data[0] = span->data[1] + (offset - span->size[0]);
+		sub->size[0] = size;
+		sub->data[1] = NULL;
+		sub->size[1] = 0;
+	}
+}
+
+static inline void spsc_ring_span_write(const struct spsc_ring_span *span,
+					size_t offset, const void *data,
+					size_t size)
+{
+	struct spsc_ring_span sub;
+
+	spsc_ring_span_sub(span, offset, size, &sub);
+	memcpy(sub.data[0], data, sub.size[0]);
+	if (sub.size[1])
+		memcpy(sub.data[1], (const uint8_t *)data + sub.size[0],
+		       sub.size[1]);
+}
+
+static inline void spsc_ring_span_read(const struct spsc_ring_span *span,
+				       size_t offset, void *data, size_t size)
+{
+	struct spsc_ring_span sub;
+
+	spsc_ring_span_sub(span, offset, size, &sub);
+	memcpy(data, sub.data[0], sub.size[0]);
+	if (sub.size[1])
+		memcpy((uint8_t *)data + sub.size[0], sub.data[1],
+		       sub.size[1]);
+}
+
+#ifdef __cplusplus
+}
+#endif
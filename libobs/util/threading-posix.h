@@ -42,6 +42,23 @@ static inline bool os_atomic_compare_swap_long(volatile long *val, long old_val,
 	return __sync_bool_compare_and_swap(val, old_val, new_val);
 }
 
+static inline long long os_atomic_add_long_long(volatile long long *val,
+						long long add)
+{
+	return __sync_add_and_fetch(val, add);
+}
+
+static inline long long os_atomic_set_long_long(volatile long long *ptr,
+						long long val)
+{
+	return __sync_lock_test_and_set(ptr, val);
+}
+
+static inline long long os_atomic_load_long_long(const volatile long long *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
 static inline bool os_atomic_set_bool(volatile bool *ptr, bool val)
 {
 	return __sync_lock_test_and_set(ptr, val);
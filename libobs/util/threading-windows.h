@@ -44,6 +44,23 @@ static inline bool os_atomic_compare_swap_long(volatile long *val, long old_val,
 	return _InterlockedCompareExchange(val, new_val, old_val) == old_val;
 }
 
+static inline long long os_atomic_add_long_long(volatile long long *val,
+						long long add)
+{
+	return _InterlockedExchangeAdd64(val, add) + add;
+}
+
+static inline long long os_atomic_set_long_long(volatile long long *ptr,
+						long long val)
+{
+	return _InterlockedExchange64(ptr, val);
+}
+
+static inline long long os_atomic_load_long_long(const volatile long long *ptr)
+{
+	return _InterlockedCompareExchange64((volatile long long *)ptr, 0, 0);
+}
+
 static inline bool os_atomic_set_bool(volatile bool *ptr, bool val)
 {
 	return !!_InterlockedExchange8((volatile char *)ptr, (char)val);
@@ -25,10 +25,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include "ffmpeg-mux.h"
 
 #include <libavformat/avformat.h>
 
+#ifdef FFMPEG_MUX_NO_MAIN
+#include <util/base.h>
+#endif
+
 #if LIBAVCODEC_VERSION_MAJOR >= 58
 #define CODEC_FLAG_GLOBAL_H AV_CODEC_FLAG_GLOBAL_HEADER
 #else
@@ -68,28 +73,6 @@ static inline void resize_buf_free(struct resize_buf *rb)
 
 /* ------------------------------------------------------------------------- */
 
-struct main_params {
-	char *file;
-	int has_video;
-	int tracks;
-	char *vcodec;
-	int vbitrate;
-	int gop;
-	int width;
-	int height;
-	int fps_num;
-	int fps_den;
-	char *acodec;
-	char *muxer_settings;
-};
-
-struct audio_params {
-	char *name;
-	int abitrate;
-	int sample_rate;
-	int channels;
-};
-
 struct header {
 	uint8_t *data;
 	int size;
@@ -108,6 +91,20 @@ struct ffmpeg_mux {
 	char error[4096];
 };
 
+static void mux_error(struct ffmpeg_mux *ffm, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(ffm->error, sizeof(ffm->error), format, args);
+	va_end(args);
+
+	/* in process, the output logs it when it fails (ffm_get_error) */
+#ifndef FFMPEG_MUX_NO_MAIN
+	fputs(ffm->error, stderr);
+#endif
+}
+
 static void header_free(struct header *header)
 {
 	free(header->data);
@@ -269,7 +266,7 @@ static bool new_stream(struct ffmpeg_mux *ffm, AVStream **stream,
 	AVCodec *codec;
 
 	if (!desc) {
-		fprintf(stderr, "Couldn't find encoder '%s'\n", name);
+		mux_error(ffm, "Couldn't find encoder '%s'\n", name);
 		return false;
 	}
 
@@ -277,14 +274,14 @@ static bool new_stream(struct ffmpeg_mux *ffm, AVStream **stream,
 
 	codec = avcodec_find_encoder(desc->id);
 	if (!codec) {
-		fprintf(stderr, "Couldn't create encoder");
+		mux_error(ffm, "Couldn't create encoder");
 		return false;
 	}
 
 	*stream = avformat_new_stream(ffm->output, codec);
 	if (!*stream) {
-		fprintf(stderr, "Couldn't create stream for encoder '%s'\n",
-			name);
+		mux_error(ffm, "Couldn't create stream for encoder '%s'\n",
+			  name);
 		return false;
 	}
 
@@ -471,8 +468,8 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 		ret = avio_open(&ffm->output->pb, ffm->params.file,
 				AVIO_FLAG_WRITE);
 		if (ret < 0) {
-			fprintf(stderr, "Couldn't open '%s', %s",
-				ffm->params.file, av_err2str(ret));
+			mux_error(ffm, "Couldn't open '%s', %s",
+				  ffm->params.file, av_err2str(ret));
 			return FFM_ERROR;
 		}
 	}
@@ -484,13 +481,21 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 	AVDictionary *dict = NULL;
 	if ((ret = av_dict_parse_string(&dict, ffm->params.muxer_settings, "=",
 					" ", 0))) {
-		fprintf(stderr, "Failed to parse muxer settings: %s\n%s",
-			av_err2str(ret), ffm->params.muxer_settings);
+		mux_error(ffm, "Failed to parse muxer settings: %s\n%s",
+			  av_err2str(ret), ffm->params.muxer_settings);
 
 		av_dict_free(&dict);
 	}
 
 	if (av_dict_count(dict) > 0) {
+#ifdef FFMPEG_MUX_NO_MAIN
+		blog(LOG_INFO, "ffmpeg-mux: Using muxer settings:");
+
+		AVDictionaryEntry *entry = NULL;
+		while ((entry = av_dict_get(dict, "", entry,
+					    AV_DICT_IGNORE_SUFFIX)))
+			blog(LOG_INFO, "\t%s=%s", entry->key, entry->value);
+#else
 		printf("Using muxer settings:");
 
 		AVDictionaryEntry *entry = NULL;
@@ -499,12 +504,13 @@ static inline int open_output_file(struct ffmpeg_mux *ffm)
 			printf("\n\t%s=%s", entry->key, entry->value);
 
 		printf("\n");
+#endif
 	}
 
 	ret = avformat_write_header(ffm->output, &dict);
 	if (ret < 0) {
-		fprintf(stderr, "Error opening '%s': %s", ffm->params.file,
-			av_err2str(ret));
+		mux_error(ffm, "Error opening '%s': %s", ffm->params.file,
+			  av_err2str(ret));
 
 		av_dict_free(&dict);
 
@@ -523,16 +529,16 @@ static int ffmpeg_mux_init_context(struct ffmpeg_mux *ffm)
 
 	output_format = av_guess_format(NULL, ffm->params.file, NULL);
 	if (output_format == NULL) {
-		fprintf(stderr, "Couldn't find an appropriate muxer for '%s'\n",
-			ffm->params.file);
+		mux_error(ffm, "Couldn't find an appropriate muxer for '%s'\n",
+			  ffm->params.file);
 		return FFM_ERROR;
 	}
 
 	ret = avformat_alloc_output_context2(&ffm->output, output_format, NULL,
 					     NULL);
 	if (ret < 0) {
-		fprintf(stderr, "Couldn't initialize output context: %s\n",
-			av_err2str(ret));
+		mux_error(ffm, "Couldn't initialize output context: %s\n",
+			  av_err2str(ret));
 		return FFM_ERROR;
 	}
 
@@ -645,8 +651,63 @@ static inline bool ffmpeg_mux_packet(struct ffmpeg_mux *ffm, uint8_t *buf,
 	return av_interleaved_write_frame(ffm->output, &packet) >= 0;
 }
 
+/* ------------------------------------------------------------------------- */
+/* in-process muxing: the same muxer, fed by the plugin instead of the pipe */
+
+struct ffmpeg_mux *ffm_create(const struct main_params *params,
+			      const struct audio_params *audio)
+{
+	struct ffmpeg_mux *ffm = calloc(1, sizeof(*ffm));
+
+	ffm->params = *params;
+
+	if (ffm->params.tracks) {
+		size_t size = sizeof(struct audio_params) * ffm->params.tracks;
+
+		ffm->audio = malloc(size);
+		memcpy(ffm->audio, audio, size);
+		ffm->audio_header =
+			calloc(1, sizeof(struct header) * ffm->params.tracks);
+	}
+
+	return ffm;
+}
+
+void ffm_set_header(struct ffmpeg_mux *ffm, uint8_t *data,
+		    struct ffm_packet_info *info)
+{
+	ffmpeg_mux_header(ffm, data, info);
+}
+
+int ffm_open(struct ffmpeg_mux *ffm)
+{
+	int ret = ffmpeg_mux_init_context(ffm);
+	ffm->initialized = ret == FFM_SUCCESS;
+	return ret;
+}
+
+bool ffm_write(struct ffmpeg_mux *ffm, uint8_t *data,
+	       struct ffm_packet_info *info)
+{
+	return ffmpeg_mux_packet(ffm, data, info);
+}
+
+const char *ffm_get_error(struct ffmpeg_mux *ffm)
+{
+	return ffm->error;
+}
+
+void ffm_destroy(struct ffmpeg_mux *ffm)
+{
+	if (ffm) {
+		ffmpeg_mux_free(ffm);
+		free(ffm);
+	}
+}
+
 /* ------------------------------------------------------------------------- */
 
+#ifndef FFMPEG_MUX_NO_MAIN
 #ifdef _WIN32
 int wmain(int argc, wchar_t *argv_w[])
 #else
@@ -707,3 +768,4 @@ int main(int argc, char *argv[])
 #endif
 	return 0;
 }
+#endif
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 enum ffm_packet_type {
 	FFM_PACKET_VIDEO,
@@ -35,3 +36,44 @@ struct ffm_packet_info {
 	enum ffm_packet_type type;
 	bool keyframe;
 };
+
+struct main_params {
+	char *file;
+	int has_video;
+	int tracks;
+	char *vcodec;
+	int vbitrate;
+	int gop;
+	int width;
+	int height;
+	int fps_num;
+	int fps_den;
+	char *acodec;
+	char *muxer_settings;
+};
+
+struct audio_params {
+	char *name;
+	int abitrate;
+	int sample_rate;
+	int channels;
+};
+
+/*
+ * In-process muxing, for ffmpeg-mux.c built into the plugin with
+ * FFMPEG_MUX_NO_MAIN.  Same steps as through the pipe: the headers of the
+ * video track and then of each audio track, ffm_open, then the packets.
+ * The params' strings must outlive the muxer.
+ */
+
+struct ffmpeg_mux;
+
+extern struct ffmpeg_mux *ffm_create(const struct main_params *params,
+				     const struct audio_params *audio);
+extern void ffm_set_header(struct ffmpeg_mux *ffm, uint8_t *data,
+			   struct ffm_packet_info *info);
+extern int ffm_open(struct ffmpeg_mux *ffm);
+extern bool ffm_write(struct ffmpeg_mux *ffm, uint8_t *data,
+		      struct ffm_packet_info *info);
+extern const char *ffm_get_error(struct ffmpeg_mux *ffm);
+extern void ffm_destroy(struct ffmpeg_mux *ffm);
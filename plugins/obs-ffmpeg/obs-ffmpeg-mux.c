@@ -25,6 +25,7 @@
 #include <util/circlebuf.h>
 #include <util/threading.h>
 #include "ffmpeg-mux/ffmpeg-mux.h"
+#include "obs-ffmpeg-replay-store.h"
 
 #ifdef _WIN32
 #include "util/windows/win-version.h"
@@ -39,6 +40,25 @@
 #define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
 
+struct mux_stats {
+	uint64_t packets;
+	uint64_t write_errors;
+
+	/* time spent writing each packet: in av_interleaved_write_frame when
+	 * muxing in process, in the pipe writes otherwise */
+	uint64_t write_ns;
+	uint64_t max_write_ns;
+
+	/* from queueing a packet to it being written (in process only) */
+	uint64_t latency_ns;
+	uint64_t max_latency_ns;
+
+	/* times the output had to wait for room in the queue */
+	uint64_t waits;
+	uint64_t wait_ns;
+	size_t max_queued_bytes;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t *output;
 	os_process_pipe_t *pipe;
@@ -51,19 +71,37 @@ struct ffmpeg_muxer {
 	volatile bool capturing;
 
 	/* replay buffer */
-	struct circlebuf packets;
-	int64_t cur_size;
-	int64_t cur_time;
-	int64_t max_size;
-	int64_t max_time;
+	struct replay_store *store;
 	int64_t save_ts;
-	int keyframes;
 	obs_hotkey_id hotkey;
 
-	DARRAY(struct encoder_packet) mux_packets;
+	struct replay_snapshot *snapshot;
 	pthread_t mux_thread;
 	bool mux_thread_joinable;
 	volatile bool muxing;
+
+	/* in-process muxing */
+	bool in_process;
+	struct ffmpeg_mux *mux;
+	struct main_params params;
+	struct audio_params audio[MAX_AUDIO_MIXES];
+	struct dstr mux_path;
+	struct dstr mux_settings;
+	struct dstr audio_names[MAX_AUDIO_MIXES];
+
+	pthread_t write_thread;
+	bool write_thread_active;
+	pthread_mutex_t queue_mutex;
+	os_sem_t *queue_sem;
+	os_event_t *queue_space;
+	struct circlebuf queue;
+	size_t queue_bytes;
+	size_t max_queue_bytes;
+	volatile bool mux_failed;
+	int mux_ret;
+	uint64_t last_backpressure_signal;
+
+	struct mux_stats stats;
 };
 
 static const char *ffmpeg_mux_getname(void *type)
@@ -74,19 +112,9 @@ static const char *ffmpeg_mux_getname(void *type)
 
 static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 {
-	while (stream->packets.size > 0) {
-		struct encoder_packet pkt;
-		circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-		obs_encoder_packet_release(&pkt);
-	}
-
-	circlebuf_free(&stream->packets);
-	stream->cur_size = 0;
-	stream->cur_time = 0;
-	stream->max_size = 0;
-	stream->max_time = 0;
+	replay_store_destroy(stream->store);
+	stream->store = NULL;
 	stream->save_ts = 0;
-	stream->keyframes = 0;
 }
 
 static void ffmpeg_mux_destroy(void *data)
@@ -96,22 +124,54 @@ static void ffmpeg_mux_destroy(void *data)
 	replay_buffer_clear(stream);
 	if (stream->mux_thread_joinable)
 		pthread_join(stream->mux_thread, NULL);
-	da_free(stream->mux_packets);
 
 	os_process_pipe_destroy(stream->pipe);
+	pthread_mutex_destroy(&stream->queue_mutex);
 	dstr_free(&stream->path);
+	dstr_free(&stream->mux_path);
+	dstr_free(&stream->mux_settings);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
+		dstr_free(&stream->audio_names[i]);
 	bfree(stream);
 }
 
-static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
+static void get_mux_stats(void *data, calldata_t *cd);
+
+static struct ffmpeg_muxer *create_muxer(obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
 
-	UNUSED_PARAMETER(settings);
+	pthread_mutex_init_value(&stream->queue_mutex);
+	if (pthread_mutex_init(&stream->queue_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph,
+			 "void get_mux_stats(out bool in_process, "
+			 "out int packets, out int queued_bytes, "
+			 "out int backpressure_waits, "
+			 "out float backpressure_ms, "
+			 "out float write_latency_avg_ms, "
+			 "out float write_latency_max_ms, "
+			 "out float queue_latency_avg_ms, "
+			 "out float queue_latency_max_ms)",
+			 get_mux_stats, stream);
+
+	signal_handler_t *sh = obs_output_get_signal_handler(output);
+	signal_handler_add(sh, "void mux_backpressure(ptr output, "
+			       "int queued_bytes, float wait_ms)");
 	return stream;
 }
 
+static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
+{
+	UNUSED_PARAMETER(settings);
+	return create_muxer(output);
+}
+
 #ifdef _WIN32
 #define FFMPEG_MUX "obs-ffmpeg-mux.exe"
 #else
@@ -264,6 +324,327 @@ static inline void start_pipe(struct ffmpeg_muxer *stream, const char *path)
 	dstr_free(&cmd);
 }
 
+/* ------------------------------------------------------------------------ */
+/* in-process muxing                                                        */
+
+/* the same parameters the helper gets on its command line */
+static void build_mux_params(struct ffmpeg_muxer *stream, const char *path)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	struct main_params *params = &stream->params;
+	audio_t *audio = obs_get_audio();
+
+	memset(params, 0, sizeof(*params));
+	memset(stream->audio, 0, sizeof(stream->audio));
+
+	dstr_copy(&stream->mux_path, path);
+	params->file = stream->mux_path.array;
+
+	if (vencoder) {
+		obs_data_t *vsettings = obs_encoder_get_settings(vencoder);
+		const struct video_output_info *info =
+			video_output_get_info(obs_get_video());
+
+		params->has_video = 1;
+		params->vcodec = (char *)obs_encoder_get_codec(vencoder);
+		params->vbitrate = (int)obs_data_get_int(vsettings, "bitrate");
+		params->width = (int)obs_output_get_width(stream->output);
+		params->height = (int)obs_output_get_height(stream->output);
+		params->fps_num = (int)info->fps_num;
+		params->fps_den = (int)info->fps_den;
+
+		obs_data_release(vsettings);
+	}
+
+	for (int i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(stream->output, i);
+		struct audio_params *ap = &stream->audio[i];
+		obs_data_t *asettings;
+
+		if (!aencoder)
+			break;
+
+		asettings = obs_encoder_get_settings(aencoder);
+		dstr_copy(&stream->audio_names[i],
+			  obs_encoder_get_name(aencoder));
+
+		ap->name = stream->audio_names[i].array;
+		ap->abitrate = (int)obs_data_get_int(asettings, "bitrate");
+		ap->sample_rate = (int)obs_encoder_get_sample_rate(aencoder);
+		ap->channels = (int)audio_output_get_channels(audio);
+		params->tracks++;
+
+		obs_data_release(asettings);
+	}
+
+	if (params->tracks)
+		params->acodec = "aac";
+
+	dstr_copy(&stream->mux_settings,
+		  obs_data_get_string(settings, "muxer_settings"));
+	log_muxer_params(stream, stream->mux_settings.array);
+	params->muxer_settings = stream->mux_settings.array
+					 ? stream->mux_settings.array
+					 : "";
+
+	obs_data_release(settings);
+}
+
+struct mux_packet {
+	struct encoder_packet packet;
+	struct ffm_packet_info info;
+	uint64_t queued_ns;
+};
+
+static inline bool mux_failed(struct ffmpeg_muxer *stream)
+{
+	return os_atomic_load_bool(&stream->mux_failed);
+}
+
+static void *write_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	int ret;
+
+	os_set_thread_name("ffmpeg-mux: write thread");
+
+	ret = ffm_open(stream->mux);
+	if (ret != FFM_SUCCESS) {
+		stream->mux_ret = ret;
+		os_atomic_set_bool(&stream->mux_failed, true);
+		os_event_signal(stream->queue_space);
+	}
+
+	for (;;) {
+		struct mux_packet mp;
+		uint64_t start, end;
+
+		os_sem_wait(stream->queue_sem);
+
+		/* posted without a packet: stop */
+		pthread_mutex_lock(&stream->queue_mutex);
+		if (!stream->queue.size) {
+			pthread_mutex_unlock(&stream->queue_mutex);
+			break;
+		}
+
+		circlebuf_pop_front(&stream->queue, &mp, sizeof(mp));
+		stream->queue_bytes -= mp.packet.size;
+		pthread_mutex_unlock(&stream->queue_mutex);
+
+		os_event_signal(stream->queue_space);
+
+		if (mux_failed(stream)) {
+			obs_encoder_packet_release(&mp.packet);
+			continue;
+		}
+
+		start = os_gettime_ns();
+		bool success = ffm_write(stream->mux, mp.packet.data, &mp.info);
+		end = os_gettime_ns();
+
+		pthread_mutex_lock(&stream->queue_mutex);
+		struct mux_stats *stats = &stream->stats;
+		if (!success && !stats->write_errors++)
+			warn("Failed to write a packet to '%s'",
+			     stream->mux_path.array);
+		stats->packets++;
+		stats->write_ns += end - start;
+		if (stats->max_write_ns < end - start)
+			stats->max_write_ns = end - start;
+		stats->latency_ns += end - mp.queued_ns;
+		if (stats->max_latency_ns < end - mp.queued_ns)
+			stats->max_latency_ns = end - mp.queued_ns;
+		pthread_mutex_unlock(&stream->queue_mutex);
+
+		obs_encoder_packet_release(&mp.packet);
+	}
+
+	return NULL;
+}
+
+static bool start_write_thread(struct ffmpeg_muxer *stream)
+{
+	if (os_sem_init(&stream->queue_sem, 0) != 0)
+		return false;
+	if (os_event_init(&stream->queue_space, OS_EVENT_TYPE_AUTO) != 0)
+		return false;
+
+	stream->mux_ret = FFM_SUCCESS;
+	os_atomic_set_bool(&stream->mux_failed, false);
+
+	stream->write_thread_active =
+		pthread_create(&stream->write_thread, NULL, write_thread,
+			       stream) == 0;
+	return stream->write_thread_active;
+}
+
+/* writes whatever is still queued and the trailer, returns the FFM_ code */
+static int stop_write_thread(struct ffmpeg_muxer *stream)
+{
+	int ret = stream->mux_ret;
+
+	if (stream->write_thread_active) {
+		os_sem_post(stream->queue_sem);
+		pthread_join(stream->write_thread, NULL);
+		stream->write_thread_active = false;
+		ret = stream->mux_ret;
+	}
+
+	ffm_destroy(stream->mux);
+	stream->mux = NULL;
+
+	while (stream->queue.size) {
+		struct mux_packet mp;
+		circlebuf_pop_front(&stream->queue, &mp, sizeof(mp));
+		obs_encoder_packet_release(&mp.packet);
+	}
+	circlebuf_free(&stream->queue);
+	stream->queue_bytes = 0;
+
+	os_sem_destroy(stream->queue_sem);
+	os_event_destroy(stream->queue_space);
+	stream->queue_sem = NULL;
+	stream->queue_space = NULL;
+	return ret;
+}
+
+static void report_backpressure(struct ffmpeg_muxer *stream, size_t queued,
+				uint64_t wait_ns)
+{
+	uint64_t now = os_gettime_ns();
+	struct calldata cd;
+	uint8_t stack[128];
+
+	if (stream->stats.waits == 1)
+		warn("Muxing queue full (%d MB), the output is waiting for "
+		     "'%s' to be written",
+		     (int)(stream->max_queue_bytes / (1024 * 1024)),
+		     stream->mux_path.array);
+
+	/* at most once a second */
+	if (now - stream->last_backpressure_signal < 1000000000ULL)
+		return;
+	stream->last_backpressure_signal = now;
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_ptr(&cd, "output", stream->output);
+	calldata_set_int(&cd, "queued_bytes", (long long)queued);
+	calldata_set_float(&cd, "wait_ms", (double)wait_ns / 1000000.0);
+	signal_handler_signal(obs_output_get_signal_handler(stream->output),
+			      "mux_backpressure", &cd);
+}
+
+/* queues a reference to the packet, waiting for room if the queue is full */
+static bool queue_packet(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *packet,
+			 const struct ffm_packet_info *info)
+{
+	struct mux_packet mp = {.info = *info};
+	uint64_t wait_start = 0;
+	uint64_t wait_ns = 0;
+	size_t queued;
+
+	pthread_mutex_lock(&stream->queue_mutex);
+
+	while (stream->queue_bytes &&
+	       stream->queue_bytes + packet->size > stream->max_queue_bytes &&
+	       !mux_failed(stream)) {
+		pthread_mutex_unlock(&stream->queue_mutex);
+		if (!wait_start)
+			wait_start = os_gettime_ns();
+		os_event_wait(stream->queue_space);
+		pthread_mutex_lock(&stream->queue_mutex);
+	}
+
+	if (mux_failed(stream)) {
+		pthread_mutex_unlock(&stream->queue_mutex);
+		return false;
+	}
+
+	obs_encoder_packet_ref(&mp.packet, packet);
+	mp.queued_ns = os_gettime_ns();
+	circlebuf_push_back(&stream->queue, &mp, sizeof(mp));
+	stream->queue_bytes += packet->size;
+	queued = stream->queue_bytes;
+
+	if (stream->stats.max_queued_bytes < queued)
+		stream->stats.max_queued_bytes = queued;
+
+	if (wait_start) {
+		wait_ns = mp.queued_ns - wait_start;
+		stream->stats.waits++;
+		stream->stats.wait_ns += wait_ns;
+	}
+
+	pthread_mutex_unlock(&stream->queue_mutex);
+
+	os_sem_post(stream->queue_sem);
+
+	if (wait_start)
+		report_backpressure(stream, queued, wait_ns);
+	return true;
+}
+
+static inline double avg_ms(uint64_t total_ns, uint64_t count)
+{
+	return count ? (double)total_ns / (double)count / 1000000.0 : 0.0;
+}
+
+static void log_mux_stats(struct ffmpeg_muxer *stream)
+{
+	struct mux_stats *stats = &stream->stats;
+
+	if (!stats->packets)
+		return;
+
+	info("Wrote %llu packets %s: write latency avg %.2f ms, max %.2f ms",
+	     (unsigned long long)stats->packets,
+	     stream->in_process ? "in process" : "to the helper process",
+	     avg_ms(stats->write_ns, stats->packets),
+	     (double)stats->max_write_ns / 1000000.0);
+
+	if (stream->in_process)
+		info("Queue latency avg %.2f ms, max %.2f ms, at most %d KB "
+		     "queued, waited for room %llu times (%.1f ms)",
+		     avg_ms(stats->latency_ns, stats->packets),
+		     (double)stats->max_latency_ns / 1000000.0,
+		     (int)(stats->max_queued_bytes / 1024),
+		     (unsigned long long)stats->waits,
+		     (double)stats->wait_ns / 1000000.0);
+}
+
+static void get_mux_stats(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+	struct mux_stats stats;
+	size_t queued;
+
+	pthread_mutex_lock(&stream->queue_mutex);
+	stats = stream->stats;
+	queued = stream->queue_bytes;
+	pthread_mutex_unlock(&stream->queue_mutex);
+
+	calldata_set_bool(cd, "in_process", stream->in_process);
+	calldata_set_int(cd, "packets", (long long)stats.packets);
+	calldata_set_int(cd, "queued_bytes", (long long)queued);
+	calldata_set_int(cd, "backpressure_waits", (long long)stats.waits);
+	calldata_set_float(cd, "backpressure_ms",
+			   (double)stats.wait_ns / 1000000.0);
+	calldata_set_float(cd, "write_latency_avg_ms",
+			   avg_ms(stats.write_ns, stats.packets));
+	calldata_set_float(cd, "write_latency_max_ms",
+			   (double)stats.max_write_ns / 1000000.0);
+	calldata_set_float(cd, "queue_latency_avg_ms",
+			   avg_ms(stats.latency_ns, stats.packets));
+	calldata_set_float(cd, "queue_latency_max_ms",
+			   (double)stats.max_latency_ns / 1000000.0);
+}
+
+/* ------------------------------------------------------------------------ */
+
 static bool ffmpeg_mux_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -305,10 +686,22 @@ static bool ffmpeg_mux_start(void *data)
 	fclose(test_file);
 	os_unlink(path);
 
-	start_pipe(stream, path);
+	stream->in_process = obs_data_get_bool(settings, "in_process");
+	stream->max_queue_bytes =
+		(size_t)obs_data_get_int(settings, "mux_queue_size_mb") * 1024 *
+		1024;
+	memset(&stream->stats, 0, sizeof(stream->stats));
+
+	if (stream->in_process) {
+		/* the muxer is opened once the encoders' headers are known */
+		build_mux_params(stream, path);
+		dstr_copy(&stream->path, path);
+	} else {
+		start_pipe(stream, path);
+	}
 	obs_data_release(settings);
 
-	if (!stream->pipe) {
+	if (!stream->in_process && !stream->pipe) {
 		obs_output_set_last_error(
 			stream->output, obs_module_text("HelperProcessFailed"));
 		warn("Failed to create process pipe");
@@ -330,13 +723,18 @@ static int deactivate(struct ffmpeg_muxer *stream, int code)
 	int ret = -1;
 
 	if (active(stream)) {
-		ret = os_process_pipe_destroy(stream->pipe);
-		stream->pipe = NULL;
+		if (stream->in_process) {
+			ret = stop_write_thread(stream);
+		} else {
+			ret = os_process_pipe_destroy(stream->pipe);
+			stream->pipe = NULL;
+		}
 
 		os_atomic_set_bool(&stream->active, false);
 		os_atomic_set_bool(&stream->sent_headers, false);
 
 		info("Output of file '%s' stopped", stream->path.array);
+		log_mux_stats(stream);
 	}
 
 	if (code) {
@@ -368,8 +766,17 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 
 	size_t len;
 
-	len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
-				       sizeof(error) - 1);
+	if (stream->in_process) {
+		const char *mux_error = stream->mux ? ffm_get_error(stream->mux)
+						    : "";
+		len = strlen(mux_error);
+		if (len > sizeof(error) - 1)
+			len = sizeof(error) - 1;
+		memcpy(error, mux_error, len);
+	} else {
+		len = os_process_pipe_read_err(stream->pipe, (uint8_t *)error,
+					       sizeof(error) - 1);
+	}
 
 	if (len > 0) {
 		error[len] = 0;
@@ -404,6 +811,20 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 				       .type = is_video ? FFM_PACKET_VIDEO
 							: FFM_PACKET_AUDIO,
 				       .keyframe = packet->keyframe};
+	uint64_t start;
+
+	if (stream->in_process) {
+		if (!queue_packet(stream, packet, &info)) {
+			warn("Muxer failed, could not queue packet");
+			signal_failure(stream);
+			return false;
+		}
+
+		stream->total_bytes += packet->size;
+		return true;
+	}
+
+	start = os_gettime_ns();
 
 	ret = os_process_pipe_write(stream->pipe, (const uint8_t *)&info,
 				    sizeof(info));
@@ -420,10 +841,39 @@ static bool write_packet(struct ffmpeg_muxer *stream,
 		return false;
 	}
 
+	uint64_t write_ns = os_gettime_ns() - start;
+
+	pthread_mutex_lock(&stream->queue_mutex);
+	stream->stats.packets++;
+	stream->stats.write_ns += write_ns;
+	if (stream->stats.max_write_ns < write_ns)
+		stream->stats.max_write_ns = write_ns;
+	pthread_mutex_unlock(&stream->queue_mutex);
+
 	stream->total_bytes += packet->size;
 	return true;
 }
 
+/* headers go to the helper like packets, or straight to the muxer before
+ * it's opened on the write thread */
+static bool write_header(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *packet)
+{
+	if (stream->in_process) {
+		struct ffm_packet_info info = {
+			.size = (uint32_t)packet->size,
+			.index = (int)packet->track_idx,
+			.type = packet->type == OBS_ENCODER_VIDEO
+					? FFM_PACKET_VIDEO
+					: FFM_PACKET_AUDIO};
+
+		ffm_set_header(stream->mux, packet->data, &info);
+		return true;
+	}
+
+	return write_packet(stream, packet);
+}
+
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 			       obs_encoder_t *aencoder, size_t idx)
 {
@@ -431,7 +881,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 		.type = OBS_ENCODER_AUDIO, .timebase_den = 1, .track_idx = idx};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_header(stream, &packet);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -442,7 +892,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 					.timebase_den = 1};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return write_header(stream, &packet);
 }
 
 static bool send_headers(struct ffmpeg_muxer *stream)
@@ -450,6 +900,9 @@ static bool send_headers(struct ffmpeg_muxer *stream)
 	obs_encoder_t *aencoder;
 	size_t idx = 0;
 
+	if (stream->in_process)
+		stream->mux = ffm_create(&stream->params, stream->audio);
+
 	if (!send_video_headers(stream))
 		return false;
 
@@ -463,6 +916,12 @@ static bool send_headers(struct ffmpeg_muxer *stream)
 		}
 	} while (aencoder);
 
+	if (stream->in_process && !start_write_thread(stream)) {
+		warn("Failed to start the write thread");
+		signal_failure(stream);
+		return false;
+	}
+
 	return true;
 }
 
@@ -496,6 +955,12 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 	write_packet(stream, packet);
 }
 
+static void ffmpeg_mux_defaults(obs_data_t *s)
+{
+	obs_data_set_default_bool(s, "in_process", false);
+	obs_data_set_default_int(s, "mux_queue_size_mb", 64);
+}
+
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
@@ -504,6 +969,11 @@ static obs_properties_t *ffmpeg_mux_properties(void *unused)
 
 	obs_properties_add_text(props, "path", obs_module_text("FilePath"),
 				OBS_TEXT_DEFAULT);
+	obs_properties_add_bool(props, "in_process",
+				obs_module_text("FFmpegMuxer.InProcess"));
+	obs_properties_add_int(props, "mux_queue_size_mb",
+			       obs_module_text("FFmpegMuxer.QueueSize"), 1,
+			       1024, 1);
 	return props;
 }
 
@@ -524,6 +994,7 @@ struct obs_output_info ffmpeg_muxer = {
 	.stop = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes = ffmpeg_mux_total_bytes,
+	.get_defaults = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties,
 };
 
@@ -575,8 +1046,9 @@ static void get_last_replay(void *data, calldata_t *cd)
 static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 {
 	UNUSED_PARAMETER(settings);
-	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
-	stream->output = output;
+	struct ffmpeg_muxer *stream = create_muxer(output);
+	if (!stream)
+		return NULL;
 
 	stream->hotkey =
 		obs_hotkey_register_output(output, "ReplayBuffer.Save",
@@ -609,10 +1081,16 @@ static bool replay_buffer_start(void *data)
 		return false;
 
 	obs_data_t *s = obs_output_get_settings(stream->output);
-	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
-	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+	stream->store = replay_store_create(
+		obs_data_get_int(s, "max_time_sec") * 1000000LL,
+		obs_data_get_int(s, "max_size_mb") * (1024 * 1024),
+		obs_data_get_int(s, "max_memory_sec") * 1000000LL,
+		obs_data_get_string(s, "spill_directory"));
 	obs_data_release(s);
 
+	if (!stream->store)
+		return false;
+
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
 	stream->total_bytes = 0;
@@ -621,98 +1099,6 @@ static bool replay_buffer_start(void *data)
 	return true;
 }
 
-static bool purge_front(struct ffmpeg_muxer *stream)
-{
-	struct encoder_packet pkt;
-	bool keyframe;
-
-	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
-
-	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
-
-	if (keyframe)
-		stream->keyframes--;
-
-	if (!stream->packets.size) {
-		stream->cur_size = 0;
-		stream->cur_time = 0;
-	} else {
-		struct encoder_packet first;
-		circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-		stream->cur_time = first.dts_usec;
-		stream->cur_size -= (int64_t)pkt.size;
-	}
-
-	obs_encoder_packet_release(&pkt);
-	return keyframe;
-}
-
-static inline void purge(struct ffmpeg_muxer *stream)
-{
-	if (purge_front(stream)) {
-		struct encoder_packet pkt;
-
-		for (;;) {
-			circlebuf_peek_front(&stream->packets, &pkt,
-					     sizeof(pkt));
-			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
-				return;
-
-			purge_front(stream);
-		}
-	}
-}
-
-static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
-				       struct encoder_packet *pkt)
-{
-	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
-			return;
-
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
-			purge(stream);
-	}
-
-	if (!stream->packets.size || stream->keyframes <= 2)
-		return;
-
-	while ((pkt->dts_usec - stream->cur_time) > stream->max_time)
-		purge(stream);
-}
-
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
-{
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
-
-	obs_encoder_packet_ref(&pkt, packet);
-
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_dts_offset;
-		pkt.pts -= video_dts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
-	}
-
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
-	}
-
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
-}
-
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -730,61 +1116,32 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
-	}
+	struct encoder_packet pkt;
+	while (replay_snapshot_next(stream->snapshot, &pkt))
+		write_packet(stream, &pkt);
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
 	os_process_pipe_destroy(stream->pipe);
 	stream->pipe = NULL;
-	da_free(stream->mux_packets);
+	replay_snapshot_destroy(stream->snapshot);
+	stream->snapshot = NULL;
 	os_atomic_set_bool(&stream->muxing, false);
 	return NULL;
 }
 
 static void replay_buffer_save(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
+	int64_t mem_size, disk_size;
 
-	da_reserve(stream->mux_packets, num_packets);
+	stream->snapshot = replay_store_snapshot(stream->store);
 
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_dts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_offset = pkt->dts_usec;
-				video_dts_offset = pkt->dts;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
-
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_dts_offset,
-			      audio_dts_offsets);
-	}
+	replay_store_get_size(stream->store, &mem_size, &disk_size);
+	if (disk_size)
+		info("Saving replay buffer, %d MB in memory and %d MB on disk",
+		     (int)(mem_size / (1024 * 1024)),
+		     (int)(disk_size / (1024 * 1024)));
 
 	/* ---------------------------- */
 	/* generate filename */
@@ -831,7 +1188,6 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
-	struct encoder_packet pkt;
 
 	if (!active(stream))
 		return;
@@ -849,17 +1205,7 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
-
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
-
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
-
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+	replay_store_push(stream->store, packet);
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
@@ -879,6 +1225,8 @@ static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	obs_data_set_default_int(s, "max_memory_sec", 0);
+	obs_data_set_default_string(s, "spill_directory", "");
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
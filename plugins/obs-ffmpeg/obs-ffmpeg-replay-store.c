@@ -0,0 +1,686 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "obs-ffmpeg-replay-store.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[replay buffer store] " format, ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+
+#define REPLAY_TRACKS (1 + MAX_AUDIO_MIXES)
+
+/* ------------------------------------------------------------------------ */
+/* temporary file mappings                                                  */
+
+struct replay_map {
+	uint8_t *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+static void replay_map_destroy(struct replay_map *map)
+{
+	if (!map)
+		return;
+
+#ifdef _WIN32
+	if (map->data)
+		UnmapViewOfFile(map->data);
+	if (map->mapping)
+		CloseHandle(map->mapping);
+	if (map->file != INVALID_HANDLE_VALUE)
+		CloseHandle(map->file);
+#else
+	if (map->data)
+		munmap(map->data, map->size);
+#endif
+
+	bfree(map);
+}
+
+#ifdef _WIN32
+static bool write_all(HANDLE file, const uint8_t *data, size_t size)
+{
+	while (size) {
+		DWORD chunk = size > 0x40000000 ? 0x40000000 : (DWORD)size;
+		DWORD written = 0;
+
+		if (!WriteFile(file, data, chunk, &written, NULL) || !written)
+			return false;
+
+		data += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+/* the file is deleted once the mapping is closed */
+static struct replay_map *replay_map_create(const char *dir,
+					    struct encoder_packet *packets,
+					    size_t num, size_t size)
+{
+	struct replay_map *map = bzalloc(sizeof(*map));
+	wchar_t *wdir = NULL;
+	wchar_t path[MAX_PATH];
+
+	map->file = INVALID_HANDLE_VALUE;
+	map->size = size;
+
+	os_utf8_to_wcs_ptr(dir, 0, &wdir);
+	if (!wdir || !GetTempFileNameW(wdir, L"obs", 0, path)) {
+		bfree(wdir);
+		goto fail;
+	}
+	bfree(wdir);
+
+	map->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				CREATE_ALWAYS,
+				FILE_ATTRIBUTE_TEMPORARY |
+					FILE_FLAG_DELETE_ON_CLOSE,
+				NULL);
+	if (map->file == INVALID_HANDLE_VALUE) {
+		DeleteFileW(path);
+		goto fail;
+	}
+
+	for (size_t i = 0; i < num; i++) {
+		if (!write_all(map->file, packets[i].data, packets[i].size))
+			goto fail;
+	}
+
+	map->mapping = CreateFileMappingW(map->file, NULL, PAGE_READONLY, 0, 0,
+					  NULL);
+	if (!map->mapping)
+		goto fail;
+
+	map->data = MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!map->data)
+		goto fail;
+
+	return map;
+
+fail:
+	replay_map_destroy(map);
+	return NULL;
+}
+
+static void get_temp_dir(struct dstr *dir)
+{
+	wchar_t path[MAX_PATH + 1];
+	char *utf8 = NULL;
+
+	if (GetTempPathW(MAX_PATH + 1, path)) {
+		os_wcs_to_utf8_ptr(path, 0, &utf8);
+		dstr_copy(dir, utf8);
+		bfree(utf8);
+	}
+}
+#else
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+	while (size) {
+		ssize_t written = write(fd, data, size);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			return false;
+
+		data += written;
+		size -= (size_t)written;
+	}
+
+	return true;
+}
+
+/* the file is unlinked right away, the mapping keeps it alive */
+static struct replay_map *replay_map_create(const char *dir,
+					    struct encoder_packet *packets,
+					    size_t num, size_t size)
+{
+	struct replay_map *map = bzalloc(sizeof(*map));
+	struct dstr path = {0};
+	void *data;
+	int fd;
+
+	map->size = size;
+
+	dstr_printf(&path, "%s/obs-replay-XXXXXX", dir);
+	fd = mkstemp(path.array);
+	if (fd != -1)
+		unlink(path.array);
+	dstr_free(&path);
+
+	if (fd == -1)
+		goto fail;
+
+	for (size_t i = 0; i < num; i++) {
+		if (!write_all(fd, packets[i].data, packets[i].size)) {
+			close(fd);
+			goto fail;
+		}
+	}
+
+	data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		goto fail;
+
+	map->data = data;
+	return map;
+
+fail:
+	replay_map_destroy(map);
+	return NULL;
+}
+
+static void get_temp_dir(struct dstr *dir)
+{
+	const char *tmp = getenv("TMPDIR");
+	dstr_copy(dir, tmp && *tmp ? tmp : "/tmp");
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* segments                                                                 */
+
+struct replay_segment {
+	volatile long refs;
+	DARRAY(struct encoder_packet) packets;
+
+	int64_t start_dts_usec;
+	int64_t end_dts_usec;
+	int64_t size;
+
+	/* starts on a video keyframe, only the first segment may not */
+	bool keyframe;
+
+	/* dropped from the store */
+	bool purged;
+
+	/* once spilled, the packets point into the mapping */
+	struct replay_map *map;
+};
+
+static struct replay_segment *segment_create(bool keyframe)
+{
+	struct replay_segment *seg = bzalloc(sizeof(*seg));
+	seg->refs = 1;
+	seg->keyframe = keyframe;
+	return seg;
+}
+
+static inline void segment_addref(struct replay_segment *seg)
+{
+	os_atomic_inc_long(&seg->refs);
+}
+
+static void segment_release(struct replay_segment *seg)
+{
+	if (!seg || os_atomic_dec_long(&seg->refs) != 0)
+		return;
+
+	if (seg->map) {
+		replay_map_destroy(seg->map);
+	} else {
+		for (size_t i = 0; i < seg->packets.num; i++)
+			obs_encoder_packet_release(&seg->packets.array[i]);
+	}
+
+	da_free(seg->packets);
+	bfree(seg);
+}
+
+static inline void segment_push(struct replay_segment *seg,
+				struct encoder_packet *packet)
+{
+	struct encoder_packet *pkt = da_push_back_new(seg->packets);
+	obs_encoder_packet_ref(pkt, packet);
+
+	if (seg->packets.num == 1)
+		seg->start_dts_usec = packet->dts_usec;
+	seg->end_dts_usec = packet->dts_usec;
+	seg->size += (int64_t)packet->size;
+}
+
+/* ------------------------------------------------------------------------ */
+/* store                                                                    */
+
+struct replay_store {
+	pthread_mutex_t mutex;
+
+	/* oldest first, packets are only added to the last one */
+	DARRAY(struct replay_segment *) segments;
+	int keyframes;
+	int64_t size;
+	int64_t mem_size;
+	int64_t newest_dts_usec;
+
+	int64_t max_time;
+	int64_t max_size;
+	int64_t mem_time;
+
+	struct dstr spill_dir;
+	pthread_t spill_thread;
+	bool spill_thread_active;
+	os_sem_t *spill_sem;
+	volatile bool stop;
+	bool spill_failed;
+};
+
+static inline bool can_spill(struct replay_store *store,
+			     struct replay_segment *seg)
+{
+	/* segments in a snapshot are left alone until it's done with them */
+	return !seg->map && seg->size && seg->refs == 1 &&
+	       store->newest_dts_usec - seg->end_dts_usec > store->mem_time;
+}
+
+static struct replay_segment *next_spill(struct replay_store *store)
+{
+	struct replay_segment *seg = NULL;
+
+	pthread_mutex_lock(&store->mutex);
+
+	if (!store->spill_failed && store->segments.num) {
+		for (size_t i = 0; i < store->segments.num - 1; i++) {
+			if (can_spill(store, store->segments.array[i])) {
+				seg = store->segments.array[i];
+				segment_addref(seg);
+				break;
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&store->mutex);
+	return seg;
+}
+
+static void spill(struct replay_store *store, struct replay_segment *seg)
+{
+	struct replay_map *map;
+	bool swapped = false;
+
+	/* a segment the store no longer adds to doesn't change until it's
+	 * spilled, so it can be written out without holding the lock */
+	map = replay_map_create(store->spill_dir.array, seg->packets.array,
+				seg->packets.num, (size_t)seg->size);
+
+	pthread_mutex_lock(&store->mutex);
+
+	if (!map) {
+		warn("Failed to spill the replay buffer to '%s', keeping it "
+		     "in memory",
+		     store->spill_dir.array);
+		store->spill_failed = true;
+
+	} else if (!seg->purged && seg->refs == 2) {
+		uint8_t *data = map->data;
+
+		for (size_t i = 0; i < seg->packets.num; i++) {
+			struct encoder_packet *pkt = &seg->packets.array[i];
+			struct encoder_packet ref = *pkt;
+
+			obs_encoder_packet_release(&ref);
+			pkt->data = data;
+			data += pkt->size;
+		}
+
+		seg->map = map;
+		store->mem_size -= seg->size;
+		swapped = true;
+	}
+
+	pthread_mutex_unlock(&store->mutex);
+
+	if (!swapped)
+		replay_map_destroy(map);
+	segment_release(seg);
+}
+
+static void *spill_thread(void *data)
+{
+	struct replay_store *store = data;
+
+	os_set_thread_name("replay buffer: spill thread");
+
+	while (os_sem_wait(store->spill_sem) == 0) {
+		struct replay_segment *seg;
+
+		if (os_atomic_load_bool(&store->stop))
+			break;
+
+		while ((seg = next_spill(store)) != NULL) {
+			spill(store, seg);
+
+			if (os_atomic_load_bool(&store->stop))
+				break;
+		}
+	}
+
+	return NULL;
+}
+
+struct replay_store *replay_store_create(int64_t max_time_usec,
+					 int64_t max_size,
+					 int64_t mem_time_usec,
+					 const char *spill_dir)
+{
+	struct replay_store *store = bzalloc(sizeof(*store));
+
+	store->max_time = max_time_usec;
+	store->max_size = max_size;
+	store->mem_time = mem_time_usec;
+
+	pthread_mutex_init_value(&store->mutex);
+	if (pthread_mutex_init(&store->mutex, NULL) != 0) {
+		bfree(store);
+		return NULL;
+	}
+
+	if (!mem_time_usec || mem_time_usec >= max_time_usec)
+		return store;
+
+	if (spill_dir && *spill_dir)
+		dstr_copy(&store->spill_dir, spill_dir);
+	else
+		get_temp_dir(&store->spill_dir);
+
+	if (dstr_is_empty(&store->spill_dir)) {
+		warn("No temporary directory, keeping the replay buffer in "
+		     "memory");
+		return store;
+	}
+
+	if (os_sem_init(&store->spill_sem, 0) == 0)
+		store->spill_thread_active =
+			pthread_create(&store->spill_thread, NULL,
+				       spill_thread, store) == 0;
+
+	if (!store->spill_thread_active)
+		warn("Failed to create the spill thread, keeping the replay "
+		     "buffer in memory");
+
+	return store;
+}
+
+void replay_store_destroy(struct replay_store *store)
+{
+	if (!store)
+		return;
+
+	if (store->spill_thread_active) {
+		os_atomic_set_bool(&store->stop, true);
+		os_sem_post(store->spill_sem);
+		pthread_join(store->spill_thread, NULL);
+	}
+
+	for (size_t i = 0; i < store->segments.num; i++) {
+		store->segments.array[i]->purged = true;
+		segment_release(store->segments.array[i]);
+	}
+	da_free(store->segments);
+
+	os_sem_destroy(store->spill_sem);
+	pthread_mutex_destroy(&store->mutex);
+	dstr_free(&store->spill_dir);
+	bfree(store);
+}
+
+static void purge_front(struct replay_store *store)
+{
+	struct replay_segment *seg = store->segments.array[0];
+
+	da_erase(store->segments, 0);
+
+	store->size -= seg->size;
+	if (!seg->map)
+		store->mem_size -= seg->size;
+	if (seg->keyframe)
+		store->keyframes--;
+
+	seg->purged = true;
+	segment_release(seg);
+}
+
+/* trims whole segments, always keeping the last two keyframes */
+static void purge(struct replay_store *store, struct encoder_packet *pkt)
+{
+	if (store->max_size) {
+		while (store->keyframes > 2 &&
+		       store->size + (int64_t)pkt->size > store->max_size)
+			purge_front(store);
+	}
+
+	while (store->keyframes > 2 &&
+	       pkt->dts_usec - store->segments.array[0]->start_dts_usec >
+		       store->max_time)
+		purge_front(store);
+}
+
+void replay_store_push(struct replay_store *store,
+		       struct encoder_packet *packet)
+{
+	bool keyframe = packet->type == OBS_ENCODER_VIDEO && packet->keyframe;
+	bool sealed = false;
+
+	pthread_mutex_lock(&store->mutex);
+
+	purge(store, packet);
+
+	if (keyframe || !store->segments.num) {
+		struct replay_segment *seg = segment_create(keyframe);
+		sealed = store->segments.num > 0;
+
+		da_push_back(store->segments, &seg);
+		if (keyframe)
+			store->keyframes++;
+	}
+
+	segment_push(store->segments.array[store->segments.num - 1], packet);
+
+	store->size += (int64_t)packet->size;
+	store->mem_size += (int64_t)packet->size;
+	if (store->newest_dts_usec < packet->dts_usec)
+		store->newest_dts_usec = packet->dts_usec;
+
+	pthread_mutex_unlock(&store->mutex);
+
+	if (sealed && store->spill_thread_active)
+		os_sem_post(store->spill_sem);
+}
+
+void replay_store_get_size(struct replay_store *store, int64_t *mem_size,
+			   int64_t *disk_size)
+{
+	pthread_mutex_lock(&store->mutex);
+	*mem_size = store->mem_size;
+	*disk_size = store->size - store->mem_size;
+	pthread_mutex_unlock(&store->mutex);
+}
+
+/* ------------------------------------------------------------------------ */
+/* snapshots                                                                */
+
+struct replay_cursor {
+	size_t seg;
+	size_t idx;
+};
+
+struct replay_snapshot {
+	DARRAY(struct replay_segment *) segments;
+
+	/* next packet of each track */
+	struct replay_cursor cursors[REPLAY_TRACKS];
+	int64_t dts_usec_offsets[REPLAY_TRACKS];
+	int64_t dts_offsets[REPLAY_TRACKS];
+};
+
+static inline size_t track_of(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : 1 + packet->track_idx;
+}
+
+static inline struct encoder_packet *
+cursor_packet(struct replay_snapshot *snapshot, size_t track)
+{
+	struct replay_cursor *cursor = &snapshot->cursors[track];
+
+	if (cursor->seg == snapshot->segments.num)
+		return NULL;
+	return &snapshot->segments.array[cursor->seg]->packets.array[cursor->idx];
+}
+
+/* moves a track's cursor to its first packet at or after seg/idx */
+static void cursor_seek(struct replay_snapshot *snapshot, size_t track,
+			size_t seg, size_t idx)
+{
+	for (; seg < snapshot->segments.num; seg++, idx = 0) {
+		struct replay_segment *s = snapshot->segments.array[seg];
+
+		for (; idx < s->packets.num; idx++) {
+			if (track_of(&s->packets.array[idx]) == track) {
+				snapshot->cursors[track].seg = seg;
+				snapshot->cursors[track].idx = idx;
+				return;
+			}
+		}
+	}
+
+	snapshot->cursors[track].seg = snapshot->segments.num;
+	snapshot->cursors[track].idx = 0;
+}
+
+struct replay_snapshot *replay_store_snapshot(struct replay_store *store)
+{
+	struct replay_snapshot *snapshot = bzalloc(sizeof(*snapshot));
+	struct replay_segment *open = NULL;
+
+	pthread_mutex_lock(&store->mutex);
+
+	da_reserve(snapshot->segments, store->segments.num);
+
+	for (size_t i = 0; i < store->segments.num; i++) {
+		struct replay_segment *seg = store->segments.array[i];
+
+		/* the store keeps adding to the last segment, so that one is
+		 * referenced packet by packet instead */
+		if (i == store->segments.num - 1) {
+			open = segment_create(seg->keyframe);
+			da_reserve(open->packets, seg->packets.num);
+
+			for (size_t j = 0; j < seg->packets.num; j++)
+				segment_push(open, &seg->packets.array[j]);
+			seg = open;
+		} else {
+			segment_addref(seg);
+		}
+
+		da_push_back(snapshot->segments, &seg);
+	}
+
+	pthread_mutex_unlock(&store->mutex);
+
+	for (size_t i = 0; i < REPLAY_TRACKS; i++) {
+		struct encoder_packet *first;
+
+		cursor_seek(snapshot, i, 0, 0);
+
+		first = cursor_packet(snapshot, i);
+		if (first) {
+			snapshot->dts_usec_offsets[i] = first->dts_usec;
+			snapshot->dts_offsets[i] = first->dts;
+		}
+	}
+
+	return snapshot;
+}
+
+static inline bool cursor_after(const struct replay_cursor *a,
+				const struct replay_cursor *b)
+{
+	return a->seg != b->seg ? a->seg > b->seg : a->idx > b->idx;
+}
+
+/* merges the tracks by dts, later packets first on equal dts like the
+ * insertion into the save array used to */
+bool replay_snapshot_next(struct replay_snapshot *snapshot,
+			  struct encoder_packet *packet)
+{
+	size_t best = REPLAY_TRACKS;
+	int64_t best_dts = 0;
+
+	for (size_t i = 0; i < REPLAY_TRACKS; i++) {
+		struct encoder_packet *pkt = cursor_packet(snapshot, i);
+		int64_t dts;
+
+		if (!pkt)
+			continue;
+
+		dts = pkt->dts_usec - snapshot->dts_usec_offsets[i];
+		if (best == REPLAY_TRACKS || dts < best_dts ||
+		    (dts == best_dts && cursor_after(&snapshot->cursors[i],
+						     &snapshot->cursors[best]))) {
+			best = i;
+			best_dts = dts;
+		}
+	}
+
+	if (best == REPLAY_TRACKS)
+		return false;
+
+	*packet = *cursor_packet(snapshot, best);
+	packet->dts_usec -= snapshot->dts_usec_offsets[best];
+	packet->dts -= snapshot->dts_offsets[best];
+	packet->pts -= snapshot->dts_offsets[best];
+
+	cursor_seek(snapshot, best, snapshot->cursors[best].seg,
+		    snapshot->cursors[best].idx + 1);
+	return true;
+}
+
+void replay_snapshot_destroy(struct replay_snapshot *snapshot)
+{
+	if (!snapshot)
+		return;
+
+	for (size_t i = 0; i < snapshot->segments.num; i++)
+		segment_release(snapshot->segments.array[i]);
+
+	da_free(snapshot->segments);
+	bfree(snapshot);
+}
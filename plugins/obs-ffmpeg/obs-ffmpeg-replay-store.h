@@ -0,0 +1,59 @@
+/******************************************************************************
+    Copyright (C) 2020 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+
+/*
+ * Packet store of the replay buffer.
+ *
+ * Packets are kept in segments that each start on a video keyframe, and the
+ * buffer is trimmed a whole segment at a time.  When mem_time is set, the
+ * segments that ended more than mem_time ago are written out to a temporary
+ * file by a background thread and read back through a memory mapping, so
+ * only the newest mem_time of the buffer stays in memory.
+ *
+ * A snapshot holds on to the segments at the time it's taken and walks them
+ * in the order they are muxed in, without copying the packets.
+ */
+
+struct replay_store;
+struct replay_snapshot;
+
+/* spill_dir may be NULL or empty for the system's temporary directory */
+extern struct replay_store *replay_store_create(int64_t max_time_usec,
+						int64_t max_size,
+						int64_t mem_time_usec,
+						const char *spill_dir);
+extern void replay_store_destroy(struct replay_store *store);
+
+/* references the packet */
+extern void replay_store_push(struct replay_store *store,
+			      struct encoder_packet *packet);
+
+/* payload bytes in memory and spilled to disk */
+extern void replay_store_get_size(struct replay_store *store,
+				  int64_t *mem_size, int64_t *disk_size);
+
+extern struct replay_snapshot *replay_store_snapshot(struct replay_store *store);
+
+/* next packet to mux, with the timestamps of each track starting at zero.
+ * the packet's data is valid until the snapshot is destroyed */
+extern bool replay_snapshot_next(struct replay_snapshot *snapshot,
+				 struct encoder_packet *packet);
+extern void replay_snapshot_destroy(struct replay_snapshot *snapshot);
@@ -0,0 +1,148 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "AdaptationController.h"
+
+#include "obs.h"
+
+#include <math.h>
+
+#define info(format, ...) blog(LOG_INFO, format, ##__VA_ARGS__)
+
+struct adaptation_level {
+    uint32_t scale_num;
+    uint32_t scale_den;
+    uint32_t frame_rate_divisor;
+};
+
+// Resolution first, then frame rate
+static const adaptation_level levels[] = {
+    {1, 1, 1},
+    {3, 4, 1},
+    {1, 2, 1},
+    {1, 2, 2},
+    {1, 4, 2},
+};
+#define NUM_LEVELS (int)(sizeof(levels) / sizeof(levels[0]))
+
+// Bitrate needed grows slower than the pixel rate
+#define PIXEL_RATE_EXPONENT 0.75
+// Step down below 90% of the needed bitrate, up above 120% of the next one
+#define DOWNGRADE_RATIO 0.9
+#define UPGRADE_RATIO 1.2
+// Consecutive stats samples needed before changing level
+#define DOWNGRADE_SAMPLES 2
+#define UPGRADE_SAMPLES 5
+// Do not go back up right after a change
+#define UPGRADE_HOLD_US (10 * 1000000LL)
+
+AdaptationController::AdaptationController()
+    : width_(0),
+      height_(0),
+      fps_(0.0),
+      bitrate_bps_(0.0),
+      low_samples_(0),
+      high_samples_(0),
+      last_change_us_(0),
+      level_(0),
+      downgrades_(0),
+      upgrades_(0)
+{
+}
+
+void AdaptationController::reset(uint32_t width, uint32_t height, double fps,
+                                 int bitrate_kbps)
+{
+    width_ = width;
+    height_ = height;
+    fps_ = fps;
+    bitrate_bps_ = (double)bitrate_kbps * 1000.0;
+    low_samples_ = 0;
+    high_samples_ = 0;
+    last_change_us_ = 0;
+    level_ = 0;
+    downgrades_ = 0;
+    upgrades_ = 0;
+}
+
+uint32_t AdaptationController::width(int level) const
+{
+    const adaptation_level &l = levels[level];
+    return (width_ * l.scale_num / l.scale_den) & ~1u;
+}
+
+uint32_t AdaptationController::height(int level) const
+{
+    const adaptation_level &l = levels[level];
+    return (height_ * l.scale_num / l.scale_den) & ~1u;
+}
+
+uint32_t AdaptationController::frameRateDivisor(int level) const
+{
+    return levels[level].frame_rate_divisor;
+}
+
+double AdaptationController::neededBitrate(int level) const
+{
+    const adaptation_level &l = levels[level];
+    double scale = (double)l.scale_num / (double)l.scale_den;
+    double pixel_rate = scale * scale / (double)l.frame_rate_divisor;
+    return bitrate_bps_ * pow(pixel_rate, PIXEL_RATE_EXPONENT);
+}
+
+bool AdaptationController::update(const WebRTCStatsSnapshot &stats)
+{
+    // No estimation yet (still connecting)
+    double target = stats.available_outgoing_bitrate;
+    if (!bitrate_bps_ || target <= 0.0)
+        return false;
+
+    int level = level_;
+    bool bandwidth_limited =
+            stats.quality_limitation == QUALITY_LIMITATION_BANDWIDTH;
+    bool low = target < neededBitrate(level) * DOWNGRADE_RATIO;
+    bool high = level > 0 && !bandwidth_limited &&
+                target > neededBitrate(level - 1) * UPGRADE_RATIO;
+
+    low_samples_ = (low || bandwidth_limited) ? low_samples_ + 1 : 0;
+    high_samples_ = high ? high_samples_ + 1 : 0;
+
+    if (low_samples_ >= DOWNGRADE_SAMPLES && level + 1 < NUM_LEVELS) {
+        setLevel(level + 1,
+                 low ? "target bitrate below what the current level needs"
+                     : "libwebrtc reports a bandwidth limitation",
+                 target);
+        last_change_us_ = stats.timestamp_us;
+        downgrades_++;
+        return true;
+    }
+
+    if (high_samples_ >= UPGRADE_SAMPLES &&
+        stats.timestamp_us - last_change_us_ >= UPGRADE_HOLD_US) {
+        setLevel(level - 1, "target bitrate recovered", target);
+        last_change_us_ = stats.timestamp_us;
+        upgrades_++;
+        return true;
+    }
+
+    return false;
+}
+
+void AdaptationController::setLevel(int level, const char *reason,
+                                    double target_bps)
+{
+    int old_level = level_;
+
+    level_ = level;
+    low_samples_ = 0;
+    high_samples_ = 0;
+
+    info("WebRTC adaptation %s: %ux%u@%.4g -> %ux%u@%.4g (%s: target "
+         "%d kbps, level %d needs %d kbps)",
+         level > old_level ? "down" : "up",
+         width(old_level), height(old_level),
+         fps_ / (double)frameRateDivisor(old_level),
+         width(level), height(level), fps_ / (double)frameRateDivisor(level),
+         reason,
+         (int)(target_bps / 1000.0), level,
+         (int)(neededBitrate(level) / 1000.0));
+}
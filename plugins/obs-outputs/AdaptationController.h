@@ -0,0 +1,65 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _ADAPTATION_CONTROLLER_H_
+#define _ADAPTATION_CONTROLLER_H_
+
+#include "StatsSampler.h"
+
+#include <atomic>
+#include <stdint.h>
+
+// Picks the video resolution and frame rate to send from the bandwidth
+// estimation, so that congested links get smaller frames instead of late
+// ones.
+//
+// Levels go from the full resolution and frame rate (0) down to a quarter
+// of the resolution at half the frame rate. Each level needs a bitrate
+// derived from the configured one; the controller steps down when the
+// target bitrate stays below what the current level needs (or libwebrtc
+// reports a bandwidth limitation), and back up only once the target
+// comfortably covers the previous level for a while.
+//
+// update() runs on the signaling thread; the current level can be read from
+// any thread.
+class AdaptationController {
+public:
+    AdaptationController();
+
+    // Start over at full quality for a stream of width x height at fps,
+    // sent at up to bitrate_kbps.
+    void reset(uint32_t width, uint32_t height, double fps, int bitrate_kbps);
+
+    // Feed a new stats snapshot. Returns true if the level changed.
+    bool update(const WebRTCStatsSnapshot &stats);
+
+    // Read the level once, then get its parameters
+    int level() const { return level_; }
+    // Resolution to send at level, even dimensions
+    uint32_t width(int level) const;
+    uint32_t height(int level) const;
+    // Send one frame out of frameRateDivisor(level)
+    uint32_t frameRateDivisor(int level) const;
+
+    uint64_t downgrades() const { return downgrades_; }
+    uint64_t upgrades() const   { return upgrades_; }
+
+private:
+    double neededBitrate(int level) const;
+    void setLevel(int level, const char *reason, double target_bps);
+
+    uint32_t width_;
+    uint32_t height_;
+    double fps_;
+    double bitrate_bps_;
+
+    // Only touched by update()
+    int low_samples_;
+    int high_samples_;
+    int64_t last_change_us_;
+
+    std::atomic<int> level_;
+    std::atomic<uint64_t> downgrades_;
+    std::atomic<uint64_t> upgrades_;
+};
+
+#endif
@@ -5,9 +5,16 @@
 #include "obs.h"
 #include "media-io/audio-io.h"
 
-AudioDeviceModuleWrapper::AudioDeviceModuleWrapper() : _initialized(false)
+#include <algorithm>
+
+AudioDeviceModuleWrapper::AudioDeviceModuleWrapper()
+    : _initialized(false),
+      audioTransport(nullptr),
+      sampleRate(48000),
+      channels(2),
+      chunkFrames(480),
+      chunkLength(0)
 {
-    pendingLength = 0;
 }
 
 AudioDeviceModuleWrapper::~AudioDeviceModuleWrapper() {}
@@ -40,65 +47,76 @@ bool AudioDeviceModuleWrapper::Initialized() const
     return _initialized;
 }
 
-void AudioDeviceModuleWrapper::onIncomingData(uint8_t* data,
+void AudioDeviceModuleWrapper::setFormat(uint32_t sample_rate,
+                                         size_t channels)
+{
+    rtc::CritScope lock(&_critSect);
+    // libwebrtc only takes mono or stereo
+    this->channels = channels > 2 ? 2 : channels;
+    this->sampleRate = sample_rate;
+    // Get chunk for 10ms
+    this->chunkFrames = sample_rate / 100;
+    if (this->chunkFrames * this->channels > kMaxChunkSamples)
+        this->chunkFrames = kMaxChunkSamples / this->channels;
+    this->chunkLength = 0;
+}
+
+static inline int16_t float_to_s16(float sample)
+{
+    if (sample >= 1.0f)
+        return 32767;
+    if (sample <= -1.0f)
+        return -32768;
+    return (int16_t)(sample * 32767.0f);
+}
+
+void AudioDeviceModuleWrapper::onIncomingData(uint8_t* const* data,
                                               size_t samples_per_channel)
 {
-    _critSect.Enter();
-    if (!audioTransport)
+    rtc::CritScope lock(&_critSect);
+    if (!audioTransport || !chunkFrames)
         return;
-    _critSect.Leave();
-
-    // Get audio
-    audio_t *audio = obs_get_audio();
-    // This info is set on the stream before starting capture
-    size_t channels = 2;
-    uint32_t sample_rate = 48000;
-    size_t sample_size = 2;
-    // Get chunk for 10ms
-    size_t chunk = (sample_rate / 100);
 
+    const float *planes[2];
+    for (size_t ch = 0; ch < channels; ch++)
+        planes[ch] = (const float *)data[ch];
+
+    size_t sample_size = sizeof(int16_t);
+    uint32_t level = 0;
     size_t i = 0;
-    uint32_t level;
-
-    // Check if we had pending chunks
-    if (pendingLength) {
-        // Copy missing chunks
-        i = chunk - pendingLength;
-        memcpy(pending + pendingLength * sample_size * channels,
-               data,
-               i * sample_size * channels);
-        // Add sent
-        audioTransport->RecordedDataIsAvailable(pending,
-                                                chunk,
-                                                sample_size * channels,
-                                                channels,
-                                                sample_rate,
-                                                0, 0, 0, false,
-                                                level);
-        // No pending chunks
-        pendingLength = 0;
-    }
 
-    // Send all possible full chunks
-    while (i + chunk < samples_per_channel) {
-        // Send them
-        audioTransport->RecordedDataIsAvailable(data + i * sample_size * channels,
-                                                chunk,
-                                                sample_size * channels,
-                                                channels,
-                                                sample_rate,
-                                                0, 0, 0, false,
-                                                level);
-        i += chunk;
-    }
+    while (i < samples_per_channel) {
+        // Interleave and convert straight into the chunk being built
+        size_t count = std::min(chunkFrames - chunkLength,
+                                samples_per_channel - i);
+        int16_t *dst = chunk + chunkLength * channels;
+
+        if (channels == 2) {
+            const float *left = planes[0] + i;
+            const float *right = planes[1] + i;
+            for (size_t j = 0; j < count; j++) {
+                *(dst++) = float_to_s16(left[j]);
+                *(dst++) = float_to_s16(right[j]);
+            }
+        } else {
+            const float *mono = planes[0] + i;
+            for (size_t j = 0; j < count; j++)
+                dst[j] = float_to_s16(mono[j]);
+        }
+
+        chunkLength += count;
+        i += count;
 
-    // If there are missing chunks
-    if (i != samples_per_channel) {
-        // Calculate pending chunks
-        pendingLength = samples_per_channel - i;
-        // Copy chunks to pending buffer
-        memcpy(pending,
-               data + i * sample_size * channels,
-               pendingLength * sample_size * channels);
+        // Send every complete 10ms chunk, keep the rest for next time
+        if (chunkLength == chunkFrames) {
+            audioTransport->RecordedDataIsAvailable(chunk,
+                                                    chunkFrames,
+                                                    sample_size * channels,
+                                                    channels,
+                                                    sampleRate,
+                                                    0, 0, 0, false,
+                                                    level);
+            chunkLength = 0;
+        }
     }
 }
@@ -30,7 +30,9 @@ public:
     int32_t Terminate() override;
     bool Initialized() const override;
 
-    void onIncomingData(uint8_t* data, size_t samples_per_channel);
+    // Format of the float planar audio pushed through onIncomingData
+    void setFormat(uint32_t sample_rate, size_t channels);
+    void onIncomingData(uint8_t* const* data, size_t samples_per_channel);
 
     virtual int64_t TimeUntilNextProcess() { return 1000; }
     virtual void Process() {}
@@ -45,6 +47,7 @@ public:
     // Full-duplex transportation of PCM audio
     int32_t RegisterAudioCallback(AudioTransport* audioCallback) override
     {
+        rtc::CritScope lock(&_critSect);
         this->audioTransport = audioCallback;
         return 0;
     }
@@ -80,12 +83,22 @@ public:
         return 0;
     }
 
+private:
+    // Largest 10ms chunk: 2 channels at 192kHz
+    static const size_t kMaxChunkSamples = 1920 * 2;
+
 public:
     bool                 _initialized;
     rtc::CriticalSection _critSect;
     AudioTransport*      audioTransport;
-    uint8_t              pending[640 * 2 * 2];
-    size_t               pendingLength;
+
+    // Audio is only ever pushed from the OBS audio thread, so the chunk
+    // being filled doubles as the carry-over between two OBS frames.
+    uint32_t             sampleRate;
+    size_t               channels;
+    size_t               chunkFrames;
+    int16_t              chunk[kMaxChunkSamples];
+    size_t               chunkLength;
 };
 
 #endif
@@ -0,0 +1,336 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "FanoutDestination.h"
+#include "SDPModif.h"
+
+#include "obs.h"
+
+#include "api/jsep.h"
+
+#include <algorithm>
+#include <memory>
+
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+
+FanoutDestination::FanoutDestination(int index,
+        const FanoutDestinationSettings &settings,
+        rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory,
+        rtc::Thread *signaling)
+    : index_(index),
+      settings_(settings),
+      factory_(factory),
+      video_bitrate_(0),
+      audio_bitrate_(0),
+      stats_interval_ms_(1000),
+      connected_(false),
+      closing_(false)
+{
+    stats_sampler_ = new rtc::RefCountedObject<StatsSampler>(signaling);
+}
+
+FanoutDestination::~FanoutDestination()
+{
+    joinCloseThread();
+    close(true);
+}
+
+const char *FanoutDestination::typeName() const
+{
+    switch (settings_.type) {
+    case Type::Janus:     return "janus";
+    case Type::Wowza:     return "wowza";
+    case Type::Millicast: return "millicast";
+    case Type::Evercast:  return "evercast";
+    case Type::Loopback:  return "loopback";
+    }
+    return "unknown";
+}
+
+bool FanoutDestination::start(
+        rtc::scoped_refptr<webrtc::MediaStreamInterface> stream,
+        const webrtc::PeerConnectionInterface::RTCConfiguration &config,
+        int video_bitrate, int audio_bitrate, int stats_interval_ms)
+{
+    video_bitrate_ = video_bitrate;
+    audio_bitrate_ = audio_bitrate;
+    stats_interval_ms_ = stats_interval_ms ? stats_interval_ms : 1000;
+    closing_ = false;
+
+    // Same factory, so the same threads and encoder factory as the output
+    webrtc::PeerConnectionDependencies dependencies(this);
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc =
+            factory_->CreatePeerConnection(config, std::move(dependencies));
+    if (!pc.get()) {
+        warn("Destination %d: error creating Peer Connection", index_);
+        return false;
+    }
+    // Same tracks: frames are captured and converted once for all
+    if (!pc->AddStream(stream)) {
+        warn("Destination %d: adding stream to PeerConnection failed", index_);
+        pc->Close();
+        return false;
+    }
+
+    std::shared_ptr<WebsocketClient> client;
+    if (settings_.type == Type::Loopback) {
+        latency_.reset();
+        client.reset(new LoopbackWebsocketClientImpl(factory_, &latency_));
+    } else {
+        client.reset(createWebsocketClient(settings_.type));
+    }
+    if (!client) {
+        warn("Destination %d: error creating Websocket client", index_);
+        pc->Close();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pc_ = pc;
+        client_ = client;
+    }
+
+    std::string server_url = settings_.url;
+    if (settings_.type == Type::Millicast)
+        server_url = "Millicast";
+    info("Destination %d: connecting to %s (%s)", index_,
+            server_url.c_str(), typeName());
+
+    // Not locked: the client may call us back right away
+    if (!client->connect(server_url, settings_.room, settings_.username,
+                settings_.password, this)) {
+        warn("Destination %d: error connecting to server", index_);
+        close(false);
+        return false;
+    }
+    return true;
+}
+
+void FanoutDestination::stop()
+{
+    closing_ = true;
+    joinCloseThread();
+    close(true);
+}
+
+void FanoutDestination::close(bool wait)
+{
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    std::shared_ptr<WebsocketClient> client;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pc = pc_;
+        pc_ = nullptr;
+        client = client_;
+        client_ = nullptr;
+    }
+    connected_ = false;
+    if (!pc.get())
+        return;
+    // Stop sampling stats
+    stats_sampler_->stop();
+    // Close Peer Connection
+    pc->Close();
+    // Shutdown websocket connection
+    if (client)
+        client->disconnect(wait);
+}
+
+rtc::scoped_refptr<webrtc::PeerConnectionInterface>
+FanoutDestination::peerConnection()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pc_;
+}
+
+std::shared_ptr<WebsocketClient> FanoutDestination::websocketClient()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return client_;
+}
+
+void FanoutDestination::fail(const char *reason)
+{
+    // Closing triggers more callbacks, only the first failure counts
+    if (closing_.exchange(true))
+        return;
+    warn("Destination %d: %s, the other destinations keep streaming",
+            index_, reason);
+    joinCloseThread();
+    // Keep this object alive until closed
+    rtc::scoped_refptr<FanoutDestination> self(this);
+    std::lock_guard<std::mutex> lock(mutex_);
+    close_thread_ = std::thread([self]() {
+        self->close(false);
+    });
+}
+
+void FanoutDestination::joinCloseThread()
+{
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        thread.swap(close_thread_);
+    }
+    if (!thread.joinable())
+        return;
+    // The close thread may hold the last reference
+    if (thread.get_id() == std::this_thread::get_id())
+        thread.detach();
+    else
+        thread.join();
+}
+
+void FanoutDestination::onConnected()
+{
+    info("Destination %d: connected", index_);
+}
+
+void FanoutDestination::onDisconnected()
+{
+    fail("disconnected");
+}
+
+void FanoutDestination::onLogged(int /* code */)
+{
+    info("Destination %d: logged, creating offer...", index_);
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc = peerConnection();
+    if (!pc.get())
+        return;
+    webrtc::PeerConnectionInterface::RTCOfferAnswerOptions offer_options;
+    offer_options.voice_activity_detection = false;
+    pc->CreateOffer(this, offer_options);
+}
+
+void FanoutDestination::onLoggedError(int code)
+{
+    info("Destination %d: login error [code: %d]", index_, code);
+    fail("login failed");
+}
+
+void FanoutDestination::OnSuccess(webrtc::SessionDescriptionInterface *desc)
+{
+    std::string sdp;
+    desc->ToString(&sdp);
+
+    std::string sdpCopy = sdp;
+    std::string video_codec = settings_.codec;
+    if (settings_.type == Type::Wowza) {
+        std::vector<int> audio_payloads;
+        std::vector<int> video_payloads;
+        // Force specific video/audio payload
+        SDPModif::forcePayload(sdpCopy, audio_payloads, video_payloads,
+                video_codec.empty() ? "" : "opus", video_codec, 0, "42e01f", 0);
+        // Constrain video bitrate
+        SDPModif::bitrateMaxMinSDP(sdpCopy, video_bitrate_, video_payloads);
+        // Enable stereo & constrain audio bitrate
+        SDPModif::stereoSDP(sdpCopy, audio_bitrate_);
+    }
+
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc = peerConnection();
+    std::shared_ptr<WebsocketClient> client = websocketClient();
+    if (!pc.get() || !client) {
+        delete desc;
+        return;
+    }
+    pc->SetLocalDescription(this, desc);
+    client->open(sdpCopy, video_codec, settings_.username);
+}
+
+void FanoutDestination::OnFailure(const std::string &error)
+{
+    warn("Destination %d: OnFailure [%s]", index_, error.c_str());
+    fail("negotiation failed");
+}
+
+void FanoutDestination::OnIceCandidate(const webrtc::IceCandidateInterface *candidate)
+{
+    std::string str;
+    candidate->ToString(&str);
+    if (std::shared_ptr<WebsocketClient> client = websocketClient())
+        client->trickle(candidate->sdp_mid(), candidate->sdp_mline_index(),
+                str, false);
+}
+
+void FanoutDestination::OnIceConnectionChange(
+        webrtc::PeerConnectionInterface::IceConnectionState state)
+{
+    switch (state) {
+    case webrtc::PeerConnectionInterface::kIceConnectionConnected:
+    case webrtc::PeerConnectionInterface::kIceConnectionCompleted:
+        connected_ = true;
+        break;
+    case webrtc::PeerConnectionInterface::kIceConnectionFailed:
+        fail("ICE failed");
+        break;
+    default:
+        break;
+    }
+}
+
+void FanoutDestination::onRemoteIceCandidate(const std::string &sdpData)
+{
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc = peerConnection();
+    if (!pc.get())
+        return;
+    if (sdpData.empty()) {
+        pc->AddIceCandidate(nullptr);
+        return;
+    }
+    std::string s = sdpData;
+    s.erase(std::remove(s.begin(), s.end(), '\"'), s.end());
+    if (!settings_.protocol.empty() &&
+            !SDPModif::filterIceCandidates(s, settings_.protocol))
+        return;
+    webrtc::SdpParseError error;
+    std::unique_ptr<webrtc::IceCandidateInterface> candidate(
+            webrtc::CreateIceCandidate("", 0, s, &error));
+    if (candidate)
+        pc->AddIceCandidate(candidate.get());
+}
+
+void FanoutDestination::onOpened(const std::string &sdp)
+{
+    std::string sdpCopy = sdp;
+    if (settings_.type != Type::Wowza) {
+        // Constrain video bitrate
+        SDPModif::bitrateSDP(sdpCopy, video_bitrate_);
+        // Enable stereo & constrain audio bitrate
+        SDPModif::stereoSDP(sdpCopy, audio_bitrate_);
+    }
+
+    webrtc::SdpParseError error;
+    std::unique_ptr<webrtc::SessionDescriptionInterface> answer =
+            webrtc::CreateSessionDescription(webrtc::SdpType::kAnswer,
+                    sdpCopy, &error);
+    if (!answer) {
+        warn("Destination %d: error parsing answer: %s", index_,
+                error.description.c_str());
+        fail("invalid answer");
+        return;
+    }
+
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc = peerConnection();
+    if (!pc.get())
+        return;
+    pc->SetRemoteDescription(std::move(answer),
+            rtc::scoped_refptr<webrtc::SetRemoteDescriptionObserverInterface>(this));
+    // Own stats, so that each destination shows its own bandwidth
+    stats_sampler_->start(pc, stats_interval_ms_, {});
+}
+
+void FanoutDestination::onOpenedError(int code)
+{
+    info("Destination %d: publish error [code: %d]", index_, code);
+    fail("publishing failed");
+}
+
+void FanoutDestination::OnSetRemoteDescriptionComplete(webrtc::RTCError error)
+{
+    if (error.ok())
+        info("Destination %d: streaming", index_);
+    else
+        warn("Destination %d: error setting Remote Description: %s",
+                index_, error.message());
+}
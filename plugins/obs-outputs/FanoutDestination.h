@@ -0,0 +1,129 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _FANOUT_DESTINATION_H_
+#define _FANOUT_DESTINATION_H_
+
+#include "WebsocketClient.h"
+#include "LoopbackWebsocketClientImpl.h"
+#include "StatsSampler.h"
+
+#include "api/media_stream_interface.h"
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "api/set_remote_description_observer_interface.h"
+#include "rtc_base/ref_counted_object.h"
+#include "rtc_base/thread.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Where an extra copy of the stream is sent
+struct FanoutDestinationSettings {
+    int type = Type::Janus;   // WebsocketClient type
+    std::string url;
+    std::string room;
+    std::string username;
+    std::string password;
+    std::string codec;
+    std::string protocol;
+};
+
+class FanoutDestinationInterface :
+    public WebsocketClient::Listener,
+    public webrtc::PeerConnectionObserver,
+    public webrtc::CreateSessionDescriptionObserver,
+    public webrtc::SetSessionDescriptionObserver,
+    public webrtc::SetRemoteDescriptionObserverInterface {};
+
+// Additional destination of a WebRTC output.
+//
+// Publishes the media stream of the output (same tracks, so the frames are
+// captured and converted once) on its own peer connection, created from the
+// output's factory, with its own signaling session, bandwidth estimation
+// and stats. Failures only take this destination down, the output and its
+// other destinations keep streaming.
+class FanoutDestination : public rtc::RefCountedObject<FanoutDestinationInterface> {
+public:
+    FanoutDestination(int index, const FanoutDestinationSettings &settings,
+            rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory,
+            rtc::Thread *signaling);
+    ~FanoutDestination() override;
+
+    // Publish stream, same ICE servers and bitrates as the output
+    bool start(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream,
+               const webrtc::PeerConnectionInterface::RTCConfiguration &config,
+               int video_bitrate, int audio_bitrate, int stats_interval_ms);
+    void stop();
+    // "janus", "wowza", ... for logs
+    const char *typeName() const;
+
+    bool connected() const { return connected_; }
+    int index() const      { return index_; }
+    WebRTCStatsSnapshot stats() const { return stats_sampler_->snapshot(); }
+    // Loopback destinations only
+    LoopbackLatencyStats loopbackStats() const { return latency_.stats(); }
+
+    //
+    // WebsocketClient::Listener implementation.
+    //
+    void onConnected() override;
+    void onDisconnected() override;
+    void onLogged(int code) override;
+    void onLoggedError(int code) override;
+    void onOpened(const std::string &sdp) override;
+    void onOpenedError(int code) override;
+    void onRemoteIceCandidate(const std::string &sdpData) override;
+
+    //
+    // PeerConnectionObserver implementation.
+    //
+    void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState) override {}
+    void OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface>) override {}
+    void OnRemoveStream(rtc::scoped_refptr<webrtc::MediaStreamInterface>) override {}
+    void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface>) override {}
+    void OnRenegotiationNeeded() override {}
+    void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState) override {}
+    void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState state) override;
+    void OnIceCandidate(const webrtc::IceCandidateInterface *candidate) override;
+
+    // CreateSessionDescriptionObserver / SetSessionDescriptionObserver
+    void OnSuccess(webrtc::SessionDescriptionInterface *desc) override;
+    void OnSuccess() override {}
+    void OnFailure(const std::string &error) override;
+
+    // SetRemoteDescriptionObserverInterface
+    void OnSetRemoteDescriptionComplete(webrtc::RTCError error) override;
+
+private:
+    // Callbacks come from the websocket and signaling threads, which
+    // close() waits for: failures close on a separate thread
+    void fail(const char *reason);
+    void close(bool wait);
+    // Waits for the thread started by fail(), not with mutex_ held
+    void joinCloseThread();
+    // Snapshots, never call them with mutex_ held
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> peerConnection();
+    std::shared_ptr<WebsocketClient> websocketClient();
+
+    int index_;
+    FanoutDestinationSettings settings_;
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory_;
+    int video_bitrate_;
+    int audio_bitrate_;
+    int stats_interval_ms_;
+
+    // Only guards the swaps of pc_, client_ and close_thread_
+    std::mutex mutex_;
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc_;
+    std::shared_ptr<WebsocketClient> client_;
+    rtc::scoped_refptr<StatsSampler> stats_sampler_;
+    LoopbackLatency latency_;
+    std::atomic<bool> connected_;
+    std::atomic<bool> closing_;
+    std::thread close_thread_;
+};
+
+#endif
@@ -0,0 +1,76 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "FrameBufferPool.h"
+
+// Fallback when the video output cache size is unknown.
+#define DEFAULT_MAX_BUFFERS 8
+
+FrameBufferPool::FrameBufferPool()
+    : width_(0),
+      height_(0),
+      max_buffers_(DEFAULT_MAX_BUFFERS),
+      hits_(0),
+      misses_(0),
+      exhausted_(0),
+      allocated_(0)
+{
+}
+
+FrameBufferPool::~FrameBufferPool() = default;
+
+void FrameBufferPool::SetMaxBuffers(size_t max_buffers)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_buffers_ = max_buffers ? max_buffers : DEFAULT_MAX_BUFFERS;
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer>
+FrameBufferPool::CreateBuffer(int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Resolution changed: buffers still in use stay alive through their own
+    // references, the pool just forgets about them.
+    if (width != width_ || height != height_) {
+        buffers_.clear();
+        width_ = width;
+        height_ = height;
+        allocated_ = 0;
+    }
+
+    for (const auto &buffer : buffers_) {
+        // Only the pool holds a reference: nobody is using it anymore
+        if (buffer->HasOneRef()) {
+            ++hits_;
+            return buffer;
+        }
+    }
+
+    if (buffers_.size() >= max_buffers_) {
+        ++exhausted_;
+        return nullptr;
+    }
+
+    int stride_y = width;
+    int stride_uv = (width + 1) / 2;
+    rtc::scoped_refptr<PooledI420Buffer> buffer =
+            new PooledI420Buffer(width, height, stride_y, stride_uv, stride_uv);
+    buffers_.push_back(buffer);
+
+    ++misses_;
+    allocated_ = buffers_.size();
+    return buffer;
+}
+
+void FrameBufferPool::Release()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = buffers_.begin();
+    while (it != buffers_.end()) {
+        if ((*it)->HasOneRef())
+            it = buffers_.erase(it);
+        else
+            ++it;
+    }
+    allocated_ = buffers_.size();
+}
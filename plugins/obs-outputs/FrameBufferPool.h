@@ -0,0 +1,62 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _FRAME_BUFFER_POOL_H_
+#define _FRAME_BUFFER_POOL_H_
+
+#include "api/scoped_refptr.h"
+#include "api/video/i420_buffer.h"
+#include "rtc_base/ref_counted_object.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Recycling pool of I420 frame buffers.
+//
+// Buffers are handed out as refcounted webrtc::I420Buffer. A buffer is
+// considered free again once the pool holds the only reference to it, i.e.
+// once the encoder (and any other sink) released the webrtc::VideoFrame that
+// wrapped it. The pool is keyed by resolution: asking for a different size
+// drops every buffer of the previous size.
+//
+// CreateBuffer() is called from the video-io thread, Release() and
+// SetMaxBuffers() from the thread starting and stopping the output, which
+// may run while the raw video is still being disconnected: the buffer list
+// is guarded by a mutex. The counters can be read from any thread.
+class FrameBufferPool {
+public:
+    FrameBufferPool();
+    ~FrameBufferPool();
+
+    // Maximum number of buffers kept alive per resolution. When every buffer
+    // is in use and the limit is reached, CreateBuffer() returns nullptr.
+    void SetMaxBuffers(size_t max_buffers);
+
+    rtc::scoped_refptr<webrtc::I420Buffer> CreateBuffer(int width, int height);
+
+    // Drop every buffer not currently in use.
+    void Release();
+
+    uint64_t hits() const       { return hits_; }
+    uint64_t misses() const     { return misses_; }
+    uint64_t exhausted() const  { return exhausted_; }
+    size_t   allocated() const  { return allocated_; }
+
+private:
+    // Allows HasOneRef() to be used on the pooled buffers.
+    typedef rtc::RefCountedObject<webrtc::I420Buffer> PooledI420Buffer;
+
+    // Guards buffers_, width_, height_ and max_buffers_
+    std::mutex mutex_;
+    std::vector<rtc::scoped_refptr<PooledI420Buffer>> buffers_;
+    int width_;
+    int height_;
+    size_t max_buffers_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> exhausted_;
+    std::atomic<size_t>   allocated_;
+};
+
+#endif
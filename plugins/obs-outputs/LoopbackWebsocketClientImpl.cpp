@@ -0,0 +1,340 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "LoopbackWebsocketClientImpl.h"
+
+#include "obs.h"
+#include <util/platform.h>
+
+#include "api/jsep.h"
+#include "api/video/i420_buffer.h"
+
+#include <algorithm>
+
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+#define debug(format, ...) blog(LOG_DEBUG,   format, ##__VA_ARGS__)
+#define error(format, ...) blog(LOG_ERROR,   format, ##__VA_ARGS__)
+
+// Latency stamp layout, see test/test-input/test-latency.c
+#define STAMP_BITS 40
+#define STAMP_CHECK 0xA5
+#define STAMP_THRESHOLD 128
+// Latency samples kept for the percentiles
+#define MAX_LATENCY_SAMPLES (1 << 16)
+
+static bool read_stamp(const uint8_t *y_plane, int stride, int width,
+                       int height, uint32_t &ms)
+{
+    int cell = width / STAMP_BITS;
+    if (cell < 2 || height < cell)
+        return false;
+
+    // Sample the middle of each cell, away from the block edges
+    uint64_t bits = 0;
+    const uint8_t *line = y_plane + (cell / 2) * stride;
+    for (int i = 0; i < STAMP_BITS; i++) {
+        int x = i * cell + cell / 2;
+        int luma = (line[x - 1] + line[x] + line[x + stride - 1] +
+                    line[x + stride]) / 4;
+        bits = (bits << 1) | (luma >= STAMP_THRESHOLD ? 1 : 0);
+    }
+
+    ms = (uint32_t)(bits >> 8);
+    uint8_t check = (uint8_t)((ms >> 24) ^ (ms >> 16) ^ (ms >> 8) ^ ms ^
+                              STAMP_CHECK);
+    return check == (uint8_t)(bits & 0xff);
+}
+
+void LoopbackLatency::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = LoopbackLatencyStats();
+    latency_sum_ms_ = 0.0;
+    samples_.clear();
+}
+
+void LoopbackLatency::onFrame(const webrtc::VideoFrame &frame)
+{
+    // Same clock as the source
+    uint32_t now_ms = (uint32_t)(os_gettime_ns() / 1000000);
+
+    rtc::scoped_refptr<webrtc::I420BufferInterface> buffer =
+            frame.video_frame_buffer()->ToI420();
+    uint32_t stamp_ms = 0;
+    bool stamped = buffer && read_stamp(buffer->DataY(), buffer->StrideY(),
+            buffer->width(), buffer->height(), stamp_ms);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.frames_received++;
+    stats_.width = frame.width();
+    stats_.height = frame.height();
+    if (!stamped)
+        return;
+
+    // Wraps with the 32 bit ms clock
+    double latency_ms = (double)(int32_t)(now_ms - stamp_ms);
+    if (latency_ms < 0.0)
+        return;
+
+    if (!stats_.frames_stamped || latency_ms < stats_.latency_min_ms)
+        stats_.latency_min_ms = latency_ms;
+    if (latency_ms > stats_.latency_max_ms)
+        stats_.latency_max_ms = latency_ms;
+    stats_.frames_stamped++;
+    latency_sum_ms_ += latency_ms;
+    if (samples_.size() < MAX_LATENCY_SAMPLES)
+        samples_.push_back(latency_ms);
+}
+
+LoopbackLatencyStats LoopbackLatency::stats() const
+{
+    std::vector<double> samples;
+    LoopbackLatencyStats stats;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = stats_;
+        samples = samples_;
+        if (stats.frames_stamped)
+            stats.latency_avg_ms =
+                    latency_sum_ms_ / (double)stats.frames_stamped;
+    }
+
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        stats.latency_p50_ms = samples[samples.size() / 2];
+        stats.latency_p95_ms = samples[samples.size() * 95 / 100];
+    }
+    return stats;
+}
+
+class LoopbackReceiverInterface :
+    public webrtc::PeerConnectionObserver,
+    public webrtc::CreateSessionDescriptionObserver,
+    public webrtc::SetSessionDescriptionObserver,
+    public rtc::VideoSinkInterface<webrtc::VideoFrame> {};
+
+// Receiving end of the loopback, lives on the factory signaling thread
+class LoopbackWebsocketClientImpl::Receiver :
+    public rtc::RefCountedObject<LoopbackReceiverInterface> {
+public:
+    Receiver(WebsocketClient::Listener *listener, LoopbackLatency *latency)
+        : listener(listener), latency(latency), remote_set(false) {}
+
+    bool init(webrtc::PeerConnectionFactoryInterface *factory)
+    {
+        // Host candidates only, nothing leaves the machine
+        webrtc::PeerConnectionInterface::RTCConfiguration config;
+        webrtc::PeerConnectionDependencies dependencies(this);
+        pc = factory->CreatePeerConnection(config, std::move(dependencies));
+        return pc.get() != nullptr;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            listener = nullptr;
+        }
+        if (video_track)
+            video_track->RemoveSink(this);
+        video_track = nullptr;
+        if (pc)
+            pc->Close();
+        pc = nullptr;
+    }
+
+    bool answer(const std::string &sdp)
+    {
+        webrtc::SdpParseError error;
+        webrtc::SessionDescriptionInterface *offer =
+                webrtc::CreateSessionDescription("offer", sdp, &error);
+        if (!offer) {
+            warn("Loopback: invalid offer: %s", error.description.c_str());
+            return false;
+        }
+        pc->SetRemoteDescription(this, offer);
+
+        // Candidates trickled before the offer
+        std::vector<std::unique_ptr<webrtc::IceCandidateInterface>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            remote_set = true;
+            pending.swap(pending_candidates);
+        }
+        for (auto &candidate : pending)
+            pc->AddIceCandidate(candidate.get());
+
+        webrtc::PeerConnectionInterface::RTCOfferAnswerOptions options;
+        pc->CreateAnswer(this, options);
+        return true;
+    }
+
+    bool addCandidate(const std::string &mid, int index,
+                      const std::string &sdp)
+    {
+        webrtc::SdpParseError error;
+        std::unique_ptr<webrtc::IceCandidateInterface> candidate(
+                webrtc::CreateIceCandidate(mid, index, sdp, &error));
+        if (!candidate) {
+            warn("Loopback: invalid candidate: %s",
+                    error.description.c_str());
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!remote_set) {
+                pending_candidates.push_back(std::move(candidate));
+                return true;
+            }
+        }
+        return pc->AddIceCandidate(candidate.get());
+    }
+
+    //
+    // PeerConnectionObserver implementation.
+    //
+    void OnSignalingChange(
+            webrtc::PeerConnectionInterface::SignalingState) override {}
+    void OnAddStream(
+            rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) override
+    {
+        auto tracks = stream->GetVideoTracks();
+        if (tracks.empty())
+            return;
+        video_track = tracks[0];
+        video_track->AddOrUpdateSink(this, rtc::VideoSinkWants());
+    }
+    void OnRemoveStream(
+            rtc::scoped_refptr<webrtc::MediaStreamInterface>) override {}
+    void OnDataChannel(
+            rtc::scoped_refptr<webrtc::DataChannelInterface>) override {}
+    void OnRenegotiationNeeded() override {}
+    void OnIceGatheringChange(
+            webrtc::PeerConnectionInterface::IceGatheringState) override {}
+    void OnIceCandidate(
+            const webrtc::IceCandidateInterface *candidate) override
+    {
+        std::string sdp;
+        candidate->ToString(&sdp);
+        if (WebsocketClient::Listener *l = getListener())
+            l->onRemoteIceCandidate(sdp);
+    }
+
+    //
+    // CreateSessionDescriptionObserver implementation.
+    //
+    void OnSuccess(webrtc::SessionDescriptionInterface *desc) override
+    {
+        std::string sdp;
+        desc->ToString(&sdp);
+        pc->SetLocalDescription(this, desc);
+        if (WebsocketClient::Listener *l = getListener())
+            l->onOpened(sdp);
+    }
+    void OnFailure(const std::string &error) override
+    {
+        warn("Loopback: %s", error.c_str());
+        if (WebsocketClient::Listener *l = getListener())
+            l->onOpenedError(-1);
+    }
+
+    //
+    // SetSessionDescriptionObserver implementation.
+    //
+    void OnSuccess() override {}
+
+    //
+    // VideoSinkInterface implementation, decoder thread.
+    //
+    void OnFrame(const webrtc::VideoFrame &frame) override
+    {
+        if (latency)
+            latency->onFrame(frame);
+    }
+
+private:
+    // Not called with the lock held: the stream may close us from there
+    WebsocketClient::Listener *getListener()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return listener;
+    }
+
+    std::mutex mutex;
+    WebsocketClient::Listener *listener;
+    LoopbackLatency *latency;
+    bool remote_set;
+    std::vector<std::unique_ptr<webrtc::IceCandidateInterface>>
+            pending_candidates;
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
+};
+
+LoopbackWebsocketClientImpl::LoopbackWebsocketClientImpl(
+        rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory,
+        LoopbackLatency *latency)
+    : factory(factory), latency(latency)
+{
+}
+
+LoopbackWebsocketClientImpl::~LoopbackWebsocketClientImpl()
+{
+    // Disconnect just in case
+    disconnect(false);
+}
+
+bool LoopbackWebsocketClientImpl::connect(
+        const std::string & /* url */,
+        const std::string & /* room */,
+        const std::string & /* username */,
+        const std::string & /* token */,
+        WebsocketClient::Listener * listener)
+{
+    disconnect(true);
+
+    receiver = new Receiver(listener, latency);
+    if (!receiver->init(factory)) {
+        error("Loopback: error creating the receiving Peer Connection");
+        receiver = nullptr;
+        return false;
+    }
+    if (latency)
+        latency->reset();
+
+    // Nothing to wait for: connected and logged in right away
+    listener->onConnected();
+    listener->onLogged(0);
+    return true;
+}
+
+bool LoopbackWebsocketClientImpl::open(
+        const std::string & sdp,
+        const std::string & /* codec */,
+        const std::string & /* username */)
+{
+    if (!receiver)
+        return false;
+    return receiver->answer(sdp);
+}
+
+bool LoopbackWebsocketClientImpl::trickle(
+        const std::string & mid,
+        int index,
+        const std::string & candidate,
+        bool last)
+{
+    if (!receiver)
+        return false;
+    if (last || candidate.empty())
+        return true;
+    return receiver->addCandidate(mid, index, candidate);
+}
+
+bool LoopbackWebsocketClientImpl::disconnect(bool /* wait */)
+{
+    if (!receiver)
+        return false;
+    receiver->close();
+    receiver = nullptr;
+    return true;
+}
@@ -0,0 +1,97 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _LOOPBACK_WEBSOCKET_CLIENT_IMPL_H_
+#define _LOOPBACK_WEBSOCKET_CLIENT_IMPL_H_
+
+#include "WebsocketClient.h"
+
+#include "api/media_stream_interface.h"
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "api/video/video_frame.h"
+#include "api/video/video_sink_interface.h"
+#include "rtc_base/ref_counted_object.h"
+
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct LoopbackLatencyStats {
+    uint64_t frames_received = 0;
+    // Frames whose latency stamp could be read
+    uint64_t frames_stamped = 0;
+    // Last frame received
+    int width = 0;
+    int height = 0;
+    double latency_avg_ms = 0.0;
+    double latency_min_ms = 0.0;
+    double latency_p50_ms = 0.0;
+    double latency_p95_ms = 0.0;
+    double latency_max_ms = 0.0;
+};
+
+// Glass-to-receive latency of the frames decoded by the loopback receiver.
+//
+// Frames stamped by the "latency_stamp_source" test source carry the time
+// they were produced, as a row of black/white cells across the top of the
+// picture (see test/test-input/test-latency.c, keep both in sync). Frames
+// from any other source are only counted.
+class LoopbackLatency {
+public:
+    void reset();
+    // Decoder thread
+    void onFrame(const webrtc::VideoFrame &frame);
+    LoopbackLatencyStats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    LoopbackLatencyStats stats_;
+    double latency_sum_ms_ = 0.0;
+    // Kept for the percentiles, bounded
+    std::vector<double> samples_;
+};
+
+// In-process stand-in for the signaling server: the offer is answered by a
+// receiving peer connection created from the same factory, so the whole
+// WebRTCStream pipeline (capture, encode, pacing, DTLS/SRTP, decode) runs
+// without any signaling server. Candidates are host candidates only; note
+// that libwebrtc ignores the loopback network interface by default.
+//
+// Used for WebRTCStream::Type::Loopback, createWebsocketClient() has no
+// libwebrtc to build it with.
+class LoopbackWebsocketClientImpl : public WebsocketClient {
+public:
+    LoopbackWebsocketClientImpl(
+            rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory,
+            LoopbackLatency *latency);
+    ~LoopbackWebsocketClientImpl() override;
+
+    // WebsocketClient implementation
+    bool connect(
+            const std::string & url,
+            const std::string & room,
+            const std::string & username,
+            const std::string & token,
+            WebsocketClient::Listener * listener) override;
+    bool open(
+            const std::string & sdp,
+            const std::string & codec,
+            const std::string & username) override;
+    bool trickle(
+            const std::string & mid,
+            int index,
+            const std::string & candidate,
+            bool last) override;
+    bool disconnect(bool wait) override;
+
+private:
+    class Receiver;
+
+    rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+    LoopbackLatency *latency;
+    rtc::scoped_refptr<Receiver> receiver;
+};
+
+#endif
@@ -0,0 +1,321 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "ObsEncoderFactory.h"
+
+#include "absl/strings/match.h"
+#include "api/video_codecs/video_encoder.h"
+#include "common_video/h264/h264_common.h"
+#include "media/base/h264_profile_level_id.h"
+#include "media/base/media_constants.h"
+#include "modules/include/module_common_types.h"
+#include "modules/video_coding/codecs/h264/include/h264.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+#include "modules/video_coding/include/video_error_codes.h"
+#include "rtc_base/time_utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define debug(format, ...) blog(LOG_DEBUG,   format, ##__VA_ARGS__)
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+
+// Do not flood the OBS encoder with keyframe requests
+#define KEYFRAME_REQUEST_INTERVAL_MS 500
+// Bitrate updates: minimum interval and relative change
+#define BITRATE_UPDATE_INTERVAL_MS 1000
+#define BITRATE_UPDATE_THRESHOLD 0.1
+#define MIN_BITRATE_KBPS 100
+
+EncodedFrameBuffer::EncodedFrameBuffer(struct encoder_packet *packet,
+                                       const uint8_t *header,
+                                       size_t header_size,
+                                       int width, int height,
+                                       uint64_t sequence)
+    : width_(width), height_(height), sequence_(sequence)
+{
+    obs_encoder_packet_ref(&packet_, packet);
+
+    // OBS encoders only send SPS/PPS once as extra data, the receiver
+    // needs them in front of every keyframe to join the stream
+    if (packet_.keyframe && header && header_size) {
+        keyframe_data_.resize(header_size + packet_.size);
+        memcpy(keyframe_data_.data(), header, header_size);
+        memcpy(keyframe_data_.data() + header_size, packet_.data,
+               packet_.size);
+    }
+}
+
+EncodedFrameBuffer::~EncodedFrameBuffer()
+{
+    obs_encoder_packet_release(&packet_);
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> EncodedFrameBuffer::ToI420()
+{
+    rtc::scoped_refptr<webrtc::I420Buffer> black =
+            webrtc::I420Buffer::Create(width_, height_);
+    webrtc::I420Buffer::SetBlack(black.get());
+    return black;
+}
+
+const uint8_t *EncodedFrameBuffer::data() const
+{
+    return keyframe_data_.empty() ? packet_.data : keyframe_data_.data();
+}
+
+size_t EncodedFrameBuffer::size() const
+{
+    return keyframe_data_.empty() ? packet_.size : keyframe_data_.size();
+}
+
+// "Encoder" packetizing the EncodedFrameBuffer of incoming frames.
+// Keyframe requests (PLI/FIR) are forwarded to the OBS encoder and the
+// bandwidth estimation drives its bitrate.
+class ObsVideoEncoder : public webrtc::VideoEncoder {
+public:
+    ObsVideoEncoder(obs_encoder_t *encoder, int max_bitrate_kbps)
+        : encoder_(obs_encoder_get_ref(encoder)),
+          callback_(nullptr),
+          max_bitrate_kbps_(max_bitrate_kbps),
+          bitrate_kbps_(max_bitrate_kbps),
+          last_bitrate_update_ms_(0),
+          last_keyframe_request_ms_(0),
+          last_sequence_(0),
+          waiting_keyframe_(true)
+    {
+    }
+
+    ~ObsVideoEncoder() override { obs_encoder_release(encoder_); }
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       int32_t /* number_of_cores */,
+                       size_t /* max_payload_size */) override
+    {
+        if (!codec_settings ||
+            codec_settings->codecType != webrtc::kVideoCodecH264)
+            return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+        // The stream starts on the next keyframe
+        waiting_keyframe_ = true;
+        return encoder_ ? WEBRTC_VIDEO_CODEC_OK : WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    int32_t RegisterEncodeCompleteCallback(
+            webrtc::EncodedImageCallback *callback) override
+    {
+        callback_ = callback;
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+
+    int32_t Release() override
+    {
+        callback_ = nullptr;
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override
+    {
+        if (!callback_)
+            return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+                frame.video_frame_buffer();
+        if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative)
+            return WEBRTC_VIDEO_CODEC_ERROR;
+        // The only native buffers fed to the video track are ours
+        auto *encoded = static_cast<EncodedFrameBuffer *>(buffer.get());
+
+        bool keyframe_wanted = false;
+        if (frame_types) {
+            for (auto frame_type : *frame_types)
+                if (frame_type == webrtc::VideoFrameType::kVideoFrameKey)
+                    keyframe_wanted = true;
+        }
+
+        // libwebrtc dropped a frame before handing it to us: the
+        // reference chain is broken until the next keyframe
+        if (last_sequence_ && encoded->sequence() != last_sequence_ + 1) {
+            debug("Passthrough: %llu frame(s) dropped, waiting for keyframe",
+                  (unsigned long long)(encoded->sequence() -
+                                       last_sequence_ - 1));
+            waiting_keyframe_ = true;
+        }
+        last_sequence_ = encoded->sequence();
+
+        if (waiting_keyframe_ && !encoded->keyframe())
+            keyframe_wanted = true;
+        if (keyframe_wanted && !encoded->keyframe())
+            requestKeyframe();
+        if (waiting_keyframe_ && !encoded->keyframe())
+            return WEBRTC_VIDEO_CODEC_OK;
+        waiting_keyframe_ = false;
+
+        webrtc::EncodedImage image;
+        image.set_buffer(const_cast<uint8_t *>(encoded->data()),
+                         encoded->size());
+        image.set_size(encoded->size());
+        image._encodedWidth = encoded->width();
+        image._encodedHeight = encoded->height();
+        image.SetTimestamp(frame.timestamp());
+        image.ntp_time_ms_ = frame.ntp_time_ms();
+        image.capture_time_ms_ = frame.render_time_ms();
+        image.rotation_ = frame.rotation();
+        image._frameType = encoded->keyframe()
+                ? webrtc::VideoFrameType::kVideoFrameKey
+                : webrtc::VideoFrameType::kVideoFrameDelta;
+        image._completeFrame = true;
+
+        // NAL units boundaries, required by the H.264 packetizer
+        std::vector<webrtc::H264::NaluIndex> nalus =
+                webrtc::H264::FindNaluIndices(encoded->data(),
+                                              encoded->size());
+        if (nalus.empty())
+            return WEBRTC_VIDEO_CODEC_ERROR;
+        webrtc::RTPFragmentationHeader fragmentation;
+        fragmentation.VerifyAndAllocateFragmentationHeader(nalus.size());
+        for (size_t i = 0; i < nalus.size(); i++) {
+            fragmentation.fragmentationOffset[i] = nalus[i].payload_start_offset;
+            fragmentation.fragmentationLength[i] = nalus[i].payload_size;
+        }
+
+        webrtc::CodecSpecificInfo codec_info;
+        codec_info.codecType = webrtc::kVideoCodecH264;
+        codec_info.codecSpecific.H264.packetization_mode =
+                webrtc::H264PacketizationMode::NonInterleaved;
+
+        // The packetizer copies the payload before returning
+        webrtc::EncodedImageCallback::Result result =
+                callback_->OnEncodedImage(image, &codec_info, &fragmentation);
+        return result.error == webrtc::EncodedImageCallback::Result::OK
+                ? WEBRTC_VIDEO_CODEC_OK
+                : WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    void SetRates(const RateControlParameters &parameters) override
+    {
+        int target_kbps = (int)(parameters.bitrate.get_sum_bps() / 1000);
+        if (target_kbps <= 0)
+            return;
+        if (max_bitrate_kbps_ > 0 && target_kbps > max_bitrate_kbps_)
+            target_kbps = max_bitrate_kbps_;
+        if (target_kbps < MIN_BITRATE_KBPS)
+            target_kbps = MIN_BITRATE_KBPS;
+
+        // The bandwidth estimation moves constantly, only follow it when
+        // the change is significant, and not faster than the encoder's
+        // rate control can react
+        int64_t now_ms = rtc::TimeMillis();
+        double change = (double)abs(target_kbps - bitrate_kbps_) /
+                        (double)bitrate_kbps_;
+        if (change < BITRATE_UPDATE_THRESHOLD ||
+            now_ms - last_bitrate_update_ms_ < BITRATE_UPDATE_INTERVAL_MS)
+            return;
+
+        info("Passthrough: encoder bitrate %d -> %d kbps",
+             bitrate_kbps_, target_kbps);
+        obs_data_t *settings = obs_data_create();
+        obs_data_set_int(settings, "bitrate", target_kbps);
+        obs_encoder_update(encoder_, settings);
+        obs_data_release(settings);
+
+        bitrate_kbps_ = target_kbps;
+        last_bitrate_update_ms_ = now_ms;
+    }
+
+    EncoderInfo GetEncoderInfo() const override
+    {
+        EncoderInfo info;
+        info.implementation_name = "obs-passthrough";
+        // Frames carry EncodedFrameBuffer, never convert them to I420
+        info.supports_native_handle = true;
+        // The OBS encoder has its own rate control: dropping a frame here
+        // would break the reference chain
+        info.has_trusted_rate_controller = true;
+        info.is_hardware_accelerated = true;
+        info.scaling_settings = VideoEncoder::ScalingSettings::kOff;
+        return info;
+    }
+
+private:
+    void requestKeyframe()
+    {
+        int64_t now_ms = rtc::TimeMillis();
+        if (now_ms - last_keyframe_request_ms_ < KEYFRAME_REQUEST_INTERVAL_MS)
+            return;
+        last_keyframe_request_ms_ = now_ms;
+        obs_encoder_request_keyframe(encoder_);
+    }
+
+    obs_encoder_t *encoder_;
+    webrtc::EncodedImageCallback *callback_;
+    int max_bitrate_kbps_;
+    int bitrate_kbps_;
+    int64_t last_bitrate_update_ms_;
+    int64_t last_keyframe_request_ms_;
+    uint64_t last_sequence_;
+    bool waiting_keyframe_;
+};
+
+ObsEncoderFactory::ObsEncoderFactory(
+        std::unique_ptr<webrtc::VideoEncoderFactory> fallback)
+    : fallback_(std::move(fallback)), encoder_(nullptr), max_bitrate_kbps_(0)
+{
+}
+
+ObsEncoderFactory::~ObsEncoderFactory()
+{
+    setEncoder(nullptr, 0);
+}
+
+void ObsEncoderFactory::setEncoder(obs_encoder_t *encoder,
+                                   int max_bitrate_kbps)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    obs_encoder_release(encoder_);
+    encoder_ = obs_encoder_get_ref(encoder);
+    max_bitrate_kbps_ = max_bitrate_kbps;
+}
+
+std::vector<webrtc::SdpVideoFormat>
+ObsEncoderFactory::GetSupportedFormats() const
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (encoder_) {
+            // OBS encoders are set to the baseline profile, without B frames
+            return { webrtc::CreateH264Format(
+                    webrtc::H264::kProfileConstrainedBaseline,
+                    webrtc::H264::kLevel3_1, "1") };
+        }
+    }
+    return fallback_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+ObsEncoderFactory::QueryVideoEncoder(const webrtc::SdpVideoFormat &format) const
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (encoder_) {
+            CodecInfo info;
+            info.is_hardware_accelerated = true;
+            info.has_internal_source = false;
+            return info;
+        }
+    }
+    return fallback_->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+ObsEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat &format)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (encoder_ &&
+            absl::EqualsIgnoreCase(format.name, cricket::kH264CodecName))
+            return std::make_unique<ObsVideoEncoder>(encoder_,
+                                                     max_bitrate_kbps_);
+    }
+    return fallback_->CreateVideoEncoder(format);
+}
@@ -0,0 +1,78 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _OBS_ENCODER_FACTORY_H_
+#define _OBS_ENCODER_FACTORY_H_
+
+#include "obs.h"
+
+#include "api/video/i420_buffer.h"
+#include "api/video/video_frame_buffer.h"
+#include "api/video_codecs/video_encoder_factory.h"
+
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+// H.264 packet produced by an OBS encoder, carried through the video track
+// as a native buffer so libwebrtc keeps pacing, RTP timestamps and
+// keyframe requests while ObsVideoEncoder only packetizes it.
+class EncodedFrameBuffer : public webrtc::VideoFrameBuffer {
+public:
+    // packet is referenced, header (SPS/PPS) is prepended to keyframes.
+    EncodedFrameBuffer(struct encoder_packet *packet,
+                       const uint8_t *header, size_t header_size,
+                       int width, int height, uint64_t sequence);
+    ~EncodedFrameBuffer() override;
+
+    Type type() const override { return Type::kNative; }
+    int width() const override  { return width_; }
+    int height() const override { return height_; }
+    // Only reached if a sink cannot handle native buffers: black frame
+    rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+    const uint8_t *data() const;
+    size_t size() const;
+    bool keyframe() const     { return packet_.keyframe; }
+    uint64_t sequence() const { return sequence_; }
+
+private:
+    struct encoder_packet packet_;
+    // Header + packet, keyframes only
+    std::vector<uint8_t> keyframe_data_;
+    int width_;
+    int height_;
+    uint64_t sequence_;
+};
+
+// Video encoder factory used by WebRTCStream.
+//
+// When an OBS encoder is attached, only H.264 is offered and the encoders
+// created just forward its packets: the frames fed to the track must then
+// be EncodedFrameBuffer. Otherwise every call goes to the wrapped factory.
+class ObsEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    explicit ObsEncoderFactory(
+            std::unique_ptr<webrtc::VideoEncoderFactory> fallback);
+    ~ObsEncoderFactory() override;
+
+    // Encoder whose packets are passed through, nullptr to let libwebrtc
+    // encode. Bitrate targets from the bandwidth estimation are applied to
+    // it, up to max_bitrate_kbps.
+    void setEncoder(obs_encoder_t *encoder, int max_bitrate_kbps);
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override;
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override;
+
+private:
+    std::unique_ptr<webrtc::VideoEncoderFactory> fallback_;
+
+    mutable std::mutex mutex_;
+    obs_encoder_t *encoder_;
+    int max_bitrate_kbps_;
+};
+
+#endif
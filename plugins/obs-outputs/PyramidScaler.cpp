@@ -0,0 +1,75 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "PyramidScaler.h"
+
+#include "rtc_base/ref_counted_object.h"
+#include <libyuv.h>
+
+SimulcastFrameBuffer::SimulcastFrameBuffer(
+        rtc::scoped_refptr<webrtc::I420Buffer> *layers, size_t count)
+    : count_(count)
+{
+    for (size_t i = 0; i < count; i++)
+        layers_[i] = layers[i];
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> SimulcastFrameBuffer::ToI420()
+{
+    return layers_[0];
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface>
+SimulcastFrameBuffer::layer(int width, int height) const
+{
+    for (size_t i = count_; i > 0; i--) {
+        const auto &layer = layers_[i - 1];
+        if (layer->width() >= width && layer->height() >= height)
+            return layer;
+    }
+    return layers_[0];
+}
+
+void PyramidScaler::SetMaxBuffers(size_t max_buffers)
+{
+    for (auto &pool : pools_)
+        pool.SetMaxBuffers(max_buffers);
+}
+
+uint64_t PyramidScaler::misses() const
+{
+    uint64_t misses = 0;
+    for (const auto &pool : pools_)
+        misses += pool.misses();
+    return misses;
+}
+
+rtc::scoped_refptr<SimulcastFrameBuffer>
+PyramidScaler::Scale(rtc::scoped_refptr<webrtc::I420Buffer> top, size_t layers)
+{
+    rtc::scoped_refptr<webrtc::I420Buffer> levels[MAX_SIMULCAST_LAYERS];
+    if (layers > MAX_SIMULCAST_LAYERS)
+        layers = MAX_SIMULCAST_LAYERS;
+
+    levels[0] = top;
+    for (size_t i = 1; i < layers; i++) {
+        const auto &src = levels[i - 1];
+        int width = (src->width() + 1) / 2;
+        int height = (src->height() + 1) / 2;
+
+        levels[i] = pools_[i - 1].CreateBuffer(width, height);
+        if (!levels[i])
+            return nullptr;
+
+        libyuv::I420Scale(
+                src->DataY(), src->StrideY(),
+                src->DataU(), src->StrideU(),
+                src->DataV(), src->StrideV(),
+                src->width(), src->height(),
+                levels[i]->MutableDataY(), levels[i]->StrideY(),
+                levels[i]->MutableDataU(), levels[i]->StrideU(),
+                levels[i]->MutableDataV(), levels[i]->StrideV(),
+                width, height, libyuv::kFilterBox);
+    }
+
+    return new rtc::RefCountedObject<SimulcastFrameBuffer>(levels, layers);
+}
@@ -0,0 +1,54 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _PYRAMID_SCALER_H_
+#define _PYRAMID_SCALER_H_
+
+#include "FrameBufferPool.h"
+
+#include "api/video/video_frame_buffer.h"
+
+#define MAX_SIMULCAST_LAYERS 3
+
+// Native frame buffer carrying every simulcast layer of one frame, largest
+// layer first. Layer encoders pick the layer matching their resolution, any
+// other consumer only sees the full resolution layer.
+class SimulcastFrameBuffer : public webrtc::VideoFrameBuffer {
+public:
+    SimulcastFrameBuffer(rtc::scoped_refptr<webrtc::I420Buffer> *layers,
+                         size_t count);
+
+    Type type() const override { return Type::kNative; }
+    int width() const override { return layers_[0]->width(); }
+    int height() const override { return layers_[0]->height(); }
+    rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+    size_t count() const { return count_; }
+
+    // Smallest layer at least |width|x|height|, or the largest one
+    rtc::scoped_refptr<webrtc::I420BufferInterface> layer(int width,
+                                                          int height) const;
+
+private:
+    rtc::scoped_refptr<webrtc::I420Buffer> layers_[MAX_SIMULCAST_LAYERS];
+    size_t count_;
+};
+
+// Builds the simulcast layers of a frame. Each layer is half the size of the
+// previous one and is scaled from it rather than from the full frame, so
+// building three layers reads 1.25 full frames instead of two, and each pass
+// reads a source four times smaller than the one before.
+class PyramidScaler {
+public:
+    void SetMaxBuffers(size_t max_buffers);
+
+    // Returns nullptr when a layer buffer is not available.
+    rtc::scoped_refptr<SimulcastFrameBuffer>
+    Scale(rtc::scoped_refptr<webrtc::I420Buffer> top, size_t layers);
+
+    uint64_t misses() const;
+
+private:
+    FrameBufferPool pools_[MAX_SIMULCAST_LAYERS - 1];
+};
+
+#endif
@@ -3,8 +3,10 @@
 #pragma once
 
 // clang-format off
+#include <random>
 #include <regex>
 #include <sstream>
+#include <stdint.h>
 #include <string>
 #include <string.h>
 #include <vector>
@@ -184,6 +186,85 @@ public:
         sdp = join(sdpLines, "\r\n");
     }
 
+    // Enable Plan B simulcast: add |layers| - 1 ssrcs (and their rtx ssrcs)
+    // to the video section and group them with a=ssrc-group:SIM.
+    // Returns the simulcast ssrcs, lowest resolution layer first.
+    // The same offer goes to the server: Janus, Evercast and Millicast all
+    // take the layers from the SIM group, there is no rid signaling.
+    static std::vector<uint32_t> simulcastSDP(std::string &sdp, int layers)
+    {
+        std::vector<uint32_t> ssrcs;
+        std::vector<std::string> sdpLines;
+        split(sdp, (char *)"\r\n", sdpLines);
+        int aLine = findLines(sdpLines, "m=audio ");
+        int vLine = findLines(sdpLines, "m=video ");
+        if (vLine == -1 || layers < 2)
+            return ssrcs;
+        int video_start = vLine;
+        int video_end = aLine > video_start ? aLine : sdpLines.size();
+        // Already has simulcast
+        int testLine = findLines(sdpLines, "a=ssrc-group:SIM");
+        if (testLine >= video_start && testLine < video_end)
+            return ssrcs;
+        // Primary ssrc and its rtx ssrc, if any
+        std::string primary;
+        std::string rtx;
+        int firstSsrcLine = -1;
+        for (int i = video_start; i < video_end; i++) {
+            std::smatch match;
+            std::regex fidRe("a=ssrc-group:FID ([0-9]+) ([0-9]+)");
+            std::regex ssrcRe("a=ssrc:([0-9]+) ");
+            if (std::regex_search(sdpLines[i], match, fidRe)) {
+                primary = match[1].str();
+                rtx = match[2].str();
+                firstSsrcLine = i;
+                break;
+            }
+            if (std::regex_search(sdpLines[i], match, ssrcRe)) {
+                primary = match[1].str();
+                firstSsrcLine = i;
+                break;
+            }
+        }
+        if (primary.empty())
+            return ssrcs;
+        // Attributes (cname, msid, ...) to replicate for every new ssrc
+        std::vector<std::string> attributes;
+        int lastSsrcLine = firstSsrcLine;
+        for (int i = video_start; i < video_end; i++) {
+            if (sdpLines[i].compare(0, 7, "a=ssrc:") == 0)
+                lastSsrcLine = i;
+            std::string prefix = "a=ssrc:" + primary + " ";
+            if (sdpLines[i].compare(0, prefix.size(), prefix) == 0)
+                attributes.push_back(sdpLines[i].substr(prefix.size()));
+        }
+        std::random_device rd;
+        std::mt19937 gen(rd());
+        std::uniform_int_distribution<uint32_t> dist(1, 0xFFFFFFFF);
+        std::vector<std::string> newLines;
+        std::string simGroup = "a=ssrc-group:SIM " + primary;
+        ssrcs.push_back((uint32_t)std::stoul(primary));
+        for (int layer = 1; layer < layers; layer++) {
+            std::string ssrc = std::to_string(dist(gen));
+            std::string rtxSsrc = std::to_string(dist(gen));
+            simGroup += " " + ssrc;
+            ssrcs.push_back((uint32_t)std::stoul(ssrc));
+            if (!rtx.empty())
+                newLines.push_back("a=ssrc-group:FID " + ssrc + " " + rtxSsrc);
+            for (const auto &attribute : attributes)
+                newLines.push_back("a=ssrc:" + ssrc + " " + attribute);
+            if (!rtx.empty()) {
+                for (const auto &attribute : attributes)
+                    newLines.push_back("a=ssrc:" + rtxSsrc + " " + attribute);
+            }
+        }
+        sdpLines.insert(sdpLines.begin() + lastSsrcLine + 1,
+                        newLines.begin(), newLines.end());
+        sdpLines.insert(sdpLines.begin() + firstSsrcLine, simGroup);
+        sdp = join(sdpLines, "\r\n");
+        return ssrcs;
+    }
+
     // Only accept ice candidates matching protocol (UDP, TCP)
     static bool filterIceCandidates(const std::string &candidate, const std::string &protocol)
     {
@@ -0,0 +1,417 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "SharedEncoderFactory.h"
+
+#include "obs.h"
+
+#include "api/video_codecs/video_encoder.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+#include "modules/video_coding/include/video_error_codes.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+
+// Same encoder output for both: resolution, rate control limits and layers
+static bool same_settings(const webrtc::VideoCodec &a,
+                          const webrtc::VideoCodec &b)
+{
+    if (a.codecType != b.codecType || a.width != b.width ||
+        a.height != b.height || a.maxFramerate != b.maxFramerate ||
+        a.qpMax != b.qpMax || a.mode != b.mode ||
+        a.numberOfSimulcastStreams != b.numberOfSimulcastStreams)
+        return false;
+    for (unsigned char i = 0; i < a.numberOfSimulcastStreams; i++) {
+        const webrtc::SimulcastStream &sa = a.simulcastStream[i];
+        const webrtc::SimulcastStream &sb = b.simulcastStream[i];
+        if (sa.width != sb.width || sa.height != sb.height ||
+            sa.numberOfTemporalLayers != sb.numberOfTemporalLayers)
+            return false;
+    }
+    return true;
+}
+
+// One real encoder and the SharedEncoders using it.
+//
+// Lock order: encode_mutex_, then members_mutex_. encode_mutex_ keeps the
+// encoder from being used concurrently. Synchronous encoders deliver the
+// encoded images from Encode(), with encode_mutex_ held, asynchronous ones
+// (e.g. passthrough) from their own thread: the delivery only takes
+// members_mutex_.
+class SharedEncoderFactory::Group : public webrtc::EncodedImageCallback {
+public:
+    Group(webrtc::VideoEncoderFactory *factory,
+          const webrtc::SdpVideoFormat &format,
+          std::atomic<int> *active_encoders)
+        : factory_(factory),
+          format_(format),
+          active_encoders_(active_encoders),
+          last_timestamp_us_(std::numeric_limits<int64_t>::min()),
+          keyframe_pending_(false)
+    {
+    }
+
+    ~Group() override { releaseEncoder(); }
+
+    // Start using the shared encoder: initialize it for the first user,
+    // only join if the settings match for the others
+    bool join(SharedEncoder *member, const webrtc::VideoCodec &settings,
+              int32_t number_of_cores, size_t max_payload_size)
+    {
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        if (members_.empty()) {
+            if (!encoder_) {
+                encoder_ = factory_->CreateVideoEncoder(format_);
+                if (!encoder_)
+                    return false;
+                encoder_->RegisterEncodeCompleteCallback(this);
+            }
+            if (encoder_->InitEncode(&settings, number_of_cores,
+                                     max_payload_size) !=
+                WEBRTC_VIDEO_CODEC_OK) {
+                releaseEncoder();
+                return false;
+            }
+            settings_ = settings;
+            last_timestamp_us_ = std::numeric_limits<int64_t>::min();
+            (*active_encoders_)++;
+        } else if (!same_settings(settings_, settings)) {
+            return false;
+        } else {
+            // The new peer connection needs a keyframe to start decoding
+            keyframe_pending_ = true;
+            info("Sharing the %s encoder between %d peer connections",
+                 format_.name.c_str(), (int)members_.size() + 1);
+        }
+
+        std::lock_guard<std::mutex> members_lock(members_mutex_);
+        members_[member] = Member();
+        return true;
+    }
+
+    void leave(SharedEncoder *member)
+    {
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        {
+            std::lock_guard<std::mutex> members_lock(members_mutex_);
+            if (!members_.erase(member))
+                return;
+            if (!members_.empty()) {
+                applyRates();
+                return;
+            }
+        }
+        encoder_->Release();
+        (*active_encoders_)--;
+    }
+
+    void setCallback(SharedEncoder *member,
+                     webrtc::EncodedImageCallback *callback)
+    {
+        std::lock_guard<std::mutex> lock(members_mutex_);
+        auto it = members_.find(member);
+        if (it != members_.end())
+            it->second.callback = callback;
+    }
+
+    int32_t encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types)
+    {
+        bool keyframe = false;
+        if (frame_types) {
+            for (auto frame_type : *frame_types)
+                if (frame_type == webrtc::VideoFrameType::kVideoFrameKey)
+                    keyframe = true;
+        }
+
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        // Another peer connection already handed us this frame (or a
+        // newer one): remember a keyframe request for the next frame
+        if (frame.timestamp_us() <= last_timestamp_us_) {
+            keyframe_pending_ |= keyframe;
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+        last_timestamp_us_ = frame.timestamp_us();
+
+        if (!keyframe_pending_)
+            return encoder_->Encode(frame, frame_types);
+
+        size_t streams = std::max<size_t>(1, settings_.numberOfSimulcastStreams);
+        std::vector<webrtc::VideoFrameType> keyframes(
+                streams, webrtc::VideoFrameType::kVideoFrameKey);
+        keyframe_pending_ = false;
+        return encoder_->Encode(frame, &keyframes);
+    }
+
+    void setRates(SharedEncoder *member,
+                  const webrtc::VideoEncoder::RateControlParameters &rates)
+    {
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        std::lock_guard<std::mutex> members_lock(members_mutex_);
+        auto it = members_.find(member);
+        if (it == members_.end())
+            return;
+        it->second.rates = rates;
+        it->second.has_rates = true;
+        applyRates();
+    }
+
+    webrtc::VideoEncoder::EncoderInfo info()
+    {
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        return encoder_->GetEncoderInfo();
+    }
+
+    //
+    // EncodedImageCallback implementation: fan the images out.
+    //
+    Result OnEncodedImage(
+            const webrtc::EncodedImage &image,
+            const webrtc::CodecSpecificInfo *codec_specific_info,
+            const webrtc::RTPFragmentationHeader *fragmentation) override
+    {
+        Result result(Result::OK);
+        std::lock_guard<std::mutex> lock(members_mutex_);
+        for (auto &member : members_) {
+            if (!member.second.callback)
+                continue;
+            Result r = member.second.callback->OnEncodedImage(
+                    image, codec_specific_info, fragmentation);
+            if (r.error != Result::OK)
+                result = r;
+        }
+        return result;
+    }
+
+    void OnDroppedFrame(DropReason reason) override
+    {
+        std::lock_guard<std::mutex> lock(members_mutex_);
+        for (auto &member : members_)
+            if (member.second.callback)
+                member.second.callback->OnDroppedFrame(reason);
+    }
+
+private:
+    struct Member {
+        webrtc::EncodedImageCallback *callback = nullptr;
+        webrtc::VideoEncoder::RateControlParameters rates;
+        bool has_rates = false;
+    };
+
+    // Lowest non-zero target of the members, members_mutex_ held
+    void applyRates()
+    {
+        const Member *lowest = nullptr;
+        for (auto &member : members_) {
+            const Member &m = member.second;
+            if (!m.has_rates || !m.rates.bitrate.get_sum_bps())
+                continue;
+            if (!lowest || m.rates.bitrate.get_sum_bps() <
+                           lowest->rates.bitrate.get_sum_bps())
+                lowest = &m;
+        }
+        if (lowest)
+            encoder_->SetRates(lowest->rates);
+    }
+
+    void releaseEncoder()
+    {
+        if (encoder_)
+            encoder_->Release();
+        encoder_.reset();
+    }
+
+    webrtc::VideoEncoderFactory *factory_;
+    webrtc::SdpVideoFormat format_;
+    std::atomic<int> *active_encoders_;
+
+    std::mutex encode_mutex_;
+    std::unique_ptr<webrtc::VideoEncoder> encoder_;
+    webrtc::VideoCodec settings_;
+    int64_t last_timestamp_us_;
+    bool keyframe_pending_;
+
+    std::mutex members_mutex_;
+    std::map<SharedEncoder *, Member> members_;
+};
+
+// Encoder handed to a peer connection: uses the shared encoder of its
+// format when the settings allow it, its own encoder otherwise.
+class SharedEncoderFactory::SharedEncoder : public webrtc::VideoEncoder {
+public:
+    SharedEncoder(std::shared_ptr<Group> group,
+                  std::unique_ptr<webrtc::VideoEncoder> own,
+                  const std::atomic<bool> *sharing,
+                  std::atomic<int> *active_encoders)
+        : group_(group),
+          own_(std::move(own)),
+          sharing_(sharing),
+          active_encoders_(active_encoders),
+          callback_(nullptr),
+          joined_(false),
+          own_active_(false),
+          number_of_cores_(1),
+          max_payload_size_(0),
+          has_rates_(false)
+    {
+    }
+
+    ~SharedEncoder() override { Release(); }
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       int32_t number_of_cores,
+                       size_t max_payload_size) override
+    {
+        Release();
+        if (!codec_settings)
+            return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+        settings_ = *codec_settings;
+        number_of_cores_ = number_of_cores;
+        max_payload_size_ = max_payload_size;
+
+        if (*sharing_ && joinGroup())
+            return WEBRTC_VIDEO_CODEC_OK;
+        return initOwn();
+    }
+
+    int32_t RegisterEncodeCompleteCallback(
+            webrtc::EncodedImageCallback *callback) override
+    {
+        callback_ = callback;
+        if (joined_)
+            group_->setCallback(this, callback);
+        return own_->RegisterEncodeCompleteCallback(callback);
+    }
+
+    int32_t Release() override
+    {
+        if (joined_)
+            group_->leave(this);
+        joined_ = false;
+        if (own_active_)
+            (*active_encoders_)--;
+        own_active_ = false;
+        return own_->Release();
+    }
+
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override
+    {
+        // Settings changed back to the shared ones (e.g. after the
+        // resolution was adapted): stop encoding on our own
+        if (own_active_ && *sharing_ && joinGroup()) {
+            own_->Release();
+            own_active_ = false;
+            (*active_encoders_)--;
+        }
+        if (joined_)
+            return group_->encode(frame, frame_types);
+        return own_->Encode(frame, frame_types);
+    }
+
+    void SetRates(const RateControlParameters &parameters) override
+    {
+        rates_ = parameters;
+        has_rates_ = true;
+        if (joined_)
+            group_->setRates(this, parameters);
+        else
+            own_->SetRates(parameters);
+    }
+
+    EncoderInfo GetEncoderInfo() const override
+    {
+        return joined_ ? group_->info() : own_->GetEncoderInfo();
+    }
+
+private:
+    bool joinGroup()
+    {
+        if (!group_->join(this, settings_, number_of_cores_,
+                          max_payload_size_))
+            return false;
+        joined_ = true;
+        group_->setCallback(this, callback_);
+        if (has_rates_)
+            group_->setRates(this, rates_);
+        return true;
+    }
+
+    int32_t initOwn()
+    {
+        int32_t ret = own_->InitEncode(&settings_, number_of_cores_,
+                                       max_payload_size_);
+        if (ret != WEBRTC_VIDEO_CODEC_OK)
+            return ret;
+        own_active_ = true;
+        (*active_encoders_)++;
+        if (has_rates_)
+            own_->SetRates(rates_);
+        return ret;
+    }
+
+    std::shared_ptr<Group> group_;
+    std::unique_ptr<webrtc::VideoEncoder> own_;
+    const std::atomic<bool> *sharing_;
+    std::atomic<int> *active_encoders_;
+
+    webrtc::EncodedImageCallback *callback_;
+    bool joined_;
+    bool own_active_;
+    webrtc::VideoCodec settings_;
+    int32_t number_of_cores_;
+    size_t max_payload_size_;
+    RateControlParameters rates_;
+    bool has_rates_;
+};
+
+SharedEncoderFactory::SharedEncoderFactory(
+        std::unique_ptr<webrtc::VideoEncoderFactory> wrapped)
+    : wrapped_(std::move(wrapped)), sharing_(true), active_encoders_(0)
+{
+}
+
+SharedEncoderFactory::~SharedEncoderFactory()
+{
+}
+
+std::vector<webrtc::SdpVideoFormat>
+SharedEncoderFactory::GetSupportedFormats() const
+{
+    return wrapped_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+SharedEncoderFactory::QueryVideoEncoder(
+        const webrtc::SdpVideoFormat &format) const
+{
+    return wrapped_->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+SharedEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat &format)
+{
+    std::unique_ptr<webrtc::VideoEncoder> own =
+            wrapped_->CreateVideoEncoder(format);
+    if (!own)
+        return nullptr;
+
+    // Format parameters (e.g. the H.264 profile) are part of the key
+    std::string key = format.name;
+    for (auto &param : format.parameters)
+        key += ";" + param.first + "=" + param.second;
+
+    std::shared_ptr<Group> group;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Group> &slot = groups_[key];
+        if (!slot)
+            slot = std::make_shared<Group>(wrapped_.get(), format,
+                                           &active_encoders_);
+        group = slot;
+    }
+    return std::make_unique<SharedEncoder>(group, std::move(own), &sharing_,
+                                           &active_encoders_);
+}
@@ -0,0 +1,56 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _SHARED_ENCODER_FACTORY_H_
+#define _SHARED_ENCODER_FACTORY_H_
+
+#include "api/video_codecs/video_encoder_factory.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Video encoder factory letting the peer connections of a fan-out output
+// share their encoders.
+//
+// Every peer connection still gets its own encoder object, but the ones
+// created for the same format with the same settings all delegate to a
+// single real encoder: the first of them to receive a frame encodes it,
+// the copies of that frame coming from the other peer connections are
+// skipped, and the encoded images go to all of them. Each peer connection
+// keeps its own bandwidth estimation; the shared encoder runs at the lowest
+// of their targets and honours keyframe requests from any of them.
+// Encoders whose settings differ, or all of them when sharing is off,
+// encode on their own.
+class SharedEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    explicit SharedEncoderFactory(
+            std::unique_ptr<webrtc::VideoEncoderFactory> wrapped);
+    ~SharedEncoderFactory() override;
+
+    // Applies to the encoders initialized from now on
+    void setSharing(bool sharing) { sharing_ = sharing; }
+    // Real encoders currently encoding
+    int activeEncoders() const    { return active_encoders_; }
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override;
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override;
+
+private:
+    class Group;
+    class SharedEncoder;
+
+    std::unique_ptr<webrtc::VideoEncoderFactory> wrapped_;
+
+    std::mutex mutex_;
+    // By format, they live as long as the factory
+    std::map<std::string, std::shared_ptr<Group>> groups_;
+    std::atomic<bool> sharing_;
+    std::atomic<int> active_encoders_;
+};
+
+#endif
@@ -0,0 +1,151 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "SimulcastEncoderFactory.h"
+#include "PyramidScaler.h"
+
+#include "api/video/i420_buffer.h"
+#include "api/video_codecs/builtin_video_encoder_factory.h"
+#include "api/video_codecs/video_encoder.h"
+#include "media/engine/internal_encoder_factory.h"
+#include "media/engine/simulcast_encoder_adapter.h"
+
+// Encoder of a single simulcast layer: replaces the SimulcastFrameBuffer of
+// incoming frames with the pre-scaled layer matching its resolution.
+class LayerEncoder : public webrtc::VideoEncoder {
+public:
+    explicit LayerEncoder(std::unique_ptr<webrtc::VideoEncoder> encoder)
+        : encoder_(std::move(encoder)), width_(0), height_(0)
+    {
+    }
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       int32_t number_of_cores,
+                       size_t max_payload_size) override
+    {
+        width_ = codec_settings->width;
+        height_ = codec_settings->height;
+        return encoder_->InitEncode(codec_settings, number_of_cores,
+                                    max_payload_size);
+    }
+
+    int32_t RegisterEncodeCompleteCallback(
+            webrtc::EncodedImageCallback *callback) override
+    {
+        return encoder_->RegisterEncodeCompleteCallback(callback);
+    }
+
+    int32_t Release() override { return encoder_->Release(); }
+
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override
+    {
+        rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+                frame.video_frame_buffer();
+        if (buffer->type() != webrtc::VideoFrameBuffer::Type::kNative)
+            return encoder_->Encode(frame, frame_types);
+
+        // The only native buffers fed to the video track are ours
+        auto *layers = static_cast<SimulcastFrameBuffer *>(buffer.get());
+        rtc::scoped_refptr<webrtc::I420BufferInterface> layer =
+                layers->layer(width_, height_);
+
+        // Resolution adapted in between two layers: scale the closest one
+        if (layer->width() != width_ || layer->height() != height_) {
+            rtc::scoped_refptr<webrtc::I420Buffer> scaled =
+                    webrtc::I420Buffer::Create(width_, height_);
+            scaled->ScaleFrom(*layer);
+            layer = scaled;
+        }
+
+        webrtc::VideoFrame layer_frame(frame);
+        layer_frame.set_video_frame_buffer(layer);
+        return encoder_->Encode(layer_frame, frame_types);
+    }
+
+    void SetRates(const RateControlParameters &parameters) override
+    {
+        encoder_->SetRates(parameters);
+    }
+
+    void OnPacketLossRateUpdate(float packet_loss_rate) override
+    {
+        encoder_->OnPacketLossRateUpdate(packet_loss_rate);
+    }
+
+    void OnRttUpdate(int64_t rtt_ms) override
+    {
+        encoder_->OnRttUpdate(rtt_ms);
+    }
+
+    EncoderInfo GetEncoderInfo() const override
+    {
+        EncoderInfo info = encoder_->GetEncoderInfo();
+        // Keep libwebrtc from converting SimulcastFrameBuffer to I420
+        info.supports_native_handle = true;
+        return info;
+    }
+
+private:
+    std::unique_ptr<webrtc::VideoEncoder> encoder_;
+    int width_;
+    int height_;
+};
+
+class SimulcastEncoderFactory::LayerEncoderFactory
+    : public webrtc::VideoEncoderFactory {
+public:
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override
+    {
+        return internal_.GetSupportedFormats();
+    }
+
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override
+    {
+        return internal_.QueryVideoEncoder(format);
+    }
+
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override
+    {
+        std::unique_ptr<webrtc::VideoEncoder> encoder =
+                internal_.CreateVideoEncoder(format);
+        if (!encoder)
+            return nullptr;
+        return std::make_unique<LayerEncoder>(std::move(encoder));
+    }
+
+private:
+    webrtc::InternalEncoderFactory internal_;
+};
+
+SimulcastEncoderFactory::SimulcastEncoderFactory()
+    : builtin_(webrtc::CreateBuiltinVideoEncoderFactory()),
+      layer_factory_(new LayerEncoderFactory()),
+      layers_(1)
+{
+}
+
+SimulcastEncoderFactory::~SimulcastEncoderFactory() = default;
+
+std::vector<webrtc::SdpVideoFormat>
+SimulcastEncoderFactory::GetSupportedFormats() const
+{
+    return builtin_->GetSupportedFormats();
+}
+
+webrtc::VideoEncoderFactory::CodecInfo
+SimulcastEncoderFactory::QueryVideoEncoder(
+        const webrtc::SdpVideoFormat &format) const
+{
+    return builtin_->QueryVideoEncoder(format);
+}
+
+std::unique_ptr<webrtc::VideoEncoder>
+SimulcastEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat &format)
+{
+    if (layers_ < 2)
+        return builtin_->CreateVideoEncoder(format);
+    return std::make_unique<webrtc::SimulcastEncoderAdapter>(
+            layer_factory_.get(), format);
+}
@@ -0,0 +1,39 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _SIMULCAST_ENCODER_FACTORY_H_
+#define _SIMULCAST_ENCODER_FACTORY_H_
+
+#include "api/video_codecs/video_encoder_factory.h"
+
+#include <atomic>
+#include <memory>
+
+// Video encoder factory used by WebRTCStream.
+//
+// Without simulcast it behaves like the builtin factory. With simulcast,
+// encoders are built as a SimulcastEncoderAdapter whose per-layer encoders
+// take their input from the SimulcastFrameBuffer layer matching their
+// resolution, so libwebrtc does not rescale the full frame for every layer.
+class SimulcastEncoderFactory : public webrtc::VideoEncoderFactory {
+public:
+    SimulcastEncoderFactory();
+    ~SimulcastEncoderFactory() override;
+
+    // Number of layers of the next encoders created
+    void setLayers(int layers) { layers_ = layers; }
+
+    std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
+    CodecInfo QueryVideoEncoder(
+            const webrtc::SdpVideoFormat &format) const override;
+    std::unique_ptr<webrtc::VideoEncoder> CreateVideoEncoder(
+            const webrtc::SdpVideoFormat &format) override;
+
+private:
+    class LayerEncoderFactory;
+
+    std::unique_ptr<webrtc::VideoEncoderFactory> builtin_;
+    std::unique_ptr<webrtc::VideoEncoderFactory> layer_factory_;
+    std::atomic<int> layers_;
+};
+
+#endif
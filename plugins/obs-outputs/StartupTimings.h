@@ -0,0 +1,76 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _STARTUP_TIMINGS_H_
+#define _STARTUP_TIMINGS_H_
+
+#include "rtc_base/time_utils.h"
+
+#include <atomic>
+#include <stdint.h>
+
+enum StartupPhase {
+    STARTUP_PEER_CONNECTION = 0, // peer connection created
+    STARTUP_WS_CONNECTED,        // signaling websocket connected
+    STARTUP_LOGGED,              // signaling session ready for an offer
+    STARTUP_ICE_GATHERED,        // local candidates gathered
+    STARTUP_DTLS_CONNECTED,      // peer connection state "connected"
+    STARTUP_FIRST_FRAME,         // first video frame handed to the track
+    STARTUP_PHASE_COUNT
+};
+
+// Time from WebRTCStream::start() to each startup phase.
+//
+// Phases reached while the connection was pre-warmed count as 0 ms once the
+// stream starts. mark() can be called from any thread, only the first call
+// for a phase is kept.
+class StartupTimings {
+public:
+    StartupTimings() : warm_(false), start_us_(0)
+    {
+        for (auto &phase : phases_us_)
+            phase = 0;
+    }
+
+    // New connection (cold start or pre-warming)
+    void reset()
+    {
+        warm_ = false;
+        start_us_ = rtc::TimeMicros();
+        for (auto &phase : phases_us_)
+            phase = 0;
+    }
+
+    // start() reuses the connection opened by reset()
+    void restart()
+    {
+        warm_ = true;
+        start_us_ = rtc::TimeMicros();
+    }
+
+    void mark(StartupPhase phase)
+    {
+        int64_t expected = 0;
+        phases_us_[phase].compare_exchange_strong(expected,
+                                                  rtc::TimeMicros());
+    }
+
+    bool reached(StartupPhase phase) const { return phases_us_[phase] != 0; }
+
+    // -1 if not reached yet
+    int64_t elapsedMs(StartupPhase phase) const
+    {
+        int64_t us = phases_us_[phase];
+        if (!us)
+            return -1;
+        return us > start_us_ ? (us - start_us_) / 1000 : 0;
+    }
+
+    bool warm() const { return warm_; }
+
+private:
+    std::atomic<bool> warm_;
+    std::atomic<int64_t> start_us_;
+    std::atomic<int64_t> phases_us_[STARTUP_PHASE_COUNT];
+};
+
+#endif
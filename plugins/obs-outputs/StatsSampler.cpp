@@ -0,0 +1,223 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#include "StatsSampler.h"
+
+#include "api/stats/rtcstats_objects.h"
+#include "rtc_base/location.h"
+
+#define MSG_SAMPLE 1
+#define MIN_INTERVAL_MS 100
+
+static WebRTCQualityLimitation
+quality_limitation(const webrtc::RTCStatsMember<std::string> &member)
+{
+    if (!member.is_defined() || *member == "none")
+        return QUALITY_LIMITATION_NONE;
+    if (*member == "cpu")
+        return QUALITY_LIMITATION_CPU;
+    if (*member == "bandwidth")
+        return QUALITY_LIMITATION_BANDWIDTH;
+    return QUALITY_LIMITATION_OTHER;
+}
+
+template <typename T, typename M>
+static inline void get_value(const M &member, T &value)
+{
+    if (member.is_defined())
+        value = (T)*member;
+}
+
+StatsSampler::StatsSampler(rtc::Thread *signaling)
+    : signaling_(signaling),
+      interval_ms_(1000),
+      pending_(false),
+      total_bytes_sent_(0),
+      pli_count_(0)
+{
+}
+
+StatsSampler::~StatsSampler()
+{
+    signaling_->Clear(this);
+}
+
+void StatsSampler::start(rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc,
+                         int interval_ms,
+                         const std::vector<uint32_t> &layer_ssrcs)
+{
+    signaling_->Invoke<void>(RTC_FROM_HERE, [&]() {
+        signaling_->Clear(this);
+        pc_ = pc;
+        layer_ssrcs_ = layer_ssrcs;
+        if (layer_ssrcs_.size() > MAX_STATS_LAYERS)
+            layer_ssrcs_.resize(MAX_STATS_LAYERS);
+        interval_ms_ = interval_ms < MIN_INTERVAL_MS ? MIN_INTERVAL_MS
+                                                     : interval_ms;
+        pending_ = false;
+        previous_ = WebRTCStatsSnapshot();
+        signaling_->PostDelayed(RTC_FROM_HERE, interval_ms_, this, MSG_SAMPLE);
+    });
+}
+
+void StatsSampler::stop()
+{
+    signaling_->Invoke<void>(RTC_FROM_HERE, [this]() {
+        signaling_->Clear(this);
+        pc_ = nullptr;
+    });
+}
+
+WebRTCStatsSnapshot StatsSampler::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return snapshot_;
+}
+
+void StatsSampler::publish(const WebRTCStatsSnapshot &snapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        snapshot_ = snapshot;
+    }
+
+    total_bytes_sent_ = snapshot.audio_bytes_sent + snapshot.video_bytes_sent;
+    pli_count_ = snapshot.pli_count;
+}
+
+void StatsSampler::OnMessage(rtc::Message *msg)
+{
+    if (msg->message_id != MSG_SAMPLE || !pc_)
+        return;
+
+    // Skip this tick if the previous report has not been delivered yet
+    if (!pending_) {
+        pending_ = true;
+        pc_->GetStats(this);
+    }
+
+    signaling_->PostDelayed(RTC_FROM_HERE, interval_ms_, this, MSG_SAMPLE);
+}
+
+void StatsSampler::OnStatsDelivered(
+        const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report)
+{
+    pending_ = false;
+    if (!report)
+        return;
+
+    WebRTCStatsSnapshot s;
+    s.timestamp_us = report->timestamp_us();
+
+    for (const auto &stat :
+         report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+        if (*stat->kind == "audio") {
+            get_value(stat->bytes_sent, s.audio_bytes_sent);
+            get_value(stat->packets_sent, s.audio_packets_sent);
+        } else if (*stat->kind == "video") {
+            // Simulcast layers each have their own stream, sum them up
+            uint64_t bytes_sent = 0, packets_sent = 0, qp_sum = 0;
+            uint32_t nack_count = 0, pli_count = 0, fir_count = 0;
+            uint32_t frames_encoded = 0;
+            double total_encode_time = 0.0;
+            get_value(stat->bytes_sent, bytes_sent);
+            get_value(stat->packets_sent, packets_sent);
+            get_value(stat->nack_count, nack_count);
+            get_value(stat->pli_count, pli_count);
+            get_value(stat->fir_count, fir_count);
+            get_value(stat->frames_encoded, frames_encoded);
+            get_value(stat->total_encode_time, total_encode_time);
+            get_value(stat->qp_sum, qp_sum);
+            s.video_bytes_sent += bytes_sent;
+            s.video_packets_sent += packets_sent;
+            s.nack_count += nack_count;
+            s.pli_count += pli_count;
+            s.fir_count += fir_count;
+            s.frames_encoded += frames_encoded;
+            s.total_encode_time += total_encode_time;
+            s.qp_sum += qp_sum;
+            // Highest priority reason among the layers
+            WebRTCQualityLimitation limitation =
+                    quality_limitation(stat->quality_limitation_reason);
+            if (limitation > s.quality_limitation)
+                s.quality_limitation = limitation;
+
+            uint32_t ssrc = 0;
+            get_value(stat->ssrc, ssrc);
+            for (size_t i = 0; i < layer_ssrcs_.size(); i++) {
+                if (layer_ssrcs_[i] != ssrc)
+                    continue;
+                s.layers[i].ssrc = ssrc;
+                s.layers[i].bytes_sent = bytes_sent;
+                s.layers[i].frames_encoded = frames_encoded;
+            }
+        }
+    }
+    s.layer_count = layer_ssrcs_.size();
+
+    for (const auto &stat :
+         report->GetStatsOfType<webrtc::RTCRemoteInboundRtpStreamStats>()) {
+        if (*stat->kind == "video") {
+            get_value(stat->round_trip_time, s.round_trip_time);
+            get_value(stat->jitter, s.jitter);
+        }
+    }
+
+    for (const auto &stat :
+         report->GetStatsOfType<webrtc::RTCIceCandidatePairStats>()) {
+        if (!stat->nominated.is_defined() || !*stat->nominated)
+            continue;
+        get_value(stat->available_outgoing_bitrate,
+                  s.available_outgoing_bitrate);
+        // Prefer the RTCP round trip time, fall back to STUN's
+        if (s.round_trip_time == 0.0)
+            get_value(stat->current_round_trip_time, s.round_trip_time);
+    }
+
+    for (const auto &stat :
+         report->GetStatsOfType<webrtc::RTCMediaStreamTrackStats>()) {
+        if (*stat->kind == "audio") {
+            get_value(stat->audio_level, s.audio_level);
+            get_value(stat->total_audio_energy, s.total_audio_energy);
+            get_value(stat->total_samples_duration, s.total_samples_duration);
+        } else if (*stat->kind == "video") {
+            get_value(stat->frame_width, s.frame_width);
+            get_value(stat->frame_height, s.frame_height);
+            get_value(stat->frames_sent, s.frames_sent);
+            get_value(stat->huge_frames_sent, s.huge_frames_sent);
+        }
+    }
+
+    for (const auto &stat :
+         report->GetStatsOfType<webrtc::RTCTransportStats>()) {
+        get_value(stat->bytes_sent, s.transport_bytes_sent);
+        get_value(stat->bytes_received, s.transport_bytes_received);
+    }
+
+    // FPS = frames sent since the previous sample / elapsed time
+    if (previous_.timestamp_us && s.timestamp_us > previous_.timestamp_us &&
+        s.frames_sent >= previous_.frames_sent) {
+        double elapsed = (double)(s.timestamp_us - previous_.timestamp_us) /
+                         1000000.0;
+        s.fps = (double)(s.frames_sent - previous_.frames_sent) / elapsed;
+    }
+    if (previous_.timestamp_us && s.timestamp_us > previous_.timestamp_us) {
+        double elapsed = (double)(s.timestamp_us - previous_.timestamp_us) /
+                         1000000.0;
+        for (size_t i = 0; i < s.layer_count; i++) {
+            const WebRTCLayerStats &prev = previous_.layers[i];
+            WebRTCLayerStats &layer = s.layers[i];
+            if (layer.bytes_sent >= prev.bytes_sent)
+                layer.bitrate = (double)(layer.bytes_sent - prev.bytes_sent) *
+                                8.0 / elapsed;
+            if (layer.frames_encoded >= prev.frames_encoded)
+                layer.fps = (double)(layer.frames_encoded -
+                                     prev.frames_encoded) / elapsed;
+        }
+    }
+    previous_ = s;
+
+    publish(s);
+
+    if (listener_)
+        listener_(s);
+}
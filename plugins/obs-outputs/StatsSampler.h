@@ -0,0 +1,140 @@
+/* Copyright Dr. Alex. Gouaillard (2015, 2020) */
+
+#ifndef _STATS_SAMPLER_H_
+#define _STATS_SAMPLER_H_
+
+#include "api/peer_connection_interface.h"
+#include "api/scoped_refptr.h"
+#include "api/stats/rtc_stats_collector_callback.h"
+#include "rtc_base/message_handler.h"
+#include "rtc_base/ref_counted_object.h"
+#include "rtc_base/thread.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#define MAX_STATS_LAYERS 3
+
+// Why libwebrtc currently limits the video quality (qualityLimitationReason),
+// by increasing priority
+enum WebRTCQualityLimitation {
+    QUALITY_LIMITATION_NONE = 0,
+    QUALITY_LIMITATION_OTHER,
+    QUALITY_LIMITATION_CPU,
+    QUALITY_LIMITATION_BANDWIDTH
+};
+
+// Counters of one simulcast layer (outbound RTP stream).
+struct WebRTCLayerStats {
+    uint32_t ssrc = 0;
+    uint64_t bytes_sent = 0;
+    uint32_t frames_encoded = 0;
+    double   bitrate = 0.0;           // bits per second
+    double   fps = 0.0;
+};
+
+// Typed counters extracted from one RTCStatsReport.
+struct WebRTCStatsSnapshot {
+    int64_t  timestamp_us = 0;
+
+    // Outbound RTP
+    uint64_t audio_bytes_sent = 0;
+    uint64_t audio_packets_sent = 0;
+    uint64_t video_bytes_sent = 0;
+    uint64_t video_packets_sent = 0;
+    uint32_t nack_count = 0;
+    uint32_t pli_count = 0;
+    uint32_t fir_count = 0;
+    uint32_t frames_encoded = 0;
+    double   total_encode_time = 0.0; // seconds
+    uint64_t qp_sum = 0;
+    WebRTCQualityLimitation quality_limitation = QUALITY_LIMITATION_NONE;
+
+    // Remote inbound RTP (receiver reports) and transport
+    double   round_trip_time = 0.0;   // seconds
+    double   jitter = 0.0;            // seconds
+    double   available_outgoing_bitrate = 0.0; // bits per second
+
+    // Tracks
+    uint32_t frame_width = 0;
+    uint32_t frame_height = 0;
+    uint32_t frames_sent = 0;
+    uint32_t huge_frames_sent = 0;
+    double   fps = 0.0;
+    double   audio_level = 0.0;
+    double   total_audio_energy = 0.0;
+    double   total_samples_duration = 0.0;
+
+    // Simulcast layers, lowest resolution first
+    size_t   layer_count = 0;
+    WebRTCLayerStats layers[MAX_STATS_LAYERS];
+
+    // Transport
+    uint64_t transport_bytes_sent = 0;
+    uint64_t transport_bytes_received = 0;
+};
+
+// Periodically collects the peer connection stats on the signaling thread
+// and publishes them as a snapshot. Readers never wait on libwebrtc: they
+// copy the latest published snapshot, only waiting for a copy in progress.
+class StatsSampler : public rtc::MessageHandler,
+                     public webrtc::RTCStatsCollectorCallback {
+public:
+    explicit StatsSampler(rtc::Thread *signaling);
+    ~StatsSampler() override;
+
+    // Start/stop sampling pc every interval_ms. Safe to call from any
+    // thread; both are executed on the signaling thread. layer_ssrcs lists
+    // the simulcast ssrcs, lowest layer first (empty without simulcast).
+    void start(rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc,
+               int interval_ms,
+               const std::vector<uint32_t> &layer_ssrcs);
+    void stop();
+
+    // Called on the signaling thread with every new snapshot. Set it
+    // before start().
+    void setListener(std::function<void(const WebRTCStatsSnapshot &)> listener)
+    {
+        listener_ = listener;
+    }
+
+    // Latest published snapshot.
+    WebRTCStatsSnapshot snapshot() const;
+
+    // Totals of the latest snapshot, for get_total_bytes/get_dropped_frames.
+    uint64_t totalBytesSent() const { return total_bytes_sent_; }
+    int      pliCount() const       { return (int)pli_count_; }
+
+protected:
+    // rtc::MessageHandler
+    void OnMessage(rtc::Message *msg) override;
+
+    // webrtc::RTCStatsCollectorCallback
+    void OnStatsDelivered(
+            const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report) override;
+
+private:
+    void publish(const WebRTCStatsSnapshot &snapshot);
+
+    rtc::Thread *signaling_;
+
+    // Only touched on the signaling thread
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc_;
+    int interval_ms_;
+    std::vector<uint32_t> layer_ssrcs_;
+    bool pending_;
+    WebRTCStatsSnapshot previous_;
+    std::function<void(const WebRTCStatsSnapshot &)> listener_;
+
+    // Published once per interval, a copy is all it guards
+    mutable std::mutex snapshot_mutex_;
+    WebRTCStatsSnapshot snapshot_;
+
+    std::atomic<uint64_t> total_bytes_sent_;
+    std::atomic<uint32_t> pli_count_;
+};
+
+#endif
@@ -3,7 +3,9 @@
 #include "WebRTCStream.h"
 #include "SDPModif.h"
 
+#include "media-io/audio-io.h"
 #include "media-io/video-io.h"
+#include "util/profiler.h"
 
 #include "api/audio_codecs/builtin_audio_decoder_factory.h"
 #include "api/audio_codecs/builtin_audio_encoder_factory.h"
@@ -11,13 +13,13 @@
 #include "api/video_codecs/builtin_video_encoder_factory.h"
 #include "api/video/i420_buffer.h"
 #include "common_video/libyuv/include/webrtc_libyuv.h"
-#include "pc/rtc_stats_collector.h"
 #include "rtc_base/checks.h"
 #include "rtc_base/critical_section.h"
 #include <libyuv.h>
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <iterator>
 #include <memory>
 #include <mutex>
@@ -30,21 +32,14 @@
 #define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
 #define error(format, ...) blog(LOG_ERROR,   format, ##__VA_ARGS__)
 
-class StatsCallback : public webrtc::RTCStatsCollectorCallback {
-public:
-    rtc::scoped_refptr<const webrtc::RTCStatsReport> report() { return report_; }
-    bool called() const { return called_; }
-protected:
-    void OnStatsDelivered(
-            const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report) override
-    {
-        report_ = report;
-        called_ = true;
-    }
-private:
-    bool called_ = false;
-    rtc::scoped_refptr<const webrtc::RTCStatsReport> report_;
-};
+static const char *onAudioFrame_name = "WebRTCStream::onAudioFrame";
+static const char *pyramid_profile_name = "WebRTCStream::onVideoFrame(simulcast)";
+static const char *adapt_profile_name = "WebRTCStream::onVideoFrame(adapt)";
+
+static void on_video_packet(void *param, struct encoder_packet *packet)
+{
+    static_cast<WebRTCStream *>(param)->onVideoPacket(packet);
+}
 
 class CustomLogger : public rtc::LogSink {
 public:
@@ -62,10 +57,17 @@ WebRTCStream::WebRTCStream(obs_output_t *output)
     rtc::LogMessage::AddLogToStream(&logger, rtc::LoggingSeverity::LS_VERBOSE);
 
     frame_id = 0;
-    pli_received = 0;
-    audio_bytes_sent = 0;
-    video_bytes_sent = 0;
-    total_bytes_sent = 0;
+    simulcast_layers = 1;
+    passthrough_encoder = nullptr;
+    passthrough_sequence = 0;
+    passthrough = false;
+    adaptive_video = false;
+    warm_start = false;
+    active = false;
+    logged = false;
+    factory_ms = 0;
+    type = WebRTCStream::Type::Janus;
+    convert_profile_name = "WebRTCStream::onVideoFrame";
 
     audio_bitrate = 128;
     video_bitrate = 2500;
@@ -92,6 +94,25 @@ WebRTCStream::WebRTCStream(obs_output_t *output)
     signaling->SetName("signaling", nullptr);
     signaling->Start();
 
+    // Stats are collected asynchronously on the signaling thread
+    stats_sampler = new rtc::RefCountedObject<StatsSampler>(signaling.get());
+    stats_sampler->setListener([this](const WebRTCStatsSnapshot &stats) {
+        onStats(stats);
+    });
+
+    // Video encoder factories, owned by the peer connection factory
+    std::unique_ptr<SimulcastEncoderFactory> simulcast_encoder_factory(
+            new SimulcastEncoderFactory());
+    encoder_factory = simulcast_encoder_factory.get();
+    std::unique_ptr<ObsEncoderFactory> obs_video_encoder_factory(
+            new ObsEncoderFactory(std::move(simulcast_encoder_factory)));
+    obs_encoder_factory = obs_video_encoder_factory.get();
+    // Fan-out destinations share the encoders with the same settings
+    std::unique_ptr<SharedEncoderFactory> video_encoder_factory(
+            new SharedEncoderFactory(std::move(obs_video_encoder_factory)));
+    shared_encoder_factory = video_encoder_factory.get();
+
+    int64_t factory_start_us = rtc::TimeMicros();
     factory = webrtc::CreatePeerConnectionFactory(
             network.get(),
             worker.get(),
@@ -99,11 +120,13 @@ WebRTCStream::WebRTCStream(obs_output_t *output)
             adm,
             webrtc::CreateBuiltinAudioEncoderFactory(),
             webrtc::CreateBuiltinAudioDecoderFactory(),
-            webrtc::CreateBuiltinVideoEncoderFactory(),
+            std::move(video_encoder_factory),
             webrtc::CreateBuiltinVideoDecoderFactory(),
             nullptr,
             nullptr);
 
+    factory_ms = (rtc::TimeMicros() - factory_start_us) / 1000;
+
     // Create video capture module
     videoCapturer = new rtc::RefCountedObject<VideoCapturer>();
 }
@@ -112,10 +135,12 @@ WebRTCStream::~WebRTCStream()
 {
     rtc::LogMessage::RemoveLogToStream(&logger);
 
-    // Shutdown websocket connection and close Peer Connection
+    // Shutdown websocket connection and close Peer Connections
+    stopDestinations();
     close(false);
 
     // Free factories
+    stats_sampler = nullptr;
     adm = nullptr;
     pc = nullptr;
     factory = nullptr;
@@ -134,19 +159,36 @@ WebRTCStream::~WebRTCStream()
     signaling.release();
 }
 
-bool WebRTCStream::start(WebRTCStream::Type type)
+bool WebRTCStream::readService(WebRTCStream::Type type, std::string &last_error)
 {
-    info("WebRTCStream::start");
     this->type = type;
 
+    // Output settings
+    obs_data_t *settings = obs_output_get_settings(output);
+    warm_start = obs_data_get_bool(settings, "warm_start");
+    shared_encoder_factory->setSharing(
+            obs_data_get_bool(settings, "fanout_shared_encoder"));
+    const char *servers = obs_data_get_string(settings, "ice_servers");
+    ice_servers = servers && *servers ? servers : "stun:stun.l.google.com:19302";
+    // Loopback: answered in process, there is no service and no STUN
+    // server is needed
+    if (type == WebRTCStream::Type::Loopback) {
+        ice_servers = servers ? servers : "";
+        url = room = "loopback";
+        username = password = protocol = "";
+        video_codec = obs_data_get_string(settings, "codec");
+        simulcast_layers = 1;
+        passthrough = false;
+        obs_data_release(settings);
+        return true;
+    }
+    obs_data_release(settings);
+
     // Access service if started, or fail
 
     obs_service_t *service = obs_output_get_service(output);
     if (!service) {
-        obs_output_set_last_error(
-            output,
-            "An unexpected error occurred during stream startup.");
-        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        last_error = "An unexpected error occurred during stream startup.";
         return false;
     }
 
@@ -158,9 +200,15 @@ bool WebRTCStream::start(WebRTCStream::Type type)
     password = obs_service_get_password(service) ? obs_service_get_password(service) : "";
     video_codec = obs_service_get_codec(service) ? obs_service_get_codec(service)    : "";
     protocol = obs_service_get_protocol(service) ? obs_service_get_protocol(service) : "";
-    // Some extra log
-    info("Video codec: %s", video_codec.empty() ? "Automatic" : video_codec.c_str());
-    info("Protocol:    %s", protocol.empty()    ? "Automatic" : protocol.c_str());
+    obs_data_t *service_settings = obs_service_get_settings(service);
+    simulcast_layers = (int)obs_data_get_int(service_settings, "simulcast_layers");
+    passthrough = obs_data_get_bool(service_settings, "encoder_passthrough");
+    obs_data_release(service_settings);
+    simulcast_layers = std::max(1, std::min(simulcast_layers, MAX_SIMULCAST_LAYERS));
+    // Wowza takes a single video stream, and its offer is rewritten down
+    // to one payload anyway
+    if (type == WebRTCStream::Type::Wowza)
+        simulcast_layers = 1;
 
     // Stream setting sanity check
 
@@ -182,9 +230,46 @@ bool WebRTCStream::start(WebRTCStream::Type type)
         }
     }
     if (!isServiceValid) {
-        obs_output_set_last_error(
-            output,
-            "Your service settings are not complete. Open the settings => stream window and complete them.");
+        last_error = "Your service settings are not complete. Open the settings => stream window and complete them.";
+        return false;
+    }
+
+    return true;
+}
+
+std::string WebRTCStream::sessionKey() const
+{
+    return std::to_string(type) + "\n" + url + "\n" + room + "\n" +
+            username + "\n" + password + "\n" + ice_servers;
+}
+
+bool WebRTCStream::prewarm(WebRTCStream::Type type)
+{
+    if (pc.get())
+        return true;
+
+    std::string last_error;
+    if (!readService(type, last_error)) {
+        warn("Not pre-warming the connection: %s", last_error.c_str());
+        return false;
+    }
+
+    info("WebRTCStream::prewarm");
+    startup.reset();
+    if (!connectSignaling(last_error)) {
+        warn("Pre-warming the connection failed: %s", last_error.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool WebRTCStream::start(WebRTCStream::Type type)
+{
+    info("WebRTCStream::start");
+
+    std::string last_error;
+    if (!readService(type, last_error)) {
+        obs_output_set_last_error(output, last_error.c_str());
         obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
         return false;
     }
@@ -204,14 +289,103 @@ bool WebRTCStream::start(WebRTCStream::Type type)
     video_bitrate = (int)obs_data_get_int(vsettings, "bitrate");
     obs_data_release(vsettings);
 
-    // Shutdown websocket connection and close Peer Connection (just in case)
-    if (close(false))
+    // Passthrough: send the packets of the OBS video encoder instead of
+    // encoding the raw frames again. Only H.264 without simulcast.
+    passthrough_encoder = nullptr;
+    if (passthrough) {
+        const char *codec = vencoder ? obs_encoder_get_codec(vencoder) : nullptr;
+        if (!codec || strcmp(codec, "h264") != 0) {
+            warn("Encoder passthrough needs an H.264 video encoder");
+        } else if (simulcast_layers > 1) {
+            warn("Encoder passthrough is not available with simulcast");
+        } else {
+            passthrough_encoder = vencoder;
+            video_codec = "h264";
+            // WebRTC does not allow B frames. Only change the encoder if
+            // nothing else (e.g. recording) is using it.
+            if (!obs_encoder_active(vencoder)) {
+                obs_data_t *update = obs_data_create();
+                obs_data_set_string(update, "profile", "baseline");
+                obs_data_set_int(update, "bf", 0);
+                obs_encoder_update(vencoder, update);
+                obs_data_release(update);
+            } else {
+                warn("Encoder passthrough: '%s' is already active, its "
+                     "settings must not use B frames",
+                     obs_encoder_get_name(vencoder));
+            }
+        }
+    }
+    encoder_factory->setLayers(simulcast_layers);
+    obs_encoder_factory->setEncoder(passthrough_encoder, video_bitrate);
+
+    // Some extra log
+    info("Video codec: %s", video_codec.empty() ? "Automatic" : video_codec.c_str());
+    info("Protocol:    %s", protocol.empty()    ? "Automatic" : protocol.c_str());
+    info("Simulcast:   %d layer(s)", simulcast_layers);
+    info("Passthrough: %s", passthrough_encoder ?
+            obs_encoder_get_name(passthrough_encoder) : "Off");
+
+    bool was_active;
+    {
+        std::lock_guard<std::mutex> lock(warm_mutex);
+        was_active = active;
+        active = true;
+
+        // Pre-warmed connection to the same service: only the offer/answer
+        // is left to do. The encoders settings above only matter from the
+        // offer on.
+        if (!was_active && pc.get() && client && warm_key == sessionKey()) {
+            info("Using pre-warmed connection to %s", url.c_str());
+            startup.restart();
+            if (logged)
+                createOffer();
+            startDestinations();
+            return true;
+        }
+    }
+
+    // Shutdown websocket connection and close Peer Connection (just in
+    // case). A stale pre-warmed connection is not an error.
+    if (close(false) && was_active)
         obs_output_signal_stop(output, OBS_OUTPUT_ERROR);
 
+    startup.reset();
+    if (!connectSignaling(last_error)) {
+        active = false;
+        obs_output_set_last_error(output, last_error.c_str());
+        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        return false;
+    }
+    startDestinations();
+    return true;
+}
+
+webrtc::PeerConnectionInterface::RTCConfiguration
+WebRTCStream::rtcConfiguration() const
+{
     webrtc::PeerConnectionInterface::RTCConfiguration config;
     webrtc::PeerConnectionInterface::IceServer server;
-    server.urls = { "stun:stun.l.google.com:19302" };
-    config.servers.push_back(server);
+    // Comma or space separated list of STUN/TURN urls
+    std::regex separator("[ ,]+");
+    std::sregex_token_iterator it(ice_servers.begin(), ice_servers.end(),
+            separator, -1);
+    for (; it != std::sregex_token_iterator(); ++it)
+        if (it->length())
+            server.urls.push_back(*it);
+    if (!server.urls.empty())
+        config.servers.push_back(server);
+    return config;
+}
+
+bool WebRTCStream::connectSignaling(std::string &last_error)
+{
+    webrtc::PeerConnectionInterface::RTCConfiguration config =
+            rtcConfiguration();
+    // Gather candidates as soon as the peer connection exists, so that
+    // a pre-warmed connection has them ready when the offer is made
+    if (warm_start)
+        config.ice_candidate_pool_size = 1;
     // config.bundle_policy = webrtc::PeerConnectionInterface::kBundlePolicyMaxBundle;
     // config.disable_ipv6 = true;
     // config.rtcp_mux_policy = webrtc::PeerConnectionInterface::kRtcpMuxPolicyRequire;
@@ -225,12 +399,12 @@ bool WebRTCStream::start(WebRTCStream::Type type)
 
     if (!pc.get()) {
         error("Error creating Peer Connection");
-        obs_output_set_last_error(output, "There was an error connecting to the server. Are you connected to the internet?");
-        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        last_error = "There was an error connecting to the server. Are you connected to the internet?";
         return false;
     } else {
         info("PEER CONNECTION CREATED\n");
     }
+    startup.mark(STARTUP_PEER_CONNECTION);
 
     cricket::AudioOptions options;
     options.echo_cancellation.emplace(false); // default: true
@@ -261,27 +435,25 @@ bool WebRTCStream::start(WebRTCStream::Type type)
         warn("Adding stream to PeerConnection failed");
         // Close Peer Connection
         close(false);
-        // Disconnect, this will call stop on main thread
-        obs_output_set_last_error(output,
-            "There was a problem connecting your source(s) to the webrtc stream. Do your sources appear to be working correctly?");
-        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        last_error = "There was a problem connecting your source(s) to the webrtc stream. Do your sources appear to be working correctly?";
         return false;
     }
 
-    client = createWebsocketClient(type);
+    if (type == WebRTCStream::Type::Loopback)
+        client = new LoopbackWebsocketClientImpl(factory, &loopback_latency);
+    else
+        client = createWebsocketClient(type);
     if (!client) {
         warn("Error creating Websocket client");
         // Close Peer Connection
         close(false);
-        // Disconnect, this will call stop on main thread
-        obs_output_set_last_error(output,
-            "There was a problem creating the websocket connection.  Are you behind a firewall?");
-        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        last_error = "There was a problem creating the websocket connection.  Are you behind a firewall?";
         return false;
     }
 
     // Extra logging
 
+    std::string server_url = url;
     if (type == WebRTCStream::Type::Janus) {
         info("Server Room:      %s\nStream Key:       %s\n",
                 room.c_str(), password.c_str());
@@ -292,22 +464,24 @@ bool WebRTCStream::start(WebRTCStream::Type type)
         info("Stream Name:      %s\nPublishing Token: %s\n",
                 username.c_str(), password.c_str());
         // Note alex: What~~?
-        url = "Millicast";
+        server_url = "Millicast";
     } else if (type == WebRTCStream::Type::Evercast) {
         info("Server Room:      %s\nStream Key:       %s\n",
                 room.c_str(), password.c_str());
+    } else if (type == WebRTCStream::Type::Loopback) {
+        info("Answering in process\n");
     }
-    info("CONNECTING TO %s", url.c_str());
+    info("CONNECTING TO %s", server_url.c_str());
+
+    warm_key = sessionKey();
+    logged = false;
 
     // Connect to the signalling server
-    if (!client->connect(url, room, username, password, this)) {
+    if (!client->connect(server_url, room, username, password, this)) {
         warn("Error connecting to server");
         // Shutdown websocket connection and close Peer Connection
         close(false);
-        // Disconnect, this will call stop on main thread
-        obs_output_set_last_error(output,
-             "There was a problem connecting to your room.");
-        obs_output_signal_stop(output, OBS_OUTPUT_CONNECT_FAILED);
+        last_error = "There was a problem connecting to your room.";
         return false;
     }
     return true;
@@ -316,11 +490,24 @@ bool WebRTCStream::start(WebRTCStream::Type type)
 void WebRTCStream::onConnected()
 {
     info("WebRTCStream::onConnected");
+    startup.mark(STARTUP_WS_CONNECTED);
 }
 
 void WebRTCStream::onLogged(int /* code */)
 {
+    startup.mark(STARTUP_LOGGED);
+    std::lock_guard<std::mutex> lock(warm_mutex);
+    logged = true;
+    if (!active) {
+        info("WebRTCStream::onLogged\nPre-warmed connection ready");
+        return;
+    }
     info("WebRTCStream::onLogged\nCreating offer...");
+    createOffer();
+}
+
+void WebRTCStream::createOffer()
+{
     webrtc::PeerConnectionInterface::RTCOfferAnswerOptions offer_options;
     offer_options.voice_activity_detection = false;
     pc->CreateOffer(this, offer_options);
@@ -339,6 +526,22 @@ void WebRTCStream::OnSuccess(webrtc::SessionDescriptionInterface *desc)
     info("Video bitrate:    %d\n", video_bitrate);
     info("OFFER:\n\n%s\n", sdp.c_str());
 
+    // Simulcast: add the layer ssrcs to the local description. The
+    // server gets the same SIM group (see SDPModif::simulcastSDP)
+    simulcast_ssrcs.clear();
+    std::unique_ptr<webrtc::SessionDescriptionInterface> simulcast_desc;
+    if (simulcast_layers > 1) {
+        simulcast_ssrcs = SDPModif::simulcastSDP(sdp, simulcast_layers);
+        webrtc::SdpParseError error;
+        simulcast_desc = webrtc::CreateSessionDescription(
+                webrtc::SdpType::kOffer, sdp, &error);
+        if (!simulcast_desc) {
+            warn("Error enabling simulcast: %s", error.description.c_str());
+            simulcast_ssrcs.clear();
+            desc->ToString(&sdp);
+        }
+    }
+
     std::string sdpCopy = sdp;
     if (type == WebRTCStream::Type::Wowza) {
         std::vector<int> audio_payloads;
@@ -358,7 +561,13 @@ void WebRTCStream::OnSuccess(webrtc::SessionDescriptionInterface *desc)
     }
 
     info("SETTING LOCAL DESCRIPTION\n\n");
-    pc->SetLocalDescription(this, desc);
+    if (simulcast_desc) {
+        // SetLocalDescription takes ownership
+        pc->SetLocalDescription(this, simulcast_desc.release());
+        delete desc;
+    } else {
+        pc->SetLocalDescription(this, desc);
+    }
 
     info("Sending OFFER (SDP) to remote peer:\n\n%s", sdpCopy.c_str());
     client->open(sdpCopy, video_codec, username);
@@ -397,6 +606,7 @@ void WebRTCStream::OnIceConnectionChange(
             // Close must be carried out on a separate thread in order to avoid deadlock
             thread_closeAsync = std::thread([&] () {
                 close(false);
+                active = false;
                 obs_output_set_last_error(
                     output,
                     "We found your room, but streaming failed. Are you behind a firewall?\n\n"
@@ -410,6 +620,21 @@ void WebRTCStream::OnIceConnectionChange(
     }
 }
 
+void WebRTCStream::OnIceGatheringChange(
+  webrtc::PeerConnectionInterface::IceGatheringState state)
+{
+    if (state == webrtc::PeerConnectionInterface::kIceGatheringComplete)
+        startup.mark(STARTUP_ICE_GATHERED);
+}
+
+void WebRTCStream::OnConnectionChange(
+  webrtc::PeerConnectionInterface::PeerConnectionState state)
+{
+    // DTLS is only connected once the whole peer connection is
+    if (state == webrtc::PeerConnectionInterface::PeerConnectionState::kConnected)
+        startup.mark(STARTUP_DTLS_CONNECTED);
+}
+
 void WebRTCStream::onRemoteIceCandidate(const std::string &sdpData)
 {
     if (sdpData.empty()) {
@@ -458,12 +683,80 @@ void WebRTCStream::onOpened(const std::string &sdp)
     info("SETTING REMOTE DESCRIPTION\n\n%s", sdpCopy.c_str());
     pc->SetRemoteDescription(std::move(answer), srd_observer);
 
-    // Set audio conversion info
-    audio_convert_info conversion;
-    conversion.format = AUDIO_FORMAT_16BIT;
-    conversion.samples_per_sec = 48000;
-    conversion.speakers = SPEAKERS_STEREO;
-    obs_output_set_audio_conversion(output, &conversion);
+    // Take the mix as float planar at the OBS sample rate, the wrapper
+    // converts it while building its 10ms chunks. Only surround layouts
+    // need libobs to resample, as libwebrtc takes mono or stereo.
+    const struct audio_output_info *aoi =
+            audio_output_get_info(obs_output_audio(output));
+    uint32_t sample_rate = aoi ? aoi->samples_per_sec : 48000;
+    size_t channels = aoi ? get_audio_channels(aoi->speakers) : 2;
+    if (!aoi || aoi->format != AUDIO_FORMAT_FLOAT_PLANAR || channels > 2) {
+        audio_convert_info conversion;
+        conversion.format = AUDIO_FORMAT_FLOAT_PLANAR;
+        conversion.samples_per_sec = sample_rate;
+        conversion.speakers = channels == 1 ? SPEAKERS_MONO : SPEAKERS_STEREO;
+        obs_output_set_audio_conversion(output, &conversion);
+        channels = get_audio_channels(conversion.speakers);
+    }
+    adm->setFormat(sample_rate, channels);
+
+    // Start sampling stats
+    obs_data_t *settings = obs_output_get_settings(output);
+    int stats_interval_ms = (int)obs_data_get_int(settings, "stats_interval_ms");
+    // Simulcast already sends smaller layers, and encoded packets cannot
+    // be rescaled
+    adaptive_video = obs_data_get_bool(settings, "adaptive_video") &&
+            !passthrough_encoder && simulcast_ssrcs.empty();
+    obs_data_release(settings);
+    const struct video_output_info *voi =
+            video_output_get_info(obs_output_video(output));
+    if (adaptive_video && voi) {
+        adaptation.reset(obs_output_get_width(output),
+                obs_output_get_height(output),
+                (double)voi->fps_num / (double)voi->fps_den, video_bitrate);
+    } else {
+        adaptive_video = false;
+    }
+    stats_sampler->start(pc, stats_interval_ms ? stats_interval_ms : 1000,
+            simulcast_ssrcs);
+
+    if (passthrough_encoder) {
+        // Video comes from the encoder packets, only capture raw audio
+        passthrough_sequence = 0;
+        if (!obs_encoder_connect_packets(passthrough_encoder,
+                    on_video_packet, this)) {
+            warn("Error connecting to the passthrough encoder");
+            close(false);
+            obs_output_set_last_error(output,
+                "The video encoder could not be started.");
+            obs_output_signal_stop(output, OBS_OUTPUT_ERROR);
+            return;
+        }
+        info("Begin data capture (audio only, video passthrough)...");
+        obs_output_begin_data_capture(output, OBS_OUTPUT_AUDIO);
+        return;
+    }
+
+    // Always ask libobs for I420, the layout of the buffers handed to
+    // libwebrtc: an I420 canvas comes straight from the GPU conversion,
+    // any other one is converted once by video-io for every output that
+    // asks for I420.
+    video_scale_info video_conversion = {};
+    video_conversion.format = VIDEO_FORMAT_I420;
+    video_conversion.range = VIDEO_RANGE_DEFAULT;
+    video_conversion.colorspace = VIDEO_CS_DEFAULT;
+    obs_output_set_video_conversion(output, &video_conversion);
+
+    convert_profile_name = profile_store_name(obs_get_profiler_name_store(),
+            "WebRTCStream::onVideoFrame(%s %ux%u)",
+            get_video_format_name(VIDEO_FORMAT_I420),
+            obs_output_get_width(output), obs_output_get_height(output));
+
+    // Keep as many buffers as video-io can queue, plus the frames
+    // libwebrtc may still hold (one being encoded, one pending)
+    frame_pool.SetMaxBuffers(voi ? voi->cache_size + 2 : 0);
+    pyramid.SetMaxBuffers(voi ? voi->cache_size + 2 : 0);
+    adapted_pool.SetMaxBuffers(voi ? voi->cache_size + 2 : 0);
 
     info("Begin data capture...");
     obs_output_begin_data_capture(output, 0);
@@ -481,6 +774,8 @@ bool WebRTCStream::close(bool wait)
 {
     if (!pc.get())
         return false;
+    // Stop sampling stats
+    stats_sampler->stop();
     // Get pointer
     auto old = pc.release();
     // Close Peer Connection
@@ -494,16 +789,113 @@ bool WebRTCStream::close(bool wait)
     return true;
 }
 
-bool WebRTCStream::stop()
+bool WebRTCStream::stop(bool rewarm)
 {
     info("WebRTCStream::stop");
-    // Shutdown websocket connection and close Peer Connection
+    // Shutdown websocket connections and close Peer Connections
+    stopDestinations();
     close(true);
+    active = false;
+    if (passthrough_encoder) {
+        obs_encoder_disconnect_packets(passthrough_encoder,
+                on_video_packet, this);
+        passthrough_encoder = nullptr;
+        obs_encoder_factory->setEncoder(nullptr, 0);
+    }
     // Disconnect, this will call stop on main thread
     obs_output_end_data_capture(output);
+    info("Frame buffer pool: %llu hits, %llu misses, %llu exhausted, %zu allocated",
+            (unsigned long long)frame_pool.hits(),
+            (unsigned long long)frame_pool.misses(),
+            (unsigned long long)frame_pool.exhausted(),
+            frame_pool.allocated());
+    frame_pool.Release();
+    adapted_pool.Release();
+    if (adaptive_video)
+        info("Video adaptation: %llu downgrade(s), %llu upgrade(s)",
+                (unsigned long long)adaptation.downgrades(),
+                (unsigned long long)adaptation.upgrades());
+    // Get the next start ready while the user is back in preview
+    if (rewarm && warm_start)
+        prewarm(type);
     return true;
 }
 
+static int destination_type(const char *name)
+{
+    if (!name || !*name || strcmp(name, "janus") == 0)
+        return Type::Janus;
+    if (strcmp(name, "wowza") == 0)
+        return Type::Wowza;
+    if (strcmp(name, "millicast") == 0)
+        return Type::Millicast;
+    if (strcmp(name, "evercast") == 0)
+        return Type::Evercast;
+    if (strcmp(name, "loopback") == 0)
+        return Type::Loopback;
+    return -1;
+}
+
+void WebRTCStream::startDestinations()
+{
+    stopDestinations();
+
+    obs_data_t *settings = obs_output_get_settings(output);
+    obs_data_array_t *array = obs_data_get_array(settings, "destinations");
+    int stats_interval_ms = (int)obs_data_get_int(settings, "stats_interval_ms");
+    obs_data_release(settings);
+    size_t count = obs_data_array_count(array);
+    if (count && simulcast_layers > 1) {
+        // The extra offers are not munged for simulcast
+        warn("Fan-out destinations are not available with simulcast");
+        count = 0;
+    }
+
+    webrtc::PeerConnectionInterface::RTCConfiguration config =
+            rtcConfiguration();
+    std::lock_guard<std::mutex> lock(destinations_mutex);
+    for (size_t i = 0; i < count; i++) {
+        obs_data_t *item = obs_data_array_item(array, i);
+        FanoutDestinationSettings ds;
+        ds.type = destination_type(obs_data_get_string(item, "type"));
+        ds.url = obs_data_get_string(item, "url");
+        ds.room = obs_data_get_string(item, "room");
+        ds.username = obs_data_get_string(item, "username");
+        ds.password = obs_data_get_string(item, "password");
+        ds.codec = obs_data_get_string(item, "codec");
+        ds.protocol = obs_data_get_string(item, "protocol");
+        obs_data_release(item);
+        if (ds.type < 0) {
+            warn("Destination %zu: unknown type, skipped", i + 1);
+            continue;
+        }
+        // Same codec as the output unless set, so the encoder can be shared
+        if (ds.codec.empty())
+            ds.codec = video_codec;
+
+        rtc::scoped_refptr<FanoutDestination> destination =
+                new FanoutDestination((int)i + 1, ds, factory, signaling.get());
+        if (destination->start(stream, config, video_bitrate, audio_bitrate,
+                    stats_interval_ms))
+            destinations.push_back(destination);
+    }
+    obs_data_array_release(array);
+    if (count)
+        info("Fan-out: %zu of %zu destination(s) started",
+                destinations.size(), count);
+}
+
+void WebRTCStream::stopDestinations()
+{
+    std::vector<rtc::scoped_refptr<FanoutDestination>> stopped;
+    {
+        std::lock_guard<std::mutex> lock(destinations_mutex);
+        stopped.swap(destinations);
+    }
+    for (auto &destination : stopped)
+        destination->stop();
+}
+
 void WebRTCStream::onDisconnected()
 {
     info("WebRTCStream::onDisconnected");
@@ -515,6 +907,15 @@ void WebRTCStream::onDisconnected()
     // Shutdown websocket connection and close Peer Connection asynchronously
     thread_closeAsync = std::thread([&]() {
         close(false);
+        if (!active) {
+            // Not streaming yet, nothing to stop
+            info("Pre-warmed connection lost");
+            return;
+        }
+        active = false;
+        // No pre-warming from here: the client may report a failed connect
+        // synchronously, which would join this thread from itself. The
+        // reconnect starts a fresh session and stop() pre-warms again.
         // Disconnect, this will call stop on main thread
         obs_output_signal_stop(output, OBS_OUTPUT_DISCONNECTED);
     });
@@ -525,6 +926,8 @@ void WebRTCStream::onLoggedError(int code)
     info("WebRTCStream::onLoggedError [code: %d]", code);
     // Shutdown websocket connection and close Peer Connection
     close(false);
+    if (!active)
+        return;
     // Disconnect, this will call stop on main thread
     obs_output_set_last_error(output,
          "We are having trouble connecting to your room. Are you behind a firewall?\n");
@@ -536,6 +939,8 @@ void WebRTCStream::onOpenedError(int code)
     info("WebRTCStream::onOpenedError [code: %d]", code);
     // Shutdown websocket connection and close Peer Connection
     close(false);
+    if (!active)
+        return;
     // Disconnect, this will call stop on main thread
     obs_output_signal_stop(output, OBS_OUTPUT_ERROR);
 }
@@ -545,7 +950,9 @@ void WebRTCStream::onAudioFrame(audio_data *frame)
     if (!frame)
         return;
     // Push it to the device
-    adm->onIncomingData(frame->data[0], frame->frames);
+    profile_start(onAudioFrame_name);
+    adm->onIncomingData(frame->data, frame->frames);
+    profile_end(onAudioFrame_name);
 }
 
 void WebRTCStream::onVideoFrame(video_data *frame)
@@ -555,37 +962,57 @@ void WebRTCStream::onVideoFrame(video_data *frame)
     if (!videoCapturer)
         return;
 
-    if (std::chrono::system_clock::time_point(std::chrono::duration<int>(0)) == previous_time)
-      // First frame sent: Initialize previous_time
-      previous_time = std::chrono::system_clock::now();
-
-    // Calculate size
-    int outputWidth = obs_output_get_width(output);
-    int outputHeight = obs_output_get_height(output);
-    auto videoType = webrtc::VideoType::kNV12;
-    uint32_t size = outputWidth * outputHeight * 3 / 2;
+    int target_width = abs((int)obs_output_get_width(output));
+    int target_height = abs((int)obs_output_get_height(output));
 
-    int stride_y = outputWidth;
-    int stride_uv = (outputWidth + 1) / 2;
-    int target_width = abs(outputWidth);
-    int target_height = abs(outputHeight);
-
-    // Convert frame
-    rtc::scoped_refptr<webrtc::I420Buffer> buffer = webrtc::I420Buffer::Create(
-            target_width, target_height, stride_y, stride_uv, stride_uv);
-
-    libyuv::RotationMode rotation_mode = libyuv::kRotate0;
-
-    const int conversionResult = libyuv::ConvertToI420(
-            frame->data[0], size,
-            buffer.get()->MutableDataY(), buffer.get()->StrideY(),
-            buffer.get()->MutableDataU(), buffer.get()->StrideU(),
-            buffer.get()->MutableDataV(), buffer.get()->StrideV(), 0, 0,
-            outputWidth, outputHeight, target_width, target_height,
-            rotation_mode, ConvertVideoType(videoType));
+    // Copy frame into a recycled buffer
+    rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+            frame_pool.CreateBuffer(target_width, target_height);
+    if (!buffer) {
+        // Every buffer is still held by the encoder, drop this frame
+        debug("Frame buffer pool exhausted, dropping frame");
+        return;
+    }
 
-    // not using the result yet, silence compiler
-    (void)conversionResult;
+    // The frame lives in a video-io cache slot that is reused as soon as
+    // this callback returns, so it cannot be wrapped without a copy. It is
+    // already I420: a plain plane copy, no conversion.
+    profile_start(convert_profile_name);
+    libyuv::I420Copy(
+            frame->data[0], frame->linesize[0],
+            frame->data[1], frame->linesize[1],
+            frame->data[2], frame->linesize[2],
+            buffer->MutableDataY(), buffer->StrideY(),
+            buffer->MutableDataU(), buffer->StrideU(),
+            buffer->MutableDataV(), buffer->StrideV(),
+            target_width, target_height);
+    profile_end(convert_profile_name);
+
+    // Simulcast: scale every layer once, layer encoders pick theirs
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer = buffer;
+    if (adaptive_video && adaptation.level() > 0) {
+        int level = adaptation.level();
+        rtc::scoped_refptr<webrtc::I420Buffer> adapted =
+                adapted_pool.CreateBuffer(adaptation.width(level),
+                        adaptation.height(level));
+        if (!adapted) {
+            debug("Adaptation buffer pool exhausted, dropping frame");
+            return;
+        }
+        profile_start(adapt_profile_name);
+        adapted->ScaleFrom(*buffer);
+        profile_end(adapt_profile_name);
+        frame_buffer = adapted;
+    }
+    if (!simulcast_ssrcs.empty()) {
+        profile_start(pyramid_profile_name);
+        frame_buffer = pyramid.Scale(buffer, simulcast_ssrcs.size());
+        profile_end(pyramid_profile_name);
+        if (!frame_buffer) {
+            debug("Simulcast buffer pool exhausted, dropping frame");
+            return;
+        }
+    }
 
     const int64_t obs_timestamp_us =
             (int64_t)frame->timestamp / rtc::kNumNanosecsPerMicrosec;
@@ -597,7 +1024,7 @@ void WebRTCStream::onVideoFrame(video_data *frame)
     // Create a webrtc::VideoFrame to pass to the capturer
     webrtc::VideoFrame video_frame =
             webrtc::VideoFrame::Builder()
-            .set_video_frame_buffer(buffer)
+            .set_video_frame_buffer(frame_buffer)
             .set_rotation(webrtc::kVideoRotation_0)
             .set_timestamp_us(aligned_timestamp_us)
             .set_id(++frame_id)
@@ -605,165 +1032,154 @@ void WebRTCStream::onVideoFrame(video_data *frame)
 
     // Send frame to video capturer
     videoCapturer->OnFrameCaptured(video_frame);
+    startup.mark(STARTUP_FIRST_FRAME);
 }
 
-// NOTE LUDO: #80 add getStats
-void WebRTCStream::getStats()
+void WebRTCStream::onVideoPacket(encoder_packet *packet)
 {
-  rtc::scoped_refptr<const webrtc::RTCStatsReport> report = NewGetStats();
-  if (nullptr == report) {
-    return;
-  }
-  stats_list = "";
+    if (!packet || !videoCapturer)
+        return;
 
-  std::vector<const webrtc::RTCOutboundRTPStreamStats*> send_stream_stats =
-          report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>();
-  for (const auto& stat : send_stream_stats) {
-    if (stat->kind.ValueToString() == "audio") {
-      audio_bytes_sent = std::stoll(stat->bytes_sent.ValueToJson());
-    }
-    if (stat->kind.ValueToString() == "video") {
-      video_bytes_sent = std::stoll(stat->bytes_sent.ValueToJson());
-      pli_received = std::stoi(stat->pli_count.ValueToJson());
-    }
-  }
-  total_bytes_sent = audio_bytes_sent + video_bytes_sent;
-
-  // RTCDataChannelStats
-  std::vector<const webrtc::RTCDataChannelStats*> data_channel_stats =
-          report->GetStatsOfType<webrtc::RTCDataChannelStats>();
-  for (const auto& stat : data_channel_stats) {
-    stats_list += "data_messages_sent:"     + stat->messages_sent.ValueToJson() + "\n";
-    stats_list += "data_bytes_sent:"        + stat->bytes_sent.ValueToJson() + "\n";
-    stats_list += "data_messages_received:" + stat->messages_received.ValueToJson() + "\n";
-    stats_list += "data_bytes_received:"    + stat->bytes_received.ValueToJson() + "\n";
-  }
+    uint8_t *header = nullptr;
+    size_t header_size = 0;
+    if (packet->keyframe)
+        obs_encoder_get_extra_data(passthrough_encoder, &header, &header_size);
 
-  // RTCMediaStreamTrackStats
-  // double audio_track_jitter_buffer_delay = 0.0;
-  // double video_track_jitter_buffer_delay = 0.0;
-  // uint64_t audio_track_jitter_buffer_emitted_count = 0;
-  // uint64_t video_track_jitter_buffer_emitted_count = 0;
-  std::vector<const webrtc::RTCMediaStreamTrackStats*> media_stream_track_stats =
-          report->GetStatsOfType<webrtc::RTCMediaStreamTrackStats>();
-  for (const auto& stat : media_stream_track_stats) {
-    if (stat->kind.ValueToString() == "audio") {
-      stats_list += "track_audio_level:"            + stat->audio_level.ValueToJson() + "\n";
-      stats_list += "track_total_audio_energy:"     + stat->total_audio_energy.ValueToJson() + "\n";
-      // stats_list += "track_echo_return_loss:"   + stat->echo_return_loss.ValueToJson() + "\n";
-      // stats_list += "track_echo_return_loss_enhancement:" + stat->echo_return_loss_enhancement.ValueToJson() + "\n";
-      // stats_list += "track_total_samples_received:" + stat->total_samples_received.ValueToJson() + "\n";
-      stats_list += "track_total_samples_duration:" + stat->total_samples_duration.ValueToJson() + "\n";
-      // stats_list += "track_concealed_samples:" + stat->concealed_samples.ValueToJson() + "\n";
-      // stats_list += "track_concealment_events:" + stat->concealment_events.ValueToJson() + "\n";
-    }
-    if (stat->kind.ValueToString() == "video") {
-      // stats_list += "track_jitter_buffer_delay:"    + stat->jitter_buffer_delay.ValueToJson() + "\n";
-      // stats_list += "track_jitter_buffer_emitted_count:" + stat->jitter_buffer_emitted_count.ValueToJson() + "\n";
-      stats_list += "track_frame_width:"            + stat->frame_width.ValueToJson() + "\n";
-      stats_list += "track_frame_height:"           + stat->frame_height.ValueToJson() + "\n";
-      stats_list += "track_frames_sent:"            + stat->frames_sent.ValueToJson() + "\n";
-      stats_list += "track_huge_frames_sent:"       + stat->huge_frames_sent.ValueToJson() + "\n";
- 
-      // FPS = frames_sent / (time_now - start_time)
-      std::chrono::system_clock::time_point time_now = std::chrono::system_clock::now();
-      std::chrono::duration<double> elapsed_seconds = time_now - previous_time;
-      previous_time = time_now;
-      uint32_t frames_sent = std::stol(stat->frames_sent.ValueToJson());
-      stats_list += "track_fps:" + std::to_string((frames_sent - previous_frames_sent) / elapsed_seconds.count()) + "\n";
-      previous_frames_sent = frames_sent;
-
-      // stats_list += "track_frames_received:"        + stat->frames_received.ValueToJson() + "\n";
-      // stats_list += "track_frames_decoded:"         + stat->frames_decoded.ValueToJson() + "\n";
-      // stats_list += "track_frames_dropped:"         + stat->frames_dropped.ValueToJson() + "\n";
-      // stats_list += "track_frames_corrupted:"       + stat->frames_corrupted.ValueToJson() + "\n";
-      // stats_list += "track_partial_frames_lost:"    + stat->partial_frames_lost.ValueToJson() + "\n";
-      // stats_list += "track_full_frames_lost:"       + stat->full_frames_lost.ValueToJson() + "\n";
-    }
-  }
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+            new rtc::RefCountedObject<EncodedFrameBuffer>(packet,
+                    header, header_size,
+                    (int)obs_encoder_get_width(passthrough_encoder),
+                    (int)obs_encoder_get_height(passthrough_encoder),
+                    ++passthrough_sequence);
 
-  // RTCPeerConnectionStats
-  // std::vector<const webrtc::RTCPeerConnectionStats*> pc_stats =
-  //         report->GetStatsOfType<webrtc::RTCPeerConnectionStats>();
-  // for (const auto& stat : pc_stats) {
-  //   stats_list += "data_channels_opened:" + stat->data_channels_opened.ValueToJson() + "\n";
-  //   stats_list += "data_channels_closed:" + stat->data_channels_closed.ValueToJson() + "\n";
-  // }
-
-  // RTCRTPStreamStats
-  // std::vector<const webrtc::RTCRTPStreamStats*> rtcrtp_stats =
-  //         report->GetStatsOfType<webrtc::RTCRTPStreamStats>();
-  // for (const auto& stat : rtcrtp_stats) {
-  //   if (stat->kind.ValueToString() == "video") {
-  //     stats_list += "rtcrtp_fir_count:" + stat->fir_count.ValueToJson() + "\n";
-  //     stats_list += "rtcrtp_pli_count:" + stat->pli_count.ValueToJson() + "\n";
-  //     stats_list += "rtcrtp_nack_count:" + stat->nack_count.ValueToJson() + "\n";
-  //     stats_list += "rtcrtp_sli_count:" + stat->sli_count.ValueToJson() + "\n";
-  //     stats_list += "rtcrtp_qp_sum:" + stat->qp_sum.ValueToJson() + "\n";
-  //   }
-  // }
-
-  // RTCInboundRTPStreamStats
-  // std::vector<const webrtc::RTCInboundRTPStreamStats*> inbound_stream_stats =
-  //         report->GetStatsOfType<webrtc::RTCInboundRTPStreamStats>();
-  // for (const auto& stat : inbound_stream_stats) {
-  //   stats_list += "inbound_stream_packets_received:"        + stat->packets_received.ValueToJson() + "\n";
-  //   stats_list += "inbound_stream_bytes_received:"          + stat->bytes_received.ValueToJson() + "\n";
-  //   stats_list += "inbound_stream_packets_lost:"            + stat->packets_lost.ValueToJson() + "\n";
-
-  //   if (stat->kind.ValueToString() == "audio") {
-  //     stats_list += "inbound_stream_jitter:" + stat->jitter.ValueToJson() + "\n";
-  //   }
-  // }
+    // No B frames: decode order is presentation order
+    const int64_t obs_timestamp_us = packet->dts * rtc::kNumMicrosecsPerSec *
+            packet->timebase_num / packet->timebase_den;
 
-  // RTCOutboundRTPStreamStats
-  std::vector<const webrtc::RTCOutboundRTPStreamStats*> outbound_stream_stats =
-          report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>();
-  for (const auto& stat : outbound_stream_stats) {
-    if (stat->kind.ValueToString() == "audio") {
-      stats_list += "outbound_audio_packets_sent:"   + stat->packets_sent.ValueToJson() + "\n";
-      stats_list += "outbound_audio_bytes_sent:"     + stat->bytes_sent.ValueToJson() + "\n";
-      // stats_list += "outbound_audio_target_bitrate:" + stat->target_bitrate.ValueToJson() + "\n";
-      // stats_list += "outbound_audio_frames_encoded:" + stat->frames_encoded.ValueToJson() + "\n";
-    }
-    if (stat->kind.ValueToString() == "video") {
-      stats_list += "outbound_video_packets_sent:"   + stat->packets_sent.ValueToJson() + "\n";
-      stats_list += "outbound_video_bytes_sent:"     + stat->bytes_sent.ValueToJson() + "\n";
-      // stats_list += "outbound_video_target_bitrate:" + stat->target_bitrate.ValueToJson() + "\n";
-      // stats_list += "outbound_video_frames_encoded:" + stat->frames_encoded.ValueToJson() + "\n";
-      stats_list += "outbound_video_fir_count:"      + stat->fir_count.ValueToJson() + "\n";
-      stats_list += "outbound_video_pli_count:"      + stat->pli_count.ValueToJson() + "\n";
-      stats_list += "outbound_video_nack_count:"     + stat->nack_count.ValueToJson() + "\n";
-      // stats_list += "outbound_video_sli_count:"      + stat->sli_count.ValueToJson() + "\n";
-      stats_list += "outbound_video_qp_sum:"         + stat->qp_sum.ValueToJson() + "\n";
-    }
-  }
+    // Align timestamps from OBS encoder with rtc::TimeMicros timebase
+    const int64_t aligned_timestamp_us =
+            timestamp_aligner_.TranslateTimestamp(obs_timestamp_us, rtc::TimeMicros());
 
-  // RTCTransportStats
-  std::vector<const webrtc::RTCTransportStats*> transport_stats =
-          report->GetStatsOfType<webrtc::RTCTransportStats>();
-  for (const auto& stat : transport_stats) {
-    stats_list += "transport_bytes_sent:"     + stat->bytes_sent.ValueToJson() + "\n";
-    stats_list += "transport_bytes_received:" + stat->bytes_received.ValueToJson() + "\n";
-  }
+    webrtc::VideoFrame video_frame =
+            webrtc::VideoFrame::Builder()
+            .set_video_frame_buffer(buffer)
+            .set_rotation(webrtc::kVideoRotation_0)
+            .set_timestamp_us(aligned_timestamp_us)
+            .set_id(++frame_id)
+            .build();
 
+    // Goes through the track to ObsVideoEncoder
+    videoCapturer->OnFrameCaptured(video_frame);
+    startup.mark(STARTUP_FIRST_FRAME);
 }
 
-rtc::scoped_refptr<const webrtc::RTCStatsReport> WebRTCStream::NewGetStats()
+void WebRTCStream::onStats(const WebRTCStatsSnapshot &stats)
 {
-    rtc::CritScope lock(&crit_);
+    if (!adaptive_video || !adaptation.update(stats))
+        return;
+    // Frame rate is reduced before conversion, on the raw connection
+    int level = adaptation.level();
+    obs_output_set_video_frame_rate_divisor(output,
+            adaptation.frameRateDivisor(level));
+}
 
-    if (nullptr == pc) {
-      return nullptr;
-    }
+// NOTE LUDO: #80 add getStats
+void WebRTCStream::getStats()
+{
+  // Never blocks: reads the latest snapshot published by the sampler
+  WebRTCStatsSnapshot s = stats_sampler->snapshot();
+  stats_list = "";
 
-    rtc::scoped_refptr<StatsCallback> stats_callback =
-        new rtc::RefCountedObject<StatsCallback>();
+  // RTCMediaStreamTrackStats
+  stats_list += "track_audio_level:"            + std::to_string(s.audio_level) + "\n";
+  stats_list += "track_total_audio_energy:"     + std::to_string(s.total_audio_energy) + "\n";
+  stats_list += "track_total_samples_duration:" + std::to_string(s.total_samples_duration) + "\n";
+  stats_list += "track_frame_width:"            + std::to_string(s.frame_width) + "\n";
+  stats_list += "track_frame_height:"           + std::to_string(s.frame_height) + "\n";
+  stats_list += "track_frames_sent:"            + std::to_string(s.frames_sent) + "\n";
+  stats_list += "track_huge_frames_sent:"       + std::to_string(s.huge_frames_sent) + "\n";
+  stats_list += "track_fps:"                    + std::to_string(s.fps) + "\n";
+
+  // RTCOutboundRTPStreamStats
+  stats_list += "outbound_audio_packets_sent:"   + std::to_string(s.audio_packets_sent) + "\n";
+  stats_list += "outbound_audio_bytes_sent:"     + std::to_string(s.audio_bytes_sent) + "\n";
+  stats_list += "outbound_video_packets_sent:"   + std::to_string(s.video_packets_sent) + "\n";
+  stats_list += "outbound_video_bytes_sent:"     + std::to_string(s.video_bytes_sent) + "\n";
+  stats_list += "outbound_video_fir_count:"      + std::to_string(s.fir_count) + "\n";
+  stats_list += "outbound_video_pli_count:"      + std::to_string(s.pli_count) + "\n";
+  stats_list += "outbound_video_nack_count:"     + std::to_string(s.nack_count) + "\n";
+  stats_list += "outbound_video_qp_sum:"         + std::to_string(s.qp_sum) + "\n";
+  stats_list += "outbound_video_frames_encoded:" + std::to_string(s.frames_encoded) + "\n";
+  stats_list += "outbound_video_total_encode_time:" + std::to_string(s.total_encode_time) + "\n";
+  stats_list += "outbound_video_quality_limitation:" + std::to_string(s.quality_limitation) + "\n";
+
+  // Simulcast layers, lowest resolution first
+  for (size_t i = 0; i < s.layer_count; i++) {
+    std::string layer = "outbound_video_layer" + std::to_string(i);
+    stats_list += layer + "_bytes_sent:" + std::to_string(s.layers[i].bytes_sent) + "\n";
+    stats_list += layer + "_bitrate:"    + std::to_string(s.layers[i].bitrate) + "\n";
+    stats_list += layer + "_fps:"        + std::to_string(s.layers[i].fps) + "\n";
+  }
 
-    pc->GetStats(stats_callback);
+  // RTCRemoteInboundRtpStreamStats / RTCIceCandidatePairStats
+  stats_list += "remote_round_trip_time:"        + std::to_string(s.round_trip_time) + "\n";
+  stats_list += "remote_jitter:"                 + std::to_string(s.jitter) + "\n";
+  stats_list += "available_outgoing_bitrate:"    + std::to_string(s.available_outgoing_bitrate) + "\n";
 
-    while (!stats_callback->called())
-        std::this_thread::sleep_for(std::chrono::microseconds(1));
+  // RTCTransportStats
+  stats_list += "transport_bytes_sent:"     + std::to_string(s.transport_bytes_sent) + "\n";
+  stats_list += "transport_bytes_received:" + std::to_string(s.transport_bytes_received) + "\n";
+
+  // Bandwidth adaptation: 0 is full resolution and frame rate
+  stats_list += "adaptation_level:"      + std::to_string(adaptation.level()) + "\n";
+  stats_list += "adaptation_downgrades:" + std::to_string(adaptation.downgrades()) + "\n";
+  stats_list += "adaptation_upgrades:"   + std::to_string(adaptation.upgrades()) + "\n";
+
+  // Frame buffer pool: misses should stop growing once streaming is steady
+  stats_list += "frame_pool_hits:"      + std::to_string(frame_pool.hits()) + "\n";
+  stats_list += "frame_pool_misses:"    + std::to_string(frame_pool.misses()) + "\n";
+  stats_list += "frame_pool_exhausted:" + std::to_string(frame_pool.exhausted()) + "\n";
+
+  // Startup phases, in ms since start (-1: not reached, 0: pre-warmed).
+  // The factory and threads are created once per output.
+  stats_list += "startup_warm:"               + std::to_string(startup.warm()) + "\n";
+  stats_list += "startup_factory_ms:"         + std::to_string(factory_ms) + "\n";
+  stats_list += "startup_peer_connection_ms:" + std::to_string(startup.elapsedMs(STARTUP_PEER_CONNECTION)) + "\n";
+  stats_list += "startup_ws_connected_ms:"    + std::to_string(startup.elapsedMs(STARTUP_WS_CONNECTED)) + "\n";
+  stats_list += "startup_logged_ms:"          + std::to_string(startup.elapsedMs(STARTUP_LOGGED)) + "\n";
+  stats_list += "startup_ice_gathered_ms:"    + std::to_string(startup.elapsedMs(STARTUP_ICE_GATHERED)) + "\n";
+  stats_list += "startup_dtls_connected_ms:"  + std::to_string(startup.elapsedMs(STARTUP_DTLS_CONNECTED)) + "\n";
+  stats_list += "startup_first_frame_ms:"     + std::to_string(startup.elapsedMs(STARTUP_FIRST_FRAME)) + "\n";
+
+  // Fan-out destinations, numbered from 1 (the output itself is 0).
+  // Encoders: distinct encodes running, for the output and all of them.
+  std::vector<rtc::scoped_refptr<FanoutDestination>> fanout;
+  {
+    std::lock_guard<std::mutex> lock(destinations_mutex);
+    fanout = destinations;
+  }
+  stats_list += "fanout_destinations:" + std::to_string(fanout.size()) + "\n";
+  stats_list += "fanout_encoders:"     + std::to_string(shared_encoder_factory->activeEncoders()) + "\n";
+  for (auto &destination : fanout) {
+    WebRTCStatsSnapshot d = destination->stats();
+    std::string name = "destination" + std::to_string(destination->index());
+    stats_list += name + "_connected:"                  + std::to_string(destination->connected()) + "\n";
+    stats_list += name + "_bytes_sent:"                 + std::to_string(d.transport_bytes_sent) + "\n";
+    stats_list += name + "_available_outgoing_bitrate:" + std::to_string(d.available_outgoing_bitrate) + "\n";
+    stats_list += name + "_round_trip_time:"            + std::to_string(d.round_trip_time) + "\n";
+    stats_list += name + "_frames_encoded:"             + std::to_string(d.frames_encoded) + "\n";
+  }
 
-    return stats_callback->report();
+  // Loopback receiver
+  if (type == WebRTCStream::Type::Loopback) {
+    LoopbackLatencyStats l = loopback_latency.stats();
+    stats_list += "loopback_frames_received:" + std::to_string(l.frames_received) + "\n";
+    stats_list += "loopback_frames_stamped:"  + std::to_string(l.frames_stamped) + "\n";
+    stats_list += "loopback_frame_width:"     + std::to_string(l.width) + "\n";
+    stats_list += "loopback_frame_height:"    + std::to_string(l.height) + "\n";
+    stats_list += "loopback_latency_avg_ms:"  + std::to_string(l.latency_avg_ms) + "\n";
+    stats_list += "loopback_latency_p50_ms:"  + std::to_string(l.latency_p50_ms) + "\n";
+    stats_list += "loopback_latency_p95_ms:"  + std::to_string(l.latency_p95_ms) + "\n";
+    stats_list += "loopback_latency_max_ms:"  + std::to_string(l.latency_max_ms) + "\n";
+  }
 }
@@ -14,6 +14,16 @@
 #include "WebsocketClient.h"
 #include "VideoCapturer.h"
 #include "AudioDeviceModuleWrapper.h"
+#include "AdaptationController.h"
+#include "FanoutDestination.h"
+#include "FrameBufferPool.h"
+#include "LoopbackWebsocketClientImpl.h"
+#include "ObsEncoderFactory.h"
+#include "PyramidScaler.h"
+#include "SharedEncoderFactory.h"
+#include "SimulcastEncoderFactory.h"
+#include "StartupTimings.h"
+#include "StatsSampler.h"
 
 #include "api/create_peerconnection_factory.h"
 #include "api/media_stream_interface.h"
@@ -26,7 +36,9 @@
 #include "rtc_base/thread.h"
 #include "rtc_base/timestamp_aligner.h"
 
+#include <atomic>
 #include <initializer_list>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <vector>
@@ -46,7 +58,8 @@ public:
         Janus     = 0,
         Wowza     = 1,
         Millicast = 2,
-        Evercast  = 3
+        Evercast  = 3,
+        Loopback  = 4
     };
 
     WebRTCStream(obs_output_t *output);
@@ -54,9 +67,14 @@ public:
 
     bool close(bool wait);
     bool start(Type type);
-    bool stop();
+    // Open the signaling session and gather ICE candidates ahead of start()
+    bool prewarm(Type type);
+    // rewarm: pre-warm again for the next start if "warm_start" is set
+    bool stop(bool rewarm = true);
     void onAudioFrame(audio_data *frame);
     void onVideoFrame(video_data *frame);
+    void onVideoPacket(encoder_packet *packet);
+    void onStats(const WebRTCStatsSnapshot &stats);
     void setCodec(const std::string &new_codec) { this->video_codec = new_codec; }
 
     //
@@ -79,7 +97,8 @@ public:
     void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> /* channel */) override {}
     void OnRenegotiationNeeded() override {}
     void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState /* new_state */) override; 
-    void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState /* new_state */) override {}
+    void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) override;
+    void OnConnectionChange(webrtc::PeerConnectionInterface::PeerConnectionState new_state) override;
     void OnIceCandidate(const webrtc::IceCandidateInterface *candidate) override;
     void OnIceConnectionReceivingChange(bool /* receiving */) override {}
 
@@ -99,11 +118,13 @@ public:
     // WebRTC stats
     void getStats();
     const char *get_stats_list() { return stats_list.c_str(); }
+    // Latest typed stats, never blocks
+    WebRTCStatsSnapshot getStatsSnapshot() { return stats_sampler->snapshot(); }
+    // Glass-to-receive latency, Type::Loopback only
+    LoopbackLatencyStats getLoopbackStats() const { return loopback_latency.stats(); }
     // Bitrate & dropped frames
-    uint64_t getBitrate()        { return total_bytes_sent; }
-    int getDroppedFrames()       { return pli_received; }
-    // Synchronously get stats
-    rtc::scoped_refptr<const webrtc::RTCStatsReport> NewGetStats();
+    uint64_t getBitrate()        { return stats_sampler->totalBytesSent(); }
+    int getDroppedFrames()       { return stats_sampler->pliCount(); }
 
     template <typename T>
     rtc::scoped_refptr<T> make_scoped_refptr(T *t) {
@@ -111,6 +132,17 @@ public:
     }
 
 private:
+    bool readService(Type type, std::string &last_error);
+    bool connectSignaling(std::string &last_error);
+    // ICE servers of the output, for every peer connection
+    webrtc::PeerConnectionInterface::RTCConfiguration rtcConfiguration() const;
+    // Extra destinations from the "destinations" output setting
+    void startDestinations();
+    void stopDestinations();
+    void createOffer();
+    // Identifies the server/credentials a connection was opened for
+    std::string sessionKey() const;
+
     // Connection properties
     Type type;
     int audio_bitrate;
@@ -123,24 +155,35 @@ private:
     std::string audio_codec;
     std::string video_codec;
     int channel_count;
+    int simulcast_layers;
+    bool passthrough;
+    std::string ice_servers;
+
+    // Warm start: the connection is opened ahead of start() and re-opened
+    // right after a stop or a disconnection
+    bool warm_start;
+    std::mutex warm_mutex;
+    std::atomic<bool> active;
+    std::atomic<bool> logged;
+    std::string warm_key;
+    StartupTimings startup;
+    int64_t factory_ms;
+    // Frames received by the loopback client
+    LoopbackLatency loopback_latency;
+    // OBS encoder whose packets are sent as is, nullptr when libwebrtc
+    // encodes the raw frames
+    obs_encoder_t *passthrough_encoder;
+    uint64_t passthrough_sequence;
+    // Simulcast ssrcs negotiated, lowest layer first
+    std::vector<uint32_t> simulcast_ssrcs;
 
     // NOTE LUDO: #80 add getStats
     std::string stats_list;
     uint16_t frame_id;
-    uint64_t audio_bytes_sent;
-    uint64_t video_bytes_sent;
-    uint64_t total_bytes_sent;
-    int pli_received;
-    // Used to compute fps
-    // NOTE ALEX: Should be initialized in constructor.
-    std::chrono::system_clock::time_point previous_time
-       = std::chrono::system_clock::time_point(std::chrono::duration<int>(0));
-    uint32_t previous_frames_sent = 0;
+    rtc::scoped_refptr<StatsSampler> stats_sampler;
 
     std::thread thread_closeAsync;
 
-    rtc::CriticalSection crit_;
-
     // Audio Wrapper
     rtc::scoped_refptr<AudioDeviceModuleWrapper> adm;
 
@@ -148,8 +191,21 @@ private:
     rtc::scoped_refptr<VideoCapturer> videoCapturer;
     rtc::TimestampAligner timestamp_aligner_;
 
+    // Recycled I420 buffers handed to the video track
+    FrameBufferPool frame_pool;
+    // Simulcast layers built from each frame
+    PyramidScaler pyramid;
+    // Resolution/frame rate adaptation to the bandwidth estimation
+    AdaptationController adaptation;
+    bool adaptive_video;
+    FrameBufferPool adapted_pool;
+    const char *convert_profile_name;
+
     // PeerConnection
     rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
+    SimulcastEncoderFactory *encoder_factory;
+    ObsEncoderFactory *obs_encoder_factory;
+    SharedEncoderFactory *shared_encoder_factory;
     rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
 
     // SetRemoteDescription observer
@@ -170,6 +226,10 @@ private:
     // Websocket client
     WebsocketClient *client;
 
+    // Fan-out: the same stream published on extra peer connections
+    std::mutex destinations_mutex;
+    std::vector<rtc::scoped_refptr<FanoutDestination>> destinations;
+
     // OBS stream output
     obs_output_t *output;
 };
@@ -180,19 +180,17 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+bool flv_packet_tag(struct encoder_packet *packet, int32_t dts_offset,
+		    struct flv_tag *tag, bool is_header)
 {
-	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
 	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
+		return false;
 
 #ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Video: %lu", time_ms);
+	blog(LOG_DEBUG, "%s: %lu",
+	     packet->type == OBS_ENCODER_VIDEO ? "Video" : "Audio", time_ms);
 
 	if (last_time > time_ms)
 		blog(LOG_DEBUG, "Non-monotonic");
@@ -200,48 +198,48 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 5);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	tag->time_ms = time_ms;
 
-	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t offset = packet->pts - packet->dts;
+		int32_t cts = get_ms_time(packet, offset);
 
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
-}
+		tag->type = RTMP_PACKET_TYPE_VIDEO;
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
-{
-	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+		/* these are the 5 extra bytes in front of the video data */
+		tag->prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		tag->prefix[1] = is_header ? 0 : 1;
+		tag->prefix[2] = (uint8_t)(cts >> 16);
+		tag->prefix[3] = (uint8_t)(cts >> 8);
+		tag->prefix[4] = (uint8_t)cts;
+		tag->prefix_size = 5;
+	} else {
+		tag->type = RTMP_PACKET_TYPE_AUDIO;
 
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
+		/* these are the two extra bytes in front of the audio data */
+		tag->prefix[0] = 0xaf;
+		tag->prefix[1] = is_header ? 0 : 1;
+		tag->prefix_size = 2;
+	}
 
-#ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Audio: %lu", time_ms);
+	return true;
+}
 
-	if (last_time > time_ms)
-		blog(LOG_DEBUG, "Non-monotonic");
+static void flv_packet(struct serializer *s, int32_t dts_offset,
+		       struct encoder_packet *packet, bool is_header)
+{
+	struct flv_tag tag;
 
-	last_time = time_ms;
-#endif
+	if (!flv_packet_tag(packet, dts_offset, &tag, is_header))
+		return;
 
-	s_wb24(s, (uint32_t)packet->size + 2);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
+	s_w8(s, tag.type);
+	s_wb24(s, (uint32_t)(packet->size + tag.prefix_size));
+	s_wb24(s, tag.time_ms);
+	s_w8(s, (tag.time_ms >> 24) & 0x7F);
 	s_wb24(s, 0);
 
-	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	s_write(s, tag.prefix, tag.prefix_size);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
@@ -256,10 +254,7 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 
 	array_output_serializer_init(&s, &data);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, dts_offset, packet, is_header);
-	else
-		flv_audio(&s, dts_offset, packet, is_header);
+	flv_packet(&s, dts_offset, packet, is_header);
 
 	*output = data.bytes.array;
 	*size = data.bytes.num;
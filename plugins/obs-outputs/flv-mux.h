@@ -30,5 +30,19 @@ extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 			  bool write_header, size_t audio_idx);
+/* the parts of a packet's FLV tag that don't come from the packet data: the
+ * tag type and timestamp, and the bytes that go in front of the data */
+struct flv_tag {
+	uint8_t type;
+	int32_t time_ms;
+	uint8_t prefix[5];
+	size_t prefix_size;
+};
+
+/* size of a FLV tag besides its body: the tag header and the trailing size */
+#define FLV_TAG_OVERHEAD (11 + 4)
+
+extern bool flv_packet_tag(struct encoder_packet *packet, int32_t dts_offset,
+			   struct flv_tag *tag, bool is_header);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
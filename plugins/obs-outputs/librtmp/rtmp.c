@@ -4204,18 +4204,19 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* encodes the header of a packet's first chunk so that it ends at hend, and
+ * returns its size (0 on failure).  c and cSize are what the following chunk
+ * headers are made of. */
+static int
+EncodeChunkHeader(RTMP *r, RTMPPacket *packet, char *hend, char **pheader,
+                  int *pcSize, char *pc)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *header, *hptr, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4226,7 +4227,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             free(r->m_vecChannelsOut);
             r->m_vecChannelsOut = NULL;
             r->m_channelsAllocatedOut = 0;
-            return FALSE;
+            return 0;
         }
         r->m_vecChannelsOut = packets;
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
@@ -4252,7 +4253,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     {
         RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
                  (unsigned char)packet->m_headerType);
-        return FALSE;
+        return 0;
     }
 
     nSize = packetSize[packet->m_headerType];
@@ -4260,16 +4261,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     cSize = 0;
     t = packet->m_nTimeStamp - last;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
+    header = hend - nSize;
 
     if (packet->m_nChannel > 319)
         cSize = 2;
@@ -4326,6 +4318,27 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pheader = header;
+    *pcSize = cSize;
+    *pc = c;
+    return hSize;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    hend = packet->m_body ? packet->m_body : hbuf + sizeof(hbuf);
+    hSize = EncodeChunkHeader(r, packet, hend, &header, &cSize, &c);
+    if (!hSize)
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4421,6 +4434,195 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+/* how the pieces of a packet sent with RTMP_SendPacketV get written: one
+ * gathering send per RTMP_MAX_IOV pieces on a plain socket, through the
+ * custom send function piece by piece, or copied together and written at
+ * once where the whole packet has to go through one call (RTMPT, TLS and
+ * RTMPE) */
+typedef struct RTMPWriteV
+{
+    RTMP *r;
+    AVal parts[RTMP_MAX_IOV];
+    int num;
+    int gather;
+    char *tbuf;
+    char *toff;
+} RTMPWriteV;
+
+static int
+WriteVFlush(RTMPWriteV *w)
+{
+    AVal *parts = w->parts;
+    int num = w->num;
+
+    w->num = 0;
+
+    if (!w->gather)
+    {
+        int i;
+        for (i = 0; i < num; i++)
+            if (!WriteN(w->r, parts[i].av_val, parts[i].av_len))
+                return FALSE;
+        return TRUE;
+    }
+
+    while (num)
+    {
+        int nBytes = RTMPSockBuf_SendV(&w->r->m_sb, parts, num);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            w->r->last_error_code = sockerr;
+
+            RTMP_Close(w->r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip what went out, the rest goes in the next send */
+        while (num && nBytes >= parts->av_len)
+        {
+            nBytes -= parts->av_len;
+            parts++;
+            num--;
+        }
+        if (num)
+        {
+            parts->av_val += nBytes;
+            parts->av_len -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
+static int
+WriteVPush(RTMPWriteV *w, char *buf, int len)
+{
+    if (w->tbuf)
+    {
+        memcpy(w->toff, buf, len);
+        w->toff += len;
+        return TRUE;
+    }
+
+    if (w->num == RTMP_MAX_IOV && !WriteVFlush(w))
+        return FALSE;
+
+    w->parts[w->num].av_val = buf;
+    w->parts[w->num].av_len = len;
+    w->num++;
+    return TRUE;
+}
+
+int
+RTMP_SendPacketV(RTMP *r, RTMPPacket *packet, const AVal *body, int numBody)
+{
+    RTMPWriteV w;
+    char hbuf[RTMP_MAX_HEADER_SIZE], cbuf[3], c;
+    char *header;
+    int hSize, cSize, nSize = 0;
+    int nChunkSize = r->m_outChunkSize;
+    int chunkLeft = nChunkSize;
+    int ret = TRUE;
+    int i;
+
+    for (i = 0; i < numBody; i++)
+        nSize += body[i].av_len;
+
+    packet->m_nBodySize = nSize;
+    packet->m_body = NULL;
+
+    hSize = EncodeChunkHeader(r, packet, hbuf + sizeof(hbuf), &header,
+                              &cSize, &c);
+    if (!hSize)
+        return FALSE;
+
+    /* every following chunk starts with the same short header */
+    cbuf[0] = 0xc0 | c;
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cbuf[1] = tmp & 0xff;
+        if (cSize == 2)
+            cbuf[2] = tmp >> 8;
+    }
+
+    memset(&w, 0, sizeof(w));
+    w.r = r;
+    w.gather = !r->m_bCustomSend || !r->m_customSendFunc;
+
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP)
+#ifdef CRYPTO
+            || r->Link.rc4keyOut
+#if !defined(NO_SSL)
+            || r->m_sb.sb_ssl
+#endif
+#endif
+       )
+    {
+        int chunks = nSize ? (nSize + nChunkSize - 1) / nChunkSize : 1;
+        w.tbuf = malloc(hSize + nSize + (chunks - 1) * (cSize + 1));
+        if (!w.tbuf)
+            return FALSE;
+        w.toff = w.tbuf;
+    }
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, (int)r->m_sb.sb_socket,
+             nSize);
+
+    ret = WriteVPush(&w, header, hSize);
+
+    for (i = 0; ret && i < numBody; i++)
+    {
+        char *ptr = body[i].av_val;
+        int left = body[i].av_len;
+
+        while (ret && left)
+        {
+            int n = left < chunkLeft ? left : chunkLeft;
+
+            if (!chunkLeft)
+            {
+                ret = WriteVPush(&w, cbuf, cSize + 1);
+                chunkLeft = nChunkSize;
+                continue;
+            }
+
+            ret = WriteVPush(&w, ptr, n);
+            ptr += n;
+            left -= n;
+            chunkLeft -= n;
+        }
+    }
+
+    if (ret)
+    {
+        if (w.tbuf)
+            ret = WriteN(r, w.tbuf, (int)(w.toff - w.tbuf));
+        else if (w.num)
+            ret = WriteVFlush(&w);
+    }
+
+    free(w.tbuf);
+    if (!ret)
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
 int
 RTMP_Serve(RTMP *r)
 {
@@ -4656,6 +4858,42 @@ RTMPSockBuf_Send(RTMPSockBuf *sb, const char *buf, int len)
     return rc;
 }
 
+/* gathering send on the plain socket, num is at most RTMP_MAX_IOV */
+int
+RTMPSockBuf_SendV(RTMPSockBuf *sb, const AVal *bufs, int num)
+{
+#ifdef _WIN32
+    WSABUF wsabufs[RTMP_MAX_IOV];
+    DWORD sent = 0;
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        wsabufs[i].buf = bufs[i].av_val;
+        wsabufs[i].len = (ULONG)bufs[i].av_len;
+    }
+
+    if (WSASend(sb->sb_socket, wsabufs, num, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    struct iovec iov[RTMP_MAX_IOV];
+    struct msghdr msg;
+    int i;
+
+    for (i = 0; i < num; i++)
+    {
+        iov[i].iov_base = bufs[i].av_val;
+        iov[i].iov_len = (size_t)bufs[i].av_len;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = num;
+    return (int)sendmsg(sb->sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
 int
 RTMPSockBuf_Close(RTMPSockBuf *sb)
 {
@@ -5526,3 +5764,23 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* writes an audio or video message like RTMP_Write does with a FLV tag,
+ * but with the tag body given in pieces (such as the tag's own bytes and
+ * the encoded data), none of which get copied */
+int
+RTMP_WriteV(RTMP *r, uint8_t type, uint32_t timestamp, const AVal *body,
+            int numBody, int streamIdx)
+{
+    RTMPPacket pkt;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.m_nChannel = 0x04;	/* source channel */
+    pkt.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    pkt.m_packetType = type;
+    pkt.m_nTimeStamp = timestamp;
+    pkt.m_headerType = timestamp ? RTMP_PACKET_SIZE_MEDIUM
+                       : RTMP_PACKET_SIZE_LARGE;
+
+    return RTMP_SendPacketV(r, &pkt, body, numBody);
+}
@@ -0,0 +1,222 @@
+// Copyright Dr. Alex. Gouaillard (2015, 2020)
+
+#include <stdio.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <inttypes.h>
+
+#define warn(format, ...)  blog(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  blog(LOG_INFO,    format, ##__VA_ARGS__)
+#define debug(format, ...) blog(LOG_DEBUG,   format, ##__VA_ARGS__)
+
+#define OPT_STATS_INTERVAL_MS "stats_interval_ms"
+#define OPT_ADAPTIVE_VIDEO "adaptive_video"
+#define OPT_WARM_START "warm_start"
+#define OPT_ICE_SERVERS "ice_servers"
+#define OPT_FANOUT_SHARED_ENCODER "fanout_shared_encoder"
+#define OPT_CODEC "codec"
+
+#include "WebRTCStream.h"
+
+// WebRTC output answered in process by a local receiving peer connection,
+// for benchmarks and tests without any server. Not a service output.
+
+extern "C" const char *loopback_stream_getname(void *unused)
+{
+	info("loopback_stream_getname");
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("LoopbackStream");
+}
+
+extern "C" void loopback_stream_destroy(void *data)
+{
+	info("loopback_stream_destroy");
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Stop it
+	stream->stop(false);
+	//Remove ref and let it self destroy
+	stream->Release();
+}
+
+static void loopback_stream_get_latency(void *data, calldata_t *cd)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Report what the receiving end got so far
+	LoopbackLatencyStats stats = stream->getLoopbackStats();
+	calldata_set_int(cd, "frames_received", (long long)stats.frames_received);
+	calldata_set_int(cd, "frames_stamped", (long long)stats.frames_stamped);
+	calldata_set_int(cd, "width", stats.width);
+	calldata_set_int(cd, "height", stats.height);
+	calldata_set_float(cd, "avg_ms", stats.latency_avg_ms);
+	calldata_set_float(cd, "min_ms", stats.latency_min_ms);
+	calldata_set_float(cd, "p50_ms", stats.latency_p50_ms);
+	calldata_set_float(cd, "p95_ms", stats.latency_p95_ms);
+	calldata_set_float(cd, "max_ms", stats.latency_max_ms);
+}
+
+static void loopback_stream_get_stats(void *data, calldata_t *cd)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Same "name:value" lines as the other WebRTC outputs
+	stream->getStats();
+	calldata_set_string(cd, "stats", stream->get_stats_list());
+}
+
+extern "C" void *loopback_stream_create(obs_data_t *settings, obs_output_t *output)
+{
+	info("loopback_stream_create");
+	UNUSED_PARAMETER(settings);
+	//Create new stream
+	WebRTCStream *stream = new WebRTCStream(output);
+	//Don't allow it to be deleted
+	stream->AddRef();
+	//Let the caller read the glass-to-receive latency and stats
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_latency(out int frames_received, "
+			"out int frames_stamped, out int width, out int height, "
+			"out float avg_ms, out float min_ms, out float p50_ms, "
+			"out float p95_ms, out float max_ms)",
+			loopback_stream_get_latency, stream);
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_stats(out string stats)",
+			loopback_stream_get_stats, stream);
+	//Return it
+	return (void*)stream;
+}
+
+extern "C" void loopback_stream_stop(void *data, uint64_t ts)
+{
+	info("loopback_stream_stop");
+	UNUSED_PARAMETER(ts);
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Stop it
+	stream->stop();
+	//Remove ref and let it self destroy
+	stream->Release();
+}
+
+extern "C" bool loopback_stream_start(void *data)
+{
+	info("loopback_stream_start");
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Don't allow it to be deleted
+	stream->AddRef();
+	//Start it
+	return stream->start(WebRTCStream::Type::Loopback);
+}
+
+extern "C" void loopback_receive_video(void *data, struct video_data *frame)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Process video
+	stream->onVideoFrame(frame);
+}
+extern "C" void loopback_receive_audio(void *data, struct audio_data *frame)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Process audio
+	stream->onAudioFrame(frame);
+}
+
+extern "C" void loopback_stream_defaults(obs_data_t *defaults)
+{
+	info("loopback_stream_defaults");
+	obs_data_set_default_int(defaults, OPT_STATS_INTERVAL_MS, 1000);
+	// Measure each resolution as configured
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_VIDEO, false);
+	obs_data_set_default_bool(defaults, OPT_WARM_START, false);
+	obs_data_set_default_string(defaults, OPT_ICE_SERVERS, "");
+	obs_data_set_default_bool(defaults, OPT_FANOUT_SHARED_ENCODER, true);
+	obs_data_set_default_string(defaults, OPT_CODEC, "");
+}
+
+extern "C" obs_properties_t *loopback_stream_properties(void *data)
+{
+	info("loopback_stream_properties");
+	UNUSED_PARAMETER(data);
+
+	return obs_properties_create();
+}
+
+extern "C" uint64_t loopback_stream_total_bytes_sent(void *data)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*) data;
+	return stream->getBitrate();
+}
+
+extern "C" int loopback_stream_dropped_frames(void *data)
+{
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*) data;
+	return stream->getDroppedFrames();
+}
+
+extern "C" float loopback_stream_congestion(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 0.0f;
+}
+
+extern "C" {
+#ifdef _WIN32
+	struct obs_output_info loopback_output_info = {
+		"webrtc_loopback_output", //id
+		OBS_OUTPUT_AV, //flags
+		loopback_stream_getname, //get_name
+		loopback_stream_create, //create
+		loopback_stream_destroy, //destroy
+		loopback_stream_start, //start
+		loopback_stream_stop, //stop
+		loopback_receive_video, //raw_video
+		loopback_receive_audio, //raw_audio
+		nullptr, //encoded_packet
+		nullptr, //update
+		loopback_stream_defaults, //get_defaults
+		loopback_stream_properties, //get_properties
+		nullptr, //unused1 (formerly pause)
+		loopback_stream_total_bytes_sent, //get_total_bytes
+		loopback_stream_dropped_frames, //get_dropped_frames
+		nullptr, //type_data
+		nullptr, //free_type_data
+		loopback_stream_congestion, //get_congestion
+		nullptr, //get_connect_time_ms
+		"vp8", //encoded_video_codecs
+		"opus", //encoded_audio_codecs
+		nullptr //raw_audio2
+	};
+#else
+	struct obs_output_info loopback_output_info = {
+		.id                   = "webrtc_loopback_output",
+		.flags                = OBS_OUTPUT_AV,
+		.get_name             = loopback_stream_getname,
+		.create               = loopback_stream_create,
+		.destroy              = loopback_stream_destroy,
+		.start                = loopback_stream_start,
+		.stop                 = loopback_stream_stop,
+		.raw_video            = loopback_receive_video,
+		.raw_audio            = loopback_receive_audio,
+		.encoded_packet       = nullptr,
+		.update               = nullptr,
+		.get_defaults         = loopback_stream_defaults,
+		.get_properties       = loopback_stream_properties,
+		.unused1              = nullptr,
+		.get_total_bytes      = loopback_stream_total_bytes_sent,
+		.get_dropped_frames   = loopback_stream_dropped_frames,
+		.type_data            = nullptr,
+		.free_type_data       = nullptr,
+		.get_congestion       = loopback_stream_congestion,
+		.get_connect_time_ms  = nullptr,
+		.encoded_video_codecs = "vp8",
+		.encoded_audio_codecs = "opus",
+		.raw_audio2           = nullptr
+	};
+#endif
+}
@@ -334,8 +334,8 @@ static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
-	uint8_t *data;
-	size_t size;
+	struct flv_tag tag;
+	size_t size = 0;
 	int recv_size = 0;
 	int ret = 0;
 
@@ -353,15 +353,28 @@ static int send_packet(struct rtmp_stream *stream,
 		}
 	}
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data,
-		       &size, is_header);
+	/* the tag bytes and the packet data go to the socket as they are,
+	 * without being muxed into a FLV buffer first */
+	ret = 0;
+	if (flv_packet_tag(packet, is_header ? 0 : stream->start_dts_offset,
+			   &tag, is_header)) {
+		AVal body[2] = {
+			{(char *)tag.prefix, (int)tag.prefix_size},
+			{(char *)packet->data, (int)packet->size},
+		};
+
+		size = FLV_TAG_OVERHEAD + tag.prefix_size + packet->size;
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, (int)idx);
-	bfree(data);
+		ret = RTMP_WriteV(&stream->rtmp, tag.type,
+				  (uint32_t)tag.time_ms & 0x7FFFFFFF, body, 2,
+				  (int)idx)
+			      ? (int)size
+			      : -1;
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -19,6 +19,11 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_STATS_INTERVAL_MS "stats_interval_ms"
+#define OPT_ADAPTIVE_VIDEO "adaptive_video"
+#define OPT_WARM_START "warm_start"
+#define OPT_ICE_SERVERS "ice_servers"
+#define OPT_FANOUT_SHARED_ENCODER "fanout_shared_encoder"
 
 #include "WebRTCStream.h"
 
@@ -34,11 +39,20 @@ extern "C" void wowza_stream_destroy(void *data)
 	//Get stream
 	WebRTCStream *stream = (WebRTCStream*)data;
 	//Stop it
-	stream->stop();
+	stream->stop(false);
 	//Remove ref and let it self destroy
 	stream->Release();
 }
 
+static void wowza_stream_prewarm(void *data, calldata_t *cd)
+{
+	UNUSED_PARAMETER(cd);
+	//Get stream
+	WebRTCStream *stream = (WebRTCStream*)data;
+	//Open the connection ahead of start
+	stream->prewarm(WebRTCStream::Type::Wowza);
+}
+
 extern "C" void *wowza_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	UNUSED_PARAMETER(settings);
@@ -47,6 +61,9 @@ extern "C" void *wowza_stream_create(obs_data_t *settings, obs_output_t *output)
 	WebRTCStream *stream = new WebRTCStream(output);
 	//Don't allow it to be deleted
 	stream->AddRef();
+	//Let the frontend warm the connection up while in preview
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void prewarm()", wowza_stream_prewarm, stream);
 	//Return it
 	return (void*)stream;
 }
@@ -106,6 +123,12 @@ extern "C" void wowza_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_int(defaults, OPT_STATS_INTERVAL_MS, 1000);
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_VIDEO, true);
+	obs_data_set_default_bool(defaults, OPT_WARM_START, false);
+	obs_data_set_default_string(defaults, OPT_ICE_SERVERS,
+			"stun:stun.l.google.com:19302");
+	obs_data_set_default_bool(defaults, OPT_FANOUT_SHARED_ENCODER, true);
 }
 
 extern "C" obs_properties_t *wowza_stream_properties(void *unused)
@@ -109,6 +109,13 @@ static obs_properties_t *webrtc_evercast_properties(void *unused)
   obs_property_button_group_add_string(obs_properties_get(ppts,"codec"),"vp8",  "vp8" );
   obs_property_button_group_add_string(obs_properties_get(ppts,"codec"),"vp9",  "vp9" );
 
+  // Same signaling as Janus: layers are announced with a=ssrc-group:SIM
+  p = obs_properties_add_list(ppts, "simulcast_layers", "Simulcast",
+      OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+  obs_property_list_add_int(p, "Off", 1);
+  obs_property_list_add_int(p, "2 layers", 2);
+  obs_property_list_add_int(p, "3 layers", 3);
+
   p = obs_properties_get(ppts, "server");
   obs_property_set_visible(p, true);
 
@@ -97,6 +97,15 @@ static obs_properties_t *webrtc_janus_properties(void *unused)
 	obs_properties_add_text(ppts, "codec", "Codec", OBS_TEXT_DEFAULT);
 	obs_properties_add_text(ppts, "protocol", "Protocol", OBS_TEXT_DEFAULT);
 
+	p = obs_properties_add_list(ppts, "simulcast_layers", "Simulcast",
+				    OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(p, "Off", 1);
+	obs_property_list_add_int(p, "2 layers", 2);
+	obs_property_list_add_int(p, "3 layers", 3);
+
+	obs_properties_add_bool(ppts, "encoder_passthrough",
+				"Send the OBS H.264 encoder output");
+
 	// obs_properties_add_list(ppts, "codec", "Codec", OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	// obs_property_list_add_string(obs_properties_get(ppts, "codec"), "Automatic", "");
 	// obs_property_list_add_string(obs_properties_get(ppts, "codec"), "H264", "h264");
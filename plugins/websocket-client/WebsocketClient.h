@@ -23,7 +23,9 @@ enum Type {
     Janus     = 0,
     Wowza     = 1,
     Millicast = 2,
-    Evercast  = 3
+    Evercast  = 3,
+    // Answered in process by obs-outputs, not created here
+    Loopback  = 4
 };
 
 class WEBSOCKETCLIENT_API WebsocketClient {
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-kernels.h>
+#include <media-io/audio-resampler.h>
+
+/* Checks that every audio kernel implementation the CPU supports gives
+ * bit-exact results against the scalar one, then times them on the audio
+ * thread's per-tick load: SOURCES sources mixed into MAX_AUDIO_MIXES
+ * stereo mixes of AUDIO_OUTPUT_FRAMES frames.  Also times SOURCES 44.1 kHz
+ * sources resampled to 48 kHz, with the polyphase resampler and with
+ * libswresample.
+ *
+ * --check only runs the comparison (used by ctest). */
+
+#define SOURCES 40
+#define CHANNELS 2
+#define TICKS 2000
+
+/* odd sizes and offsets to go through the vector tails */
+static const size_t sizes[] = {0, 1, 3, 4, 7, 8, 15, 17, 31, 1023, 1024};
+
+static float rand_sample(void)
+{
+	/* mostly in range, with some clipping */
+	return ((float)rand() / (float)RAND_MAX) * 3.0f - 1.5f;
+}
+
+static void fill(float *data, size_t count, unsigned seed)
+{
+	static const float specials[] = {0.0f, -0.0f, 1.0f, -1.0f,
+					 INFINITY, -INFINITY, NAN, 1e-40f};
+
+	srand(seed);
+	for (size_t i = 0; i < count; i++)
+		data[i] = rand_sample();
+	for (size_t i = 0; i < count && i < 8; i++)
+		data[(i * 37) % count] = specials[i];
+}
+
+static bool same(const float *a, const float *b, size_t count)
+{
+	return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+static enum audio_kernel_level levels[] = {
+	AUDIO_KERNEL_SSE2,
+	AUDIO_KERNEL_AVX2,
+	AUDIO_KERNEL_NEON,
+};
+
+#define MAX_N (AUDIO_OUTPUT_FRAMES + 8)
+
+static int check_level(enum audio_kernel_level level)
+{
+	float ref[CHANNELS][MAX_N], out[CHANNELS][MAX_N];
+	float src[MAX_N], gain[MAX_N];
+	int failures = 0;
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (size_t offset = 0; offset < 3; offset++) {
+			size_t n = sizes[s];
+			float *r = ref[0] + offset, *o = out[0] + offset;
+			const char *failed = NULL;
+
+			fill(src, MAX_N, 1);
+			fill(gain, MAX_N, 2);
+
+#define RUN(name, call)                                        \
+	do {                                                   \
+		fill(ref[0], MAX_N, 3);                        \
+		memcpy(out[0], ref[0], sizeof(ref[0]));        \
+		audio_kernels_set_level(AUDIO_KERNEL_SCALAR);  \
+		call(r);                                       \
+		audio_kernels_set_level(level);                \
+		call(o);                                       \
+		if (!failed && !same(ref[0], out[0], MAX_N))   \
+			failed = name;                         \
+	} while (false)
+
+#define MIX_ADD(p) audio_mix_add(p, src + offset, n)
+#define MIX_ADD_GAIN(p) audio_mix_add_gain(p, src + offset, gain, n)
+#define GAIN(p) audio_apply_gain(p, 0.37f, n)
+#define GAIN_RAMP(p) audio_apply_gain_ramp(p, gain + offset, n)
+#define CLAMP(p) audio_clamp(p, n)
+
+			RUN("mix_add", MIX_ADD);
+			RUN("mix_add_gain", MIX_ADD_GAIN);
+			RUN("apply_gain", GAIN);
+			RUN("apply_gain_ramp", GAIN_RAMP);
+			RUN("clamp", CLAMP);
+
+			/* downmix works on all planes */
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				fill(ref[ch], MAX_N, 4 + (unsigned)ch);
+				memcpy(out[ch], ref[ch], sizeof(ref[ch]));
+			}
+			float *ref_planes[CHANNELS] = {ref[0] + offset,
+						       ref[1] + offset};
+			float *out_planes[CHANNELS] = {out[0] + offset,
+						       out[1] + offset};
+			audio_kernels_set_level(AUDIO_KERNEL_SCALAR);
+			audio_downmix_to_mono_planar(ref_planes, CHANNELS, n);
+			audio_kernels_set_level(level);
+			audio_downmix_to_mono_planar(out_planes, CHANNELS, n);
+			if (!failed && (!same(ref[0], out[0], MAX_N) ||
+					!same(ref[1], out[1], MAX_N)))
+				failed = "downmix_to_mono_planar";
+
+			float ref_dot, out_dot;
+			audio_kernels_set_level(AUDIO_KERNEL_SCALAR);
+			ref_dot = audio_dot_product(src + offset, gain, n);
+			audio_kernels_set_level(level);
+			out_dot = audio_dot_product(src + offset, gain, n);
+			if (!failed && memcmp(&ref_dot, &out_dot, sizeof(float)))
+				failed = "dot_product";
+
+			if (failed) {
+				printf("%s: %s differs from scalar "
+				       "(count %zu, offset %zu)\n",
+				       audio_kernels_level_name(level), failed,
+				       n, offset);
+				failures++;
+			}
+		}
+	}
+	return failures;
+}
+
+static double bench_level(enum audio_kernel_level level)
+{
+	size_t frames = AUDIO_OUTPUT_FRAMES;
+	float *sources = bmalloc(sizeof(float) * SOURCES * MAX_AUDIO_MIXES *
+				 CHANNELS * frames);
+	float *mixes = bmalloc(sizeof(float) * MAX_AUDIO_MIXES * CHANNELS *
+			       frames);
+	float *ramp = bmalloc(sizeof(float) * frames);
+	uint64_t start;
+
+	fill(sources, SOURCES * MAX_AUDIO_MIXES * CHANNELS * frames, 5);
+	/* unit gains so that the samples do not decay to denormals over the
+	 * ticks, which would slow every implementation down */
+	for (size_t i = 0; i < frames; i++)
+		ramp[i] = (i & 1) ? -1.0f : 1.0f;
+
+	audio_kernels_set_level(level);
+	start = os_gettime_ns();
+
+	for (int tick = 0; tick < TICKS; tick++) {
+		memset(mixes, 0,
+		       sizeof(float) * MAX_AUDIO_MIXES * CHANNELS * frames);
+
+		for (size_t s = 0; s < SOURCES; s++) {
+			float *source = sources + s * MAX_AUDIO_MIXES *
+							  CHANNELS * frames;
+
+			/* volume: constant on most sources, a fade on some */
+			if (s % 8 == 0)
+				for (size_t p = 0; p < MAX_AUDIO_MIXES * CHANNELS;
+				     p++)
+					audio_apply_gain_ramp(
+						source + p * frames, ramp,
+						frames);
+			else
+				audio_apply_gain(source, -1.0f,
+						 MAX_AUDIO_MIXES * CHANNELS *
+							 frames);
+
+			for (size_t p = 0; p < MAX_AUDIO_MIXES * CHANNELS; p++)
+				audio_mix_add(mixes + p * frames,
+					      source + p * frames, frames);
+		}
+
+		for (size_t p = 0; p < MAX_AUDIO_MIXES * CHANNELS; p++)
+			audio_clamp(mixes + p * frames, frames);
+	}
+
+	double us = (double)(os_gettime_ns() - start) / 1000.0 / TICKS;
+
+	bfree(sources);
+	bfree(mixes);
+	bfree(ramp);
+	return us;
+}
+
+#define RESAMPLE_FRAMES 441
+
+static double bench_resampler(bool polyphase)
+{
+	struct resample_info src = {44100, AUDIO_FORMAT_FLOAT_PLANAR,
+				    SPEAKERS_STEREO};
+	struct resample_info dst = {48000, AUDIO_FORMAT_FLOAT_PLANAR,
+				    SPEAKERS_STEREO};
+	audio_resampler_t *resamplers[SOURCES];
+	struct audio_resampler_stats stats;
+	float *data = bmalloc(sizeof(float) * CHANNELS * RESAMPLE_FRAMES);
+	const uint8_t *input[CHANNELS] = {
+		(const uint8_t *)data,
+		(const uint8_t *)(data + RESAMPLE_FRAMES)};
+	uint64_t start;
+
+	fill(data, CHANNELS * RESAMPLE_FRAMES, 6);
+
+	audio_resampler_set_polyphase(polyphase);
+	for (size_t s = 0; s < SOURCES; s++)
+		resamplers[s] = audio_resampler_create(&dst, &src);
+	audio_resampler_set_polyphase(false);
+
+	/* one second of audio per source */
+	start = os_gettime_ns();
+	for (int block = 0; block < 100; block++) {
+		for (size_t s = 0; s < SOURCES; s++) {
+			uint8_t *output[MAX_AV_PLANES];
+			uint32_t frames;
+			uint64_t offset;
+			audio_resampler_resample(resamplers[s], output, &frames,
+						 &offset, input,
+						 RESAMPLE_FRAMES);
+		}
+	}
+	double ms = (double)(os_gettime_ns() - start) / 1000000.0;
+
+	if (audio_resampler_get_stats(&stats, 1))
+		printf("%-13s %8.2f ms per second of audio (%u resamplers, "
+		       "%.1f us per call)\n",
+		       stats.polyphase ? "polyphase" : "libswresample", ms,
+		       stats.resamplers,
+		       (double)stats.time_ns / 1000.0 / (double)stats.calls);
+
+	for (size_t s = 0; s < SOURCES; s++)
+		audio_resampler_destroy(resamplers[s]);
+	bfree(data);
+	return ms;
+}
+
+int main(int argc, char *argv[])
+{
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	enum audio_kernel_level best = audio_kernels_best_level();
+	int failures = 0;
+
+	printf("Best level: %s\n", audio_kernels_level_name(best));
+
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+		if (!audio_kernels_set_level(levels[i]))
+			continue;
+		int f = check_level(levels[i]);
+		printf("%-6s bit-exact: %s\n",
+		       audio_kernels_level_name(levels[i]), f ? "NO" : "yes");
+		failures += f;
+	}
+
+	if (!check_only) {
+		double scalar = bench_level(AUDIO_KERNEL_SCALAR);
+
+		printf("\n%d sources, %d mixes, %d channels, %d frames per "
+		       "tick\n",
+		       SOURCES, MAX_AUDIO_MIXES, CHANNELS, AUDIO_OUTPUT_FRAMES);
+		printf("%-6s %8.1f us/tick\n",
+		       audio_kernels_level_name(AUDIO_KERNEL_SCALAR), scalar);
+
+		for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]);
+		     i++) {
+			if (!audio_kernels_set_level(levels[i]))
+				continue;
+			double us = bench_level(levels[i]);
+			printf("%-6s %8.1f us/tick (x%.2f)\n",
+			       audio_kernels_level_name(levels[i]), us,
+			       scalar / us);
+		}
+
+		audio_kernels_set_level(best);
+		printf("\n%d stereo sources resampled from 44.1 to 48 kHz\n",
+		       SOURCES);
+		bench_resampler(true);
+		bench_resampler(false);
+	}
+
+	audio_kernels_set_level(best);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+/* Measures the audio thread against the number of sources and of active
+ * mixes.  Every source is an output channel fed with stereo float audio
+ * from a feeder thread; MIXES of the audio output mixes get a dummy
+ * consumer connected, which is what makes a mix active.
+ *
+ * Usage: audio-mix-bench [seconds per run] */
+
+#define SAMPLE_RATE 48000
+#define CHANNELS 2
+#define BLOCK_FRAMES 1024
+
+static const size_t source_counts[] = {8, 16, 32, 64};
+static const size_t mix_counts[] = {1, 2, MAX_AUDIO_MIXES};
+
+static float block[CHANNELS][BLOCK_FRAMES];
+
+static obs_source_t *sources[MAX_CHANNELS];
+static size_t num_sources;
+static pthread_mutex_t sources_mutex;
+static volatile bool feeding;
+
+static const char *bench_source_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Audio mix bench source";
+}
+
+static void *bench_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void bench_source_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static struct obs_source_info bench_source = {
+	.id = "audio_mix_bench_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name = bench_source_name,
+	.create = bench_source_create,
+	.destroy = bench_source_destroy,
+};
+
+static void *feed_thread(void *unused)
+{
+	uint64_t ts = os_gettime_ns();
+	struct obs_source_audio audio = {
+		.data = {(uint8_t *)block[0], (uint8_t *)block[1]},
+		.frames = BLOCK_FRAMES,
+		.speakers = SPEAKERS_STEREO,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.samples_per_sec = SAMPLE_RATE,
+	};
+
+	os_set_thread_name("audio-mix-bench: feed");
+
+	while (feeding) {
+		audio.timestamp = ts;
+
+		pthread_mutex_lock(&sources_mutex);
+		for (size_t i = 0; i < num_sources; i++)
+			obs_source_output_audio(sources[i], &audio);
+		pthread_mutex_unlock(&sources_mutex);
+
+		ts += (uint64_t)BLOCK_FRAMES * 1000000000ULL / SAMPLE_RATE;
+		os_sleepto_ns(ts);
+	}
+
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static void mix_consumer(void *param, size_t mix_idx, struct audio_data *data)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(mix_idx);
+	UNUSED_PARAMETER(data);
+}
+
+static void set_sources(size_t count)
+{
+	pthread_mutex_lock(&sources_mutex);
+
+	for (size_t i = count; i < num_sources; i++) {
+		obs_set_output_source((uint32_t)i, NULL);
+		obs_source_release(sources[i]);
+		sources[i] = NULL;
+	}
+	for (size_t i = num_sources; i < count; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "source %zu", i);
+		sources[i] = obs_source_create(bench_source.id, name, NULL,
+					       NULL);
+		obs_set_output_source((uint32_t)i, sources[i]);
+	}
+	num_sources = count;
+
+	pthread_mutex_unlock(&sources_mutex);
+}
+
+static void run(size_t count, size_t mixes, double seconds)
+{
+	struct obs_audio_render_stats before, after;
+	audio_t *audio = obs_get_audio();
+	os_cpu_usage_info_t *cpu;
+	uint64_t ticks;
+	double usage;
+
+	set_sources(count);
+	for (size_t mix = 0; mix < mixes; mix++)
+		audio_output_connect(audio, mix, NULL, mix_consumer, NULL);
+
+	/* let the sources settle and the buffering stabilize */
+	os_sleep_ms(500);
+
+	obs_get_audio_render_stats(&before);
+	cpu = os_cpu_usage_info_start();
+	os_sleep_ms((uint32_t)(seconds * 1000.0));
+	usage = os_cpu_usage_info_query(cpu);
+	os_cpu_usage_info_destroy(cpu);
+	obs_get_audio_render_stats(&after);
+
+	for (size_t mix = 0; mix < mixes; mix++)
+		audio_output_disconnect(audio, mix, mix_consumer, NULL);
+
+	ticks = after.ticks - before.ticks;
+	printf("%7zu %5zu %12.1f %12.1f %8llu %8.2f%%\n", count, mixes,
+	       ticks ? (double)(after.total_tick_ns - before.total_tick_ns) /
+			       1000.0 / (double)ticks
+		     : 0.0,
+	       (double)after.max_tick_ns / 1000.0,
+	       (unsigned long long)(after.deadline_misses -
+				    before.deadline_misses),
+	       usage);
+}
+
+int main(int argc, char *argv[])
+{
+	struct obs_audio_info oai = {
+		.samples_per_sec = SAMPLE_RATE,
+		.speakers = SPEAKERS_STEREO,
+	};
+	double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+	pthread_t feeder;
+	int ret = 1;
+
+	if (seconds <= 0.0)
+		seconds = 3.0;
+
+	for (size_t i = 0; i < BLOCK_FRAMES; i++) {
+		block[0][i] = sinf((float)i * 0.05f) * 0.5f;
+		block[1][i] = cosf((float)i * 0.05f) * 0.5f;
+	}
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return 1;
+	if (!obs_reset_audio(&oai)) {
+		printf("Couldn't initialize audio\n");
+		goto exit;
+	}
+
+	obs_register_source(&bench_source);
+	pthread_mutex_init(&sources_mutex, NULL);
+
+	feeding = true;
+	if (pthread_create(&feeder, NULL, feed_thread, NULL) != 0) {
+		printf("Couldn't start the feeder thread\n");
+		goto exit;
+	}
+
+	/* max is since startup, so it only grows along the rows */
+	printf("%d Hz, %d channels, %d frames per tick, %.1f s per run\n\n",
+	       SAMPLE_RATE, CHANNELS, AUDIO_OUTPUT_FRAMES, seconds);
+	printf("sources mixes  avg us/tick  max us/tick   misses      cpu\n");
+
+	for (size_t s = 0; s < sizeof(source_counts) / sizeof(source_counts[0]);
+	     s++) {
+		for (size_t m = 0; m < sizeof(mix_counts) / sizeof(mix_counts[0]);
+		     m++)
+			run(source_counts[s], mix_counts[m], seconds);
+	}
+
+	feeding = false;
+	pthread_join(feeder, NULL);
+	set_sources(0);
+	pthread_mutex_destroy(&sources_mutex);
+	ret = 0;
+
+exit:
+	obs_shutdown();
+	return ret;
+}
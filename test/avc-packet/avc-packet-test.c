@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+
+/* Unit test of obs_parse_avc_packet: the start codes of an Annex B packet
+ * are replaced by NAL sizes, and the parsed packet (and references to it)
+ * can be released with obs_encoder_packet_release like any encoder packet.
+ * Repeated, so that the later packets come out of the packet pool. */
+
+static int failures = 0;
+
+#define expect(cond)                                                     \
+	do {                                                             \
+		if (!(cond)) {                                           \
+			printf("%s:%d: failed: %s\n", __FILE__, __LINE__, \
+			       #cond);                                   \
+			failures++;                                      \
+		}                                                        \
+	} while (false)
+
+/* an SEI and an IDR slice of payload_size bytes each, with a four and a
+ * three byte start code */
+static size_t make_annexb(uint8_t *data, size_t payload_size)
+{
+	size_t pos = 0;
+
+	memcpy(data + pos, "\0\0\0\1", 4);
+	pos += 4;
+	data[pos++] = 0x06;
+	for (size_t i = 1; i < payload_size; i++)
+		data[pos++] = (uint8_t)(i % 200 + 1);
+
+	memcpy(data + pos, "\0\0\1", 3);
+	pos += 3;
+	data[pos++] = 0x65;
+	for (size_t i = 1; i < payload_size; i++)
+		data[pos++] = (uint8_t)(i % 100 + 1);
+
+	return pos;
+}
+
+static uint32_t read_be32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+	       ((uint32_t)data[2] << 8) | data[3];
+}
+
+static void test_parse(size_t payload_size)
+{
+	static uint8_t annexb[2 * 300000 + 7];
+	struct encoder_packet src = {0}, avc, ref;
+	struct obs_encoder_packet_stats before, after;
+	size_t size = make_annexb(annexb, payload_size);
+
+	obs_get_encoder_packet_stats(&before);
+
+	src.type = OBS_ENCODER_VIDEO;
+	src.data = annexb;
+	src.size = size;
+	obs_parse_avc_packet(&avc, &src);
+
+	expect(avc.keyframe);
+	expect(avc.priority == 3);
+	expect(avc.size == 2 * (4 + payload_size));
+	expect(read_be32(avc.data) == payload_size);
+	expect(avc.data[4] == 0x06);
+	expect(memcmp(avc.data + 4, annexb + 4, payload_size) == 0);
+	expect(read_be32(avc.data + 4 + payload_size) == payload_size);
+	expect(avc.data[8 + payload_size] == 0x65);
+	expect(memcmp(avc.data + 8 + payload_size, annexb + 7 + payload_size,
+		      payload_size) == 0);
+
+	obs_get_encoder_packet_stats(&after);
+	expect(after.live_packets == before.live_packets + 1);
+
+	/* the last reference frees it */
+	obs_encoder_packet_ref(&ref, &avc);
+	obs_encoder_packet_release(&avc);
+	expect(avc.data == NULL);
+	obs_get_encoder_packet_stats(&after);
+	expect(after.live_packets == before.live_packets + 1);
+
+	obs_encoder_packet_release(&ref);
+	obs_get_encoder_packet_stats(&after);
+	expect(after.live_packets == before.live_packets);
+	expect(after.live_bytes == before.live_bytes);
+}
+
+int main(void)
+{
+	struct obs_encoder_packet_stats stats;
+
+	for (int i = 0; i < 4; i++) {
+		test_parse(100);
+		test_parse(5000);
+		test_parse(300000);
+	}
+
+	obs_get_encoder_packet_stats(&stats);
+	expect(stats.pool_hits == 9);
+
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs-interleave.h>
+
+/* Feeds encoded packets of one video track and MAX_AUDIO_MIXES audio tracks
+ * to an output's interleave queue with several skewed arrival patterns, the
+ * way interleave_packets does: every arriving packet is queued, then at most
+ * one packet is sent if a packet of the opposing type with a higher
+ * timestamp has been seen.  Each pattern runs through the per-track queue
+ * and through the old sorted array, which must send the same packets in the
+ * same order.
+ *
+ * --check runs short streams and only compares the orders (used by ctest). */
+
+#define VIDEO_FPS 60
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+
+struct event {
+	struct encoder_packet packet;
+	int64_t arrival;
+	size_t seq;
+};
+
+struct sent {
+	int64_t dts_usec;
+	size_t track;
+};
+
+enum pattern {
+	PATTERN_STEADY,
+	PATTERN_AUDIO_BURSTS,
+	PATTERN_VIDEO_LAG,
+	PATTERN_LATE_TRACK,
+	PATTERN_JITTER,
+	PATTERN_COUNT,
+};
+
+static const char *pattern_names[PATTERN_COUNT] = {
+	"steady", "audio-bursts", "video-lag", "late-track", "jitter",
+};
+
+static int64_t arrival_time(enum pattern pattern, size_t track, int64_t dts,
+			    int64_t *last)
+{
+	int64_t arrival = dts;
+
+	switch (pattern) {
+	case PATTERN_STEADY:
+		/* video encoding takes about a frame */
+		if (track == 0)
+			arrival += 16000;
+		break;
+	case PATTERN_AUDIO_BURSTS:
+		/* audio encoders stall and catch up every 500 ms */
+		if (track != 0)
+			arrival = (dts / 500000 + 1) * 500000;
+		break;
+	case PATTERN_VIDEO_LAG:
+		/* deep video encoder pipeline */
+		if (track == 0)
+			arrival += 1000000;
+		break;
+	case PATTERN_LATE_TRACK:
+		/* one audio track far behind the rest */
+		if (track == INTERLEAVE_TRACKS - 1)
+			arrival += 2000000;
+		break;
+	case PATTERN_JITTER:
+		/* up to 80 ms of scheduling jitter, in order per track */
+		arrival += rand() % 80000;
+		break;
+	case PATTERN_COUNT:
+		break;
+	}
+
+	if (arrival < *last)
+		arrival = *last;
+	*last = arrival;
+	return arrival;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+	const struct event *ea = a;
+	const struct event *eb = b;
+
+	if (ea->arrival != eb->arrival)
+		return ea->arrival < eb->arrival ? -1 : 1;
+	return ea->seq < eb->seq ? -1 : (ea->seq > eb->seq ? 1 : 0);
+}
+
+static struct event *make_events(enum pattern pattern, int seconds,
+				 size_t *count)
+{
+	size_t video = (size_t)seconds * VIDEO_FPS;
+	size_t audio = (size_t)seconds * AUDIO_RATE / AUDIO_FRAMES;
+	size_t total = video + audio * MAX_AUDIO_MIXES;
+	struct event *events = bzalloc(total * sizeof(*events));
+	size_t n = 0;
+
+	srand(1);
+
+	for (size_t track = 0; track < INTERLEAVE_TRACKS; track++) {
+		size_t packets = track ? audio : video;
+		int64_t last = 0;
+
+		for (size_t i = 0; i < packets; i++) {
+			struct event *e = &events[n];
+			struct encoder_packet *p = &e->packet;
+
+			if (track == 0) {
+				p->type = OBS_ENCODER_VIDEO;
+				p->timebase_num = 1;
+				p->timebase_den = VIDEO_FPS;
+				p->keyframe = i % (VIDEO_FPS * 2) == 0;
+			} else {
+				p->type = OBS_ENCODER_AUDIO;
+				p->track_idx = track - 1;
+				p->timebase_num = 1;
+				p->timebase_den = AUDIO_RATE;
+			}
+
+			p->dts = p->pts = (int64_t)i *
+					  (track ? AUDIO_FRAMES : 1);
+			p->dts_usec = p->dts * 1000000LL * p->timebase_num /
+				      p->timebase_den;
+
+			e->arrival = arrival_time(pattern, track, p->dts_usec,
+						  &last);
+			e->seq = n++;
+		}
+	}
+
+	qsort(events, n, sizeof(*events), cmp_event);
+	*count = n;
+	return events;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct interleave_state {
+	int64_t highest_video_ts;
+	int64_t highest_audio_ts;
+	size_t max_queued;
+	DARRAY(struct sent) sent;
+};
+
+static inline void set_higher_ts(struct interleave_state *state,
+				 const struct encoder_packet *packet)
+{
+	int64_t *ts = packet->type == OBS_ENCODER_VIDEO
+			      ? &state->highest_video_ts
+			      : &state->highest_audio_ts;
+	if (*ts < packet->dts_usec)
+		*ts = packet->dts_usec;
+}
+
+static inline bool has_higher_opposing_ts(struct interleave_state *state,
+					  const struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return state->highest_audio_ts > packet->dts_usec;
+	else
+		return state->highest_video_ts > packet->dts_usec;
+}
+
+static inline void record_sent(struct interleave_state *state,
+			       const struct encoder_packet *packet)
+{
+	struct sent s = {packet->dts_usec, interleave_track_of(packet)};
+	da_push_back(state->sent, &s);
+}
+
+static void run_queue(struct interleave_state *state,
+		      const struct event *events, size_t count)
+{
+	struct interleave_queue q = {0};
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet packet = events[i].packet;
+		struct encoder_packet *first;
+
+		interleave_queue_push(&q, &packet);
+		set_higher_ts(state, &packet);
+
+		if (q.num > state->max_queued)
+			state->max_queued = q.num;
+
+		first = interleave_queue_first(&q);
+		if (has_higher_opposing_ts(state, first)) {
+			interleave_queue_pop(&q, &packet);
+			record_sent(state, &packet);
+		}
+	}
+
+	interleave_queue_free(&q);
+}
+
+/* the sorted array outputs used before the per-track queue */
+static void run_array(struct interleave_state *state,
+		      const struct event *events, size_t count)
+{
+	DARRAY(struct encoder_packet) packets;
+	da_init(packets);
+
+	for (size_t i = 0; i < count; i++) {
+		const struct encoder_packet *out = &events[i].packet;
+		size_t idx;
+
+		for (idx = 0; idx < packets.num; idx++) {
+			struct encoder_packet *cur = packets.array + idx;
+
+			if (out->dts_usec == cur->dts_usec &&
+			    out->type == OBS_ENCODER_VIDEO)
+				break;
+			else if (out->dts_usec < cur->dts_usec)
+				break;
+		}
+
+		da_insert(packets, idx, out);
+		set_higher_ts(state, out);
+
+		if (packets.num > state->max_queued)
+			state->max_queued = packets.num;
+
+		if (has_higher_opposing_ts(state, packets.array)) {
+			record_sent(state, packets.array);
+			da_erase(packets, 0);
+		}
+	}
+
+	da_free(packets);
+}
+
+static bool same_order(struct interleave_state *a, struct interleave_state *b)
+{
+	if (a->sent.num != b->sent.num)
+		return false;
+	return memcmp(a->sent.array, b->sent.array,
+		      a->sent.num * sizeof(struct sent)) == 0;
+}
+
+static int run_pattern(enum pattern pattern, int seconds, bool check_only)
+{
+	struct interleave_state queue = {0};
+	struct interleave_state array = {0};
+	uint64_t queue_ns, array_ns;
+	struct event *events;
+	size_t count;
+	bool same;
+
+	events = make_events(pattern, seconds, &count);
+
+	queue_ns = os_gettime_ns();
+	run_queue(&queue, events, count);
+	queue_ns = os_gettime_ns() - queue_ns;
+
+	array_ns = os_gettime_ns();
+	run_array(&array, events, count);
+	array_ns = os_gettime_ns() - array_ns;
+
+	same = same_order(&queue, &array);
+
+	if (check_only) {
+		printf("%-13s %7zu packets, same order: %s\n",
+		       pattern_names[pattern], count, same ? "yes" : "NO");
+	} else {
+		printf("%-13s %7zu packets, max %5zu queued, "
+		       "queue %7.1f ns/packet, array %8.1f ns/packet "
+		       "(x%.1f)%s\n",
+		       pattern_names[pattern], count, queue.max_queued,
+		       (double)queue_ns / (double)count,
+		       (double)array_ns / (double)count,
+		       (double)array_ns / (double)queue_ns,
+		       same ? "" : ", ORDER DIFFERS");
+	}
+
+	da_free(queue.sent);
+	da_free(array.sent);
+	bfree(events);
+	return same ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	int seconds = check_only ? 20 : 600;
+	int failures = 0;
+
+	printf("%d s of %d fps video and %d audio tracks\n", seconds,
+	       VIDEO_FPS, MAX_AUDIO_MIXES);
+
+	for (int i = 0; i < PATTERN_COUNT; i++)
+		failures += run_pattern((enum pattern)i, seconds, check_only);
+
+	return failures ? 1 : 0;
+}
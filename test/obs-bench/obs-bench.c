@@ -0,0 +1,868 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <obs.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <util/threading.h>
+
+/* Headless throughput benchmark of the render, output and encode pipeline.
+ *
+ * Starts libobs without any window, builds a scene of image, color, text
+ * and synthetic async sources with filters, then drives a raw output and,
+ * when the x264 and AAC encoders are available, a null encoding output for
+ * a fixed duration.  The results are written as JSON.
+ *
+ * On Linux the OpenGL renderer still needs an X server to create its
+ * windowless context: run it under Xvfb, with LIBGL_ALWAYS_SOFTWARE=1 to
+ * render on llvmpipe.
+ *
+ * Usage: obs-bench [--scene small|medium|large] [--seconds N] [--warmup N]
+ *                  [--width N] [--height N] [--fps N] [--image file]
+ *                  [--plugins bin-dir data-dir] [--no-encode]
+ *                  [--output file.json] */
+
+#define SAMPLE_RATE 48000
+#define AUDIO_BLOCK_FRAMES 1024
+#define ASYNC_WIDTH 640
+#define ASYNC_HEIGHT 360
+
+struct scene_tier {
+	const char *name;
+	int images;
+	int colors;
+	int texts;
+	int async;
+	int filters;
+};
+
+static const struct scene_tier tiers[] = {
+	{"small", 1, 1, 1, 1, 0},
+	{"medium", 4, 4, 4, 4, 1},
+	{"large", 16, 16, 8, 8, 2},
+};
+
+struct bench_options {
+	const struct scene_tier *tier;
+	double seconds;
+	double warmup;
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	const char *image;
+	const char *plugin_bin;
+	const char *plugin_data;
+	const char *output;
+	bool encode;
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic async source: I420 video and stereo audio from its own thread */
+
+struct bench_async {
+	obs_source_t *source;
+	os_event_t *stop_signal;
+	pthread_t thread;
+	bool initialized;
+	uint32_t fps;
+};
+
+static const char *bench_async_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark async source";
+}
+
+static void *bench_async_thread(void *data)
+{
+	struct bench_async *ba = data;
+	uint8_t *planes = bmalloc(ASYNC_WIDTH * ASYNC_HEIGHT * 3 / 2);
+	float samples[2][AUDIO_BLOCK_FRAMES];
+	uint64_t interval = 1000000000ULL / ba->fps;
+	uint64_t audio_interval = (uint64_t)AUDIO_BLOCK_FRAMES * 1000000000ULL /
+				  SAMPLE_RATE;
+	uint64_t start = os_gettime_ns();
+	uint64_t next_video = start, next_audio = start;
+	uint32_t count = 0;
+
+	struct obs_source_frame frame = {
+		.data = {planes, planes + ASYNC_WIDTH * ASYNC_HEIGHT,
+			 planes + ASYNC_WIDTH * ASYNC_HEIGHT * 5 / 4},
+		.linesize = {ASYNC_WIDTH, ASYNC_WIDTH / 2, ASYNC_WIDTH / 2},
+		.width = ASYNC_WIDTH,
+		.height = ASYNC_HEIGHT,
+		.format = VIDEO_FORMAT_I420,
+		.full_range = false,
+	};
+	struct obs_source_audio audio = {
+		.data = {(uint8_t *)samples[0], (uint8_t *)samples[1]},
+		.frames = AUDIO_BLOCK_FRAMES,
+		.speakers = SPEAKERS_STEREO,
+		.format = AUDIO_FORMAT_FLOAT_PLANAR,
+		.samples_per_sec = SAMPLE_RATE,
+	};
+
+	video_format_get_parameters(VIDEO_CS_601, VIDEO_RANGE_PARTIAL,
+				    frame.color_matrix, frame.color_range_min,
+				    frame.color_range_max);
+
+	for (size_t i = 0; i < AUDIO_BLOCK_FRAMES; i++) {
+		samples[0][i] = sinf((float)i * 0.0589f) * 0.25f;
+		samples[1][i] = samples[0][i];
+	}
+
+	os_set_thread_name("obs-bench: async source");
+
+	while (os_event_try(ba->stop_signal) == EAGAIN) {
+		if (next_video <= next_audio) {
+			/* a moving gradient so that every frame differs */
+			for (uint32_t y = 0; y < ASYNC_HEIGHT; y++)
+				memset(planes + y * ASYNC_WIDTH,
+				       (int)((y + count) & 0xFF), ASYNC_WIDTH);
+			memset(planes + ASYNC_WIDTH * ASYNC_HEIGHT,
+			       (int)(count & 0xFF),
+			       ASYNC_WIDTH * ASYNC_HEIGHT / 2);
+			count++;
+
+			frame.timestamp = next_video - start;
+			obs_source_output_video(ba->source, &frame);
+			next_video += interval;
+		} else {
+			audio.timestamp = next_audio - start;
+			obs_source_output_audio(ba->source, &audio);
+			next_audio += audio_interval;
+		}
+
+		os_sleepto_ns(next_video < next_audio ? next_video
+						      : next_audio);
+	}
+
+	bfree(planes);
+	return NULL;
+}
+
+static void bench_async_destroy(void *data)
+{
+	struct bench_async *ba = data;
+
+	if (ba->initialized) {
+		os_event_signal(ba->stop_signal);
+		pthread_join(ba->thread, NULL);
+	}
+
+	os_event_destroy(ba->stop_signal);
+	bfree(ba);
+}
+
+static void *bench_async_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct bench_async *ba = bzalloc(sizeof(struct bench_async));
+	ba->source = source;
+	ba->fps = (uint32_t)obs_data_get_int(settings, "fps");
+	if (!ba->fps)
+		ba->fps = 30;
+
+	if (os_event_init(&ba->stop_signal, OS_EVENT_TYPE_MANUAL) != 0 ||
+	    pthread_create(&ba->thread, NULL, bench_async_thread, ba) != 0) {
+		bench_async_destroy(ba);
+		return NULL;
+	}
+
+	ba->initialized = true;
+	return ba;
+}
+
+static struct obs_source_info bench_async_info = {
+	.id = "obs_bench_async_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO,
+	.get_name = bench_async_name,
+	.create = bench_async_create,
+	.destroy = bench_async_destroy,
+};
+
+/* ------------------------------------------------------------------------- */
+/* filter that renders its target through an extra texture */
+
+static const char *bench_filter_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark filter";
+}
+
+static void *bench_filter_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	return source;
+}
+
+static void bench_filter_destroy(void *data)
+{
+	UNUSED_PARAMETER(data);
+}
+
+static void bench_filter_render(void *data, gs_effect_t *effect)
+{
+	obs_source_t *source = data;
+
+	if (!obs_source_process_filter_begin(source, GS_RGBA,
+					     OBS_NO_DIRECT_RENDERING))
+		return;
+
+	obs_source_process_filter_end(source,
+				      obs_get_base_effect(OBS_EFFECT_DEFAULT),
+				      0, 0);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static struct obs_source_info bench_filter_info = {
+	.id = "obs_bench_filter",
+	.type = OBS_SOURCE_TYPE_FILTER,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name = bench_filter_name,
+	.create = bench_filter_create,
+	.destroy = bench_filter_destroy,
+	.video_render = bench_filter_render,
+};
+
+/* ------------------------------------------------------------------------- */
+/* raw output that only counts what it gets */
+
+struct bench_raw_output {
+	obs_output_t *output;
+	volatile long video_frames;
+	volatile long audio_frames;
+};
+
+static const char *bench_raw_output_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Benchmark raw output";
+}
+
+static void *bench_raw_output_create(obs_data_t *settings,
+				     obs_output_t *output)
+{
+	struct bench_raw_output *ro = bzalloc(sizeof(struct bench_raw_output));
+	ro->output = output;
+	UNUSED_PARAMETER(settings);
+	return ro;
+}
+
+static void bench_raw_output_destroy(void *data)
+{
+	bfree(data);
+}
+
+static bool bench_raw_output_start(void *data)
+{
+	struct bench_raw_output *ro = data;
+
+	if (!obs_output_can_begin_data_capture(ro->output, 0))
+		return false;
+
+	obs_output_begin_data_capture(ro->output, 0);
+	return true;
+}
+
+static void bench_raw_output_stop(void *data, uint64_t ts)
+{
+	struct bench_raw_output *ro = data;
+	obs_output_end_data_capture(ro->output);
+	UNUSED_PARAMETER(ts);
+}
+
+static void bench_raw_output_video(void *data, struct video_data *frame)
+{
+	struct bench_raw_output *ro = data;
+	os_atomic_inc_long(&ro->video_frames);
+	UNUSED_PARAMETER(frame);
+}
+
+static void bench_raw_output_audio(void *data, struct audio_data *frames)
+{
+	struct bench_raw_output *ro = data;
+	os_atomic_inc_long(&ro->audio_frames);
+	UNUSED_PARAMETER(frames);
+}
+
+static struct obs_output_info bench_raw_output_info = {
+	.id = "obs_bench_raw_output",
+	.flags = OBS_OUTPUT_AV,
+	.get_name = bench_raw_output_name,
+	.create = bench_raw_output_create,
+	.destroy = bench_raw_output_destroy,
+	.start = bench_raw_output_start,
+	.stop = bench_raw_output_stop,
+	.raw_video = bench_raw_output_video,
+	.raw_audio = bench_raw_output_audio,
+};
+
+/* ------------------------------------------------------------------------- */
+/* scene */
+
+static obs_data_array_t *missing_types;
+
+static bool type_available(const char *id)
+{
+	const char *available;
+	size_t idx = 0;
+
+	while (obs_enum_source_types(idx++, &available)) {
+		if (strcmp(available, id) == 0)
+			return true;
+	}
+
+	/* only note it once */
+	for (size_t i = 0; i < obs_data_array_count(missing_types); i++) {
+		obs_data_t *item = obs_data_array_item(missing_types, i);
+		bool same = strcmp(obs_data_get_string(item, "id"), id) == 0;
+		obs_data_release(item);
+		if (same)
+			return false;
+	}
+
+	obs_data_t *item = obs_data_create();
+	obs_data_set_string(item, "id", id);
+	obs_data_array_push_back(missing_types, item);
+	obs_data_release(item);
+	return false;
+}
+
+static void add_filters(obs_source_t *source, int count)
+{
+	for (int i = 0; i < count; i++) {
+		/* alternate with a real filter when the plugin is there */
+		const char *id = (i & 1) && type_available("color_filter")
+					 ? "color_filter"
+					 : bench_filter_info.id;
+		struct dstr name = {0};
+		obs_source_t *filter;
+
+		dstr_printf(&name, "%s filter %d", obs_source_get_name(source),
+			    i);
+		filter = obs_source_create(id, name.array, NULL, NULL);
+		if (filter) {
+			obs_source_filter_add(source, filter);
+			obs_source_release(filter);
+		}
+		dstr_free(&name);
+	}
+}
+
+static void add_item(obs_scene_t *scene, obs_source_t *source, int index,
+		     int total, const struct bench_options *opts)
+{
+	int columns = (int)ceil(sqrt((double)total));
+	float cell_cx = (float)opts->width / (float)columns;
+	float cell_cy = (float)opts->height / (float)columns;
+	obs_sceneitem_t *item = obs_scene_add(scene, source);
+	struct obs_transform_info info;
+
+	obs_sceneitem_get_info(item, &info);
+	info.pos.x = cell_cx * (float)(index % columns);
+	info.pos.y = cell_cy * (float)(index / columns);
+	info.bounds_type = OBS_BOUNDS_SCALE_INNER;
+	info.bounds.x = cell_cx;
+	info.bounds.y = cell_cy;
+	obs_sceneitem_set_info(item, &info);
+}
+
+static void add_sources(obs_scene_t *scene, const char *id, int count,
+			obs_data_t *settings, int *index, int total,
+			const struct bench_options *opts)
+{
+	if (!count || !type_available(id))
+		return;
+
+	for (int i = 0; i < count; i++) {
+		struct dstr name = {0};
+		obs_source_t *source;
+
+		dstr_printf(&name, "%s %d", id, i);
+		source = obs_source_create(id, name.array, settings, NULL);
+		dstr_free(&name);
+		if (!source)
+			continue;
+
+		add_filters(source, opts->tier->filters);
+		add_item(scene, source, (*index)++, total, opts);
+		obs_source_release(source);
+	}
+}
+
+static obs_scene_t *create_scene(const struct bench_options *opts)
+{
+	const struct scene_tier *tier = opts->tier;
+	obs_scene_t *scene = obs_scene_create("obs-bench");
+	int total = tier->images + tier->colors + tier->texts + tier->async;
+	int index = 0;
+	obs_data_t *settings;
+
+	if (opts->image) {
+		settings = obs_data_create();
+		obs_data_set_string(settings, "file", opts->image);
+		add_sources(scene, "image_source", tier->images, settings,
+			    &index, total, opts);
+		obs_data_release(settings);
+	}
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "color", 0xFF4080C0);
+	obs_data_set_int(settings, "width", opts->width / 4);
+	obs_data_set_int(settings, "height", opts->height / 4);
+	add_sources(scene, "color_source", tier->colors, settings, &index,
+		    total, opts);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_string(settings, "text", "obs-bench 0123456789");
+	add_sources(scene, "text_ft2_source", tier->texts, settings, &index,
+		    total, opts);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "fps", opts->fps);
+	add_sources(scene, bench_async_info.id, tier->async, settings, &index,
+		    total, opts);
+	obs_data_release(settings);
+
+	return scene;
+}
+
+/* ------------------------------------------------------------------------- */
+/* outputs */
+
+struct bench_outputs {
+	obs_output_t *raw;
+	obs_output_t *null;
+	obs_encoder_t *video_encoder;
+	obs_encoder_t *audio_encoder;
+};
+
+static bool encoder_available(const char *id)
+{
+	const char *available;
+	size_t idx = 0;
+
+	while (obs_enum_encoder_types(idx++, &available)) {
+		if (strcmp(available, id) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool output_available(const char *id)
+{
+	const char *available;
+	size_t idx = 0;
+
+	while (obs_enum_output_types(idx++, &available)) {
+		if (strcmp(available, id) == 0)
+			return true;
+	}
+	return false;
+}
+
+static void start_outputs(struct bench_outputs *outputs,
+			  const struct bench_options *opts)
+{
+	outputs->raw = obs_output_create(bench_raw_output_info.id,
+					 "obs-bench raw", NULL, NULL);
+	if (!obs_output_start(outputs->raw))
+		printf("Couldn't start the raw output\n");
+
+	if (!opts->encode || !encoder_available("obs_x264") ||
+	    !encoder_available("ffmpeg_aac") ||
+	    !output_available("null_output"))
+		return;
+
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_string(settings, "preset", "veryfast");
+	obs_data_set_int(settings, "bitrate", 6000);
+	outputs->video_encoder = obs_video_encoder_create(
+		"obs_x264", "obs-bench x264", settings, NULL);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", 160);
+	outputs->audio_encoder = obs_audio_encoder_create(
+		"ffmpeg_aac", "obs-bench aac", settings, 0, NULL);
+	obs_data_release(settings);
+
+	obs_encoder_set_video(outputs->video_encoder, obs_get_video());
+	obs_encoder_set_audio(outputs->audio_encoder, obs_get_audio());
+
+	outputs->null = obs_output_create("null_output", "obs-bench null",
+					  NULL, NULL);
+	obs_output_set_video_encoder(outputs->null, outputs->video_encoder);
+	obs_output_set_audio_encoder(outputs->null, outputs->audio_encoder, 0);
+	if (!obs_output_start(outputs->null))
+		printf("Couldn't start the null output\n");
+}
+
+static void stop_outputs(struct bench_outputs *outputs)
+{
+	if (outputs->null) {
+		obs_output_force_stop(outputs->null);
+		obs_output_release(outputs->null);
+	}
+	if (outputs->raw) {
+		obs_output_force_stop(outputs->raw);
+		obs_output_release(outputs->raw);
+	}
+
+	obs_encoder_release(outputs->video_encoder);
+	obs_encoder_release(outputs->audio_encoder);
+}
+
+/* ------------------------------------------------------------------------- */
+/* results */
+
+static void set_stage(obs_data_t *parent, const char *name,
+		      const struct obs_video_stage_stats *stage)
+{
+	obs_data_t *data = obs_data_create();
+
+	obs_data_set_double(data, "p50_ms", (double)stage->p50_ns / 1e6);
+	obs_data_set_double(data, "p95_ms", (double)stage->p95_ns / 1e6);
+	obs_data_set_double(data, "p99_ms", (double)stage->p99_ns / 1e6);
+	obs_data_set_double(data, "max_ms", (double)stage->max_ns / 1e6);
+	obs_data_set_obj(parent, name, data);
+	obs_data_release(data);
+}
+
+static int cmp_time_entry(const void *a, const void *b)
+{
+	uint64_t val_a = ((const profiler_time_entry_t *)a)->time_delta;
+	uint64_t val_b = ((const profiler_time_entry_t *)b)->time_delta;
+	return val_a < val_b ? -1 : (val_a > val_b ? 1 : 0);
+}
+
+static bool add_profiler_entry(void *context, profiler_snapshot_entry_t *entry)
+{
+	obs_data_array_t *array = context;
+	profiler_time_entries_t *times = profiler_snapshot_entry_times(entry);
+	profiler_time_entry_t *sorted;
+	uint64_t calls = 0, total_us = 0, seen = 0;
+	uint64_t median = 0, p99 = 0;
+	obs_data_t *data = obs_data_create();
+	obs_data_array_t *children = obs_data_array_create();
+
+	if (times->num) {
+		sorted = bmemdup(times->array,
+				 times->num * sizeof(*times->array));
+		qsort(sorted, times->num, sizeof(*sorted), cmp_time_entry);
+
+		for (size_t i = 0; i < times->num; i++) {
+			calls += sorted[i].count;
+			total_us += sorted[i].time_delta * sorted[i].count;
+		}
+		for (size_t i = 0; i < times->num; i++) {
+			seen += sorted[i].count;
+			if (!median && seen * 2 >= calls)
+				median = sorted[i].time_delta;
+			if (!p99 && seen * 100 >= calls * 99)
+				p99 = sorted[i].time_delta;
+		}
+		bfree(sorted);
+	}
+
+	obs_data_set_string(data, "name", profiler_snapshot_entry_name(entry));
+	obs_data_set_int(data, "calls", (long long)calls);
+	obs_data_set_double(data, "avg_ms",
+			    calls ? (double)total_us / 1000.0 / (double)calls
+				  : 0.0);
+	obs_data_set_double(data, "median_ms", (double)median / 1000.0);
+	obs_data_set_double(data, "p99_ms", (double)p99 / 1000.0);
+	obs_data_set_double(
+		data, "max_ms",
+		(double)profiler_snapshot_entry_max_time(entry) / 1000.0);
+
+	profiler_snapshot_enumerate_children(entry, add_profiler_entry,
+					     children);
+	if (obs_data_array_count(children))
+		obs_data_set_array(data, "children", children);
+
+	obs_data_array_push_back(array, data);
+	obs_data_array_release(children);
+	obs_data_release(data);
+	return true;
+}
+
+static bool run(const struct bench_options *opts, obs_data_t *results)
+{
+	struct obs_audio_render_stats audio_before, audio_after;
+	struct obs_video_frame_stats frame_stats;
+	struct bench_outputs outputs = {0};
+	struct bench_raw_output *raw;
+	uint32_t total_before, lagged_before, total_after, lagged_after;
+	uint32_t dropped = 0;
+	long raw_video_before, raw_audio_before;
+	os_cpu_usage_info_t *cpu;
+	uint64_t start, elapsed;
+	double usage;
+	obs_scene_t *scene;
+	obs_data_t *video, *audio, *out;
+
+	scene = create_scene(opts);
+	obs_set_output_source(0, obs_scene_get_source(scene));
+	start_outputs(&outputs, opts);
+	raw = obs_obj_get_data(outputs.raw);
+	if (!raw) {
+		printf("Couldn't create the raw output\n");
+		stop_outputs(&outputs);
+		obs_set_output_source(0, NULL);
+		obs_scene_release(scene);
+		return false;
+	}
+
+	os_sleep_ms((uint32_t)(opts->warmup * 1000.0));
+
+	total_before = obs_get_total_frames();
+	lagged_before = obs_get_lagged_frames();
+	raw_video_before = os_atomic_load_long(&raw->video_frames);
+	raw_audio_before = os_atomic_load_long(&raw->audio_frames);
+	obs_get_audio_render_stats(&audio_before);
+	cpu = os_cpu_usage_info_start();
+	start = os_gettime_ns();
+
+	os_sleep_ms((uint32_t)(opts->seconds * 1000.0));
+
+	elapsed = os_gettime_ns() - start;
+	usage = os_cpu_usage_info_query(cpu);
+	os_cpu_usage_info_destroy(cpu);
+	obs_get_audio_render_stats(&audio_after);
+	total_after = obs_get_total_frames();
+	lagged_after = obs_get_lagged_frames();
+	if (outputs.null)
+		dropped = (uint32_t)obs_output_get_frames_dropped(outputs.null);
+
+	video = obs_data_create();
+	obs_data_set_double(video, "fps",
+			    (double)(total_after - total_before) /
+				    ((double)elapsed / 1e9));
+	obs_data_set_int(video, "frames", total_after - total_before);
+	obs_data_set_int(video, "lagged_frames", lagged_after - lagged_before);
+	obs_data_set_int(video, "raw_frames",
+			 os_atomic_load_long(&raw->video_frames) -
+				 raw_video_before);
+	if (obs_get_video_frame_stats(&frame_stats)) {
+		/* the last OBS_VIDEO_FRAME_RECORDS frames of the run */
+		obs_data_set_int(video, "sampled_frames", frame_stats.frames);
+		obs_data_set_int(video, "skipped_frames",
+				 frame_stats.skipped_frames);
+		set_stage(video, "frame_time", &frame_stats.frame_time);
+		set_stage(video, "tick_sources", &frame_stats.tick_sources);
+		set_stage(video, "output_frame", &frame_stats.output_frame);
+		set_stage(video, "render_displays",
+			  &frame_stats.render_displays);
+		set_stage(video, "map_wait", &frame_stats.map_wait);
+		set_stage(video, "sleep_overshoot",
+			  &frame_stats.sleep_overshoot);
+	}
+	obs_data_set_obj(results, "video", video);
+	obs_data_release(video);
+
+	audio = obs_data_create();
+	uint64_t ticks = audio_after.ticks - audio_before.ticks;
+	uint64_t tick_ns = audio_after.total_tick_ns -
+			   audio_before.total_tick_ns;
+	obs_data_set_int(audio, "ticks", (long long)ticks);
+	obs_data_set_int(audio, "deadline_misses",
+			 (long long)(audio_after.deadline_misses -
+				     audio_before.deadline_misses));
+	obs_data_set_double(audio, "avg_tick_ms",
+			    ticks ? (double)tick_ns / 1e6 / (double)ticks
+				  : 0.0);
+	obs_data_set_double(audio, "max_tick_ms",
+			    (double)audio_after.max_tick_ns / 1e6);
+	/* share of wall time the audio thread spent rendering */
+	obs_data_set_double(audio, "utilisation",
+			    (double)tick_ns / (double)elapsed);
+	obs_data_set_int(audio, "raw_frames",
+			 os_atomic_load_long(&raw->audio_frames) -
+				 raw_audio_before);
+	obs_data_set_obj(results, "audio", audio);
+	obs_data_release(audio);
+
+	out = obs_data_create();
+	obs_data_set_bool(out, "encoded", outputs.null != NULL);
+	obs_data_set_int(out, "encoded_frames_dropped", dropped);
+	obs_data_set_obj(results, "outputs", out);
+	obs_data_release(out);
+
+	obs_data_set_double(results, "cpu_usage", usage);
+	obs_data_set_double(results, "elapsed_s", (double)elapsed / 1e9);
+
+	stop_outputs(&outputs);
+	obs_set_output_source(0, NULL);
+	obs_scene_release(scene);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool parse_options(int argc, char *argv[], struct bench_options *opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (strcmp(arg, "--scene") == 0 && has_value) {
+			const char *name = argv[++i];
+			opts->tier = NULL;
+			for (size_t t = 0; t < sizeof(tiers) / sizeof(tiers[0]);
+			     t++) {
+				if (strcmp(tiers[t].name, name) == 0)
+					opts->tier = &tiers[t];
+			}
+			if (!opts->tier)
+				return false;
+		} else if (strcmp(arg, "--seconds") == 0 && has_value) {
+			opts->seconds = atof(argv[++i]);
+		} else if (strcmp(arg, "--warmup") == 0 && has_value) {
+			opts->warmup = atof(argv[++i]);
+		} else if (strcmp(arg, "--width") == 0 && has_value) {
+			opts->width = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(arg, "--height") == 0 && has_value) {
+			opts->height = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(arg, "--fps") == 0 && has_value) {
+			opts->fps = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(arg, "--image") == 0 && has_value) {
+			opts->image = argv[++i];
+		} else if (strcmp(arg, "--plugins") == 0 && i + 2 < argc) {
+			opts->plugin_bin = argv[++i];
+			opts->plugin_data = argv[++i];
+		} else if (strcmp(arg, "--output") == 0 && has_value) {
+			opts->output = argv[++i];
+		} else if (strcmp(arg, "--no-encode") == 0) {
+			opts->encode = false;
+		} else {
+			return false;
+		}
+	}
+
+	return opts->seconds > 0.0 && opts->warmup >= 0.0 && opts->width &&
+	       opts->height && opts->fps;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {
+		.tier = &tiers[1],
+		.seconds = 10.0,
+		.warmup = 2.0,
+		.width = 1920,
+		.height = 1080,
+		.fps = 60,
+#ifdef OBS_BENCH_IMAGE
+		.image = OBS_BENCH_IMAGE,
+#endif
+		.encode = true,
+	};
+	struct obs_video_info ovi = {
+		.adapter = 0,
+		.graphics_module = DL_OPENGL,
+		.output_format = VIDEO_FORMAT_NV12,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BICUBIC,
+		.gpu_conversion = true,
+	};
+	struct obs_audio_info oai = {
+		.samples_per_sec = SAMPLE_RATE,
+		.speakers = SPEAKERS_STEREO,
+	};
+	profiler_name_store_t *name_store;
+	profiler_snapshot_t *snap;
+	obs_data_t *results;
+	obs_data_array_t *profiler;
+	int ret = 1;
+
+	if (!parse_options(argc, argv, &opts)) {
+		printf("usage: obs-bench [--scene small|medium|large] "
+		       "[--seconds N] [--warmup N] [--width N] [--height N] "
+		       "[--fps N] [--image file] "
+		       "[--plugins bin-dir data-dir] [--no-encode] "
+		       "[--output file.json]\n");
+		return 1;
+	}
+
+	ovi.base_width = ovi.output_width = opts.width;
+	ovi.base_height = ovi.output_height = opts.height;
+	ovi.fps_num = opts.fps;
+	ovi.fps_den = 1;
+
+	profiler_start();
+	name_store = profiler_name_store_create();
+
+	if (!obs_startup("en-US", NULL, name_store))
+		goto exit;
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		printf("Couldn't initialize video\n");
+		goto exit;
+	}
+	if (!obs_reset_audio(&oai)) {
+		printf("Couldn't initialize audio\n");
+		goto exit;
+	}
+
+	if (opts.plugin_bin)
+		obs_add_module_path(opts.plugin_bin, opts.plugin_data);
+	obs_load_all_modules();
+	obs_post_load_modules();
+
+	obs_register_source(&bench_async_info);
+	obs_register_source(&bench_filter_info);
+	obs_register_output(&bench_raw_output_info);
+
+	results = obs_data_create();
+	missing_types = obs_data_array_create();
+
+	obs_data_set_int(results, "version", 1);
+	obs_data_set_string(results, "scene", opts.tier->name);
+	obs_data_set_int(results, "width", opts.width);
+	obs_data_set_int(results, "height", opts.height);
+	obs_data_set_int(results, "fps_target", opts.fps);
+	obs_data_set_double(results, "seconds", opts.seconds);
+
+	if (!run(&opts, results)) {
+		obs_data_array_release(missing_types);
+		obs_data_release(results);
+		goto exit;
+	}
+
+	obs_data_set_array(results, "missing_types", missing_types);
+	obs_data_array_release(missing_types);
+
+	snap = profile_snapshot_create();
+	profiler = obs_data_array_create();
+	profiler_snapshot_enumerate_roots(snap, add_profiler_entry, profiler);
+	obs_data_set_array(results, "profiler", profiler);
+	obs_data_array_release(profiler);
+	profile_snapshot_free(snap);
+
+	if (opts.output) {
+		if (obs_data_save_json(results, opts.output))
+			ret = 0;
+		else
+			printf("Couldn't write '%s'\n", opts.output);
+	} else {
+		printf("%s\n", obs_data_get_json(results));
+		ret = 0;
+	}
+
+	obs_data_release(results);
+
+exit:
+	obs_shutdown();
+	profiler_stop();
+	profiler_free();
+	profiler_name_store_free(name_store);
+	return ret;
+}
@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+#include "obs-ffmpeg-replay-store.h"
+
+/* obs_duplicate_encoder_packet is the only public way to get packet data
+ * that can be referenced like an encoder's */
+#ifdef _MSC_VER
+#pragma warning(disable : 4996)
+#else
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+/* Feeds a synthetic 60 fps video track and two audio tracks (one of them
+ * delivered in bursts) to the replay buffer's segment store and to the
+ * packet circlebuf it replaced, then saves both: the segment store through a
+ * snapshot, the circlebuf by sorting references into an array the way the
+ * old replay_buffer_save did.  Reports how much of the payload each keeps in
+ * memory and how long a save takes to put together.
+ *
+ * --check runs a short stream, saves once while packets keep coming in and
+ * once at the end, and checks that both save the same packets in the same
+ * order with the same bytes, and that the store did spill to disk (used by
+ * ctest). */
+
+#define FPS 60
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+#define AUDIO_BITRATE 160
+#define AUDIO_BURST_FRAMES 12
+#define KEYFRAME_SEC 2
+
+struct params {
+	int mbps;
+	int seconds;
+	int max_time_sec;
+	int mem_time_sec;
+};
+
+/* ------------------------------------------------------------------------- */
+/* the circlebuf replay buffer                                               */
+
+struct legacy {
+	struct circlebuf packets;
+	int64_t cur_size;
+	int64_t cur_time;
+	int64_t max_time;
+	int keyframes;
+};
+
+static bool legacy_purge_front(struct legacy *l)
+{
+	struct encoder_packet pkt;
+	bool keyframe;
+
+	circlebuf_pop_front(&l->packets, &pkt, sizeof(pkt));
+
+	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
+
+	if (keyframe)
+		l->keyframes--;
+
+	if (!l->packets.size) {
+		l->cur_size = 0;
+		l->cur_time = 0;
+	} else {
+		struct encoder_packet first;
+		circlebuf_peek_front(&l->packets, &first, sizeof(first));
+		l->cur_time = first.dts_usec;
+		l->cur_size -= (int64_t)pkt.size;
+	}
+
+	obs_encoder_packet_release(&pkt);
+	return keyframe;
+}
+
+static void legacy_purge(struct legacy *l)
+{
+	if (legacy_purge_front(l)) {
+		struct encoder_packet pkt;
+
+		for (;;) {
+			circlebuf_peek_front(&l->packets, &pkt, sizeof(pkt));
+			if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
+				return;
+
+			legacy_purge_front(l);
+		}
+	}
+}
+
+static void legacy_push(struct legacy *l, struct encoder_packet *packet)
+{
+	struct encoder_packet pkt;
+	obs_encoder_packet_ref(&pkt, packet);
+
+	if (l->packets.size && l->keyframes > 2) {
+		while ((pkt.dts_usec - l->cur_time) > l->max_time)
+			legacy_purge(l);
+	}
+
+	if (!l->packets.size)
+		l->cur_time = pkt.dts_usec;
+	l->cur_size += pkt.size;
+
+	circlebuf_push_back(&l->packets, &pkt, sizeof(pkt));
+
+	if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
+		l->keyframes++;
+}
+
+static void legacy_insert(struct darray *array, struct encoder_packet *packet,
+			  int64_t video_offset, int64_t *audio_offsets,
+			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
+{
+	struct encoder_packet pkt;
+	DARRAY(struct encoder_packet) packets;
+	packets.da = *array;
+	size_t idx;
+
+	obs_encoder_packet_ref(&pkt, packet);
+
+	if (pkt.type == OBS_ENCODER_VIDEO) {
+		pkt.dts_usec -= video_offset;
+		pkt.dts -= video_dts_offset;
+		pkt.pts -= video_dts_offset;
+	} else {
+		pkt.dts_usec -= audio_offsets[pkt.track_idx];
+		pkt.dts -= audio_dts_offsets[pkt.track_idx];
+		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+	}
+
+	for (idx = packets.num; idx > 0; idx--) {
+		struct encoder_packet *p = packets.array + (idx - 1);
+		if (p->dts_usec < pkt.dts_usec)
+			break;
+	}
+
+	da_insert(packets, idx, &pkt);
+	*array = packets.da;
+}
+
+static void legacy_save(struct legacy *l, struct darray *out)
+{
+	const size_t size = sizeof(struct encoder_packet);
+	size_t num_packets = l->packets.size / size;
+	DARRAY(struct encoder_packet) mux_packets;
+
+	da_init(mux_packets);
+	da_reserve(mux_packets, num_packets);
+
+	bool found_video = false;
+	bool found_audio[MAX_AUDIO_MIXES] = {0};
+	int64_t video_offset = 0;
+	int64_t video_dts_offset = 0;
+	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+
+	for (size_t i = 0; i < num_packets; i++) {
+		struct encoder_packet *pkt;
+		pkt = circlebuf_data(&l->packets, i * size);
+
+		if (pkt->type == OBS_ENCODER_VIDEO) {
+			if (!found_video) {
+				video_offset = pkt->dts_usec;
+				video_dts_offset = pkt->dts;
+				found_video = true;
+			}
+		} else {
+			if (!found_audio[pkt->track_idx]) {
+				found_audio[pkt->track_idx] = true;
+				audio_offsets[pkt->track_idx] = pkt->dts_usec;
+				audio_dts_offsets[pkt->track_idx] = pkt->dts;
+			}
+		}
+
+		legacy_insert(&mux_packets.da, pkt, video_offset,
+			      audio_offsets, video_dts_offset,
+			      audio_dts_offsets);
+	}
+
+	*out = mux_packets.da;
+}
+
+static void legacy_free_saved(struct darray *array)
+{
+	DARRAY(struct encoder_packet) packets;
+	packets.da = *array;
+
+	for (size_t i = 0; i < packets.num; i++)
+		obs_encoder_packet_release(&packets.array[i]);
+	da_free(packets);
+}
+
+static void legacy_free(struct legacy *l)
+{
+	while (l->packets.size) {
+		struct encoder_packet pkt;
+		circlebuf_pop_front(&l->packets, &pkt, sizeof(pkt));
+		obs_encoder_packet_release(&pkt);
+	}
+	circlebuf_free(&l->packets);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct source {
+	struct params *params;
+	uint8_t *payload;
+	size_t payload_size;
+	size_t frame;
+	int64_t audio_dts[2];
+	uint32_t seq;
+
+	DARRAY(struct encoder_packet) ready;
+};
+
+/* each packet gets different bytes so a mixed up payload shows */
+static void make_packet(struct source *src, struct encoder_packet *out,
+			struct encoder_packet *tmpl, size_t size)
+{
+	uint32_t seq = src->seq++;
+
+	tmpl->data = src->payload + (seq * 977) % (src->payload_size - size);
+	tmpl->size = size;
+	obs_duplicate_encoder_packet(out, tmpl);
+}
+
+/* the packets encoded up to the next video frame, in arrival order */
+static void next_packets(struct source *src)
+{
+	struct params *p = src->params;
+	size_t frame_size = (size_t)p->mbps * 1000000 / 8 / FPS;
+	size_t audio_size = AUDIO_BITRATE * 1000 / 8 * AUDIO_FRAMES /
+			    AUDIO_RATE;
+	size_t i = src->frame++;
+
+	struct encoder_packet video = {0};
+	bool keyframe = i % (FPS * KEYFRAME_SEC) == 0;
+
+	video.type = OBS_ENCODER_VIDEO;
+	video.timebase_num = 1;
+	video.timebase_den = FPS;
+	video.dts = (int64_t)i;
+	video.pts = (int64_t)i + 2;
+	video.dts_usec = (int64_t)i * 1000000 / FPS;
+	video.keyframe = keyframe;
+
+	da_resize(src->ready, 0);
+	make_packet(src, da_push_back_new(src->ready), &video,
+		    keyframe ? frame_size * 4 : frame_size);
+
+	/* the second track's encoder hands over its packets in bursts */
+	for (size_t track = 0; track < 2; track++) {
+		int64_t until = (int64_t)(i + 1) * AUDIO_RATE;
+
+		if (track == 1) {
+			if ((i + 1) % AUDIO_BURST_FRAMES)
+				continue;
+			until -= AUDIO_RATE * AUDIO_BURST_FRAMES / 2;
+		}
+
+		while (src->audio_dts[track] * FPS < until) {
+			struct encoder_packet audio = {0};
+
+			audio.type = OBS_ENCODER_AUDIO;
+			audio.track_idx = track;
+			audio.timebase_num = 1;
+			audio.timebase_den = AUDIO_RATE;
+			audio.dts = audio.pts = src->audio_dts[track];
+			audio.dts_usec = audio.dts * 1000000 / AUDIO_RATE;
+
+			make_packet(src, da_push_back_new(src->ready), &audio,
+				    audio_size);
+			src->audio_dts[track] += AUDIO_FRAMES;
+		}
+	}
+}
+
+static void release_ready(struct source *src)
+{
+	for (size_t i = 0; i < src->ready.num; i++)
+		obs_encoder_packet_release(&src->ready.array[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool same_packet(const struct encoder_packet *a,
+			const struct encoder_packet *b)
+{
+	return a->type == b->type && a->track_idx == b->track_idx &&
+	       a->dts_usec == b->dts_usec && a->dts == b->dts &&
+	       a->pts == b->pts && a->keyframe == b->keyframe &&
+	       a->size == b->size && memcmp(a->data, b->data, a->size) == 0;
+}
+
+static void push_seconds(struct source *src, struct legacy *l,
+			 struct replay_store *store, int seconds)
+{
+	for (int i = 0; i < seconds * FPS; i++) {
+		next_packets(src);
+		for (size_t j = 0; j < src->ready.num; j++) {
+			legacy_push(l, &src->ready.array[j]);
+			replay_store_push(store, &src->ready.array[j]);
+		}
+		release_ready(src);
+	}
+}
+
+/* saves both and compares, returns the number of packets or -1 */
+static long long compare_saves(struct legacy *l, struct replay_store *store,
+			       int seconds_more, struct source *src)
+{
+	struct replay_snapshot *snapshot = replay_store_snapshot(store);
+	DARRAY(struct encoder_packet) saved;
+	struct encoder_packet pkt;
+	long long count = 0;
+	bool same = true;
+
+	legacy_save(l, &saved.da);
+
+	/* the store must leave the snapshot alone while it goes on */
+	push_seconds(src, l, store, seconds_more);
+
+	while (replay_snapshot_next(snapshot, &pkt)) {
+		if ((size_t)count >= saved.num ||
+		    !same_packet(&pkt, &saved.array[count]))
+			same = false;
+		count++;
+	}
+
+	if ((size_t)count != saved.num)
+		same = false;
+
+	replay_snapshot_destroy(snapshot);
+	legacy_free_saved(&saved.da);
+	return same ? count : -1;
+}
+
+static int check(void)
+{
+	struct params p = {20, 30, 20, 5};
+	struct source src = {&p};
+	struct legacy l = {0};
+	struct replay_store *store;
+	int64_t mem_size = 0, disk_size = 0;
+	long long count;
+	int failures = 0;
+
+	src.payload_size = 16 * 1024 * 1024;
+	src.payload = bmalloc(src.payload_size);
+	for (size_t i = 0; i < src.payload_size; i++)
+		src.payload[i] = (uint8_t)(i * 31 + (i >> 13));
+
+	l.max_time = p.max_time_sec * 1000000LL;
+	store = replay_store_create(l.max_time, 0, p.mem_time_sec * 1000000LL,
+				    NULL);
+
+	push_seconds(&src, &l, store, p.seconds - 10);
+
+	count = compare_saves(&l, store, 5, &src);
+	printf("save while recording: %lld packets, same: %s\n",
+	       count < 0 ? 0 : count, count < 0 ? "NO" : "yes");
+	if (count < 0)
+		failures++;
+
+	/* segments held by the save are spilled on the next keyframes */
+	push_seconds(&src, &l, store, 5);
+
+	for (int i = 0; i < 500; i++) {
+		replay_store_get_size(store, &mem_size, &disk_size);
+		if (mem_size < l.cur_size / 2)
+			break;
+		os_sleep_ms(10);
+	}
+
+	count = compare_saves(&l, store, 0, &src);
+	printf("save at the end:      %lld packets, same: %s\n",
+	       count < 0 ? 0 : count, count < 0 ? "NO" : "yes");
+	if (count < 0)
+		failures++;
+
+	printf("%.1f MB in memory, %.1f MB on disk, %.1f MB before\n",
+	       (double)mem_size / 1048576.0, (double)disk_size / 1048576.0,
+	       (double)l.cur_size / 1048576.0);
+	if (!disk_size) {
+		printf("nothing was spilled\n");
+		failures++;
+	}
+
+	replay_store_destroy(store);
+	legacy_free(&l);
+	da_free(src.ready);
+	bfree(src.payload);
+	return failures;
+}
+
+static void bench(struct params *p)
+{
+	struct source src = {p};
+	struct legacy l = {0};
+	struct replay_store *store;
+	int64_t legacy_peak = 0, store_peak = 0;
+	uint64_t legacy_ns = 0, store_ns = 0;
+	size_t packets = 0;
+
+	src.payload_size = 64 * 1024 * 1024;
+	src.payload = bmalloc(src.payload_size);
+	for (size_t i = 0; i < src.payload_size; i++)
+		src.payload[i] = (uint8_t)(i * 31 + (i >> 13));
+
+	l.max_time = p->max_time_sec * 1000000LL;
+	store = replay_store_create(l.max_time, 0,
+				    p->mem_time_sec * 1000000LL, NULL);
+
+	for (int i = 0; i < p->seconds * FPS; i++) {
+		int64_t mem_size, disk_size;
+		uint64_t t;
+
+		next_packets(&src);
+
+		t = os_gettime_ns();
+		for (size_t j = 0; j < src.ready.num; j++)
+			legacy_push(&l, &src.ready.array[j]);
+		legacy_ns += os_gettime_ns() - t;
+
+		t = os_gettime_ns();
+		for (size_t j = 0; j < src.ready.num; j++)
+			replay_store_push(store, &src.ready.array[j]);
+		store_ns += os_gettime_ns() - t;
+
+		packets += src.ready.num;
+		release_ready(&src);
+
+		replay_store_get_size(store, &mem_size, &disk_size);
+		if (store_peak < mem_size)
+			store_peak = mem_size;
+		if (legacy_peak < l.cur_size)
+			legacy_peak = l.cur_size;
+	}
+
+	printf("%d s at %d Mbps, %d s buffer, newest %d s in memory\n",
+	       p->seconds, p->mbps, p->max_time_sec, p->mem_time_sec);
+	printf("  push:          circlebuf %6.1f ns/packet, "
+	       "segments %6.1f ns/packet\n",
+	       (double)legacy_ns / (double)packets,
+	       (double)store_ns / (double)packets);
+	printf("  peak resident: circlebuf %6.1f MB, segments %6.1f MB\n",
+	       (double)legacy_peak / 1048576.0, (double)store_peak / 1048576.0);
+
+	uint64_t t = os_gettime_ns();
+	DARRAY(struct encoder_packet) saved;
+	legacy_save(&l, &saved.da);
+	uint64_t legacy_save_ns = os_gettime_ns() - t;
+
+	t = os_gettime_ns();
+	struct replay_snapshot *snapshot = replay_store_snapshot(store);
+	uint64_t snapshot_ns = os_gettime_ns() - t;
+
+	struct encoder_packet pkt;
+	uint64_t bytes = 0;
+
+	t = os_gettime_ns();
+	while (replay_snapshot_next(snapshot, &pkt))
+		bytes += pkt.size;
+	uint64_t walk_ns = os_gettime_ns() - t;
+
+	printf("  save:          circlebuf %6.2f ms to sort %zu packets, "
+	       "segments %6.3f ms to snapshot and %6.2f ms to walk "
+	       "%.1f MB\n",
+	       (double)legacy_save_ns / 1000000.0, saved.num,
+	       (double)snapshot_ns / 1000000.0, (double)walk_ns / 1000000.0,
+	       (double)bytes / 1048576.0);
+
+	replay_snapshot_destroy(snapshot);
+	legacy_free_saved(&saved.da);
+	replay_store_destroy(store);
+	legacy_free(&l);
+	da_free(src.ready);
+	bfree(src.payload);
+}
+
+int main(int argc, char *argv[])
+{
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+
+	if (check_only)
+		return check() ? 1 : 0;
+
+	struct params runs[] = {
+		{25, 150, 120, 10},
+		{50, 150, 120, 30},
+	};
+
+	for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+		bench(&runs[i]);
+	return 0;
+}
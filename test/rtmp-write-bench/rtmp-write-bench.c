@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <obs.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+
+#include "flv-mux.h"
+#include "librtmp/rtmp.h"
+
+/* Streams synthetic 60 fps video with 160 kbps audio over a loopback TCP
+ * socket as fast as the socket takes it, through the two ways of sending a
+ * packet with librtmp: muxing a FLV tag and handing it to RTMP_Write (two
+ * copies of the payload and a send per chunk), and RTMP_WriteV with the tag
+ * bytes and the payload gathered straight into the socket.
+ *
+ * --check sends a short stream through both and checks that the bytes on
+ * the wire are the same, over the socket and through a custom send
+ * function, with small and large chunk sizes (used by ctest). */
+
+#define FPS 60
+#define AUDIO_RATE 48000
+#define AUDIO_FRAMES 1024
+#define AUDIO_BITRATE 160
+#define KEYFRAME_SEC 2
+
+enum path {
+	PATH_FLV_MUX,
+	PATH_WRITEV,
+};
+
+static const char *path_names[] = {"flv mux + RTMP_Write", "RTMP_WriteV"};
+
+struct reader {
+	int fd;
+	bool capture;
+	uint64_t bytes;
+	DARRAY(uint8_t) data;
+};
+
+static void *reader_thread(void *param)
+{
+	struct reader *reader = param;
+	uint8_t buf[256 * 1024];
+
+	for (;;) {
+		ssize_t n = recv(reader->fd, buf, sizeof(buf), 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+
+		reader->bytes += (uint64_t)n;
+		if (reader->capture)
+			da_push_back_array(reader->data, buf, (size_t)n);
+	}
+
+	return NULL;
+}
+
+static int custom_send(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+	struct reader *reader = param;
+
+	reader->bytes += (uint64_t)len;
+	da_push_back_array(reader->data, buf, (size_t)len);
+
+	UNUSED_PARAMETER(sb);
+	return len;
+}
+
+static bool connect_loopback(int *client, int *server)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	int one = 1;
+	int listener;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		return false;
+
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+	    listen(listener, 1) != 0 ||
+	    getsockname(listener, (struct sockaddr *)&addr, &len) != 0) {
+		close(listener);
+		return false;
+	}
+
+	*client = socket(AF_INET, SOCK_STREAM, 0);
+	if (connect(*client, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(*client);
+		close(listener);
+		return false;
+	}
+
+	*server = accept(listener, NULL, NULL);
+	close(listener);
+
+	setsockopt(*client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return *server >= 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct stream {
+	int mbps;
+	int seconds;
+	uint8_t *payload;
+	size_t payload_size;
+};
+
+static bool send_packet(RTMP *rtmp, enum path path,
+			struct encoder_packet *packet)
+{
+	if (path == PATH_FLV_MUX) {
+		uint8_t *data;
+		size_t size;
+		int ret;
+
+		flv_packet_mux(packet, 0, &data, &size, false);
+		ret = RTMP_Write(rtmp, (char *)data, (int)size, 0);
+		bfree(data);
+		return ret >= 0;
+	} else {
+		struct flv_tag tag;
+
+		if (!flv_packet_tag(packet, 0, &tag, false))
+			return true;
+
+		AVal body[2] = {
+			{(char *)tag.prefix, (int)tag.prefix_size},
+			{(char *)packet->data, (int)packet->size},
+		};
+		return RTMP_WriteV(rtmp, tag.type,
+				   (uint32_t)tag.time_ms & 0x7FFFFFFF, body, 2,
+				   0) != 0;
+	}
+}
+
+static bool send_stream(RTMP *rtmp, enum path path, struct stream *s)
+{
+	size_t frame_size = (size_t)s->mbps * 1000000 / 8 / FPS;
+	size_t audio_size = AUDIO_BITRATE * 1000 / 8 * AUDIO_FRAMES /
+			    AUDIO_RATE;
+	int64_t audio_dts = 0;
+
+	for (int i = 0; i < s->seconds * FPS; i++) {
+		struct encoder_packet video = {0};
+		bool keyframe = i % (FPS * KEYFRAME_SEC) == 0;
+
+		video.type = OBS_ENCODER_VIDEO;
+		video.timebase_num = 1;
+		video.timebase_den = FPS;
+		video.dts = i;
+		video.pts = i + 2;
+		video.keyframe = keyframe;
+		video.data = s->payload;
+		video.size = keyframe ? frame_size * 4 : frame_size;
+
+		if (!send_packet(rtmp, path, &video))
+			return false;
+
+		/* the audio up to the next frame */
+		while (audio_dts * FPS < (int64_t)(i + 1) * AUDIO_RATE) {
+			struct encoder_packet audio = {0};
+
+			audio.type = OBS_ENCODER_AUDIO;
+			audio.timebase_num = 1;
+			audio.timebase_den = AUDIO_RATE;
+			audio.dts = audio.pts = audio_dts;
+			audio.data = s->payload;
+			audio.size = audio_size;
+
+			if (!send_packet(rtmp, path, &audio))
+				return false;
+
+			audio_dts += AUDIO_FRAMES;
+		}
+	}
+
+	return true;
+}
+
+static void init_rtmp(RTMP *rtmp, int chunk_size)
+{
+	RTMP_Init(rtmp);
+	rtmp->m_outChunkSize = chunk_size;
+	rtmp->Link.streams[0].id = 1;
+}
+
+static void close_rtmp(RTMP *rtmp)
+{
+	/* there is no server to unpublish from */
+	rtmp->Link.nStreams = 0;
+	RTMP_Close(rtmp);
+}
+
+/* returns the nanoseconds the sender took, 0 on failure */
+static uint64_t run_socket(enum path path, struct stream *s, int chunk_size,
+			   struct reader *reader)
+{
+	pthread_t thread;
+	uint64_t ns = 0;
+	int client, server;
+	RTMP rtmp;
+
+	if (!connect_loopback(&client, &server))
+		return 0;
+
+	reader->fd = server;
+	pthread_create(&thread, NULL, reader_thread, reader);
+
+	init_rtmp(&rtmp, chunk_size);
+	rtmp.m_sb.sb_socket = client;
+
+	ns = os_gettime_ns();
+	if (!send_stream(&rtmp, path, s))
+		ns = 0;
+	else
+		ns = os_gettime_ns() - ns;
+
+	close_rtmp(&rtmp);
+	pthread_join(thread, NULL);
+	close(server);
+	return ns;
+}
+
+static bool run_custom(enum path path, struct stream *s, int chunk_size,
+		       struct reader *reader)
+{
+	bool success;
+	RTMP rtmp;
+
+	init_rtmp(&rtmp, chunk_size);
+	rtmp.m_bCustomSend = 1;
+	rtmp.m_customSendFunc = custom_send;
+	rtmp.m_customSendParam = reader;
+
+	/* RTMP_IsConnected only looks at the socket */
+	rtmp.m_sb.sb_socket = 0;
+
+	success = send_stream(&rtmp, path, s);
+
+	rtmp.m_sb.sb_socket = -1;
+	close_rtmp(&rtmp);
+	return success;
+}
+
+static int check(struct stream *s)
+{
+	static const int chunk_sizes[] = {128, 4096};
+	int failures = 0;
+
+	for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]);
+	     i++) {
+		for (int custom = 0; custom < 2; custom++) {
+			struct reader readers[2] = {0};
+			bool same;
+
+			for (int p = 0; p < 2; p++) {
+				readers[p].capture = true;
+				if (custom)
+					run_custom((enum path)p, s,
+						   chunk_sizes[i], &readers[p]);
+				else
+					run_socket((enum path)p, s,
+						   chunk_sizes[i], &readers[p]);
+			}
+
+			same = readers[0].data.num &&
+			       readers[0].data.num == readers[1].data.num &&
+			       memcmp(readers[0].data.array,
+				      readers[1].data.array,
+				      readers[0].data.num) == 0;
+
+			printf("%s, chunk size %4d: %zu bytes, same bytes: "
+			       "%s\n",
+			       custom ? "custom send" : "socket     ",
+			       chunk_sizes[i], readers[1].data.num,
+			       same ? "yes" : "NO");
+
+			if (!same)
+				failures++;
+
+			da_free(readers[0].data);
+			da_free(readers[1].data);
+		}
+	}
+
+	return failures;
+}
+
+int main(int argc, char *argv[])
+{
+	bool check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+	static const int bitrates[] = {50, 75, 100};
+	struct stream s = {0};
+	int failures = 0;
+
+	s.payload_size = 100 * 1000000 / 8 / FPS * 4;
+	s.payload = bmalloc(s.payload_size);
+	for (size_t i = 0; i < s.payload_size; i++)
+		s.payload[i] = (uint8_t)(i * 31 + 7);
+
+	if (check_only) {
+		s.mbps = 50;
+		s.seconds = 2;
+		failures = check(&s);
+	} else {
+		s.seconds = 60;
+
+		printf("%d s of %d fps video and %d kbps audio, chunk size "
+		       "4096, over loopback TCP\n",
+		       s.seconds, FPS, AUDIO_BITRATE);
+
+		for (size_t i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]);
+		     i++) {
+			s.mbps = bitrates[i];
+
+			for (int p = 0; p < 2; p++) {
+				struct reader reader = {0};
+				uint64_t ns = run_socket((enum path)p, &s,
+							 4096, &reader);
+				if (!ns) {
+					printf("%3d Mbps %-21s failed\n",
+					       s.mbps, path_names[p]);
+					failures++;
+					continue;
+				}
+
+				printf("%3d Mbps %-21s %8.1f Mbps sent, "
+				       "%6.1f ms per stream second\n",
+				       s.mbps, path_names[p],
+				       (double)reader.bytes * 8.0 * 1000.0 /
+					       (double)ns,
+				       (double)ns / 1000000.0 /
+					       (double)s.seconds);
+			}
+		}
+	}
+
+	bfree(s.payload);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,344 @@
+#include <stdio.h>
+
+#include "SharedEncoderFactory.h"
+
+#include "api/video/i420_buffer.h"
+#include "api/video/video_frame.h"
+#include "api/video_codecs/video_encoder.h"
+#include "modules/video_coding/include/video_codec_interface.h"
+#include "modules/video_coding/include/video_error_codes.h"
+
+#include <memory>
+#include <vector>
+
+/* Unit test of the SharedEncoderFactory of obs-outputs, on fake encoders so
+ * that no codec or network is involved: the peer connections sharing an
+ * encoder only encode each frame once, a keyframe requested on a skipped
+ * copy of a frame is made on the next one, the shared encoder runs at the
+ * lowest target of its users, and differing settings get their own
+ * encoder. */
+
+static int failures = 0;
+
+#define expect(cond)                                                     \
+	do {                                                             \
+		if (!(cond)) {                                           \
+			printf("%s:%d: failed: %s\n", __FILE__, __LINE__, \
+			       #cond);                                   \
+			failures++;                                      \
+		}                                                        \
+	} while (false)
+
+/* --------------------------------------------------- */
+
+struct FakeStats {
+	int encodes = 0;
+	int keyframes = 0;
+	int64_t last_timestamp_us = 0;
+	uint32_t last_bitrate_bps = 0;
+};
+
+class FakeEncoder : public webrtc::VideoEncoder {
+	FakeStats *stats;
+	webrtc::EncodedImageCallback *callback = nullptr;
+
+public:
+	inline FakeEncoder(FakeStats *stats) : stats(stats) {}
+
+	int32_t InitEncode(const webrtc::VideoCodec *, int32_t,
+			   size_t) override
+	{
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t RegisterEncodeCompleteCallback(
+		webrtc::EncodedImageCallback *cb) override
+	{
+		callback = cb;
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	int32_t Release() override { return WEBRTC_VIDEO_CODEC_OK; }
+
+	int32_t
+	Encode(const webrtc::VideoFrame &frame,
+	       const std::vector<webrtc::VideoFrameType> *frame_types) override
+	{
+		bool keyframe = false;
+		if (frame_types) {
+			for (auto type : *frame_types)
+				if (type == webrtc::VideoFrameType::kVideoFrameKey)
+					keyframe = true;
+		}
+
+		stats->encodes++;
+		stats->keyframes += keyframe ? 1 : 0;
+		stats->last_timestamp_us = frame.timestamp_us();
+
+		if (callback) {
+			webrtc::EncodedImage image;
+			image._frameType =
+				keyframe ? webrtc::VideoFrameType::kVideoFrameKey
+					 : webrtc::VideoFrameType::kVideoFrameDelta;
+			callback->OnEncodedImage(image, nullptr, nullptr);
+		}
+		return WEBRTC_VIDEO_CODEC_OK;
+	}
+
+	void SetRates(const RateControlParameters &parameters) override
+	{
+		stats->last_bitrate_bps = parameters.bitrate.get_sum_bps();
+	}
+};
+
+/* every encoder created, the shared ones included, in creation order */
+class FakeFactory : public webrtc::VideoEncoderFactory {
+public:
+	std::vector<std::unique_ptr<FakeStats>> encoders;
+
+	std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override
+	{
+		return {webrtc::SdpVideoFormat("H264")};
+	}
+
+	CodecInfo
+	QueryVideoEncoder(const webrtc::SdpVideoFormat &) const override
+	{
+		CodecInfo info;
+		info.is_hardware_accelerated = false;
+		info.has_internal_source = false;
+		return info;
+	}
+
+	std::unique_ptr<webrtc::VideoEncoder>
+	CreateVideoEncoder(const webrtc::SdpVideoFormat &) override
+	{
+		encoders.emplace_back(new FakeStats);
+		return std::make_unique<FakeEncoder>(encoders.back().get());
+	}
+
+	int totalEncodes() const
+	{
+		int total = 0;
+		for (auto &stats : encoders)
+			total += stats->encodes;
+		return total;
+	}
+};
+
+class CountingCallback : public webrtc::EncodedImageCallback {
+public:
+	int images = 0;
+
+	Result OnEncodedImage(const webrtc::EncodedImage &,
+			      const webrtc::CodecSpecificInfo *,
+			      const webrtc::RTPFragmentationHeader *) override
+	{
+		images++;
+		return Result(Result::OK);
+	}
+};
+
+/* --------------------------------------------------- */
+
+static webrtc::VideoCodec settings(uint16_t cx, uint16_t cy)
+{
+	webrtc::VideoCodec codec;
+	codec.codecType = webrtc::kVideoCodecH264;
+	codec.width = cx;
+	codec.height = cy;
+	codec.maxFramerate = 30;
+	codec.qpMax = 51;
+	codec.numberOfSimulcastStreams = 0;
+	return codec;
+}
+
+static webrtc::VideoFrame frame(int64_t timestamp_us)
+{
+	return webrtc::VideoFrame::Builder()
+		.set_video_frame_buffer(webrtc::I420Buffer::Create(64, 64))
+		.set_timestamp_us(timestamp_us)
+		.build();
+}
+
+static webrtc::VideoEncoder::RateControlParameters rates(uint32_t bps)
+{
+	webrtc::VideoBitrateAllocation allocation;
+	allocation.SetBitrate(0, 0, bps);
+	return webrtc::VideoEncoder::RateControlParameters(allocation, 30.0);
+}
+
+static const std::vector<webrtc::VideoFrameType> key_request = {
+	webrtc::VideoFrameType::kVideoFrameKey};
+
+/* the own encoders are created with the SharedEncoders, the shared one
+ * when the first of them is initialized: it's the last one created */
+static FakeStats *shared_stats(FakeFactory *fake)
+{
+	return fake->encoders.empty() ? nullptr : fake->encoders.back().get();
+}
+
+static void test_dedupe()
+{
+	FakeFactory *fake = new FakeFactory;
+	SharedEncoderFactory factory{std::unique_ptr<FakeFactory>(fake)};
+	webrtc::SdpVideoFormat format("H264");
+	webrtc::VideoCodec codec = settings(1280, 720);
+	CountingCallback cb_a, cb_b;
+
+	auto a = factory.CreateVideoEncoder(format);
+	auto b = factory.CreateVideoEncoder(format);
+	a->RegisterEncodeCompleteCallback(&cb_a);
+	b->RegisterEncodeCompleteCallback(&cb_b);
+	expect(a->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(b->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(factory.activeEncoders() == 1);
+
+	/* the same frame from both peer connections is encoded once, and
+	 * both get the image */
+	a->Encode(frame(1000), nullptr);
+	b->Encode(frame(1000), nullptr);
+	expect(fake->totalEncodes() == 1);
+	expect(cb_a.images == 1 && cb_b.images == 1);
+
+	/* an older copy arriving late is skipped too */
+	b->Encode(frame(2000), nullptr);
+	a->Encode(frame(1000), nullptr);
+	a->Encode(frame(2000), nullptr);
+	expect(fake->totalEncodes() == 2);
+	expect(cb_a.images == 2 && cb_b.images == 2);
+
+	FakeStats *stats = shared_stats(fake);
+	expect(stats && stats->encodes == 2);
+	expect(stats && stats->last_timestamp_us == 2000);
+
+	a->Release();
+	b->Release();
+	expect(factory.activeEncoders() == 0);
+}
+
+static void test_keyframes()
+{
+	FakeFactory *fake = new FakeFactory;
+	SharedEncoderFactory factory{std::unique_ptr<FakeFactory>(fake)};
+	webrtc::SdpVideoFormat format("H264");
+	webrtc::VideoCodec codec = settings(1280, 720);
+
+	auto a = factory.CreateVideoEncoder(format);
+	auto b = factory.CreateVideoEncoder(format);
+	expect(a->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	a->Encode(frame(1000), nullptr);
+
+	FakeStats *stats = shared_stats(fake);
+	expect(stats && stats->keyframes == 0);
+	if (!stats)
+		return;
+
+	/* a new peer connection needs a keyframe to start decoding */
+	expect(b->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	b->Encode(frame(2000), nullptr);
+	expect(stats->encodes == 2 && stats->keyframes == 1);
+	a->Encode(frame(3000), nullptr);
+	expect(stats->encodes == 3 && stats->keyframes == 1);
+
+	/* requested on a copy that is skipped: made on the next frame */
+	b->Encode(frame(3000), &key_request);
+	expect(stats->encodes == 3 && stats->keyframes == 1);
+	a->Encode(frame(4000), nullptr);
+	expect(stats->encodes == 4 && stats->keyframes == 2);
+
+	/* and only once */
+	b->Encode(frame(4000), nullptr);
+	a->Encode(frame(5000), nullptr);
+	expect(stats->encodes == 5 && stats->keyframes == 2);
+
+	/* requested on a frame that is encoded */
+	b->Encode(frame(6000), &key_request);
+	expect(stats->encodes == 6 && stats->keyframes == 3);
+}
+
+static void test_rates()
+{
+	FakeFactory *fake = new FakeFactory;
+	SharedEncoderFactory factory{std::unique_ptr<FakeFactory>(fake)};
+	webrtc::SdpVideoFormat format("H264");
+	webrtc::VideoCodec codec = settings(1280, 720);
+
+	auto a = factory.CreateVideoEncoder(format);
+	auto b = factory.CreateVideoEncoder(format);
+	auto c = factory.CreateVideoEncoder(format);
+	expect(a->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(b->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(c->InitEncode(&codec, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+
+	FakeStats *stats = shared_stats(fake);
+	expect(stats != nullptr);
+	if (!stats)
+		return;
+
+	a->SetRates(rates(2000000));
+	expect(stats->last_bitrate_bps == 2000000);
+	b->SetRates(rates(800000));
+	expect(stats->last_bitrate_bps == 800000);
+
+	/* a zero target (e.g. a paused peer connection) is not the lowest */
+	c->SetRates(rates(0));
+	expect(stats->last_bitrate_bps == 800000);
+
+	/* raising the lowest one: the next lowest takes over */
+	b->SetRates(rates(3000000));
+	expect(stats->last_bitrate_bps == 2000000);
+
+	/* leaving: the rates of the remaining ones apply again */
+	b->SetRates(rates(500000));
+	expect(stats->last_bitrate_bps == 500000);
+	b->Release();
+	expect(stats->last_bitrate_bps == 2000000);
+}
+
+static void test_own_encoders()
+{
+	FakeFactory *fake = new FakeFactory;
+	SharedEncoderFactory factory{std::unique_ptr<FakeFactory>(fake)};
+	webrtc::SdpVideoFormat format("H264");
+	webrtc::VideoCodec hd = settings(1280, 720);
+	webrtc::VideoCodec sd = settings(640, 360);
+
+	auto a = factory.CreateVideoEncoder(format);
+	auto b = factory.CreateVideoEncoder(format);
+	expect(a->InitEncode(&hd, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(b->InitEncode(&sd, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(factory.activeEncoders() == 2);
+
+	/* different settings: both frames are encoded */
+	a->Encode(frame(1000), nullptr);
+	b->Encode(frame(1000), nullptr);
+	expect(fake->totalEncodes() == 2);
+
+	/* back to the shared settings: b stops encoding on its own */
+	expect(b->InitEncode(&hd, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(factory.activeEncoders() == 1);
+
+	a->Release();
+	b->Release();
+
+	/* no sharing at all */
+	factory.setSharing(false);
+	expect(a->InitEncode(&hd, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(b->InitEncode(&hd, 1, 1200) == WEBRTC_VIDEO_CODEC_OK);
+	expect(factory.activeEncoders() == 2);
+	a->Encode(frame(2000), nullptr);
+	b->Encode(frame(2000), nullptr);
+	expect(fake->totalEncodes() == 4);
+}
+
+int main()
+{
+	test_dedupe();
+	test_keyframes();
+	test_rates();
+	test_own_encoders();
+
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
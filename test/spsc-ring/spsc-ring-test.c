@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <util/spsc-ring.h>
+
+/* Unit test of util/spsc-ring.h: capacity rounding, full and empty rings,
+ * spans that wrap around the end of the buffer, sub-spans on either side of
+ * the split, positions wrapping around the range of long, and a producer and
+ * a consumer thread moving variable sized records through a small ring. */
+
+static int failures = 0;
+
+#define expect(cond)                                                     \
+	do {                                                             \
+		if (!(cond)) {                                           \
+			printf("%s:%d: failed: %s\n", __FILE__, __LINE__, \
+			       #cond);                                   \
+			failures++;                                      \
+		}                                                        \
+	} while (false)
+
+static void fill(uint8_t *data, size_t size, uint8_t seed)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)(seed + i * 7);
+}
+
+/* moves both positions to pos, as if that much had gone through */
+static void set_position(struct spsc_ring *ring, unsigned long pos)
+{
+	ring->head = (long)pos;
+	ring->tail = (long)pos;
+	ring->cached_head = pos;
+	ring->cached_tail = pos;
+}
+
+static void test_init(void)
+{
+	struct spsc_ring ring;
+
+	spsc_ring_init(&ring, 1);
+	expect(ring.capacity == 4096);
+	spsc_ring_free(&ring);
+
+	spsc_ring_init(&ring, 5000);
+	expect(ring.capacity == 8192);
+	expect(spsc_ring_free_space(&ring) == 8192);
+	expect(spsc_ring_size(&ring) == 0);
+	spsc_ring_free(&ring);
+	expect(ring.data == NULL);
+}
+
+static void test_full_and_empty(void)
+{
+	uint8_t in[4096], out[4096];
+	struct spsc_ring ring;
+	struct spsc_ring_span span;
+
+	spsc_ring_init(&ring, 4096);
+	fill(in, sizeof(in), 1);
+
+	expect(!spsc_ring_read_peek(&ring, 1, &span));
+	expect(!spsc_ring_pop(&ring, out, 1));
+
+	expect(spsc_ring_push(&ring, in, 4000));
+	expect(!spsc_ring_push(&ring, in, 97));
+	expect(spsc_ring_push(&ring, in + 4000, 96));
+	expect(spsc_ring_free_space(&ring) == 0);
+	expect(!spsc_ring_push(&ring, in, 1));
+	expect(spsc_ring_size(&ring) == 4096);
+
+	expect(!spsc_ring_pop(&ring, out, 4097));
+	expect(spsc_ring_pop(&ring, out, 4096));
+	expect(memcmp(in, out, sizeof(in)) == 0);
+	expect(spsc_ring_size(&ring) == 0);
+
+	/* popping without a destination just drops the data */
+	expect(spsc_ring_push(&ring, in, 10));
+	expect(spsc_ring_pop(&ring, NULL, 10));
+	expect(spsc_ring_size(&ring) == 0);
+
+	spsc_ring_free(&ring);
+}
+
+static void test_split_spans(void)
+{
+	uint8_t in[1000], out[1000];
+	struct spsc_ring ring;
+	struct spsc_ring_span span, sub;
+
+	spsc_ring_init(&ring, 4096);
+	set_position(&ring, 4096 - 300);
+	fill(in, sizeof(in), 3);
+
+	/* the write wraps: 300 bytes at the end, 700 at the start */
+	expect(spsc_ring_write_peek(&ring, 1000, &span));
+	expect(span.data[0] == ring.data + 4096 - 300);
+	expect(span.size[0] == 300);
+	expect(span.data[1] == ring.data);
+	expect(span.size[1] == 700);
+
+	/* writes before, across and after the split */
+	spsc_ring_span_write(&span, 0, in, 200);
+	spsc_ring_span_write(&span, 200, in + 200, 400);
+	spsc_ring_span_write(&span, 600, in + 600, 400);
+	expect(memcmp(ring.data + 4096 - 300, in, 300) == 0);
+	expect(memcmp(ring.data, in + 300, 700) == 0);
+
+	/* nothing is readable until it is committed */
+	expect(!spsc_ring_read_peek(&ring, 1, &span));
+	spsc_ring_write_commit(&ring, 1000);
+
+	expect(spsc_ring_read_peek(&ring, 1000, &span));
+	expect(span.size[0] == 300 && span.size[1] == 700);
+
+	/* sub-span within the first part */
+	spsc_ring_span_sub(&span, 10, 100, &sub);
+	expect(sub.data[0] == span.data[0] + 10 && sub.size[0] == 100);
+	expect(sub.size[1] == 0);
+
+	/* sub-span across the split */
+	spsc_ring_span_sub(&span, 250, 100, &sub);
+	expect(sub.data[0] == span.data[0] + 250 && sub.size[0] == 50);
+	expect(sub.data[1] == ring.data && sub.size[1] == 50);
+
+	/* sub-span within the second part */
+	spsc_ring_span_sub(&span, 400, 100, &sub);
+	expect(sub.data[0] == ring.data + 100 && sub.size[0] == 100);
+	expect(sub.data[1] == NULL && sub.size[1] == 0);
+
+	memset(out, 0, sizeof(out));
+	spsc_ring_span_read(&span, 0, out, 300);
+	spsc_ring_span_read(&span, 300, out + 300, 700);
+	expect(memcmp(in, out, sizeof(in)) == 0);
+
+	memset(out, 0, sizeof(out));
+	spsc_ring_span_read(&span, 290, out, 20);
+	expect(memcmp(in + 290, out, 20) == 0);
+
+	spsc_ring_read_commit(&ring, 1000);
+	expect(spsc_ring_size(&ring) == 0);
+
+	/* a span ending exactly at the end of the buffer is not split */
+	set_position(&ring, 4096 - 300);
+	expect(spsc_ring_write_peek(&ring, 300, &span));
+	expect(span.size[0] == 300 && span.size[1] == 0);
+
+	spsc_ring_free(&ring);
+}
+
+static void test_position_wrap(void)
+{
+	uint8_t in[3000], out[3000];
+	struct spsc_ring ring;
+
+	spsc_ring_init(&ring, 4096);
+	fill(in, sizeof(in), 5);
+
+	/* the positions go past the largest long and then past zero */
+	set_position(&ring, (unsigned long)LONG_MAX - 1000);
+
+	for (int i = 0; i < 8; i++) {
+		expect(spsc_ring_push(&ring, in, sizeof(in)));
+		expect(spsc_ring_size(&ring) == sizeof(in));
+		expect(spsc_ring_free_space(&ring) == 4096 - sizeof(in));
+		expect(spsc_ring_pop(&ring, out, sizeof(out)));
+		expect(memcmp(in, out, sizeof(in)) == 0);
+	}
+
+	set_position(&ring, ULONG_MAX - 1000);
+
+	for (int i = 0; i < 8; i++) {
+		expect(spsc_ring_push(&ring, in, sizeof(in)));
+		expect(spsc_ring_size(&ring) == sizeof(in));
+		expect(spsc_ring_pop(&ring, out, sizeof(out)));
+		expect(memcmp(in, out, sizeof(in)) == 0);
+	}
+
+	spsc_ring_free(&ring);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define RECORDS 200000
+
+struct record {
+	uint32_t seq;
+	uint32_t size;
+};
+
+static void *producer(void *param)
+{
+	struct spsc_ring *ring = param;
+	uint8_t payload[700];
+
+	for (uint32_t seq = 0; seq < RECORDS; seq++) {
+		struct record rec = {seq, (seq * 131) % sizeof(payload)};
+		struct spsc_ring_span span;
+
+		fill(payload, rec.size, (uint8_t)seq);
+
+		while (!spsc_ring_write_peek(ring, sizeof(rec) + rec.size,
+					     &span))
+			sched_yield();
+
+		spsc_ring_span_write(&span, 0, &rec, sizeof(rec));
+		spsc_ring_span_write(&span, sizeof(rec), payload, rec.size);
+		spsc_ring_write_commit(ring, sizeof(rec) + rec.size);
+	}
+
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	uint8_t expected[700], payload[700];
+	struct spsc_ring ring;
+	pthread_t thread;
+	uint32_t next = 0;
+	int bad = 0;
+
+	spsc_ring_init(&ring, 4096);
+	pthread_create(&thread, NULL, producer, &ring);
+
+	while (next < RECORDS) {
+		struct spsc_ring_span span;
+		struct record rec;
+
+		if (!spsc_ring_read_peek(&ring, sizeof(rec), &span)) {
+			sched_yield();
+			continue;
+		}
+
+		spsc_ring_span_read(&span, 0, &rec, sizeof(rec));
+
+		/* the payload is committed with the header */
+		if (!spsc_ring_read_peek(&ring, sizeof(rec) + rec.size,
+					 &span)) {
+			bad++;
+			break;
+		}
+
+		spsc_ring_span_read(&span, sizeof(rec), payload, rec.size);
+		fill(expected, rec.size, (uint8_t)next);
+
+		if (rec.seq != next ||
+		    rec.size != (next * 131) % sizeof(payload) ||
+		    memcmp(expected, payload, rec.size) != 0)
+			bad++;
+
+		spsc_ring_read_commit(&ring, sizeof(rec) + rec.size);
+		next++;
+	}
+
+	pthread_join(thread, NULL);
+	expect(bad == 0);
+	expect(spsc_ring_size(&ring) == 0);
+	spsc_ring_free(&ring);
+}
+
+int main(void)
+{
+	test_init();
+	test_full_and_empty();
+	test_split_spans();
+	test_position_wrap();
+	test_threads();
+
+	printf("%s\n", failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <obs.h>
+
+/* Each frame carries the time it was produced (os_gettime_ns() in ms,
+ * truncated to 32 bits) followed by an 8 bit check value, as a row of
+ * black/white cells across the top of the luma plane, most significant bit
+ * first. The loopback WebRTC receiver (LoopbackWebsocketClientImpl in
+ * obs-outputs) reads it back to measure glass-to-receive latency, keep both
+ * in sync. */
+#define STAMP_BITS 40
+#define STAMP_CHECK 0xA5
+#define STAMP_BLACK 16
+#define STAMP_WHITE 235
+
+struct latency_stamp {
+	obs_source_t *source;
+	os_event_t *stop_signal;
+	pthread_t thread;
+	bool initialized;
+
+	uint32_t width;
+	uint32_t height;
+	uint32_t fps;
+	uint8_t *planes;
+};
+
+static const char *latency_stamp_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Latency Stamp Source (Test)";
+}
+
+static void latency_stamp_destroy(void *data)
+{
+	struct latency_stamp *ls = data;
+
+	if (ls) {
+		if (ls->initialized) {
+			os_event_signal(ls->stop_signal);
+			pthread_join(ls->thread, NULL);
+		}
+
+		os_event_destroy(ls->stop_signal);
+		bfree(ls->planes);
+		bfree(ls);
+	}
+}
+
+static inline uint8_t stamp_check(uint32_t ms)
+{
+	return (uint8_t)((ms >> 24) ^ (ms >> 16) ^ (ms >> 8) ^ ms ^
+			 STAMP_CHECK);
+}
+
+static void fill_frame(struct latency_stamp *ls, uint8_t *y_plane,
+		       uint64_t frame_count, uint32_t ms)
+{
+	uint32_t cell = ls->width / STAMP_BITS;
+	uint64_t bits = ((uint64_t)ms << 8) | stamp_check(ms);
+	uint32_t x, y;
+
+	/* Moving diagonal gradient so that the encoder has work to do */
+	for (y = 0; y < ls->height; y++) {
+		uint8_t *line = y_plane + y * ls->width;
+		for (x = 0; x < ls->width; x++)
+			line[x] = (uint8_t)(x + y + frame_count * 4);
+	}
+
+	for (y = 0; y < cell && y < ls->height; y++) {
+		uint8_t *line = y_plane + y * ls->width;
+		for (x = 0; x < cell * STAMP_BITS; x++) {
+			int bit = STAMP_BITS - 1 - (int)(x / cell);
+			line[x] = ((bits >> bit) & 1) ? STAMP_WHITE
+						      : STAMP_BLACK;
+		}
+	}
+}
+
+static void *latency_stamp_thread(void *data)
+{
+	struct latency_stamp *ls = data;
+	uint64_t interval = 1000000000ULL / ls->fps;
+	uint64_t cur_time = os_gettime_ns();
+	uint64_t frame_count = 0;
+	size_t luma_size = (size_t)ls->width * ls->height;
+	size_t chroma_size = luma_size / 4;
+
+	struct obs_source_frame frame = {
+		.data = {[0] = ls->planes,
+			 [1] = ls->planes + luma_size,
+			 [2] = ls->planes + luma_size + chroma_size},
+		.linesize = {[0] = ls->width,
+			     [1] = ls->width / 2,
+			     [2] = ls->width / 2},
+		.width = ls->width,
+		.height = ls->height,
+		.format = VIDEO_FORMAT_I420,
+	};
+
+	video_format_get_parameters(VIDEO_CS_601, VIDEO_RANGE_PARTIAL,
+				    frame.color_matrix, frame.color_range_min,
+				    frame.color_range_max);
+
+	memset(ls->planes + luma_size, 128, chroma_size * 2);
+
+	while (os_event_try(ls->stop_signal) == EAGAIN) {
+		/* Stamp with the time the frame is handed to libobs */
+		uint64_t now = os_gettime_ns();
+
+		fill_frame(ls, ls->planes, frame_count++,
+			   (uint32_t)(now / 1000000));
+
+		frame.timestamp = now;
+
+		obs_source_output_video(ls->source, &frame);
+
+		os_sleepto_ns(cur_time += interval);
+	}
+
+	return NULL;
+}
+
+static void *latency_stamp_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct latency_stamp *ls = bzalloc(sizeof(struct latency_stamp));
+	ls->source = source;
+
+	/* Even sizes for I420, at least two pixels per stamp cell */
+	ls->width = (uint32_t)obs_data_get_int(settings, "width") & ~1u;
+	ls->height = (uint32_t)obs_data_get_int(settings, "height") & ~1u;
+	ls->fps = (uint32_t)obs_data_get_int(settings, "fps");
+	if (ls->width < STAMP_BITS * 2)
+		ls->width = STAMP_BITS * 2;
+	if (ls->height < 2)
+		ls->height = 2;
+	if (!ls->fps)
+		ls->fps = 30;
+
+	ls->planes = bmalloc((size_t)ls->width * ls->height * 3 / 2);
+
+	if (os_event_init(&ls->stop_signal, OS_EVENT_TYPE_MANUAL) != 0) {
+		latency_stamp_destroy(ls);
+		return NULL;
+	}
+
+	if (pthread_create(&ls->thread, NULL, latency_stamp_thread, ls) != 0) {
+		latency_stamp_destroy(ls);
+		return NULL;
+	}
+
+	ls->initialized = true;
+	return ls;
+}
+
+static void latency_stamp_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "width", 1280);
+	obs_data_set_default_int(settings, "height", 720);
+	obs_data_set_default_int(settings, "fps", 30);
+}
+
+struct obs_source_info latency_stamp_source = {
+	.id = "latency_stamp_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name = latency_stamp_getname,
+	.create = latency_stamp_create,
+	.destroy = latency_stamp_destroy,
+	.get_defaults = latency_stamp_defaults,
+};
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-frame.h>
+
+/* Times the raw video outputs of a 1920x1080 NV12 video output when 1, 2 or
+ * 4 outputs all want 1280x720 I420.  "shared" connects them with the same
+ * conversion, which is done once per frame; "separate" gives each one a
+ * different color range or space, so each frame is converted once per
+ * output.
+ *
+ * Usage: video-scale-bench [frames] [--threaded] */
+
+#define MAX_OUTPUTS 4
+
+static const size_t output_counts[] = {1, 2, MAX_OUTPUTS};
+
+static os_sem_t *frame_done;
+static volatile long pending;
+
+static void raw_video(void *param, struct video_data *frame)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(frame);
+
+	if (os_atomic_dec_long(&pending) == 0)
+		os_sem_post(frame_done);
+}
+
+static double run(size_t outputs, bool shared, bool threaded, int frames,
+		  struct video_conversion_stats *stats)
+{
+	struct video_output_info info = {
+		.name = "video-scale-bench",
+		.format = VIDEO_FORMAT_NV12,
+		.fps_num = 60,
+		.fps_den = 1,
+		.width = 1920,
+		.height = 1080,
+		.cache_size = 6,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	video_t *video;
+	uint64_t start, ts = 0;
+
+	if (video_output_open(&video, &info) != VIDEO_OUTPUT_SUCCESS)
+		return 0.0;
+
+	video_output_set_threaded_inputs(video, threaded);
+
+	for (size_t i = 0; i < outputs; i++) {
+		struct video_scale_info conversion = {
+			.format = VIDEO_FORMAT_I420,
+			.width = 1280,
+			.height = 720,
+			.range = VIDEO_RANGE_PARTIAL,
+			.colorspace = VIDEO_CS_709,
+		};
+
+		if (!shared) {
+			conversion.range = (i & 1) ? VIDEO_RANGE_FULL
+						   : VIDEO_RANGE_PARTIAL;
+			conversion.colorspace = (i & 2) ? VIDEO_CS_601
+							: VIDEO_CS_709;
+		}
+
+		video_output_connect(video, &conversion, raw_video,
+				     (void *)(uintptr_t)i);
+	}
+
+	start = os_gettime_ns();
+
+	/* one frame at a time, so that none is skipped */
+	for (int i = 0; i < frames; i++) {
+		struct video_frame frame;
+
+		os_atomic_set_long(&pending, (long)outputs);
+
+		ts += video_output_get_frame_time(video);
+		if (video_output_lock_frame(video, &frame, 1, ts)) {
+			memset(frame.data[0], i & 0xFF,
+			       frame.linesize[0] * info.height);
+			video_output_unlock_frame(video);
+			os_sem_wait(frame_done);
+		}
+	}
+
+	double us = (double)(os_gettime_ns() - start) / 1000.0 / frames;
+
+	video_output_get_conversion_stats(video, stats);
+
+	for (size_t i = 0; i < outputs; i++)
+		video_output_disconnect(video, raw_video, (void *)(uintptr_t)i);
+	video_output_close(video);
+	return us;
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 300;
+	bool threaded = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threaded") == 0)
+			threaded = true;
+		else if (atoi(argv[i]) > 0)
+			frames = atoi(argv[i]);
+	}
+
+	/* for the video thread's profiler names */
+	if (!obs_startup("en-US", NULL, NULL))
+		return 1;
+
+	os_sem_init(&frame_done, 0);
+
+	printf("1920x1080 NV12 -> 1280x720 I420, %d frames, %s inputs\n\n",
+	       frames, threaded ? "threaded" : "inline");
+	printf("outputs  separate us/frame  shared us/frame  hits  misses\n");
+
+	for (size_t i = 0; i < sizeof(output_counts) / sizeof(output_counts[0]);
+	     i++) {
+		struct video_conversion_stats separate_stats, shared_stats;
+		size_t outputs = output_counts[i];
+		double separate = run(outputs, false, threaded, frames,
+				      &separate_stats);
+		double shared =
+			run(outputs, true, threaded, frames, &shared_stats);
+
+		printf("%7zu  %18.1f  %15.1f  %4llu  %6llu\n", outputs,
+		       separate, shared, (unsigned long long)shared_stats.hits,
+		       (unsigned long long)shared_stats.misses);
+	}
+
+	os_sem_destroy(frame_done);
+	obs_shutdown();
+	return 0;
+}
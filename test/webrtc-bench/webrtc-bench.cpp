@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/base.h>
+#include <util/platform.h>
+#include <util/profiler.h>
+#include <obs.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+/* Headless end-to-end benchmark of the WebRTC outputs: frames from the
+ * "latency_stamp_source" test source go through libobs and WebRTCStream to
+ * the in-process loopback receiver of "webrtc_loopback_output", so no
+ * server or network is involved. For each resolution it reports the
+ * glass-to-receive latency, the received frame rate and bitrate, the
+ * process CPU usage and the CPU time of each profiled stage.
+ *
+ * libobs still needs a graphics module: on Linux run it under an X server
+ * (e.g. xvfb-run). The test-input and obs-outputs plugins must be
+ * installed. */
+
+struct Resolution {
+	uint32_t cx;
+	uint32_t cy;
+};
+
+struct Options {
+	std::vector<Resolution> resolutions;
+	uint32_t fps = 30;
+	int bitrate = 2500;
+	int duration = 10;
+	int warmup = 3;
+	std::string codec;
+	std::string csv_dir;
+	bool verbose = false;
+};
+
+struct StageTime {
+	uint64_t total_ns = 0;
+	uint64_t calls = 0;
+};
+
+typedef std::map<std::string, StageTime> StageTimes;
+
+/* --------------------------------------------------- */
+
+class SourceContext {
+	obs_source_t *source;
+
+public:
+	inline SourceContext(obs_source_t *source) : source(source) {}
+	inline ~SourceContext() { obs_source_release(source); }
+	inline operator obs_source_t *() { return source; }
+};
+
+class EncoderContext {
+	obs_encoder_t *encoder;
+
+public:
+	inline EncoderContext(obs_encoder_t *encoder) : encoder(encoder) {}
+	inline ~EncoderContext() { obs_encoder_release(encoder); }
+	inline operator obs_encoder_t *() { return encoder; }
+};
+
+class OutputContext {
+	obs_output_t *output;
+
+public:
+	inline OutputContext(obs_output_t *output) : output(output) {}
+	inline ~OutputContext() { obs_output_release(output); }
+	inline operator obs_output_t *() { return output; }
+};
+
+/* --------------------------------------------------- */
+
+static bool verbose = false;
+
+static void do_log(int log_level, const char *msg, va_list args, void *param)
+{
+	if (log_level > LOG_WARNING && !verbose)
+		return;
+
+	vfprintf(stderr, msg, args);
+	fputc('\n', stderr);
+
+	UNUSED_PARAMETER(param);
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s [-r WxH[,WxH...]] [-f fps] [-b kbps] [-d seconds]\n"
+	       "       [-w seconds] [-c codec] [-o csv_dir] [-v]\n"
+	       "  -r  resolutions (default 640x360,1280x720,1920x1080)\n"
+	       "  -f  frame rate (default 30)\n"
+	       "  -b  video bitrate in kbps (default 2500)\n"
+	       "  -d  measured seconds per resolution (default 10)\n"
+	       "  -w  seconds to let the connection settle first "
+	       "(default 3)\n"
+	       "  -c  video codec: vp8, vp9, h264 (default: negotiated)\n"
+	       "  -o  dump the profiler snapshot of each run as csv there\n"
+	       "  -v  show libobs info logs\n",
+	       name);
+}
+
+static bool parse_resolutions(const char *arg, std::vector<Resolution> &res)
+{
+	res.clear();
+	while (*arg) {
+		Resolution r;
+		int read = 0;
+		if (sscanf(arg, "%ux%u%n", &r.cx, &r.cy, &read) != 2 || !r.cx ||
+		    !r.cy)
+			return false;
+		res.push_back(r);
+		arg += read;
+		if (*arg == ',')
+			arg++;
+	}
+	return !res.empty();
+}
+
+static bool parse_options(int argc, char *argv[], Options &opts)
+{
+	parse_resolutions("640x360,1280x720,1920x1080", opts.resolutions);
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "-v") == 0) {
+			opts.verbose = true;
+			continue;
+		}
+		if (!value || arg[0] != '-' || strlen(arg) != 2)
+			return false;
+		i++;
+
+		switch (arg[1]) {
+		case 'r':
+			if (!parse_resolutions(value, opts.resolutions))
+				return false;
+			break;
+		case 'f':
+			opts.fps = (uint32_t)atoi(value);
+			break;
+		case 'b':
+			opts.bitrate = atoi(value);
+			break;
+		case 'd':
+			opts.duration = atoi(value);
+			break;
+		case 'w':
+			opts.warmup = atoi(value);
+			break;
+		case 'c':
+			opts.codec = value;
+			break;
+		case 'o':
+			opts.csv_dir = value;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return opts.fps && opts.bitrate > 0 && opts.duration > 0 &&
+	       opts.warmup >= 0;
+}
+
+/* --------------------------------------------------- */
+
+static bool sum_entry(void *context, profiler_snapshot_entry_t *entry)
+{
+	StageTimes &times = *static_cast<StageTimes *>(context);
+	StageTime &time = times[profiler_snapshot_entry_name(entry)];
+
+	profiler_time_entries_t *entries = profiler_snapshot_entry_times(entry);
+	for (size_t i = 0; i < entries->num; i++) {
+		/* Times are in us */
+		time.total_ns += entries->array[i].time_delta *
+				 entries->array[i].count * 1000;
+		time.calls += entries->array[i].count;
+	}
+
+	profiler_snapshot_enumerate_children(entry, sum_entry, context);
+	return true;
+}
+
+/* Profiled time of every stage so far, summed over the call sites */
+static StageTimes snapshot_stages(const Options &opts, const Resolution &res,
+				  bool dump)
+{
+	StageTimes times;
+	profiler_snapshot_t *snap = profile_snapshot_create();
+	profiler_snapshot_enumerate_roots(snap, sum_entry, &times);
+
+	if (dump && !opts.csv_dir.empty()) {
+		std::string path = opts.csv_dir + "/webrtc-bench-" +
+				   std::to_string(res.cx) + "x" +
+				   std::to_string(res.cy) + ".csv";
+		profiler_snapshot_dump_csv(snap, path.c_str());
+	}
+
+	profile_snapshot_free(snap);
+	return times;
+}
+
+static std::map<std::string, std::string> read_stats(obs_output_t *output)
+{
+	std::map<std::string, std::string> stats;
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	calldata_t cd = {0};
+
+	if (proc_handler_call(ph, "get_stats", &cd)) {
+		const char *list = calldata_string(&cd, "stats");
+		while (list && *list) {
+			const char *end = strchr(list, '\n');
+			std::string line = end ? std::string(list, end - list)
+					       : std::string(list);
+			size_t colon = line.find(':');
+			if (colon != std::string::npos)
+				stats[line.substr(0, colon)] =
+					line.substr(colon + 1);
+			list = end ? end + 1 : nullptr;
+		}
+	}
+
+	calldata_free(&cd);
+	return stats;
+}
+
+static double stat(const std::map<std::string, std::string> &stats,
+		   const char *name)
+{
+	auto it = stats.find(name);
+	return it != stats.end() ? atof(it->second.c_str()) : 0.0;
+}
+
+/* --------------------------------------------------- */
+
+static bool reset_video(const Options &opts, const Resolution &res)
+{
+	struct obs_video_info ovi = {};
+#ifdef _WIN32
+	ovi.graphics_module = DL_D3D11;
+#else
+	ovi.graphics_module = DL_OPENGL;
+#endif
+	ovi.fps_num = opts.fps;
+	ovi.fps_den = 1;
+	ovi.base_width = res.cx;
+	ovi.base_height = res.cy;
+	ovi.output_width = res.cx;
+	ovi.output_height = res.cy;
+	ovi.output_format = VIDEO_FORMAT_NV12;
+	ovi.adapter = 0;
+	ovi.gpu_conversion = true;
+	ovi.colorspace = VIDEO_CS_601;
+	ovi.range = VIDEO_RANGE_PARTIAL;
+	ovi.scale_type = OBS_SCALE_BICUBIC;
+
+	return obs_reset_video(&ovi) == OBS_VIDEO_SUCCESS;
+}
+
+static bool run(const Options &opts, const Resolution &res)
+{
+	if (!reset_video(opts, res)) {
+		fprintf(stderr, "Couldn't initialize video at %ux%u\n", res.cx,
+			res.cy);
+		return false;
+	}
+
+	obs_data_t *settings = obs_data_create();
+	obs_data_set_int(settings, "width", res.cx);
+	obs_data_set_int(settings, "height", res.cy);
+	obs_data_set_int(settings, "fps", opts.fps);
+	SourceContext source = obs_source_create(
+		"latency_stamp_source", "latency stamp", settings, nullptr);
+	obs_data_release(settings);
+	if (!source) {
+		fprintf(stderr, "Couldn't create latency stamp source\n");
+		return false;
+	}
+	obs_set_output_source(0, source);
+
+	/* Only their settings are used: WebRTCStream takes the bitrates
+	 * from the encoders, as with the streaming services */
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", opts.bitrate);
+	EncoderContext vencoder = obs_video_encoder_create(
+		"obs_x264", "bench video", settings, nullptr);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_int(settings, "bitrate", 128);
+	EncoderContext aencoder = obs_audio_encoder_create(
+		"ffmpeg_aac", "bench audio", settings, 0, nullptr);
+	obs_data_release(settings);
+
+	settings = obs_data_create();
+	obs_data_set_string(settings, "codec", opts.codec.c_str());
+	OutputContext output = obs_output_create(
+		"webrtc_loopback_output", "bench", settings, nullptr);
+	obs_data_release(settings);
+	if (!output) {
+		fprintf(stderr, "Couldn't create WebRTC loopback output\n");
+		obs_set_output_source(0, nullptr);
+		return false;
+	}
+
+	if (vencoder && aencoder) {
+		obs_encoder_set_video(vencoder, obs_get_video());
+		obs_encoder_set_audio(aencoder, obs_get_audio());
+		obs_output_set_video_encoder(output, vencoder);
+		obs_output_set_audio_encoder(output, aencoder, 0);
+	}
+
+	if (!obs_output_start(output)) {
+		fprintf(stderr, "Couldn't start WebRTC loopback output: %s\n",
+			obs_output_get_last_error(output));
+		obs_set_output_source(0, nullptr);
+		return false;
+	}
+
+	/* Connect, then measure from a clean state */
+	os_sleep_ms((uint32_t)opts.warmup * 1000);
+
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	calldata_t cd = {0};
+	proc_handler_call(ph, "get_latency", &cd);
+	long long received_start = calldata_int(&cd, "frames_received");
+	auto stats_start = read_stats(output);
+	StageTimes stages_start = snapshot_stages(opts, res, false);
+	uint32_t lagged_start = obs_get_lagged_frames();
+	os_cpu_usage_info_t *cpu = os_cpu_usage_info_start();
+	uint64_t start_ns = os_gettime_ns();
+
+	os_sleep_ms((uint32_t)opts.duration * 1000);
+
+	double cpu_usage = os_cpu_usage_info_query(cpu);
+	double seconds = (double)(os_gettime_ns() - start_ns) / 1e9;
+	StageTimes stages = snapshot_stages(opts, res, true);
+	auto stats = read_stats(output);
+	proc_handler_call(ph, "get_latency", &cd);
+	uint32_t lagged = obs_get_lagged_frames() - lagged_start;
+	os_cpu_usage_info_destroy(cpu);
+
+	obs_output_stop(output);
+	obs_set_output_source(0, nullptr);
+
+	/* Summary */
+	long long received = calldata_int(&cd, "frames_received") -
+			     received_start;
+	double frames_encoded =
+		stat(stats, "outbound_video_frames_encoded") -
+		stat(stats_start, "outbound_video_frames_encoded");
+	double encode_time =
+		stat(stats, "outbound_video_total_encode_time") -
+		stat(stats_start, "outbound_video_total_encode_time");
+	double bytes_sent = stat(stats, "outbound_video_bytes_sent") -
+			    stat(stats_start, "outbound_video_bytes_sent");
+
+	printf("\n=== %ux%u@%u, %d kbps ===\n", res.cx, res.cy, opts.fps,
+	       opts.bitrate);
+	printf("received:    %lld frames (%.1f fps) at %dx%d, "
+	       "%lld stamped\n",
+	       received, (double)received / seconds,
+	       (int)calldata_int(&cd, "width"),
+	       (int)calldata_int(&cd, "height"),
+	       calldata_int(&cd, "frames_stamped"));
+	printf("latency:     avg %.1f ms, min %.1f, p50 %.1f, p95 %.1f, "
+	       "max %.1f (whole stream)\n",
+	       calldata_float(&cd, "avg_ms"), calldata_float(&cd, "min_ms"),
+	       calldata_float(&cd, "p50_ms"), calldata_float(&cd, "p95_ms"),
+	       calldata_float(&cd, "max_ms"));
+	printf("throughput:  %.0f kbps video, %.1f frames encoded/s, "
+	       "%.2f ms encode/frame\n",
+	       bytes_sent * 8.0 / 1000.0 / seconds, frames_encoded / seconds,
+	       frames_encoded ? encode_time * 1000.0 / frames_encoded : 0.0);
+	printf("cpu:         %.1f%% process, %u lagged render frames\n",
+	       cpu_usage, lagged);
+
+	/* Stages ordered by the CPU time they took during the run */
+	std::vector<std::pair<double, std::string>> order;
+	for (auto &stage : stages) {
+		const StageTime &before = stages_start[stage.first];
+		uint64_t ns = stage.second.total_ns - before.total_ns;
+		if (ns)
+			order.emplace_back((double)ns, stage.first);
+	}
+	std::sort(order.rbegin(), order.rend());
+	printf("stages:      %% of one core, avg per call\n");
+	for (size_t i = 0; i < order.size() && i < 12; i++) {
+		const std::string &name = order[i].second;
+		uint64_t calls = stages[name].calls - stages_start[name].calls;
+		printf("  %6.2f%%  %9.3f ms  %s\n",
+		       order[i].first / (seconds * 1e9) * 100.0,
+		       calls ? order[i].first / 1e6 / (double)calls : 0.0,
+		       name.c_str());
+	}
+
+	calldata_free(&cd);
+	return received > 0;
+}
+
+/* --------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+	Options opts;
+	if (!parse_options(argc, argv, opts)) {
+		usage(argv[0]);
+		return 1;
+	}
+	verbose = opts.verbose;
+	base_set_log_handler(do_log, nullptr);
+
+	profiler_name_store_t *names = profiler_name_store_create();
+	profiler_start();
+
+	int failed = 0;
+
+	if (!obs_startup("en-US", nullptr, names)) {
+		fprintf(stderr, "Couldn't create OBS\n");
+		return 1;
+	}
+
+	struct obs_audio_info oai = {48000, SPEAKERS_STEREO};
+	if (!obs_reset_audio(&oai) ||
+	    !reset_video(opts, opts.resolutions[0])) {
+		fprintf(stderr, "Couldn't initialize audio/video\n");
+		obs_shutdown();
+		return 1;
+	}
+
+	obs_load_all_modules();
+	obs_post_load_modules();
+
+	for (const Resolution &res : opts.resolutions)
+		if (!run(opts, res))
+			failed++;
+
+	obs_shutdown();
+	profiler_stop();
+	profiler_free();
+	profiler_name_store_free(names);
+
+	if (failed)
+		fprintf(stderr, "\n%d run(s) received no frames\n", failed);
+	return failed ? 1 : 0;
+}
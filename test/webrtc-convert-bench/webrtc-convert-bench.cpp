@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+
+/* not declared extern "C" by libobs */
+extern "C" {
+#include <media-io/video-frame.h>
+}
+
+#include <libyuv.h>
+
+/* Times the copy of a raw video frame into the I420 buffer handed to
+ * libwebrtc, at 720p, 1080p and 1440p:
+ *
+ * - "ConvertToI420" is how WebRTCStream used to take frames: NV12 from
+ *   libobs, converted by the generic libyuv entry point, given the frame as
+ *   one tightly packed NV12 sample.
+ * - "I420Copy" is what it does now: libobs is asked for I420, the frame is
+ *   only copied plane by plane.
+ *
+ * The frames are allocated like the ones video-io hands to the outputs.
+ *
+ * Usage: webrtc-convert-bench [frames] [--check]
+ *
+ * --check only compares the outputs of the old and new paths (used by
+ * ctest). */
+
+struct Resolution {
+	uint32_t cx;
+	uint32_t cy;
+};
+
+static const Resolution resolutions[] = {
+	{1280, 720},
+	{1920, 1080},
+	{2560, 1440},
+};
+
+struct I420Frame {
+	uint32_t cx;
+	uint32_t cy;
+	uint8_t *y;
+	uint8_t *u;
+	uint8_t *v;
+
+	I420Frame(uint32_t cx, uint32_t cy) : cx(cx), cy(cy)
+	{
+		y = (uint8_t *)bzalloc(cx * cy * 3 / 2);
+		u = y + cx * cy;
+		v = u + cx * cy / 4;
+	}
+	~I420Frame() { bfree(y); }
+
+	int strideY() const { return (int)cx; }
+	int strideUV() const { return (int)cx / 2; }
+	size_t size() const { return cx * cy * 3 / 2; }
+};
+
+static void fill(struct video_frame *frame, enum video_format format,
+		 uint32_t cx, uint32_t cy)
+{
+	uint32_t planes = format == VIDEO_FORMAT_NV12 ? 2 : 3;
+
+	srand(cx);
+	for (uint32_t p = 0; p < planes; p++) {
+		uint32_t rows = p ? cy / 2 : cy;
+		for (uint32_t row = 0; row < rows; row++) {
+			uint8_t *line =
+				frame->data[p] + row * frame->linesize[p];
+			for (uint32_t x = 0; x < frame->linesize[p]; x++)
+				line[x] = (uint8_t)rand();
+		}
+	}
+}
+
+static void convert_old(const struct video_frame *frame, I420Frame &dst)
+{
+	libyuv::ConvertToI420(frame->data[0], dst.size(), dst.y, dst.strideY(),
+			      dst.u, dst.strideUV(), dst.v, dst.strideUV(), 0,
+			      0, (int)dst.cx, (int)dst.cy, (int)dst.cx,
+			      (int)dst.cy, libyuv::kRotate0,
+			      libyuv::FOURCC_NV12);
+}
+
+static void copy_i420(const struct video_frame *frame, I420Frame &dst)
+{
+	libyuv::I420Copy(frame->data[0], (int)frame->linesize[0],
+			 frame->data[1], (int)frame->linesize[1],
+			 frame->data[2], (int)frame->linesize[2], dst.y,
+			 dst.strideY(), dst.u, dst.strideUV(), dst.v,
+			 dst.strideUV(), (int)dst.cx, (int)dst.cy);
+}
+
+typedef void (*convert_func)(const struct video_frame *frame, I420Frame &dst);
+
+static double time_us(convert_func convert, const struct video_frame *frame,
+		      I420Frame &dst, int frames)
+{
+	/* warm up the caches and the destination pages */
+	convert(frame, dst);
+
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < frames; i++)
+		convert(frame, dst);
+	return (double)(os_gettime_ns() - start) / 1000.0 / frames;
+}
+
+/* the I420 frame libobs hands out for the same picture */
+static void to_frame(const I420Frame &src, struct video_frame *frame)
+{
+	const uint8_t *planes[3] = {src.y, src.u, src.v};
+	uint32_t widths[3] = {src.cx, src.cx / 2, src.cx / 2};
+	uint32_t heights[3] = {src.cy, src.cy / 2, src.cy / 2};
+
+	for (int p = 0; p < 3; p++) {
+		for (uint32_t row = 0; row < heights[p]; row++)
+			memcpy(frame->data[p] + row * frame->linesize[p],
+			       planes[p] + row * widths[p], widths[p]);
+	}
+}
+
+static bool check(const Resolution &res)
+{
+	struct video_frame nv12, i420;
+	I420Frame old_dst(res.cx, res.cy), new_dst(res.cx, res.cy);
+	bool ok;
+
+	video_frame_init(&nv12, VIDEO_FORMAT_NV12, res.cx, res.cy);
+	video_frame_init(&i420, VIDEO_FORMAT_I420, res.cx, res.cy);
+	fill(&nv12, VIDEO_FORMAT_NV12, res.cx, res.cy);
+
+	convert_old(&nv12, old_dst);
+	to_frame(old_dst, &i420);
+	copy_i420(&i420, new_dst);
+	ok = memcmp(old_dst.y, new_dst.y, old_dst.size()) == 0;
+
+	printf("%ux%u: I420Copy %s\n", res.cx, res.cy,
+	       ok ? "matches ConvertToI420" : "DIFFERS");
+
+	video_frame_free(&nv12);
+	video_frame_free(&i420);
+	return ok;
+}
+
+static void bench(const Resolution &res, int frames)
+{
+	struct video_frame nv12, i420;
+	I420Frame dst(res.cx, res.cy);
+
+	video_frame_init(&nv12, VIDEO_FORMAT_NV12, res.cx, res.cy);
+	video_frame_init(&i420, VIDEO_FORMAT_I420, res.cx, res.cy);
+	fill(&nv12, VIDEO_FORMAT_NV12, res.cx, res.cy);
+	fill(&i420, VIDEO_FORMAT_I420, res.cx, res.cy);
+
+	double old_us = time_us(convert_old, &nv12, dst, frames);
+	double new_us = time_us(copy_i420, &i420, dst, frames);
+
+	printf("%4ux%-4u  %13.1f  %8.1f (x%.2f)\n", res.cx, res.cy, old_us,
+	       new_us, old_us / new_us);
+
+	video_frame_free(&nv12);
+	video_frame_free(&i420);
+}
+
+int main(int argc, char *argv[])
+{
+	int frames = 500;
+	bool check_only = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--check") == 0)
+			check_only = true;
+		else if (atoi(argv[i]) > 0)
+			frames = atoi(argv[i]);
+	}
+
+	if (check_only) {
+		bool ok = true;
+		for (const Resolution &res : resolutions)
+			ok = check(res) && ok;
+		return ok ? 0 : 1;
+	}
+
+	printf("Raw frame to libwebrtc I420 buffer, us/frame over %d frames\n\n",
+	       frames);
+	printf("resolution  ConvertToI420         I420Copy\n");
+
+	for (const Resolution &res : resolutions)
+		bench(res, frames);
+
+	return 0;
+}